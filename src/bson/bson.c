@@ -91,6 +91,7 @@ void bson_reset(bson *b) {
 static bson_bool_t bson_isnumstr(const char *str, int len);
 static void bson_append_fpath_from_iterator(const char *fpath, const bson_iterator *from, bson *into);
 static const char *bson_iterator_value2(const bson_iterator *i, int *klen);
+static bson_type bson_iterator_next_impl(bson_iterator *i, int klen);
 
 /* ----------------------------
    READING
@@ -402,54 +403,52 @@ void bson_visit_fields(bson_iterator *it, bson_traverse_flags_t flags, BSONVISIT
     bson_visit_fields_impl(flags, pstack, 0, it, visitor, op);
 }
 
-static bson_type bson_find_fieldpath_value_impl(char* pstack, int curr, FFPCTX *ffpctx, bson_iterator *it) {
-    int i;
+/**
+ * Field path prefix `fpath[0, curr)` is already matched by keys of parent objects
+ * so only the next field path section is compared with keys of this level.
+ * Keys are rejected by the first char before their length is computed,
+ * known key lengths are reused to skip elements.
+ */
+static bson_type bson_find_fieldpath_value_impl(int curr, FFPCTX *ffpctx, bson_iterator *it) {
     bson_type t;
     int klen = 0;
-    int fplen = ffpctx->fplen;
+    const int fplen = ffpctx->fplen;
     const char *fpath = ffpctx->fpath;
-    while ((t = bson_iterator_next(it)) != BSON_EOO) {
-        const char* key = BSON_ITERATOR_KEY(it);
-        klen = strlen(key);
-        if (curr + klen > fplen) {
+    const int off = (curr > 0) ? curr + 1 : 0; //skip dot
+    while ((t = bson_iterator_next_impl(it, klen)) != BSON_EOO) {
+        const char *key = BSON_ITERATOR_KEY(it);
+        klen = 0;
+        if (*key != '\0' && (off >= fplen || *key != fpath[off])) {
             continue;
         }
-        //PUSH
-        if (curr > 0) { //add leading dot            
-            *(pstack + curr) = '.';
-            curr++;
+        klen = strlen(key);
+        if (off + klen > fplen || memcmp(key, fpath + off, klen)) {
+            continue;
         }
-        memcpy(pstack + curr, key, klen);
-        curr += klen;
-        for (i = 0; i < curr && i < fplen && pstack[i] == fpath[i]; ++i);
-        if (i == curr && i == fplen) { //Position matched with field path
-            ffpctx->stopos = i;
+        int ncurr = off + klen;
+        if (ncurr == fplen) { //Position matched with field path
+            ffpctx->stopos = ncurr;
             return t;
         }
-        if (i == curr && i < fplen && (t == BSON_OBJECT || t == BSON_ARRAY)) { //Only prefix and we can go into nested objects
+        if (fpath[ncurr] == '.' && (t == BSON_OBJECT || t == BSON_ARRAY)) { //Only prefix and we can go into nested objects
             if (ffpctx->stopnestedarr && t == BSON_ARRAY) {
-                int p1 = curr;
+                int p1 = ncurr;
                 while (fpath[p1] == '.' && p1 < fplen) p1++;
                 int p2 = p1;
                 while (fpath[p2] != '.' && fpath[p2] > '\0' && p2 < fplen) p2++;
                 if (!bson_isnumstr(fpath + p1, p2 - p1)) { //next fpath sections is not an array index
-                    ffpctx->stopos = i;
+                    ffpctx->stopos = ncurr;
                     return t;
                 }
             }
             bson_iterator sit;
             BSON_ITERATOR_SUBITERATOR(it, &sit);
-            bson_type st = bson_find_fieldpath_value_impl(pstack, curr, ffpctx, &sit);
+            bson_type st = bson_find_fieldpath_value_impl(ncurr, ffpctx, &sit);
             if (st != BSON_EOO) { //Found in nested
                 *it = sit;
                 return st;
             }
         }
-        //POP
-        curr -= klen;
-        if (curr > 0) {
-            curr--; //remove leading dot
-        }
     }
     return BSON_EOO;
 }
@@ -472,21 +471,7 @@ bson_type bson_find_fieldpath_value2(const char *fpath, int fplen, bson_iterator
 }
 
 bson_type bson_find_fieldpath_value3(FFPCTX* ffctx) {
-    char pstackstack[BSON_MAX_FPATH_LEN + 1];
-    char *pstack;
-    if (ffctx->fplen <= BSON_MAX_FPATH_LEN) {
-        pstack = pstackstack;
-    } else {
-        pstack = MYMALLOC((ffctx->fplen + 1) * sizeof (char));
-        if (!pstack) {
-            return BSON_EOO;
-        }
-    }
-    bson_type bt = bson_find_fieldpath_value_impl(pstack, 0, ffctx, ffctx->input);
-    if (pstack != pstackstack) {
-        MYFREE(pstack);
-    }
-    return bt;
+    return bson_find_fieldpath_value_impl(0, ffctx, ffctx->input);
 }
 
 bson_bool_t bson_iterator_more(const bson_iterator *i) {
@@ -494,7 +479,12 @@ bson_bool_t bson_iterator_more(const bson_iterator *i) {
 }
 
 bson_type bson_iterator_next(bson_iterator *i) {
-    int ds, out, klen = 0;
+    return bson_iterator_next_impl(i, 0);
+}
+
+/* Advances iterator, `klen` is the length of the current key if it is known or zero */
+static bson_type bson_iterator_next_impl(bson_iterator *i, int klen) {
+    int ds, out;
     if (i->first) {
         i->first = 0;
         return (bson_type) (*i->cur);
@@ -1346,7 +1336,9 @@ void bson_swap_endian32(void *outp, const void *inp) {
 
 static const char *bson_iterator_value2(const bson_iterator *i, int *klen) {
     const char *t = i->cur + 1;
-    *klen = strlen(t);
+    if (*klen == 0) {
+        *klen = strlen(t);
+    }
     t += (*klen + 1);
     return t;
 }
@@ -2513,7 +2505,8 @@ static int _bson2json(_BSON2JSONCTX *ctx, bson_iterator *it, bool array) {
                 break;
             case BSON_DOUBLE:
             {
-                tcxstrprintf(out, "%llf", bson_iterator_double(it));
+                //`l` modifier makes tcxstrprintf() read a long double argument
+                tcxstrprintf(out, "%f", bson_iterator_double(it));
                 break;
             }
             case BSON_STRING:
@@ -2606,6 +2599,17 @@ int bson2json(const char *bsdata, char **buf, int *sp) {
     return ret;
 }
 
+int bson2jsonxstr(const char *bsdata, TCXSTR *out) {
+    assert(bsdata && out);
+    bson_iterator it;
+    BSON_ITERATOR_FROM_BUFFER(&it, bsdata);
+    _BSON2JSONCTX ctx = {
+        .nlvl = 0,
+        .out = out
+    };
+    return _bson2json(&ctx, &it, false);
+}
+
 
 #include "nxjson.h"
 
@@ -2699,3 +2703,392 @@ finish:
     return out;
 }
 
+
+/* Maximum nesting level of JSON values accepted by `json2bsonbuf()` */
+#define JSONMAXDEPTH 512
+
+/* state of single pass JSON parser. See `json2bsonbuf()` */
+typedef struct {
+    const char *rp; //current read position
+    const char *ep; //end of input
+    bson *out;
+    TCXSTR *sbuf; //unescaped string buffer, allocated on demand
+    int depth; //current nesting level
+    bool incomplete; //input ended before the end of object
+} _JSONPCTX;
+
+static bool _jsonpvalue(_JSONPCTX *ctx, const char *key);
+
+/* Skip JSON whitespace. Returns false if the end of input reached. */
+EJDB_INLINE bool _jsonpws(_JSONPCTX *ctx) {
+    while (ctx->rp < ctx->ep) {
+        switch (*ctx->rp) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                ctx->rp++;
+                break;
+            default:
+                return true;
+        }
+    }
+    ctx->incomplete = true;
+    return false;
+}
+
+static int _jsonphex4(const char *p) {
+    int cp = 0;
+    for (int i = 0; i < 4; ++i) {
+        int c = p[i];
+        cp <<= 4;
+        if (c >= '0' && c <= '9') {
+            cp |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            cp |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            cp |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return cp;
+}
+
+/**
+ * Parse JSON string starting after the opening quote.
+ * Strings without escapes are returned as pointers into the input,
+ * otherwise they are unescaped into `ctx->sbuf`.
+ */
+static const char* _jsonpstring(_JSONPCTX *ctx, int *sp) {
+    const char *sp0 = ctx->rp;
+    //memchr() is vectorized by libc so the common case of string
+    //without escapes costs two fast scans
+    const char *qp = memchr(sp0, '"', ctx->ep - sp0);
+    if (!qp) {
+        ctx->incomplete = true;
+        return NULL;
+    }
+    if (!memchr(sp0, '\\', qp - sp0)) {
+        ctx->rp = qp + 1;
+        *sp = qp - sp0;
+        return sp0;
+    }
+    if (!ctx->sbuf) {
+        ctx->sbuf = tcxstrnew();
+    }
+    TCXSTR *sbuf = ctx->sbuf;
+    tcxstrclear(sbuf);
+    const char *rp = sp0;
+    while (true) {
+        const char *bp = memchr(rp, '\\', ctx->ep - rp);
+        qp = memchr(rp, '"', (bp ? bp : ctx->ep) - rp);
+        if (qp) {
+            TCXSTRCAT(sbuf, rp, qp - rp);
+            ctx->rp = qp + 1;
+            *sp = TCXSTRSIZE(sbuf);
+            return TCXSTRPTR(sbuf);
+        }
+        if (!bp || bp + 1 >= ctx->ep) {
+            ctx->incomplete = true;
+            return NULL;
+        }
+        TCXSTRCAT(sbuf, rp, bp - rp);
+        rp = bp + 2;
+        switch (bp[1]) {
+            case '"':
+            case '\\':
+            case '/':
+                TCXSTRCAT(sbuf, bp + 1, 1);
+                break;
+            case 'b':
+                TCXSTRCAT(sbuf, "\b", 1);
+                break;
+            case 'f':
+                TCXSTRCAT(sbuf, "\f", 1);
+                break;
+            case 'n':
+                TCXSTRCAT(sbuf, "\n", 1);
+                break;
+            case 'r':
+                TCXSTRCAT(sbuf, "\r", 1);
+                break;
+            case 't':
+                TCXSTRCAT(sbuf, "\t", 1);
+                break;
+            case 'u':
+            {
+                if (ctx->ep - rp < 4) {
+                    ctx->incomplete = true;
+                    return NULL;
+                }
+                int cp = _jsonphex4(rp);
+                if (cp < 0) {
+                    return NULL;
+                }
+                rp += 4;
+                if (cp >= 0xd800 && cp <= 0xdbff) { //surrogate pair
+                    if (ctx->ep - rp < 6) {
+                        ctx->incomplete = true;
+                        return NULL;
+                    }
+                    int lo = (rp[0] == '\\' && rp[1] == 'u') ? _jsonphex4(rp + 2) : -1;
+                    if (lo < 0xdc00 || lo > 0xdfff) {
+                        return NULL;
+                    }
+                    rp += 6;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                }
+                char ubuf[4];
+                int usiz;
+                if (cp < 0x80) {
+                    ubuf[0] = cp;
+                    usiz = 1;
+                } else if (cp < 0x800) {
+                    ubuf[0] = 0xc0 | (cp >> 6);
+                    ubuf[1] = 0x80 | (cp & 0x3f);
+                    usiz = 2;
+                } else if (cp < 0x10000) {
+                    ubuf[0] = 0xe0 | (cp >> 12);
+                    ubuf[1] = 0x80 | ((cp >> 6) & 0x3f);
+                    ubuf[2] = 0x80 | (cp & 0x3f);
+                    usiz = 3;
+                } else {
+                    ubuf[0] = 0xf0 | (cp >> 18);
+                    ubuf[1] = 0x80 | ((cp >> 12) & 0x3f);
+                    ubuf[2] = 0x80 | ((cp >> 6) & 0x3f);
+                    ubuf[3] = 0x80 | (cp & 0x3f);
+                    usiz = 4;
+                }
+                TCXSTRCAT(sbuf, ubuf, usiz);
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+}
+
+/* Parse JSON literal `lit` of length `len`. */
+static bool _jsonpliteral(_JSONPCTX *ctx, const char *lit, int len) {
+    int avail = ctx->ep - ctx->rp;
+    if (avail < len) {
+        if (!memcmp(ctx->rp, lit, avail)) {
+            ctx->incomplete = true;
+        }
+        return false;
+    }
+    if (memcmp(ctx->rp, lit, len)) {
+        return false;
+    }
+    ctx->rp += len;
+    return true;
+}
+
+static bool _jsonpnumber(_JSONPCTX *ctx, const char *key) {
+    char nbuf[TCNUMBUFSIZ * 2];
+    const char *rp = ctx->rp;
+    bool real = false;
+    int i = 0;
+    for (; rp < ctx->ep && i < (int) sizeof (nbuf) - 1; ++rp, ++i) {
+        char c = *rp;
+        if (c == '.' || c == 'e' || c == 'E') {
+            real = true;
+        } else if (!((c >= '0' && c <= '9') || c == '-' || c == '+')) {
+            break;
+        }
+        nbuf[i] = c;
+    }
+    if (rp == ctx->ep) { //number may continue in the next chunk of input
+        ctx->incomplete = true;
+        return false;
+    }
+    if (i == 0 || i == (int) sizeof (nbuf) - 1) {
+        return false;
+    }
+    nbuf[i] = '\0';
+    char *np;
+    errno = 0;
+    if (!real) {
+        long long v = strtoll(nbuf, &np, 10);
+        if (*np != '\0') {
+            return false;
+        }
+        if (errno != ERANGE) {
+            ctx->rp = rp;
+            if (v <= INT_MAX && v >= INT_MIN) {
+                return (bson_append_int(ctx->out, key, (int) v) == BSON_OK);
+            } else {
+                return (bson_append_long(ctx->out, key, v) == BSON_OK);
+            }
+        }
+    }
+    double d = strtod(nbuf, &np);
+    if (*np != '\0') {
+        return false;
+    }
+    ctx->rp = rp;
+    return (bson_append_double(ctx->out, key, d) == BSON_OK);
+}
+
+/* Parse JSON object or array members after the opening bracket. */
+static bool _jsonpmembers(_JSONPCTX *ctx, bool array, bool top) {
+    char kbuf[BSON_MAX_FPATH_LEN + 1];
+    char *key = NULL;
+    int c = 0;
+    if (++ctx->depth > JSONMAXDEPTH) {
+        return false;
+    }
+    if (!_jsonpws(ctx)) {
+        return false;
+    }
+    if (*ctx->rp == (array ? ']' : '}')) {
+        ctx->rp++;
+        ctx->depth--;
+        return true;
+    }
+    while (true) {
+        if (array) {
+            bson_numstrn(kbuf, sizeof (kbuf), c++);
+            key = kbuf;
+        } else {
+            if (*ctx->rp != '"') {
+                return false;
+            }
+            ctx->rp++;
+            int ksiz;
+            const char *kp = _jsonpstring(ctx, &ksiz);
+            if (!kp) {
+                return false;
+            }
+            //Key is copied since `kp` may point to the reused unescape buffer
+            if (ksiz < (int) sizeof (kbuf)) {
+                memcpy(kbuf, kp, ksiz);
+                kbuf[ksiz] = '\0';
+                key = kbuf;
+            } else {
+                TCMEMDUP(key, kp, ksiz);
+            }
+            if (!_jsonpws(ctx) || *ctx->rp != ':') {
+                goto fail;
+            }
+            ctx->rp++;
+            if (!_jsonpws(ctx)) {
+                goto fail;
+            }
+            //Top level `_id` produced by `bson2json()` is restored as ObjectId
+            if (top && *ctx->rp == '"' && ksiz == 3 && !strcmp(key, JDBIDKEYNAME) &&
+                    ctx->ep - ctx->rp > 25 && ctx->rp[25] == '"') {
+                bool isoid = true;
+                for (int i = 1; i < 25 && isoid; ++i) {
+                    isoid = isxdigit((unsigned char) ctx->rp[i]);
+                }
+                if (isoid) {
+                    char xoid[25];
+                    bson_oid_t oid;
+                    memcpy(xoid, ctx->rp + 1, 24);
+                    xoid[24] = '\0';
+                    bson_oid_from_string(&oid, xoid);
+                    ctx->rp += 26;
+                    bool ok = (bson_append_oid(ctx->out, key, &oid) == BSON_OK);
+                    if (key != kbuf) {
+                        TCFREE(key);
+                    }
+                    if (!ok) {
+                        return false;
+                    }
+                    goto next;
+                }
+            }
+        }
+        bool ok = _jsonpvalue(ctx, key);
+        if (key != kbuf) {
+            TCFREE(key);
+        }
+        if (!ok) {
+            return false;
+        }
+next:
+        if (!_jsonpws(ctx)) {
+            return false;
+        }
+        if (*ctx->rp == ',') {
+            ctx->rp++;
+            if (!_jsonpws(ctx)) {
+                return false;
+            }
+            continue;
+        }
+        if (*ctx->rp == (array ? ']' : '}')) {
+            ctx->rp++;
+            ctx->depth--;
+            return true;
+        }
+        return false;
+    }
+fail:
+    if (key != kbuf) {
+        TCFREE(key);
+    }
+    return false;
+}
+
+static bool _jsonpvalue(_JSONPCTX *ctx, const char *key) {
+    bson *out = ctx->out;
+    switch (*ctx->rp) {
+        case '{':
+            ctx->rp++;
+            if (bson_append_start_object(out, key) != BSON_OK || !_jsonpmembers(ctx, false, false)) {
+                return false;
+            }
+            return (bson_append_finish_object(out) == BSON_OK);
+        case '[':
+            ctx->rp++;
+            if (bson_append_start_array(out, key) != BSON_OK || !_jsonpmembers(ctx, true, false)) {
+                return false;
+            }
+            return (bson_append_finish_array(out) == BSON_OK);
+        case '"':
+        {
+            ctx->rp++;
+            int ssiz;
+            const char *str = _jsonpstring(ctx, &ssiz);
+            return (str && bson_append_string_n(out, key, str, ssiz) == BSON_OK);
+        }
+        case 't':
+            return (_jsonpliteral(ctx, "true", 4) && bson_append_bool(out, key, true) == BSON_OK);
+        case 'f':
+            return (_jsonpliteral(ctx, "false", 5) && bson_append_bool(out, key, false) == BSON_OK);
+        case 'n':
+            return (_jsonpliteral(ctx, "null", 4) && bson_append_null(out, key) == BSON_OK);
+        default:
+            return _jsonpnumber(ctx, key);
+    }
+}
+
+int json2bsonbuf(const char *jsonbuf, int len, bson *out) {
+    assert(jsonbuf && len >= 0 && out);
+    _JSONPCTX ctx = {
+        .rp = jsonbuf,
+        .ep = jsonbuf + len,
+        .out = out
+    };
+    int rv = -1;
+    if (!_jsonpws(&ctx)) {
+        return 0;
+    }
+    if (*ctx.rp != '{') {
+        return -1;
+    }
+    ctx.rp++;
+    if (_jsonpmembers(&ctx, false, true)) {
+        rv = out->err ? -1 : (ctx.rp - jsonbuf);
+    } else if (ctx.incomplete) {
+        rv = 0;
+    }
+    if (ctx.sbuf) {
+        tcxstrdel(ctx.sbuf);
+    }
+    return rv;
+}
+
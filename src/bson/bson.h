@@ -1220,6 +1220,35 @@ EJDB_EXPORT int bson_merge_array_sets(const void *mbuf, const void *inbuf, bool
  */
 EJDB_EXPORT int bson2json(const char *bsdata, char **buf, int *sp);
 
+/**
+ * Convert BSON into JSON and append it to the specified string buffer.
+ * Unlike `bson2json()` no intermediate buffer is allocated so `out`
+ * can be reused across many conversions.
+ * @param src BSON data
+ * @param out String buffer JSON data will be appended to.
+ *            On error it may contain a partially converted document.
+ * @return BSON_OK or BSON_ERROR
+ */
+EJDB_EXPORT int bson2jsonxstr(const char *bsdata, TCXSTR *out);
+
+/**
+ * Parse a single JSON object from the JSON text buffer and append
+ * its fields into `out` in one pass without building an intermediate JSON tree.
+ *
+ * Leading whitespace is skipped and parsing stops right after the closing
+ * brace of the object so a stream of newline delimited (or just concatenated)
+ * JSON objects can be consumed by successive calls.
+ * Top level `_id` string of 24 hex digits is stored as BSON ObjectId.
+ *
+ * @param jsonbuf JSON text, not required to be NULL terminated
+ * @param len Length of `jsonbuf`
+ * @param out Initialized BSON object. Caller is responsible to finish it.
+ * @return Number of consumed bytes on success,
+ *         `0` if the input ends before the object is complete (more input needed),
+ *         `-1` on syntax error.
+ */
+EJDB_EXPORT int json2bsonbuf(const char *jsonbuf, int len, bson *out);
+
 /**
  * Convert JSON into BSON object.
  * @param jsonstr NULL terminated JSON string
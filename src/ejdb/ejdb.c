@@ -69,11 +69,13 @@ typedef union {
 typedef struct {
     EJCOLL *coll; //current collection
     bool icase; //ignore case normalization
+    bool hash; //hash index key normalization
+    EJQ *ifilter; //filter of partial index, NULL for regular index
 } _BSONIPATHROWLDR;
 
 
 /* Maximum number of objects keeped to update deffered indexes */
-#define JBMAXDEFFEREDIDXNUM 512
+#define JBMAXDEFFEREDIDXNUM 4096
 
 /* context of deffered index updates. See `_updatebsonidx()` */
 typedef struct {
@@ -82,6 +84,128 @@ typedef struct {
     TCMAP *imap;
 } _DEFFEREDIDXCTX;
 
+/* Maximum number of index trees updated concurrently by `_flushdeferredidx()` */
+#define JBDEFIDXMAXTHREADS 4
+
+/* Minimum number of pending changes of an index tree to update it in its own thread */
+#define JBDEFIDXTHREADMIN 512
+
+/* deferred changes of a single index tree. See `_flushdeferredidx()` */
+typedef struct {
+    EJCOLL *coll;
+    const char *iname;  //index name
+    int inamesz;
+    TCMAP *ops;         //map of `value '\0' hash pk` -> insertions count
+    bool thread;        //job is running in its own thread
+    pthread_t thr;
+    int ecode;          //first error of the job, error codes of database objects are thread local
+} _DEFIDXJOB;
+
+/* Default size of dictionary of fast compression. See `ejdbtraincompressdict()` */
+#define JBLZDICTDEFSIZ (16 * 1024)
+
+/* Maximum size of records sampled to train dictionary of fast compression */
+#define JBLZDICTSAMPMAX (1024 * 1024)
+
+/* Leading byte of data compressed by `_lzcodecenc()` */
+enum {
+    JBLZPLAIN = 0, //LZ encoding without dictionary
+    JBLZDICT = 1 //LZ encoding with dictionary of collection
+};
+
+/* Size of read buffer used by `_importcoll()` */
+#define JBIMPORTBUFSZ (4 * 1024 * 1024)
+
+/* buffered reader of BSON dump file. See `_importcoll()` */
+typedef struct {
+    int fd;         //file descriptor
+    char *buf;      //read buffer
+    int32_t size;   //buffer size
+    int32_t pos;    //position of the first unread byte
+    int32_t len;    //number of bytes in buffer
+} _IMPORTRBUF;
+
+/* Size of write buffer used by `_exportcoll()` */
+#define JBEXPORTBUFSZ (1024 * 1024)
+
+/* Maximum number of collections exported concurrently by `ejdbexport()` */
+#define JBEXPORTMAXTHREADS 4
+
+/* export job of a single collection. See `ejdbexport()` */
+typedef struct {
+    EJCOLL *coll;       //collection to export
+    const char *dpath;  //target directory
+    int flags;          //export flags
+    TCXSTR *log;        //job log merged into the caller log, can be NULL
+    int ecode;          //error code set by the job thread
+    bool rv;            //export result
+    bool thread;        //job is running in its own thread
+    pthread_t thr;
+} _EXPORTJOB;
+
+/* Number of index matched records fetched as single batch ordered by file offset */
+#define JBQFETCHBATCHSZ 1024
+
+/* Maximum gap between records merged into the single readahead region */
+#define JBQFETCHRAGAP 65536
+
+/* Number of full scan records filtered by numeric conditions as single batch */
+#define JBQSCANBATCHSZ 256
+
+/* kinds of field values extracted into the scan batch */
+enum {
+    JBVKNONE = 0,   //missing or null field
+    JBVKINT,        //integral value in `ival`
+    JBVKDBL,        //double value in `dval`
+    JBVKRECHECK     //array or non numeric value, matched by `_qrybsmatch()`
+};
+
+/* batch of full scan records. See `_qryscanfilter()` */
+typedef struct {
+    TCLIST *pks;                    //primary keys
+    TCLIST *bsons;                  //record BSONs
+    int64_t ival[JBQSCANBATCHSZ];   //field values column
+    double dval[JBQSCANBATCHSZ];
+    uint8_t kind[JBQSCANBATCHSZ];
+    uint8_t sel[JBQSCANBATCHSZ];    //selection vector: 0 - rejected, 1 - selected, 2 - check all conditions
+} _SCANBATCH;
+
+/* Estimated cost of a random record fetch relative to a record read by full scan, used in `$in` planning */
+#define JBINRANDFETCHCOST 4
+
+/* `$in` execution strategies. See `_qryinmode()` */
+enum {
+    JBINPROBE = 1, /* separate index lookup of every token */
+    JBINSKIPSCAN, /* single forward index scan over sorted tokens, stepping instead of short jumps */
+    JBINHASHSCAN /* full scan matching records against hash map of tokens */
+};
+
+/* record location used to order fetching of a batch. See `_qryfetchorder()` */
+typedef struct {
+    int64_t off; //record offset in the collection file
+    int32_t siz; //record size
+    int pos;     //position of the record in the batch
+} _RECOFFSLOT;
+
+/* Maximum number of index entries copied by single index cursor batch */
+#define JBIDXCURBATCHSZ 1024
+
+/* Size of the first index cursor batch, doubled by every refill up to `JBIDXCURBATCHSZ` */
+#define JBIDXCURBATCHMIN 16
+
+/* index cursor reading B+ tree entries in batches. See `_idxcurkey()` */
+typedef struct {
+    BDBCUR *cur;
+    TCLIST *keys;   //batch of index keys
+    TCLIST *vals;   //batch of primary keys
+    int pos;        //position of the current entry in the batch
+    int bsz;        //size of the next batch
+    bool back;      //cursor moves to previous entries
+} _IDXCUR;
+
+/* visitor of matched records used instead of collecting the query result set. See `_qryexecute()` */
+typedef void (*_QRYVISITOR)(EJCOLL *coll, const void *bsbuf, int bsbufsz, void *op);
+
 /* query execution context. See `_qryexecute()`*/
 typedef struct {
     bool imode;     //if true ifields are included otherwise excluded
@@ -94,8 +218,59 @@ typedef struct {
     TCLIST *res;    //result set
     TCXSTR *log;    //query debug log buffer
     TCLIST *didxctx; //deffered indexes context
+    int fsorted;    //fetch index matched records by file offset: 1 forced, 0 disabled, -1 auto
+    int uinplace;   //update fixed size fields in place: 1 allowed, 0 disabled, -1 not checked yet
+    _QRYVISITOR rvisit; //matched records visitor, if set the result set is not collected
+    void *rvop;     //opaque data passed into `rvisit`
 } _QRYCTX;
 
+/* distinct values collector. See `ejdbqrydistinct()` */
+typedef struct {
+    const char *fpath;  //field path of values
+    int fpathsz;
+    TCMAP *vmap;        //unique value key -> BSON `{"v" : value}`
+    TCXSTR *kbuf;       //value key buffer
+} _DISTINCTCTX;
+
+/* group accumulators. See `ejdbqryaggregate()` */
+enum {
+    JBAGGSUM = 1,
+    JBAGGAVG,
+    JBAGGMIN,
+    JBAGGMAX,
+    JBAGGCOUNT
+};
+
+/* accumulator specification */
+typedef struct {
+    const char *name;       //name of the result field
+    int op;                 //accumulator
+    bson_iterator operand;  //field reference `$fpath` or constant
+} _AGGSPEC;
+
+/* accumulator state of a group */
+typedef struct {
+    int64_t num;    //number of accumulated values
+    _EJDBNUM sum;   //$sum, $avg
+    bool real;      //`sum.dnum` is used
+    char *mval;     //$min, $max value as BSON `{"v" : value}`
+} _AGGACC;
+
+/* group of aggregated records */
+typedef struct {
+    char *idbs;         //group `_id` as BSON `{"v" : value}`
+    _AGGACC acc[];      //accumulators in the order of specs
+} _AGGGRP;
+
+/* aggregation context. See `ejdbqryaggregate()` */
+typedef struct {
+    bson_iterator idspec;   //group `_id` specification
+    _AGGSPEC *specs;        //accumulator specifications
+    int snum;
+    TCMAP *gmap;            //group key -> `_AGGGRP`
+    TCXSTR *kbuf;           //group key buffer
+} _AGGCTX;
+
 
 /* private function prototypes */
 static void _ejdbsetecode(EJDB *jb, int ecode, const char *filename, int line, const char *func);
@@ -108,13 +283,21 @@ EJDB_INLINE bool _ejcollockmethod(EJCOLL *coll, bool wr);
 EJDB_INLINE bool _ejcollunlockmethod(EJCOLL *coll);
 static bson_type _bsonoidkey(bson *bs, bson_oid_t *oid);
 static char* _bsonitstrval(EJDB *jb, bson_iterator *it, int *vsz, TCLIST *tokens, txtflags_t flags);
+static char* _bsonithashval(EJDB *jb, bson_iterator *it, int *vsz);
+static int _hashidxnumkey(long double num, char *buf);
 static char* _bsonipathrowldr(TCLIST *tokens, const char *pkbuf, int pksz, const char *rowdata, int rowdatasz,
                               const char *ipath, int ipathsz, void *op, int *vsz);
 static char* _bsonfpathrowldr(TCLIST *tokens, const char *rowdata, int rowdatasz,
                               const char *fpath, int fpathsz, void *op, int *vsz);
-static bool _createcoldb(const char *colname, EJDB *jb, EJCOLLOPTS *opts, TCTDB** res);
+static bool _createcoldb(const char *colname, EJDB *jb, EJCOLLOPTS *opts, EJCOLL *coll, TCTDB** res);
 static bool _addcoldb0(const char *colname, EJDB *jb, EJCOLLOPTS *opts, EJCOLL **res);
 static void _delcoldb(EJCOLL *cdb);
+static void* _lzcodecenc(const void *ptr, int size, int *sp, void *op);
+static void* _lzcodecdec(const void *ptr, int size, int *sp, void *op);
+static TCLZDICT* _metagetlzdict(EJCOLL *coll);
+static bool _flushdeferredidx(EJCOLL *coll, TCLIST *dlist);
+static int _deferredidxcmp(const TCLISTDATUM *d1, const TCLISTDATUM *d2, void *opaque);
+static void* _deferredidxjobthread(void *op);
 static void _delqfdata(const EJQ *q, const EJQF *ejqf);
 static bool _ejdbsavebsonimpl(EJCOLL *coll, bson *bs, bson_oid_t *oid, bool merge);
 static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
@@ -122,7 +305,7 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
 static bool _metasetopts(EJDB *jb, const char *colname, EJCOLLOPTS *opts);
 static bool _metagetopts(EJDB *jb, const char *colname, EJCOLLOPTS *opts);
 static bson* _metagetbson(EJDB *jb, const char *colname, int colnamesz, const char *mkey);
-static bson* _metagetbson2(EJCOLL *coll, const char *mkey) __attribute__((unused));
+static bson* _metagetbson2(EJCOLL *coll, const char *mkey);
 static bool _metasetbson(EJDB *jb, const char *colname, int colnamesz,
                          const char *mkey, bson *val, bool merge, bool mergeoverwrt);
 static bool _metasetbson2(EJCOLL *coll, const char *mkey, bson *val, bool merge, bool mergeoverwrt);
@@ -131,11 +314,16 @@ static bool _qrypreprocess(_QRYCTX *ctx);
 static TCLIST* _parseqobj(EJDB *jb, EJQ *q, bson *qspec);
 static TCLIST* _parseqobj2(EJDB *jb, EJQ *q, const void *qspecbsdata);
 static int _parse_qobj_impl(EJDB *jb, EJQ *q, bson_iterator *it, TCLIST *qlist, TCLIST *pathStack, EJQF *pqf, int mgrp);
+static char* _qryrxprefix(const char *rx, int *sp);
 static int _ejdbsoncmp(const TCLISTDATUM *d1, const TCLISTDATUM *d2, void *opaque);
 static bool _qrycondcheckstrand(const char *vbuf, const TCLIST *tokens);
 static bool _qrycondcheckstror(const char *vbuf, const TCLIST *tokens);
+static void _qryinmapinit(EJQF *qf);
 static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays, int *arridx);
 static bool _qrybsmatch(EJQF *qf, const void *bsbuf, int bsbufsz);
+static bool _qryscanvec(const EJQF *qf);
+static void _qryscanfilter(const EJQF *qf, _SCANBATCH *sb);
+static bool _qryscanmatch(EJQF **qfs, int qfsz, const bool *vqfs, const void *bsbuf, int bsbufsz);
 static bool _qry_and_or_match(EJCOLL *coll, EJQ *ejq, const void *pkbuf, int pkbufsz);
 static bool _qryormatch2(EJCOLL *coll, EJQ *ejq, const void *bsbuf, int bsbufsz);
 static bool _qryormatch3(EJCOLL *coll, EJQ *ejq, EJQ *oq, const void *bsbuf, int bsbufsz);
@@ -147,16 +335,31 @@ static void _qrydel(EJQ *q, bool freequery);
 static bool _pushprocessedbson(_QRYCTX *ctx, const void *bsbuf, int bsbufsz);
 static bool _exec_do(_QRYCTX *ctx, const void *bsbuf, bson *bsout);
 static void _qryctxclear(_QRYCTX *ctx);
-static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *q, uint32_t *count, int qflags, TCXSTR *log);
+static void _qryfetchorder(EJCOLL *coll, const TCLIST *pks, bool keeporder, int *perm);
+static void _qryprefetch(EJCOLL *coll, const TCLIST *pks);
+static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *q, uint32_t *count, int qflags, TCXSTR *log,
+                           _QRYVISITOR rvisit, void *rvop);
+static bool _qrydistinctidx(EJCOLL *coll, const char *fpath, bson *rres, uint32_t *count, TCXSTR *log);
+static void _qrydistinctvisit(EJCOLL *coll, const void *bsbuf, int bsbufsz, void *op);
+static int _qrydistinctcmp(const void *a, const void *b);
+static void _qryvalkey(const bson *vbs, TCXSTR *kbuf);
+static void _qryaggoperand(const bson_iterator *spec, const void *bsbuf, const char *key, bson *out);
+static void _qryaggvisit(EJCOLL *coll, const void *bsbuf, int bsbufsz, void *op);
+static int _qryaggcmp(const void *a, const void *b);
 EJDB_INLINE void _nufetch(_EJDBNUM *nu, const char *sval, bson_type bt);
 EJDB_INLINE int _nucmp(_EJDBNUM *nu, const char *sval, bson_type bt);
 EJDB_INLINE int _nucmp2(_EJDBNUM *nu1, _EJDBNUM *nu2, bson_type bt);
 static EJCOLL* _getcoll(EJDB *jb, const char *colname);
 static bool _exportcoll(EJCOLL *coll, const char *dpath, int flags, TCXSTR *log);
+static void* _exportjobthread(void *opq);
 static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags, TCXSTR *log);
 static EJCOLL* _createcollimpl(EJDB *jb, const char *colname, EJCOLLOPTS *opts);
 static bool _rmcollimpl(EJDB *jb, EJCOLL *coll, bool unlinkfile);
-static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool nolock);
+static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bson *filter, bool nolock);
+static EJQ* _idxfilter(EJCOLL *coll, const char *ikey, int ikeysz, const void *imetadata);
+static void _idxfilterclear(EJCOLL *coll, const char *ikey);
+static void _idxfiltersload(EJCOLL *coll);
+static bool _qryidxfilterimplied(EJCOLL *coll, EJQ *q, const char *ipath, bson *idxmeta);
 
 extern const char *utf8proc_errmsg(ssize_t errcode);
 
@@ -207,6 +410,8 @@ const char* ejdberrmsg(int ecode) {
             return "data export/import failed";
         case JBETOOBIGBSON:
             return "bson size exceeds the maximum allowed size limit";
+        case JBEQAGGSPEC:
+            return "invalid aggregation group specification";
         case JBEINVALIDCMD:
             return "invalid ejdb command specified";
         default:
@@ -285,6 +490,34 @@ bool ejdbisopen(EJDB *jb) {
     return JBISOPEN(jb);
 }
 
+bool ejdbsetidxcache(EJDB *jb, int64_t size) {
+    assert(jb && jb->metadb);
+    if (!JBLOCKMETHOD(jb, true)) return false;
+    bool rv = true;
+    if (JBISOPEN(jb) || size < 0) {
+        _ejdbsetecode(jb, TCEINVALID, __FILE__, __LINE__, __func__);
+        rv = false;
+    } else {
+        jb->idxcache.limit = size;
+    }
+    JBUNLOCKMETHOD(jb);
+    return rv;
+}
+
+bool ejdbsetaio(EJDB *jb, int depth) {
+    assert(jb && jb->metadb);
+    if (!JBLOCKMETHOD(jb, true)) return false;
+    bool rv = true;
+    if (JBISOPEN(jb) || depth < 0) {
+        _ejdbsetecode(jb, TCEINVALID, __FILE__, __LINE__, __func__);
+        rv = false;
+    } else {
+        jb->aiodepth = depth;
+    }
+    JBUNLOCKMETHOD(jb);
+    return rv;
+}
+
 bool ejdbopen(EJDB *jb, const char *path, int mode) {
     assert(jb && path && jb->metadb);
     if (!JBLOCKMETHOD(jb, true)) return false;
@@ -559,7 +792,11 @@ void ejdbquerydel(EJQ *q) {
 
 /** Set index */
 bool ejdbsetindex(EJCOLL *coll, const char *fpath, int flags) {
-    return _setindeximpl(coll, fpath, flags, false);
+    return _setindeximpl(coll, fpath, flags, NULL, false);
+}
+
+bool ejdbsetindex2(EJCOLL *coll, const char *fpath, int flags, bson *filter) {
+    return _setindeximpl(coll, fpath, flags, filter, false);
 }
 
 uint32_t ejdbupdate(EJCOLL *coll, bson *qobj, bson *orqobjs, int orqobjsnum, bson *hints, TCXSTR *log) {
@@ -586,36 +823,29 @@ EJQRESULT ejdbqryexecute(EJCOLL *coll, const EJQ *q, uint32_t *count, int qflags
         JBCUNLOCKMETHOD(coll);
         return NULL;
     }
-    TCLIST *res = _qryexecute(coll, q, count, qflags, log);
+    TCLIST *res = _qryexecute(coll, q, count, qflags, log, NULL, NULL);
     JBCUNLOCKMETHOD(coll);
     return res;
 }
 
 bson* ejdbqrydistinct(EJCOLL *coll, const char *fpath, bson *qobj, bson *orqobjs, int orqobjsnum, uint32_t *count, TCXSTR *log) {
-    assert(coll);
+    assert(coll && fpath);
     uint32_t icount = 0;
-    
     bson *rqobj = qobj;
-    bson hints;
-    bson_init_as_query(&hints);
-    bson_append_start_object(&hints, "$fields");
-    bson_append_int(&hints, fpath, 1);
-    bson_append_finish_object(&hints);
-    bson_append_start_object(&hints, "$orderby");
-    bson_append_int(&hints, fpath, 1);
-    bson_append_finish_object(&hints);
-    bson_finish(&hints);
-
     EJQ *q = NULL;
     bson *rres = NULL;
     *count = 0;
 
+    if (!JBISOPEN(coll->jb)) {
+        _ejdbsetecode(coll->jb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return NULL;
+    }
     if (!rqobj) {
         rqobj = bson_create();
         bson_init(rqobj);
         bson_finish(rqobj);
     }
-    q = ejdbcreatequery(coll->jb, rqobj, orqobjs, orqobjsnum, &hints);
+    q = ejdbcreatequery(coll->jb, rqobj, orqobjs, orqobjsnum, NULL);
     if (q == NULL) {
         goto fail;
     }
@@ -623,44 +853,224 @@ bson* ejdbqrydistinct(EJCOLL *coll, const char *fpath, bson *qobj, bson *orqobjs
         _ejdbsetecode(coll->jb, JBEQERROR, __FILE__, __LINE__, __func__);
         goto fail;
     }
-    TCLIST *res = ejdbqryexecute(coll, q, &icount, 0, log);
     rres = bson_create();
     bson_init(rres);
+    JBCLOCKMETHOD(coll, false);
+    if (TCLISTNUM(q->qflist) > 0 ||
+            (q->orqlist && TCLISTNUM(q->orqlist) > 0) || (q->andqlist && TCLISTNUM(q->andqlist) > 0) ||
+            !_qrydistinctidx(coll, fpath, rres, count, log)) {
+        //Collect unique values of matched records into the hash map
+        bson_destroy(rres);
+        bson_init(rres);
+        _DISTINCTCTX dctx = {
+            .fpath = fpath,
+            .fpathsz = strlen(fpath),
+            .vmap = tcmapnew(),
+            .kbuf = tcxstrnew()
+        };
+        if (log) {
+            tcxstrprintf(log, "DISTINCT MODE: HASH SCAN\n");
+        }
+        TCLIST *res = _qryexecute(coll, q, &icount, 0, log, _qrydistinctvisit, &dctx);
+        if (res) {
+            tclistdel(res);
+        }
+        int vnum = TCMAPRNUM(dctx.vmap);
+        const char **vals;
+        TCMALLOC(vals, vnum * sizeof (*vals) + 1);
+        tcmapiterinit(dctx.vmap);
+        for (int i = 0; i < vnum; ++i) {
+            int ksz, vsz;
+            const char *kbuf = tcmapiternext(dctx.vmap, &ksz);
+            assert(kbuf);
+            vals[i] = tcmapiterval(kbuf, &vsz);
+        }
+        qsort(vals, vnum, sizeof (*vals), _qrydistinctcmp);
+        char ibuf[TCNUMBUFSIZ];
+        for (int i = 0; i < vnum; ++i) {
+            bson_iterator it;
+            bson_find_from_buffer(&it, vals[i], "v");
+            bson_numstrn(ibuf, TCNUMBUFSIZ, i);
+            bson_append_field_from_iterator2(ibuf, &it, rres);
+        }
+        TCFREE(vals);
+        tcmapdel(dctx.vmap);
+        tcxstrdel(dctx.kbuf);
+        *count = vnum;
+    }
+    JBCUNLOCKMETHOD(coll);
+    bson_finish(rres);
+
+fail:
+    if (q) {
+        ejdbquerydel(q);
+    }
+    if (rqobj != qobj) {
+        bson_del(rqobj);
+    }
+    return rres;
+}
+
+bson* ejdbqryaggregate(EJCOLL *coll, bson *group, bson *qobj, bson *orqobjs, int orqobjsnum, uint32_t *count, TCXSTR *log) {
+    assert(coll && group && count);
+    uint32_t icount = 0;
+    bson *rqobj = qobj;
+    EJQ *q = NULL;
+    bson *rres = NULL;
+    *count = 0;
 
-    bson_iterator bsi[2];
-    bson_iterator *prev = NULL, *cur;
-    int biind = 0;
-    char biindstr[TCNUMBUFSIZ];
-    memset(biindstr, '\0', 32);
-    int fplen = strlen(fpath);
-    for(int i = 0; i < TCLISTNUM(res); ++i) {
-        cur = bsi + (biind & 1);
-        BSON_ITERATOR_FROM_BUFFER(cur, TCLISTVALPTR(res, i));
-        bson_type bt = bson_find_fieldpath_value2(fpath, fplen, cur);
-        if (bt == BSON_EOO) {
+    if (!JBISOPEN(coll->jb)) {
+        _ejdbsetecode(coll->jb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return NULL;
+    }
+    //Parse group specification
+    _AGGCTX actx = {
+        .snum = 0
+    };
+    bson_iterator it, sit;
+    bson_type bt;
+    BSON_ITERATOR_INIT(&it, group);
+    while ((bt = bson_iterator_next(&it)) != BSON_EOO) {
+        actx.snum++;
+    }
+    TCMALLOC(actx.specs, actx.snum * sizeof (*actx.specs) + 1);
+    actx.snum = 0;
+    memset(&actx.idspec, 0, sizeof (actx.idspec)); //missing `_id`: single group
+    BSON_ITERATOR_INIT(&it, group);
+    while ((bt = bson_iterator_next(&it)) != BSON_EOO) {
+        const char *key = BSON_ITERATOR_KEY(&it);
+        if (!strcmp(key, JDBIDKEYNAME)) {
+            actx.idspec = it;
             continue;
         }
-        
-        if (prev == NULL || bson_compare_it_current(prev, cur)) {
-            bson_numstrn(biindstr, TCNUMBUFSIZ, biind);
-            bson_append_field_from_iterator2(biindstr, cur, rres);
-            prev = cur;
-            biind++;
+        int op = 0;
+        if (bt == BSON_OBJECT) {
+            BSON_ITERATOR_SUBITERATOR(&it, &sit);
+            if (bson_iterator_next(&sit) != BSON_EOO) {
+                const char *akey = BSON_ITERATOR_KEY(&sit);
+                op = !strcmp(akey, "$sum") ? JBAGGSUM :
+                     !strcmp(akey, "$avg") ? JBAGGAVG :
+                     !strcmp(akey, "$min") ? JBAGGMIN :
+                     !strcmp(akey, "$max") ? JBAGGMAX :
+                     !strcmp(akey, "$count") ? JBAGGCOUNT : 0;
+            }
+        }
+        if (!op || *key == '$' || bson_iterator_next(&sit) != BSON_EOO) {
+            _ejdbsetecode(coll->jb, JBEQAGGSPEC, __FILE__, __LINE__, __func__);
+            goto fail;
+        }
+        BSON_ITERATOR_SUBITERATOR(&it, &sit);
+        bson_iterator_next(&sit);
+        _AGGSPEC *spec = actx.specs + actx.snum++;
+        spec->name = key;
+        spec->op = op;
+        spec->operand = sit;
+    }
+    if (!rqobj) {
+        rqobj = bson_create();
+        bson_init(rqobj);
+        bson_finish(rqobj);
+    }
+    q = ejdbcreatequery(coll->jb, rqobj, orqobjs, orqobjsnum, NULL);
+    if (q == NULL) {
+        goto fail;
+    }
+    if (q->flags & EJQUPDATING) {
+        _ejdbsetecode(coll->jb, JBEQERROR, __FILE__, __LINE__, __func__);
+        goto fail;
+    }
+    actx.gmap = tcmapnew();
+    actx.kbuf = tcxstrnew();
+    JBCLOCKMETHOD(coll, false);
+    TCLIST *res = _qryexecute(coll, q, &icount, 0, log, _qryaggvisit, &actx);
+    JBCUNLOCKMETHOD(coll);
+    if (res) {
+        tclistdel(res);
+    }
+    int gnum = TCMAPRNUM(actx.gmap);
+    if (log) {
+        tcxstrprintf(log, "AGGREGATED RECORDS: %u\n", icount);
+        tcxstrprintf(log, "AGGREGATED GROUPS: %d\n", gnum);
+    }
+    _AGGGRP **grps;
+    TCMALLOC(grps, gnum * sizeof (*grps) + 1);
+    tcmapiterinit(actx.gmap);
+    for (int i = 0; i < gnum; ++i) {
+        int ksz, vsz;
+        const char *kbuf = tcmapiternext(actx.gmap, &ksz);
+        assert(kbuf);
+        grps[i] = (_AGGGRP *) tcmapiterval(kbuf, &vsz);
+    }
+    qsort(grps, gnum, sizeof (*grps), _qryaggcmp);
+    rres = bson_create();
+    bson_init(rres);
+    char ibuf[TCNUMBUFSIZ];
+    for (int i = 0; i < gnum; ++i) {
+        _AGGGRP *grp = grps[i];
+        bson_numstrn(ibuf, TCNUMBUFSIZ, i);
+        bson_append_start_object(rres, ibuf);
+        bson_find_from_buffer(&it, grp->idbs, "v");
+        bson_append_field_from_iterator2(JDBIDKEYNAME, &it, rres);
+        for (int j = 0; j < actx.snum; ++j) {
+            _AGGSPEC *spec = actx.specs + j;
+            _AGGACC *acc = grp->acc + j;
+            switch (spec->op) {
+                case JBAGGCOUNT:
+                    if (acc->num > INT_MAX) {
+                        bson_append_long(rres, spec->name, acc->num);
+                    } else {
+                        bson_append_int(rres, spec->name, (int) acc->num);
+                    }
+                    break;
+                case JBAGGSUM:
+                    if (acc->real) {
+                        bson_append_double(rres, spec->name, acc->sum.dnum);
+                    } else if (acc->sum.inum > INT_MAX || acc->sum.inum < INT_MIN) {
+                        bson_append_long(rres, spec->name, acc->sum.inum);
+                    } else {
+                        bson_append_int(rres, spec->name, (int) acc->sum.inum);
+                    }
+                    break;
+                case JBAGGAVG:
+                    if (acc->num > 0) {
+                        bson_append_double(rres, spec->name,
+                                           (acc->real ? acc->sum.dnum : (double) acc->sum.inum) / acc->num);
+                    } else {
+                        bson_append_null(rres, spec->name);
+                    }
+                    break;
+                default: //$min, $max
+                    if (acc->mval) {
+                        bson_find_from_buffer(&it, acc->mval, "v");
+                        bson_append_field_from_iterator2(spec->name, &it, rres);
+                        TCFREE(acc->mval);
+                    } else {
+                        bson_append_null(rres, spec->name);
+                    }
+                    break;
+            }
         }
+        bson_append_finish_object(rres);
+        TCFREE(grp->idbs);
     }
     bson_finish(rres);
-    tclistdel(res);
-    
-    *count = biind;
-    
+    TCFREE(grps);
+    *count = gnum;
+
 fail:
+    if (actx.gmap) {
+        tcmapdel(actx.gmap);
+    }
+    if (actx.kbuf) {
+        tcxstrdel(actx.kbuf);
+    }
+    TCFREE(actx.specs);
     if (q) {
         ejdbquerydel(q);
     }
-    if (rqobj != qobj) {
+    if (rqobj && rqobj != qobj) {
         bson_del(rqobj);
     }
-    bson_destroy(&hints);
     return rres;
 }
 
@@ -697,6 +1107,65 @@ bool ejdbsyncoll(EJCOLL *coll) {
     return rv;
 }
 
+bool ejdbtraincompressdict(EJCOLL *coll, int size) {
+    assert(coll);
+    if (!JBISOPEN(coll->jb)) {
+        _ejdbsetecode(coll->jb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    if (size <= 0) {
+        size = JBLZDICTDEFSIZ;
+    }
+    bool rv = true;
+    char *dbuf = NULL;
+    int dsz = 0;
+    if (!JBCLOCKMETHOD(coll, true)) return false;
+    TCHDB *hdb = coll->tdb->hdb;
+    if (!(coll->tdb->opts & TDBTEXCODEC) || coll->lzdict || !(hdb->omode & HDBOWRITER)) {
+        _ejdbsetecode(coll->jb, TCEINVALID, __FILE__, __LINE__, __func__);
+        rv = false;
+        goto finish;
+    }
+    TCLIST *samples = tclistnew2(1024);
+    TCXSTR *kxstr = tcxstrnew();
+    TCXSTR *vxstr = tcxstrnew();
+    int64_t ssz = 0;
+    rv = tchdbiterinit(hdb);
+    while (rv && ssz < JBLZDICTSAMPMAX && tchdbiternext3(hdb, kxstr, vxstr)) {
+        TCLISTPUSH(samples, TCXSTRPTR(vxstr), TCXSTRSIZE(vxstr));
+        ssz += TCXSTRSIZE(vxstr);
+    }
+    tcxstrdel(vxstr);
+    tcxstrdel(kxstr);
+    if (rv) {
+        dbuf = tclzdicttrain(samples, tclmin(size, UINT16_MAX), &dsz);
+    }
+    tclistdel(samples);
+    if (!rv) {
+        goto finish;
+    }
+    if (!dbuf) {
+        _ejdbsetecode(coll->jb, TCENOREC, __FILE__, __LINE__, __func__);
+        rv = false;
+        goto finish;
+    }
+    bson bsdict;
+    bson_init(&bsdict);
+    bson_append_binary(&bsdict, "dict", BSON_BIN_BINARY, dbuf, dsz);
+    bson_finish(&bsdict);
+    rv = _metasetbson2(coll, "lzdict", &bsdict, false, false);
+    bson_destroy(&bsdict);
+    if (rv) { //codec may run concurrently in the write-behind thread
+        __atomic_store_n(&coll->lzdict, tclzdictnew(dbuf, dsz), __ATOMIC_RELEASE);
+    }
+finish:
+    if (dbuf) {
+        TCFREE(dbuf);
+    }
+    JBCUNLOCKMETHOD(coll);
+    return rv;
+}
+
 bool ejdbsyncdb(EJDB *jb) {
     assert(jb);
     JBENSUREOPENLOCK(jb, true, false);
@@ -826,14 +1295,26 @@ bson* ejdbmeta(EJDB *jb) {
         bson_append_long(bs, "cachedrecords", coll->tdb->hdb->rcnum);
         bson_append_bool(bs, "large", (coll->tdb->opts & TDBTLARGE));
         bson_append_bool(bs, "compressed", (coll->tdb->opts & TDBTDEFLATE));
+        bson_append_bool(bs, "fastcompressed", (coll->tdb->opts & TDBTEXCODEC));
+        bson_append_long(bs, "writebehind", coll->tdb->hdb->wbmax);
+        bson_append_int(bs, "bgdefrag", tclmax(coll->tdb->hdb->dfdelay, 0));
         bson_append_finish_object(bs); //eof coll.options
 
+        bson_append_start_object(bs, "defrag"); //coll.defrag
+        bson_append_long(bs, "passes", coll->tdb->hdb->dfpasses);
+        bson_append_long(bs, "moved", coll->tdb->hdb->dfmoved);
+        bson_append_long(bs, "truncated", coll->tdb->hdb->dftrunc);
+        bson_append_long(bs, "cursor", coll->tdb->hdb->dfcur);
+        bson_append_long(bs, "filesize", coll->tdb->hdb->fsiz);
+        bson_append_finish_object(bs); //eof coll.defrag
+
         bson_append_start_array(bs, "indexes"); //coll.indexes[]
         for (int j = 0; j < coll->tdb->inum; ++j) {
             TDBIDX *idx = (coll->tdb->idxs + j);
             if (idx->type != TDBITLEXICAL &&
                     idx->type != TDBITDECIMAL &&
-                    idx->type != TDBITTOKEN) {
+                    idx->type != TDBITTOKEN &&
+                    idx->type != TDBITHASH) {
                 continue;
             }
             bson_numstrn(nbuff, TCNUMBUFSIZ, j);
@@ -850,9 +1331,16 @@ bson* ejdbmeta(EJDB *jb) {
                 case TDBITTOKEN:
                     bson_append_string(bs, "type", "token");
                     break;
+                case TDBITHASH:
+                    bson_append_string(bs, "type", "hash");
+                    break;
             }
-            TCBDB *idb = (TCBDB*) idx->db;
-            if (idb) {
+            if (idx->type == TDBITHASH) {
+                TCHDB *ihdb = (TCHDB*) idx->db;
+                bson_append_long(bs, "records", ihdb->rnum);
+                bson_append_string(bs, "file", ihdb->path);
+            } else if (idx->db) {
+                TCBDB *idb = (TCBDB*) idx->db;
                 bson_append_long(bs, "records", idb->rnum);
                 bson_append_string(bs, "file", idb->hdb->path);
             }
@@ -894,6 +1382,11 @@ bool ejdbexport(EJDB *jb, const char *path, TCLIST *cnames, int flags, TCXSTR *l
             TCLISTPUSH(_cnames, c->cname, c->cnamesz);
         }
     }
+    //Read lock all exported collections first so the export is a consistent
+    //snapshot of the database, then dump collections in parallel
+    int jnum = 0;
+    _EXPORTJOB *jobs;
+    TCMALLOC(jobs, sizeof (*jobs) * (TCLISTNUM(_cnames) + 1)); //never zero sized
     for (int i = 0; i < TCLISTNUM(_cnames); ++i) {
         const char *cn = TCLISTVALPTR(_cnames, i);
         assert(cn);
@@ -903,12 +1396,44 @@ bool ejdbexport(EJDB *jb, const char *path, TCLIST *cnames, int flags, TCXSTR *l
             err = true;
             goto finish;
         }
-        if (!_exportcoll(coll, path, flags, log)) {
-            err = true;
+        _EXPORTJOB *job = jobs + jnum++;
+        memset(job, 0, sizeof (*job));
+        job->coll = coll;
+        job->dpath = path;
+        job->flags = flags;
+        job->log = log ? tcxstrnew() : NULL;
+    }
+    for (int i = 0; i < jnum; i += JBEXPORTMAXTHREADS) {
+        int wnum = MIN(jnum - i, JBEXPORTMAXTHREADS);
+        for (int j = i + 1; j < i + wnum; ++j) {
+            jobs[j].thread = (pthread_create(&jobs[j].thr, NULL, _exportjobthread, jobs + j) == 0);
+        }
+        _exportjobthread(jobs + i);
+        for (int j = i + 1; j < i + wnum; ++j) {
+            if (!jobs[j].thread) {
+                _exportjobthread(jobs + j);
+            } else if (pthread_join(jobs[j].thr, NULL) != 0) {
+                jobs[j].rv = false;
+                jobs[j].ecode = TCETHREAD;
+            }
         }
-        JBCUNLOCKMETHOD(coll);
     }
 finish:
+    for (int i = 0; i < jnum; ++i) {
+        _EXPORTJOB *job = jobs + i;
+        if (!job->rv) {
+            err = true;
+            if (job->thread && job->ecode != TCESUCCESS) {
+                _ejdbsetecode2(jb, job->ecode, __FILE__, __LINE__, __func__, true);
+            }
+        }
+        if (job->log) {
+            TCXSTRCAT(log, TCXSTRPTR(job->log), TCXSTRSIZE(job->log));
+            tcxstrdel(job->log);
+        }
+        JBCUNLOCKMETHOD(job->coll);
+    }
+    TCFREE(jobs);
     JBUNLOCKMETHOD(jb);
     if (_cnames != cnames) {
         tclistdel(_cnames);
@@ -920,19 +1445,23 @@ bool ejdbimport(EJDB *jb, const char *path, TCLIST *cnames, int flags, TCXSTR *l
     assert(jb && path);
     bool err = false;
     bool isdir = false;
-    if (flags == 0) {
+    if (!(flags & (JBIMPORTUPDATE | JBIMPORTREPLACE))) {
         flags |= JBIMPORTUPDATE;
     }
     if (!tcstatfile(path, &isdir, NULL, NULL) || !isdir) {
         _ejdbsetecode2(jb, TCENOFILE, __FILE__, __LINE__, __func__, true);
         return false;
     }
+    const char *ext = (flags & JBJSONIMPORT) ? "json" : "bson";
     bool tail = (path[0] != '\0' && path[strlen(path) - 1] == MYPATHCHR);
-    char *bsonpat = tail ? tcsprintf("%s*.bson") : tcsprintf("%s%c*.bson", path, MYPATHCHR);
+    char *bsonpat = tail ? tcsprintf("%s*.%s", path, ext) : tcsprintf("%s%c*.%s", path, MYPATHCHR, ext);
     TCLIST *bspaths = tcglobpat(bsonpat);
     JBENSUREOPENLOCK(jb, true, false);
     for (int i = 0; i < TCLISTNUM(bspaths); ++i) {
         const char* bspath = TCLISTVALPTR(bspaths, i);
+        if (tcstrbwm(bspath, "-meta.json")) { //collection meta file
+            continue;
+        }
         if (!_importcoll(jb, bspath, cnames, flags, log)) {
             err = true;
             goto finish;
@@ -1042,13 +1571,15 @@ finish:
  * private features
  *************************************************************************************************/
 
-static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool nolock) {
+static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bson *filter, bool nolock) {
     assert(coll && fpath);
     bool rv = true;
     bson *imeta = NULL;
+    EJQ *fq = NULL; //compiled partial index filter
     bson_iterator it;
     int tcitype = 0; //TCDB index type
     int oldiflags = 0; //Old index flags stored in meta
+    bool rmfilter = false; //Filter of partial index is removed
     bool ibld = (flags & JBIDXREBLD);
     if (ibld) {
         flags &= ~JBIDXREBLD;
@@ -1079,9 +1610,35 @@ static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool noloc
     memmove(ipath + 1, fpath, fpathlen + 1);
     ipath[0] = 's'; //defaulting to string index type
 
+    if (filter && (idrop || iop)) {
+        filter = NULL;
+    }
+    if (filter && (filter->err || !filter->finished)) {
+        _ejdbsetecode(coll->jb, JBEINVALIDBSON, __FILE__, __LINE__, __func__);
+        rv = false;
+        goto finish;
+    }
+    if (filter) {
+        BSON_ITERATOR_INIT(&it, filter);
+        if (bson_iterator_next(&it) == BSON_EOO) { //Empty filter makes index regular
+            filter = NULL;
+            rmfilter = true;
+        }
+    }
+
     if (!nolock) {
         JBENSUREOPENLOCK(coll->jb, true, false);
     }
+    if (filter) {
+        fq = ejdbcreatequery(coll->jb, filter, NULL, 0, NULL);
+        if (!fq) {
+            if (!nolock) {
+                JBUNLOCKMETHOD(coll->jb);
+            }
+            rv = false;
+            goto finish;
+        }
+    }
     imeta = _imetaidx(coll, fpath);
     if (!imeta) {
         if (idrop) { //Cannot drop/optimize not existent index;
@@ -1097,7 +1654,11 @@ static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool noloc
         bson_init(imeta);
         bson_append_string(imeta, "ipath", fpath);
         bson_append_int(imeta, "iflags", flags);
+        if (filter) {
+            bson_append_bson(imeta, "ifilter", filter);
+        }
         bson_finish(imeta);
+        rmfilter = false;
         rv = _metasetbson2(coll, ikey, imeta, false, false);
         if (!rv) {
             if (!nolock) {
@@ -1109,12 +1670,34 @@ static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool noloc
         if (bson_find(&it, imeta, "iflags") != BSON_EOO) {
             oldiflags = bson_iterator_int(&it);
         }
-        if (!idrop && oldiflags != flags) { //Update index meta
+        if (rmfilter && bson_find(&it, imeta, "ifilter") != BSON_OBJECT) {
+            rmfilter = false; //Not a partial index
+        }
+        if (filter || rmfilter) { //New or removed filter of partial index, rebuild all existing index types
+            ibld = true;
+            flags |= oldiflags;
+        } else if (!idrop && !iop && bson_find(&it, imeta, "ifilter") == BSON_OBJECT) {
+            fq = ejdbcreatequery2(coll->jb, bson_iterator_value(&it));
+            if (!fq) {
+                if (!nolock) {
+                    JBUNLOCKMETHOD(coll->jb);
+                }
+                rv = false;
+                goto finish;
+            }
+        }
+        if (!idrop && (oldiflags != flags || filter || rmfilter)) { //Update index meta
             bson imetadelta;
             bson_init(&imetadelta);
+            if (rmfilter) { //Meta is replaced to drop the filter
+                bson_append_string(&imetadelta, "ipath", fpath);
+            }
             bson_append_int(&imetadelta, "iflags", (flags | oldiflags));
+            if (filter) {
+                bson_append_bson(&imetadelta, "ifilter", filter);
+            }
             bson_finish(&imetadelta);
-            rv = _metasetbson2(coll, ikey, &imetadelta, true, true);
+            rv = _metasetbson2(coll, ikey, &imetadelta, !rmfilter, !rmfilter);
             bson_destroy(&imetadelta);
             if (!rv) {
                 if (!nolock) {
@@ -1145,9 +1728,12 @@ static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool noloc
             goto finish;
         }
     }
+    _idxfilterclear(coll, ikey);
     _BSONIPATHROWLDR op;
     op.icase = false;
+    op.hash = false;
     op.coll = coll;
+    op.ifilter = fq;
     if (tcitype) {
         if (flags & JBIDXSTR) {
             ipath[0] = 's';
@@ -1166,6 +1752,12 @@ static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool noloc
             ipath[0] = 'a';
             rv = tctdbsetindexrldr(coll->tdb, ipath, tcitype, _bsonipathrowldr, &op);
         }
+        if (rv && (flags & JBIDXHASH)) {
+            ipath[0] = 'h';
+            op.icase = false;
+            op.hash = true;
+            rv = tctdbsetindexrldr(coll->tdb, ipath, tcitype, _bsonipathrowldr, &op);
+        }
         if (idrop) { //Update index meta on drop
             oldiflags &= ~flags;
             if (oldiflags) { //Index dropped only for some types
@@ -1197,7 +1789,14 @@ static bool _setindeximpl(EJCOLL *coll, const char *fpath, int flags, bool noloc
             ipath[0] = 'a';
             rv = tctdbsetindexrldr(coll->tdb, ipath, TDBITTOKEN, _bsonipathrowldr, &op);
         }
+        if (rv && (flags & JBIDXHASH) && (ibld || !(oldiflags & JBIDXHASH))) {
+            ipath[0] = 'h';
+            op.icase = false;
+            op.hash = true;
+            rv = tctdbsetindexrldr(coll->tdb, ipath, TDBITHASH, _bsonipathrowldr, &op);
+        }
     }
+    _idxfiltersload(coll);
     if (!nolock) {
         JBCUNLOCKMETHOD(coll);
     }
@@ -1205,6 +1804,9 @@ finish:
     if (imeta) {
         bson_del(imeta);
     }
+    if (fq) {
+        ejdbquerydel(fq);
+    }
     return rv;
 }
 
@@ -1223,7 +1825,7 @@ static bool _rmcollimpl(EJDB *jb, EJCOLL *coll, bool unlinkfile) {
     tclistpush2(paths, coll->tdb->hdb->path);
     for (int j = 0; j < coll->tdb->inum; ++j) {
         TDBIDX *idx = coll->tdb->idxs + j;
-        const char *ipath = tcbdbpath(idx->db);
+        const char *ipath = (idx->type == TDBITHASH) ? tchdbpath(idx->db) : tcbdbpath(idx->db);
         if (ipath) {
             tclistpush2(paths, ipath);
         }
@@ -1275,46 +1877,209 @@ finish:
     return coll;
 }
 
-static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags, TCXSTR *log) {
-    if (log) {
-        tcxstrprintf(log, "\n\nReading '%s'", bspath);
-    }
-    bool err = false;
-    // /foo/bar.bson
-    char *dp = strrchr(bspath, '.');
-    char *pp = strrchr(bspath, MYPATHCHR);
-    if (!dp || !pp || pp > dp) {
-        if (log) {
-            tcxstrprintf(log, "\nERROR: Invalid file path: '%s'", bspath);
-        }
-        _ejdbsetecode2(jb, JBEEI, __FILE__, __LINE__, __func__, true);
-        return false;
-    }
-    char *lastsep = pp;
-    int i = 0;
-    char *cname, *mjson = NULL;
+/* Register collection indexes listed in collection meta `mbson` of imported collection */
+static bool _importcollidx(EJCOLL *coll, bson *mbson, const char *cname, TCXSTR *log) {
+    bool rv = true;
     bson_type bt;
-    bson *mbson = NULL; //meta bson
     bson_iterator mbsonit;
-    int sp;
-    EJCOLL *coll;
+    BSON_ITERATOR_INIT(&mbsonit, mbson);
+    while ((bt = bson_iterator_next(&mbsonit)) != BSON_EOO) {
+        const char *key = BSON_ITERATOR_KEY(&mbsonit);
+        if (bt != BSON_OBJECT || strlen(key) < 2 || key[0] != 'i') {
+            continue;
+        }
+        char *ipath = NULL;
+        int iflags = 0;
+        bson_iterator sit;
 
-    TCMALLOC(cname, dp - pp + 1);
-    TCXSTR *xmetapath = tcxstrnew();
+        BSON_ITERATOR_SUBITERATOR(&mbsonit, &sit);
+        bt = bson_find_fieldpath_value("ipath", &sit);
+        if (bt == BSON_STRING) {
+            ipath = strdup(bson_iterator_string(&sit));
+        }
 
-    while (++pp != dp) {
-        cname[i++] = *pp;
-    }
-    cname[i] = '\0';
-    if (cnames != NULL) {
-        if (tclistlsearch(cnames, cname, i) == -1) {
-            goto finish;
+        BSON_ITERATOR_SUBITERATOR(&mbsonit, &sit);
+        bt = bson_find_fieldpath_value("iflags", &sit);
+        if (bt == BSON_INT || bt == BSON_LONG) {
+            iflags = bson_iterator_int(&sit);
         }
-    }
-    tcxstrcat(xmetapath, bspath, lastsep - bspath + 1);
-    tcxstrprintf(xmetapath, "%s-meta.json", cname);
-    mjson = tcreadfile(tcxstrptr(xmetapath), 0, &sp);
-    if (!mjson) {
+        bson ifilter;
+        bool hasifilter = false;
+        BSON_ITERATOR_SUBITERATOR(&mbsonit, &sit);
+        bt = bson_find_fieldpath_value("ifilter", &sit);
+        if (bt == BSON_OBJECT) {
+            bson_init_finished_data(&ifilter, bson_iterator_value(&sit));
+            hasifilter = true;
+        }
+        if (ipath) {
+            if (!_setindeximpl(coll, ipath, iflags, (hasifilter ? &ifilter : NULL), true)) {
+                rv = false;
+                if (log) {
+                    tcxstrprintf(log, "\nERROR: Error creating collection index. Collection: '%s' Field: '%s'", cname, ipath);
+                }
+            }
+            TCFREE(ipath);
+        }
+    }
+    return rv;
+}
+
+/**
+ * Ensure that at least `need` unread bytes are available in the import read buffer.
+ * Buffer is refilled with large reads and grows if `need` exceeds its size.
+ * @return `false` on end of file or read error.
+ */
+static bool _importrbfill(_IMPORTRBUF *rb, int32_t need) {
+    if (rb->len - rb->pos >= need) {
+        return true;
+    }
+    if (rb->pos > 0) {
+        memmove(rb->buf, rb->buf + rb->pos, rb->len - rb->pos);
+        rb->len -= rb->pos;
+        rb->pos = 0;
+    }
+    if (need > rb->size) {
+        rb->size = MAX(need, rb->size * 2);
+        TCREALLOC(rb->buf, rb->buf, rb->size);
+    }
+    while (rb->len < need) {
+        ssize_t rc = read(rb->fd, rb->buf + rb->len, rb->size - rb->len);
+        if (rc > 0) {
+            rb->len += rc;
+        } else if (rc == -1 && errno == EINTR) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Read the next BSON document of BSON dump file.
+ * Document data is not copied and stays valid until the next buffer fill.
+ * @return `1` if document is read, `0` on end of file, `-1` on error.
+ */
+static int _importnextbson(EJDB *jb, _IMPORTRBUF *rb, bson *bs, TCXSTR *log) {
+    int32_t docsiz = 0;
+    if (!_importrbfill(rb, 4)) {
+        return 0;
+    }
+    memcpy(&docsiz, rb->buf + rb->pos, 4);
+    docsiz = TCHTOIL(docsiz);
+    if (docsiz > EJDB_MAX_IMPORTED_BSON_SIZE) {
+        if (log) {
+            tcxstrprintf(log, "\nERROR: BSON document size: %d exceeds the maximum allowed size limit: %d for import operation",
+                         docsiz, EJDB_MAX_IMPORTED_BSON_SIZE);
+        }
+        _ejdbsetecode2(jb, JBETOOBIGBSON, __FILE__, __LINE__, __func__, true);
+        return -1;
+    }
+    if (docsiz < 5 || !_importrbfill(rb, docsiz)) {
+        return 0;
+    }
+    char *docbuf = rb->buf + rb->pos;
+    rb->pos += docsiz;
+    bson_init_with_data(bs, docbuf);
+    if (docbuf[docsiz - 1] != '\0' || bs->err || !bs->finished) {
+        _ejdbsetecode(jb, JBEINVALIDBSON, __FILE__, __LINE__, __func__);
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Read the next JSON object of newline delimited JSON file into `bs`.
+ * Objects crossing the read buffer boundary are parsed again after refill.
+ * @return `1` if document is read, `0` on end of file, `-1` on error.
+ */
+static int _importnextjson(EJDB *jb, _IMPORTRBUF *rb, bson *bs, char *bstack, TCXSTR *log) {
+    while (true) {
+        int32_t avail = rb->len - rb->pos;
+        bson_init_on_stack(bs, bstack, 0, JBSBUFFERSZ);
+        int rc = json2bsonbuf(rb->buf + rb->pos, avail, bs);
+        if (rc > 0) {
+            rb->pos += rc;
+            if (bson_finish(bs) != BSON_OK) {
+                bson_destroy(bs);
+                goto fail;
+            }
+            return 1;
+        }
+        bson_destroy(bs);
+        if (rc < 0) {
+            goto fail;
+        }
+        if (avail > EJDB_MAX_IMPORTED_BSON_SIZE) {
+            if (log) {
+                tcxstrprintf(log, "\nERROR: JSON document size exceeds the maximum allowed size limit: %d for import operation",
+                             EJDB_MAX_IMPORTED_BSON_SIZE);
+            }
+            _ejdbsetecode2(jb, JBETOOBIGBSON, __FILE__, __LINE__, __func__, true);
+            return -1;
+        }
+        if (!_importrbfill(rb, avail + 1) && rb->len - rb->pos == avail) { //end of file
+            for (int32_t i = rb->pos; i < rb->len; ++i) {
+                if (!isspace((unsigned char) rb->buf[i])) {
+                    goto fail;
+                }
+            }
+            return 0;
+        }
+    }
+fail:
+    if (log) {
+        tcxstrprintf(log, "\nERROR: Invalid JSON document at the position: %d of the read buffer", rb->pos);
+    }
+    _ejdbsetecode2(jb, JBEEJSONPARSE, __FILE__, __LINE__, __func__, true);
+    return -1;
+}
+
+static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags, TCXSTR *log) {
+    if (log) {
+        tcxstrprintf(log, "\n\nReading '%s'", bspath);
+    }
+    bool err = false;
+    // /foo/bar.bson
+    char *dp = strrchr(bspath, '.');
+    char *pp = strrchr(bspath, MYPATHCHR);
+    if (!dp || !pp || pp > dp) {
+        if (log) {
+            tcxstrprintf(log, "\nERROR: Invalid file path: '%s'", bspath);
+        }
+        _ejdbsetecode2(jb, JBEEI, __FILE__, __LINE__, __func__, true);
+        return false;
+    }
+    char *lastsep = pp;
+    int i = 0;
+    char *cname, *mjson = NULL;
+    bson_type bt;
+    bson *mbson = NULL; //meta bson
+    bson_iterator mbsonit;
+    int sp;
+    EJCOLL *coll;
+    bool deferidx = false; //build indexes after data loading
+    bool json = (flags & JBJSONIMPORT);
+
+    TCMALLOC(cname, dp - pp + 1);
+    TCXSTR *xmetapath = tcxstrnew();
+
+    while (++pp != dp) {
+        cname[i++] = *pp;
+    }
+    cname[i] = '\0';
+    if (cnames != NULL) {
+        if (tclistlsearch(cnames, cname, i) == -1) {
+            goto finish;
+        }
+    }
+    tcxstrcat(xmetapath, bspath, lastsep - bspath + 1);
+    tcxstrprintf(xmetapath, "%s-meta.json", cname);
+    mjson = tcreadfile(tcxstrptr(xmetapath), 0, &sp);
+    if (!mjson && json && !tcstatfile(tcxstrptr(xmetapath), NULL, NULL, NULL)) {
+        mjson = tcstrdup("{}"); //meta is optional for JSON feeds
+    }
+    if (!mjson) {
         err = true;
         if (log) {
             tcxstrprintf(log, "\nERROR: Error reading the file: '%s'", tcxstrptr(xmetapath));
@@ -1329,6 +2094,7 @@ static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags,
             tcxstrprintf(log, "\nERROR: Invalid JSON in the file: '%s'", tcxstrptr(xmetapath));
         }
         _ejdbsetecode2(jb, JBEEJSONPARSE, __FILE__, __LINE__, __func__, true);
+        goto finish;
     }
     coll = _getcoll(jb, cname);
     if (coll && (flags & JBIMPORTREPLACE)) {
@@ -1357,12 +2123,18 @@ static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags,
                 const char *key = BSON_ITERATOR_KEY(&sit);
                 if (strcmp("compressed", key) == 0 && bt == BSON_BOOL) {
                     cops.compressed = bson_iterator_bool(&sit);
+                } else if (strcmp("fastcompressed", key) == 0 && bt == BSON_BOOL) {
+                    cops.fastcompressed = bson_iterator_bool(&sit);
                 } else if (strcmp("large", key) == 0 && bt == BSON_BOOL) {
                     cops.large = bson_iterator_bool(&sit);
                 } else if (strcmp("cachedrecords", key) == 0 && BSON_IS_NUM_TYPE(bt)) {
                     cops.cachedrecords = bson_iterator_int(&sit);
                 } else if (strcmp("records", key) == 0 && BSON_IS_NUM_TYPE(bt)) {
                     cops.records = bson_iterator_long(&sit);
+                } else if (strcmp("writebehind", key) == 0 && BSON_IS_NUM_TYPE(bt)) {
+                    cops.writebehind = bson_iterator_long(&sit);
+                } else if (strcmp("bgdefrag", key) == 0 && BSON_IS_NUM_TYPE(bt)) {
+                    cops.bgdefrag = bson_iterator_int(&sit);
                 }
             }
         }
@@ -1374,40 +2146,12 @@ static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags,
             }
             goto finish;
         }
+        //New collection: load data first, then build indexes by bulk load
+        deferidx = (coll->tdb->inum == 0);
     }
 
-    //Register collection indexes
-    BSON_ITERATOR_INIT(&mbsonit, mbson);
-    while ((bt = bson_iterator_next(&mbsonit)) != BSON_EOO) {
-        const char *key = BSON_ITERATOR_KEY(&mbsonit);
-        if (bt != BSON_OBJECT || strlen(key) < 2 || key[0] != 'i') {
-            continue;
-        }
-        char *ipath = NULL;
-        int iflags = 0;
-        bson_iterator sit;
-
-        BSON_ITERATOR_SUBITERATOR(&mbsonit, &sit);
-        bt = bson_find_fieldpath_value("ipath", &sit);
-        if (bt == BSON_STRING) {
-            ipath = strdup(bson_iterator_string(&sit));
-        }
-
-        BSON_ITERATOR_SUBITERATOR(&mbsonit, &sit);
-        bt = bson_find_fieldpath_value("iflags", &sit);
-        if (bt == BSON_INT || bt == BSON_LONG) {
-            iflags = bson_iterator_int(&sit);
-        }
-        if (ipath) {
-            if (!_setindeximpl(coll, ipath, iflags, true)) {
-                err = true;
-                if (log) {
-                    tcxstrprintf(log, "\nERROR: Error creating collection index. Collection: '%s' Field: '%s'", cname, ipath);
-                }
-                TCFREE(ipath);
-            }
-            TCFREE(ipath);
-        }
+    if (!deferidx && !_importcollidx(coll, mbson, cname, log)) {
+        err = true;
     }
 
     int fd = open(bspath, O_RDONLY, TCFILEMODE);
@@ -1423,52 +2167,42 @@ static bool _importcoll(EJDB *jb, const char *bspath, TCLIST *cnames, int flags,
         err = true;
         goto finish;
     }
-    int32_t maxdocsiz = 0, docsiz = 0, numdocs = 0;
-    char *docbuf;
-    TCMALLOC(docbuf, 4);
+    int32_t numdocs = 0;
+    _IMPORTRBUF rb = {.fd = fd, .size = JBIMPORTBUFSZ};
+    TCMALLOC(rb.buf, rb.size);
+    TCMAP *rowm = deferidx ? tcmapnew2(TCMAPTINYBNUM) : NULL;
+    char bstack[JBSBUFFERSZ];
     while (true) {
-        sp = read(fd, docbuf, 4);
-        if (sp < 4) {
-            break;
-        }
-        memcpy(&docsiz, docbuf, 4);
-        docsiz = TCHTOIL(docsiz);
-        if (docsiz > EJDB_MAX_IMPORTED_BSON_SIZE) {
-            err = true;
-            if (log) {
-                tcxstrprintf(log, "\nERROR: BSON document size: %d exceeds the maximum allowed size limit: %d for import operation",
-                             docsiz, EJDB_MAX_IMPORTED_BSON_SIZE);
-            }
-            _ejdbsetecode2(jb, JBETOOBIGBSON, __FILE__, __LINE__, __func__, true);
-            break;
-        }
-        if (docsiz < 5) {
-            break;
-        }
-        if (maxdocsiz < docsiz) {
-            maxdocsiz = docsiz;
-            TCREALLOC(docbuf, docbuf, maxdocsiz);
-        }
-        sp = read(fd, docbuf + 4, docsiz - 4);
-        if (sp < docsiz - 4) {
-            break;
-        }
         bson_oid_t oid;
         bson savebs;
-        bson_init_with_data(&savebs, docbuf);
-        if (docbuf[docsiz - 1] != '\0' || savebs.err || !savebs.finished) {
-            err = true;
-            _ejdbsetecode(jb, JBEINVALIDBSON, __FILE__, __LINE__, __func__);
+        int rc = json ? _importnextjson(jb, &rb, &savebs, bstack, log) : _importnextbson(jb, &rb, &savebs, log);
+        if (rc < 1) {
+            err = (rc < 0);
             break;
         }
-        if (!_ejdbsavebsonimpl(coll, &savebs, &oid, false)) {
+        if (deferidx && _bsonoidkey(&savebs, &oid) == BSON_OID) {
+            tcmapput(rowm, JDBCOLBSON, JDBCOLBSONL, bson_data(&savebs), bson_size(&savebs));
+            if (!tctdbputasync(coll->tdb, &oid, sizeof (oid), rowm)) {
+                err = true;
+            }
+        } else if (!_ejdbsavebsonimpl(coll, &savebs, &oid, false)) {
             err = true;
+        }
+        if (json) {
+            bson_destroy(&savebs);
+        }
+        if (err) {
             break;
         }
         ++numdocs;
     }
-    if (docbuf) {
-        TCFREE(docbuf);
+    TCFREE(rb.buf);
+    close(fd);
+    if (rowm) {
+        tcmapdel(rowm);
+    }
+    if (deferidx && !_importcollidx(coll, mbson, cname, log)) {
+        err = true;
     }
     if (!tctdbsync(coll->tdb)) {
         err = true;
@@ -1492,14 +2226,47 @@ finish:
     return !err;
 }
 
+/* Thread routine of a single collection export job. */
+static void* _exportjobthread(void *opq) {
+    _EXPORTJOB *job = opq;
+    job->rv = _exportcoll(job->coll, job->dpath, job->flags, job->log);
+    if (!job->rv) { //error codes are thread local
+        job->ecode = ejdbecode(job->coll->jb);
+    }
+    return NULL;
+}
+
+/* Write the content of export buffer into the file and clear the buffer. */
+static bool _exportflush(HANDLE fd, TCXSTR *wbuf, bool gzip) {
+    bool rv = true;
+    if (TCXSTRSIZE(wbuf) < 1) {
+        return rv;
+    }
+    if (gzip) { //every flushed chunk is a gzip member
+        int zsiz;
+        char *zbuf = tcgzipencode(TCXSTRPTR(wbuf), TCXSTRSIZE(wbuf), &zsiz);
+        rv = (zbuf && tcwrite(fd, zbuf, zsiz));
+        if (zbuf) {
+            TCFREE(zbuf);
+        }
+    } else {
+        rv = tcwrite(fd, TCXSTRPTR(wbuf), TCXSTRSIZE(wbuf));
+    }
+    tcxstrclear(wbuf);
+    return rv;
+}
+
 static bool _exportcoll(EJCOLL *coll, const char *dpath, int flags, TCXSTR *log) {
     bool err = false;
-    char *fpath = tcsprintf("%s%c%s%s", dpath, MYPATHCHR, coll->cname, (flags & JBJSONEXPORT) ? ".json" : ".bson");
+    bool gzip = (flags & JBEXPORTGZIP);
+    char *fpath = tcsprintf("%s%c%s%s%s", dpath, MYPATHCHR, coll->cname,
+                            (flags & JBJSONEXPORT) ? ".json" : ".bson", gzip ? ".gz" : "");
     char *fpathm = tcsprintf("%s%c%s%s", dpath, MYPATHCHR, coll->cname, "-meta.json");
     TCHDB *hdb = coll->tdb->hdb;
     TCXSTR *skbuf = tcxstrnew3(sizeof (bson_oid_t) + 1);
     TCXSTR *colbuf = tcxstrnew3(1024);
     TCXSTR *bsbuf = tcxstrnew3(1024);
+    TCXSTR *wbuf = tcxstrnew3(JBEXPORTBUFSZ + 1024);
     int sz = 0;
 #ifndef _WIN32
     HANDLE fd = open(fpath, O_RDWR | O_CREAT | O_TRUNC, JBFILEMODE);
@@ -1523,32 +2290,28 @@ static bool _exportcoll(EJCOLL *coll, const char *dpath, int flags, TCXSTR *log)
         goto finish;
     }
     while (!err && tchdbiter2next(hdb, it, skbuf, colbuf)) {
-        sz = tcmaploadoneintoxstr(TCXSTRPTR(colbuf), TCXSTRSIZE(colbuf), JDBCOLBSON, JDBCOLBSONL, bsbuf);
-        if (sz > 0) {
-            char *wbuf = NULL;
-            int wsiz;
-            if (flags & JBJSONEXPORT) {
-                if (bson2json(TCXSTRPTR(bsbuf), &wbuf, &wsiz) != BSON_OK) {
-                    _ejdbsetecode2(coll->jb, JBEINVALIDBSON, __FILE__, __LINE__, __func__, true);
-                    goto wfinish;
-                }
-            } else {
-                wbuf = TCXSTRPTR(bsbuf);
-                wsiz = TCXSTRSIZE(bsbuf);
-            }
-            if (!tcwrite(fd, wbuf, wsiz)) {
-                _ejdbsetecode2(coll->jb, JBEEI, __FILE__, __LINE__, __func__, true);
-                goto wfinish;
-            }
-wfinish:
-            if (wbuf && wbuf != TCXSTRPTR(bsbuf)) {
-                TCFREE(wbuf);
+        if (flags & JBJSONEXPORT) {
+            sz = tcmaploadoneintoxstr(TCXSTRPTR(colbuf), TCXSTRSIZE(colbuf), JDBCOLBSON, JDBCOLBSONL, bsbuf);
+            if (sz > 0 && bson2jsonxstr(TCXSTRPTR(bsbuf), wbuf) != BSON_OK) {
+                _ejdbsetecode2(coll->jb, JBEINVALIDBSON, __FILE__, __LINE__, __func__, true);
+                err = true;
             }
+        } else { //BSON is appended to the write buffer as is
+            tcmaploadoneintoxstr(TCXSTRPTR(colbuf), TCXSTRSIZE(colbuf), JDBCOLBSON, JDBCOLBSONL, wbuf);
+        }
+        if (!err && TCXSTRSIZE(wbuf) >= JBEXPORTBUFSZ && !_exportflush(fd, wbuf, gzip)) {
+            _ejdbsetecode2(coll->jb, JBEEI, __FILE__, __LINE__, __func__, true);
+            err = true;
         }
         tcxstrclear(skbuf);
         tcxstrclear(colbuf);
         tcxstrclear(bsbuf);
     }
+    tchdbiter2dispose(hdb, it);
+    if (!err && !_exportflush(fd, wbuf, gzip)) {
+        _ejdbsetecode2(coll->jb, JBEEI, __FILE__, __LINE__, __func__, true);
+        err = true;
+    }
 
     if (!err) { //export collection meta
         TCMAP *cmeta = tctdbget(coll->jb->metadb, coll->cname, coll->cnamesz);
@@ -1600,8 +2363,12 @@ finish:
     tcxstrdel(skbuf);
     tcxstrdel(colbuf);
     tcxstrdel(bsbuf);
+    tcxstrdel(wbuf);
     TCFREE(fpath);
     TCFREE(fpathm);
+    if (err && log) {
+        tcxstrprintf(log, "\nERROR: Exporting collection: '%s' failed with error: '%s'", coll->cname, (ejdbecode(coll->jb) != 0) ? ejdberrmsg(ejdbecode(coll->jb)) : "Unknown");
+    }
     return !err;
 }
 
@@ -1867,13 +2634,13 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
                     _ejdbsetecode(qf->jb, cbufstrlen, __FILE__, __LINE__, __func__);
                     rv = false;
                 } else {
-                    rv = tcstrfwm(cbuf, expr);
+                    rv = (exprsz <= cbufstrlen) && !memcmp(cbuf, expr, exprsz);
                 }
                 if (cbuf && cbuf != sbuf) {
                     TCFREE(cbuf);
                 }
             } else {
-                rv = tcstrfwm(fval, expr);
+                rv = (exprsz <= fvalsz - 1) && !memcmp(fval, expr, exprsz);
             }
             break;
         }
@@ -1885,13 +2652,13 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
                     _ejdbsetecode(qf->jb, cbufstrlen, __FILE__, __LINE__, __func__);
                     rv = false;
                 } else {
-                    rv = tcstrbwm(cbuf, expr);
+                    rv = (exprsz <= cbufstrlen) && !memcmp(cbuf + cbufstrlen - exprsz, expr, exprsz);
                 }
                 if (cbuf && cbuf != sbuf) {
                     TCFREE(cbuf);
                 }
             } else {
-                rv = tcstrbwm(fval, expr);
+                rv = (exprsz <= fvalsz - 1) && !memcmp(fval + fvalsz - 1 - exprsz, expr, exprsz);
             }
             break;
         }
@@ -1954,7 +2721,7 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
                         for (int i = 0; i < TCLISTNUM(tokens); ++i) {
                             const char *token = TCLISTVALPTR(tokens, i);
                             int tokensz = TCLISTVALSIZ(tokens, i);
-                            if (tokensz == cbufstrlen && !strncmp(token, cbuf, tokensz)) {
+                            if (tokensz == cbufstrlen && !memcmp(token, cbuf, tokensz)) {
                                 rv = true;
                                 break;
                             }
@@ -1974,7 +2741,7 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
                     for (int i = 0; i < TCLISTNUM(tokens); ++i) {
                         const char *token = TCLISTVALPTR(tokens, i);
                         int tokensz = TCLISTVALSIZ(tokens, i);
-                        if (tokensz == (fvalsz - 1) && !strncmp(token, fval, tokensz)) {
+                        if (tokensz == (fvalsz - 1) && !memcmp(token, fval, tokensz)) {
                             rv = true;
                             break;
                         }
@@ -1996,7 +2763,7 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
                     for (int i = 0; i < TCLISTNUM(tokens); ++i) {
                         const char *token = TCLISTVALPTR(tokens, i);
                         int tokensz = TCLISTVALSIZ(tokens, i);
-                        if (tokensz <= cbufstrlen && !strncmp(token, cbuf, tokensz)) {
+                        if (tokensz <= cbufstrlen && !memcmp(token, cbuf, tokensz)) {
                             rv = true;
                             break;
                         }
@@ -2009,7 +2776,7 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
                 for (int i = 0; i < TCLISTNUM(tokens); ++i) {
                     const char *token = TCLISTVALPTR(tokens, i);
                     int tokensz = TCLISTVALSIZ(tokens, i);
-                    if (tokensz <= (fvalsz - 1) && !strncmp(token, fval, tokensz)) {
+                    if (tokensz <= (fvalsz - 1) && !memcmp(token, fval, tokensz)) {
                         rv = true;
                         break;
                     }
@@ -2093,7 +2860,21 @@ static bool _qrybsvalmatch(const EJQF *qf, bson_iterator *it, bool expandarrays,
         case TDBQCNUMOREQ: {
             TCLIST *tokens = qf->exprlist;
             assert(tokens);
-            if (bt == BSON_DOUBLE) {
+            if (qf->exprmap) { //tokens are integral numbers
+                int64_t nval;
+                if (bt == BSON_DOUBLE) {
+                    double dval = bson_iterator_double_raw(it);
+                    if (dval != floor(dval) || dval <= (double) INT64_MIN || dval >= (double) INT64_MAX) {
+                        break;
+                    }
+                    nval = (int64_t) dval;
+                } else if (bt == BSON_INT || bt == BSON_LONG || bt == BSON_BOOL || bt == BSON_DATE) {
+                    nval = bson_iterator_long(it);
+                } else {
+                    break;
+                }
+                rv = (tcmapget(qf->exprmap, &nval, sizeof (nval), &sp) != NULL);
+            } else if (bt == BSON_DOUBLE) {
                 double nval = bson_iterator_double_raw(it);
                 for (int i = 0; i < TCLISTNUM(tokens); ++i) {
                     if (tcatof(TCLISTVALPTR(tokens, i)) == nval) {
@@ -2239,6 +3020,145 @@ static bool _qrybsmatch(EJQF *qf, const void *bsbuf, int bsbufsz) {
     return _qrybsrecurrmatch(qf, &ffpctx, 0);
 }
 
+/* Returns true if `qf` can be evaluated by `_qryscanfilter()` */
+static bool _qryscanvec(const EJQF *qf) {
+    if ((qf->flags & EJFEXCLUDED) || qf->elmatchgrp > 0 || (qf->uslots && TCLISTNUM(qf->uslots) > 0)) {
+        return false;
+    }
+    switch (qf->tcop) {
+        case TDBQCNUMEQ:
+        case TDBQCNUMGT:
+        case TDBQCNUMGE:
+        case TDBQCNUMLT:
+        case TDBQCNUMLE:
+            return true;
+        case TDBQCNUMBT:
+            return (qf->exprlist && TCLISTNUM(qf->exprlist) == 2);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Evaluates numeric condition `qf` over the whole batch of records and clears rejected records
+ * in the selection vector. Field values are extracted into the contiguous columns first
+ * so comparison loops are branch free and vectorized by the compiler.
+ * Records having arrays or non numeric values of the field are marked to be matched by `_qrybsmatch()`.
+ */
+static void _qryscanfilter(const EJQF *qf, _SCANBATCH *sb) {
+    int n = TCLISTNUM(sb->bsons);
+    for (int i = 0; i < n; ++i) {
+        sb->ival[i] = 0;
+        sb->dval[i] = 0;
+        sb->kind[i] = JBVKNONE;
+        if (sb->sel[i] == 0) {
+            continue;
+        }
+        bson_iterator it;
+        BSON_ITERATOR_FROM_BUFFER(&it, TCLISTVALPTR(sb->bsons, i));
+        FFPCTX ffpctx = {
+            .fpath = qf->fpath,
+            .fplen = qf->fpathsz,
+            .input = &it,
+            .stopnestedarr = true,
+            .stopos = 0,
+            .dpos = -1,
+            .mpos = -1
+        };
+        switch (bson_find_fieldpath_value3(&ffpctx)) {
+            case BSON_EOO:
+            case BSON_UNDEFINED:
+            case BSON_NULL:
+                break;
+            case BSON_INT:
+            case BSON_LONG:
+            case BSON_BOOL:
+            case BSON_DATE:
+                sb->ival[i] = bson_iterator_long(&it);
+                sb->kind[i] = JBVKINT;
+                break;
+            case BSON_DOUBLE:
+                sb->dval[i] = bson_iterator_double_raw(&it);
+                sb->kind[i] = JBVKDBL;
+                break;
+            default:
+                sb->kind[i] = JBVKRECHECK;
+                break;
+        }
+    }
+    const uint8_t neg = qf->negate ? 1 : 0;
+    const int64_t lv = qf->exprlongval;
+    const double dv = qf->exprdblval;
+
+#define _FILTER(_icmp, _dcmp) \
+    for (int i = 0; i < n; ++i) { \
+        const int64_t iv = sb->ival[i]; \
+        const double fv = sb->dval[i]; \
+        const uint8_t k = sb->kind[i]; \
+        uint8_t m = ((k == JBVKINT) & (_icmp)) | ((k == JBVKDBL) & (_dcmp)); \
+        m = (k == JBVKNONE) ? neg : (m ^ neg); \
+        sb->sel[i] = (k == JBVKRECHECK) ? (sb->sel[i] ? 2 : 0) : (m ? sb->sel[i] : 0); \
+    }
+
+    switch (qf->tcop) {
+        case TDBQCNUMEQ:
+            _FILTER(iv == lv, fv == dv);
+            break;
+        case TDBQCNUMGT:
+            _FILTER(iv > lv, fv > dv);
+            break;
+        case TDBQCNUMGE:
+            _FILTER(iv >= lv, fv >= dv);
+            break;
+        case TDBQCNUMLT:
+            _FILTER(iv < lv, fv < dv);
+            break;
+        case TDBQCNUMLE:
+            _FILTER(iv <= lv, fv <= dv);
+            break;
+        case TDBQCNUMBT: {
+            int64_t il = tcatoi(tclistval2(qf->exprlist, 0));
+            int64_t ih = tcatoi(tclistval2(qf->exprlist, 1));
+            double dl = tcatof(tclistval2(qf->exprlist, 0));
+            double dh = tcatof(tclistval2(qf->exprlist, 1));
+            if (il > ih) {
+                int64_t t = il;
+                il = ih;
+                ih = t;
+            }
+            if (dl > dh) {
+                double t = dl;
+                dl = dh;
+                dh = t;
+            }
+            _FILTER((iv >= il) & (iv <= ih), (fv >= dl) & (fv <= dh));
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+#undef _FILTER
+}
+
+/**
+ * Returns true if all main query conditions are matched by record.
+ * Conditions flagged in optional `vqfs` are skipped since they are already applied by `_qryscanfilter()`.
+ */
+static bool _qryscanmatch(EJQF **qfs, int qfsz, const bool *vqfs, const void *bsbuf, int bsbufsz) {
+    for (int i = 0; i < qfsz; ++i) qfs[i]->mflags = qfs[i]->flags;
+    for (int i = 0; i < qfsz; ++i) {
+        EJQF *qf = qfs[i];
+        if ((qf->mflags & EJFEXCLUDED) || (vqfs && vqfs[i])) {
+            continue;
+        }
+        if (!_qrybsmatch(qf, bsbuf, bsbufsz)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool _qry_and_or_match(EJCOLL *coll, EJQ *ejq, const void *pkbuf, int pkbufsz) {
     bool isor = (ejq->orqlist && TCLISTNUM(ejq->orqlist) > 0);
     bool isand = (ejq->andqlist && TCLISTNUM(ejq->andqlist) > 0);
@@ -2477,6 +3397,10 @@ static void _qryfieldup(const EJQF *src, EJQF *target, uint32_t qflags) {
         //We cannot do deep copy of regex_t so do shallow copy only for internal query objects
         target->regex = src->regex;
     }
+    if (src->rxprefix) {
+        TCMEMDUP(target->rxprefix, src->rxprefix, src->rxprefixsz);
+        target->rxprefixsz = src->rxprefixsz;
+    }
     if (src->exprlist) {
         target->exprlist = tclistdup(src->exprlist);
     }
@@ -2612,6 +3536,20 @@ static bson_visitor_cmd_t _bsondovisitor(const char *ipath, int ipathlen, const
 						break;
 					}
 					if (lbt == BSON_ARRAY) {
+						if (coll->tdb->hdb->aio) { //read joined records at once
+							TCLIST *poids = tclistnew();
+							BSON_ITERATOR_SUBITERATOR(it, &sit);
+							while ((bt = bson_iterator_next(&sit)) != BSON_EOO) {
+								if (bt == BSON_OID) {
+									TCLISTPUSH(poids, bson_iterator_oid(&sit), sizeof (bson_oid_t));
+								} else if (bt == BSON_STRING && ejdbisvalidoidstr(bson_iterator_string(&sit))) {
+									bson_oid_from_string(&loid, bson_iterator_string(&sit));
+									TCLISTPUSH(poids, &loid, sizeof (loid));
+								}
+							}
+							_qryprefetch(coll, poids);
+							tclistdel(poids);
+						}
 						BSON_ITERATOR_SUBITERATOR(it, &sit);
 						bson_append_start_array(ictx->sbson, BSON_ITERATOR_KEY(it));
 						while ((bt = bson_iterator_next(&sit)) != BSON_EOO) {
@@ -2695,15 +3633,250 @@ static bson_visitor_cmd_t _bsondovisitor(const char *ipath, int ipathlen, const
 			}
             break;
         }
-        default:
-            bson_append_field_from_iterator(it, ictx->sbson);
+        default:
+            bson_append_field_from_iterator(it, ictx->sbson);
+
+    }
+    return rv;
+}
+
+/**
+ * Collect distinct values of `fpath` walking its lexical index in key order.
+ * Applicable if every collection record has a string value indexed, so every
+ * record is checked: the index also holds numbers, booleans and dates as strings.
+ * Otherwise `false` is returned and partially filled `rres` must be discarded.
+ */
+static bool _qrydistinctidx(EJCOLL *coll, const char *fpath, bson *rres, uint32_t *count, TCXSTR *log) {
+    TCTDB *tdb = coll->tdb;
+    TDBIDX *idx = NULL;
+    for (int i = 0; i < tdb->inum; ++i) {
+        if (tdb->idxs[i].type == TDBITLEXICAL && *tdb->idxs[i].name == 's' && !strcmp(fpath, tdb->idxs[i].name + 1)) {
+            idx = tdb->idxs + i;
+            break;
+        }
+    }
+    //Missing values, arrays and partial indexes leave records out of the index
+    if (!idx || tcbdbrnum(idx->db) != tchdbrnum(tdb->hdb)) {
+        return false;
+    }
+    if (log) {
+        tcxstrprintf(log, "DISTINCT MODE: INDEX WALK '%s'\n", idx->name);
+    }
+    bool rv = true;
+    int fpathsz = strlen(fpath);
+    uint32_t vnum = 0;
+    char ibuf[TCNUMBUFSIZ];
+    TCXSTR *colbuf = tcxstrnew3(1024);
+    TCXSTR *bsbuf = tcxstrnew3(1024);
+    TCXSTR *vbuf = tcxstrnew();
+    BDBCUR *cur = tcbdbcurnew(idx->db);
+    const char *kbuf;
+    int kbufsz;
+    tcbdbcurfirst(cur);
+    while ((kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+        int pksz;
+        const char *pkbuf = tcbdbcurval3(cur, &pksz);
+        kbufsz -= 3; //trim `\0` and two bytes of hash
+        tcxstrclear(colbuf);
+        tcxstrclear(bsbuf);
+        if (kbufsz < 0 || !pkbuf ||
+                tchdbgetintoxstr(tdb->hdb, pkbuf, pksz, colbuf) <= 0 ||
+                tcmaploadoneintoxstr(TCXSTRPTR(colbuf), TCXSTRSIZE(colbuf), JDBCOLBSON, JDBCOLBSONL, bsbuf) <= 0) {
+            rv = false;
+            break;
+        }
+        bson_iterator it;
+        BSON_ITERATOR_FROM_BUFFER(&it, TCXSTRPTR(bsbuf));
+        if (bson_find_fieldpath_value2(fpath, fpathsz, &it) != BSON_STRING ||
+                bson_iterator_string_len(&it) != kbufsz + 1 ||
+                memcmp(bson_iterator_string(&it), kbuf, kbufsz)) { //key of the stringified non string value
+            rv = false;
+            break;
+        }
+        if (vnum == 0 || kbufsz != TCXSTRSIZE(vbuf) || memcmp(kbuf, TCXSTRPTR(vbuf), kbufsz)) {
+            bson_numstrn(ibuf, TCNUMBUFSIZ, vnum++);
+            bson_append_string_n(rres, ibuf, kbuf, kbufsz);
+            tcxstrclear(vbuf);
+            TCXSTRCAT(vbuf, kbuf, kbufsz);
+        }
+        tcbdbcurnext(cur);
+    }
+    tcbdbcurdel(cur);
+    tcxstrdel(vbuf);
+    tcxstrdel(bsbuf);
+    tcxstrdel(colbuf);
+    if (rv) {
+        *count = vnum;
+    }
+    return rv;
+}
+
+/* Register the value of `_DISTINCTCTX.fpath` of matched record. */
+static void _qrydistinctvisit(EJCOLL *coll, const void *bsbuf, int bsbufsz, void *op) {
+    _DISTINCTCTX *dctx = op;
+    TCXSTR *kbuf = dctx->kbuf;
+    bson_iterator it;
+    BSON_ITERATOR_FROM_BUFFER(&it, bsbuf);
+    bson_type bt = bson_find_fieldpath_value2(dctx->fpath, dctx->fpathsz, &it);
+    if (bt == BSON_EOO) {
+        return;
+    }
+    char bstack[JBSBUFFERSZ];
+    bson vbs;
+    bson_init_on_stack(&vbs, bstack, bsbufsz, JBSBUFFERSZ);
+    bson_append_field_from_iterator2("v", &it, &vbs);
+    bson_finish(&vbs);
+    _qryvalkey(&vbs, kbuf);
+    tcmapputkeep(dctx->vmap, TCXSTRPTR(kbuf), TCXSTRSIZE(kbuf), bson_data(&vbs), bson_size(&vbs));
+    bson_destroy(&vbs);
+}
+
+/**
+ * Store into `kbuf` the hash key of the value `v` of BSON `{"v" : value}`.
+ * Numbers equal by value share the same key as in `bson_compare_it_current()`.
+ */
+static void _qryvalkey(const bson *vbs, TCXSTR *kbuf) {
+    bson_iterator it;
+    bson_type bt = bson_find_from_buffer(&it, bson_data(vbs), "v");
+    double dv = (bt == BSON_DOUBLE) ? bson_iterator_double_raw(&it) : 0.5;
+    tcxstrclear(kbuf);
+    if (bt == BSON_INT || bt == BSON_LONG || bt == BSON_DATE || bt == BSON_TIMESTAMP ||
+            (dv >= INT64_MIN && dv <= INT64_MAX && dv == (int64_t) dv)) {
+        int64_t v = (bt == BSON_INT) ? bson_iterator_int_raw(&it) :
+                    (bt == BSON_DOUBLE) ? (int64_t) dv : bson_iterator_long_raw(&it);
+        TCXSTRCAT(kbuf, "n", 1);
+        TCXSTRCAT(kbuf, &v, sizeof (v));
+    } else if (BSON_IS_STRING_TYPE(bt)) {
+        TCXSTRCAT(kbuf, "s", 1);
+        TCXSTRCAT(kbuf, bson_iterator_string(&it), bson_iterator_string_len(&it));
+    } else {
+        TCXSTRCAT(kbuf, "v", 1);
+        TCXSTRCAT(kbuf, bson_data(vbs), bson_size(vbs));
+    }
+}
+
+/* Append the value of group `_id` or accumulator operand `spec` evaluated over the record. */
+static void _qryaggoperand(const bson_iterator *spec, const void *bsbuf, const char *key, bson *out) {
+    bson_iterator sit, fit;
+    bson_type bt = BSON_ITERATOR_TYPE(spec);
+    if (bt == BSON_STRING && *bson_iterator_string(spec) == '$') { //field reference
+        BSON_ITERATOR_FROM_BUFFER(&fit, bsbuf);
+        if (bson_find_fieldpath_value(bson_iterator_string(spec) + 1, &fit) != BSON_EOO) {
+            bson_append_field_from_iterator2(key, &fit, out);
+        } else {
+            bson_append_null(out, key);
+        }
+    } else if (bt == BSON_OBJECT) { //compound group key
+        bson_append_start_object(out, key);
+        BSON_ITERATOR_SUBITERATOR(spec, &sit);
+        while (bson_iterator_next(&sit) != BSON_EOO) {
+            _qryaggoperand(&sit, bsbuf, BSON_ITERATOR_KEY(&sit), out);
+        }
+        bson_append_finish_object(out);
+    } else if (bt == BSON_EOO || bt == BSON_UNDEFINED) {
+        bson_append_null(out, key);
+    } else { //constant
+        bson_append_field_from_iterator2(key, spec, out);
+    }
+}
 
+/* Update accumulators of the record group. */
+static void _qryaggvisit(EJCOLL *coll, const void *bsbuf, int bsbufsz, void *op) {
+    _AGGCTX *actx = op;
+    char bstack[JBSBUFFERSZ];
+    bson vbs;
+    bson_init_on_stack(&vbs, bstack, bsbufsz, JBSBUFFERSZ);
+    if (actx->idspec.cur) {
+        _qryaggoperand(&actx->idspec, bsbuf, "v", &vbs);
+    } else { //missing `_id` is the same as `_id: null`
+        bson_append_null(&vbs, "v");
+    }
+    bson_finish(&vbs);
+    _qryvalkey(&vbs, actx->kbuf);
+    int gsz = sizeof (_AGGGRP) + actx->snum * sizeof (_AGGACC);
+    int sp;
+    _AGGGRP *grp = (_AGGGRP *) tcmapget(actx->gmap, TCXSTRPTR(actx->kbuf), TCXSTRSIZE(actx->kbuf), &sp);
+    if (!grp) { //new group
+        char gstack[gsz];
+        memset(gstack, 0, gsz);
+        TCMEMDUP(((_AGGGRP *) gstack)->idbs, bson_data(&vbs), bson_size(&vbs));
+        tcmapput(actx->gmap, TCXSTRPTR(actx->kbuf), TCXSTRSIZE(actx->kbuf), gstack, gsz);
+        grp = (_AGGGRP *) tcmapget(actx->gmap, TCXSTRPTR(actx->kbuf), TCXSTRSIZE(actx->kbuf), &sp);
+        assert(grp && sp == gsz);
+    }
+    bson_destroy(&vbs);
+    for (int i = 0; i < actx->snum; ++i) {
+        _AGGSPEC *spec = actx->specs + i;
+        _AGGACC *acc = grp->acc + i;
+        if (spec->op == JBAGGCOUNT) {
+            acc->num++;
+            continue;
+        }
+        bson_init_on_stack(&vbs, bstack, bsbufsz, JBSBUFFERSZ);
+        _qryaggoperand(&spec->operand, bsbuf, "v", &vbs);
+        bson_finish(&vbs);
+        bson_iterator it;
+        bson_type bt = bson_find_from_buffer(&it, bson_data(&vbs), "v");
+        if (spec->op == JBAGGSUM || spec->op == JBAGGAVG) {
+            if (bt == BSON_DOUBLE || (acc->real && BSON_IS_NUM_TYPE(bt))) {
+                if (!acc->real) {
+                    acc->sum.dnum = acc->sum.inum;
+                    acc->real = true;
+                }
+                acc->sum.dnum += bson_iterator_double(&it);
+                acc->num++;
+            } else if (bt == BSON_INT || bt == BSON_LONG) {
+                int64_t v = bson_iterator_long(&it);
+                if ((v > 0 && acc->sum.inum > INT64_MAX - v) || (v < 0 && acc->sum.inum < INT64_MIN - v)) {
+                    acc->sum.dnum = (double) acc->sum.inum + v; //integer overflow
+                    acc->real = true;
+                } else {
+                    acc->sum.inum += v;
+                }
+                acc->num++;
+            }
+        } else if (bt != BSON_EOO && bt != BSON_NULL) { //$min, $max
+            bool set = (acc->mval == NULL);
+            if (!set) {
+                bson_iterator mit;
+                bson_find_from_buffer(&mit, acc->mval, "v");
+                int cv = bson_compare_it_current(&it, &mit);
+                set = (spec->op == JBAGGMIN) ? (cv < 0) : (cv > 0);
+            }
+            if (set) {
+                if (acc->mval) {
+                    TCFREE(acc->mval);
+                }
+                TCMEMDUP(acc->mval, bson_data(&vbs), bson_size(&vbs));
+            }
+            acc->num++;
+        }
+        bson_destroy(&vbs);
     }
-    return rv;
+}
+
+/* Ascending order of aggregated groups by `_id` */
+static int _qryaggcmp(const void *a, const void *b) {
+    bson_iterator it1, it2;
+    bson_find_from_buffer(&it1, (*(const _AGGGRP **) a)->idbs, "v");
+    bson_find_from_buffer(&it2, (*(const _AGGGRP **) b)->idbs, "v");
+    return bson_compare_it_current(&it1, &it2);
+}
+
+/* Ascending order of `{"v" : value}` BSONs collected by `_qrydistinctvisit()` */
+static int _qrydistinctcmp(const void *a, const void *b) {
+    bson_iterator it1, it2;
+    bson_find_from_buffer(&it1, *(const char **) a, "v");
+    bson_find_from_buffer(&it2, *(const char **) b, "v");
+    return bson_compare_it_current(&it1, &it2);
 }
 
 static bool _pushprocessedbson(_QRYCTX *ctx, const void *bsbuf, int bsbufsz) {
     assert(bsbuf && bsbufsz);
+    if (ctx->rvisit) { //Records are streamed into the visitor
+        ctx->rvisit(ctx->coll, bsbuf, bsbufsz, ctx->rvop);
+        return true;
+    }
     if (!ctx->dfields && !ctx->ifields && !ctx->q->ifields) { //Trivial case: no $do operations or $fields
         tclistpush(ctx->res, bsbuf, bsbufsz);
         return true;
@@ -2888,6 +4061,167 @@ static bson* _qfgetupdateobj(const EJQF *qf) {
     return ret;
 }
 
+/* Returns true if field paths `p1` and `p2` are equal or one of them is nested into another */
+static bool _fpathoverlap(const char *p1, int p1sz, const char *p2, int p2sz) {
+    int sz = MIN(p1sz, p2sz);
+    if (memcmp(p1, p2, sz)) {
+        return false;
+    }
+    return (p1sz == p2sz || (p1sz > sz ? p1[sz] : p2[sz]) == '.');
+}
+
+/**
+ * Check whether `$set`/`$inc` fields of update query can be patched in place
+ * within stored records. Fields must not be covered by any index or partial index filter
+ * and the collection must not be compressed.
+ */
+static bool _qryupdinplaceallowed(EJCOLL *coll, const EJQF *setqf, const EJQF *incqf) {
+    if (coll->tdb->opts & (TDBTDEFLATE | TDBTBZIP | TDBTTCBS | TDBTEXCODEC)) {
+        return false;
+    }
+    const EJQF *uqfs[2] = {setqf, incqf};
+    for (int i = 0; i < 2; ++i) {
+        if (uqfs[i] && uqfs[i]->ufields && TCLISTNUM(uqfs[i]->ufields) > 0) { //positional `$` fields
+            return false;
+        }
+    }
+    TCMAP *cmeta = tctdbget(coll->jb->metadb, coll->cname, coll->cnamesz);
+    if (!cmeta) {
+        return false;
+    }
+    bool rv = true;
+    bson_iterator it;
+    const char *mkey;
+    int mkeysz, bsz;
+    tcmapiterinit(cmeta);
+    while (rv && (mkey = tcmapiternext(cmeta, &mkeysz)) != NULL) {
+        if (mkeysz < 2 || *mkey != 'i') {
+            continue;
+        }
+        const void *mraw = tcmapget(cmeta, mkey, mkeysz, &bsz);
+        if (!mraw || !bsz) {
+            continue;
+        }
+        if (bson_find_from_buffer(&it, mraw, "ifilter") == BSON_OBJECT) {
+            rv = false;
+            break;
+        }
+        for (int i = 0; rv && i < 2; ++i) {
+            if (!uqfs[i]) continue;
+            BSON_ITERATOR_INIT(&it, uqfs[i]->updateobj);
+            while (bson_iterator_next(&it) != BSON_EOO) {
+                const char *fpath = BSON_ITERATOR_KEY(&it);
+                if (_fpathoverlap(mkey + 1, mkeysz - 1, fpath, strlen(fpath))) {
+                    rv = false;
+                    break;
+                }
+            }
+        }
+    }
+    tcmapdel(cmeta);
+    return rv;
+}
+
+/**
+ * Apply `$set` and `$inc` operations by patching the stored record bytes in place.
+ * Every `$set` field must exist in the record and keep its fixed size type.
+ * @return `-1` if the record cannot be updated in place, otherwise the update status.
+ */
+static int _qryupdateinplace(_QRYCTX *ctx, const EJQF *setqf, const EJQF *incqf,
+                             const void *bsbuf, int bsbufsz) {
+    EJCOLL *coll = ctx->coll;
+    bson_iterator it, it2;
+    bson_type bt, bt2;
+    if (bson_find_from_buffer(&it, bsbuf, JDBIDKEYNAME) != BSON_OID) {
+        return -1;
+    }
+    bson_oid_t *oid = bson_iterator_oid(&it);
+    int rv = 1;
+    int lo = bsbufsz, hi = 0; //modified region
+    char *nbuf;
+    TCMEMDUP(nbuf, bsbuf, bsbufsz);
+    if (setqf) { //$set
+        BSON_ITERATOR_INIT(&it, setqf->updateobj);
+        while (rv > 0 && (bt = bson_iterator_next(&it)) != BSON_EOO) {
+            int vsz;
+            switch (bt) {
+                case BSON_BOOL:
+                    vsz = 1;
+                    break;
+                case BSON_INT:
+                    vsz = 4;
+                    break;
+                case BSON_DOUBLE:
+                case BSON_LONG:
+                case BSON_DATE:
+                case BSON_TIMESTAMP:
+                    vsz = 8;
+                    break;
+                case BSON_OID:
+                    vsz = 12;
+                    break;
+                default:
+                    vsz = 0;
+                    break;
+            }
+            const char *fpath = BSON_ITERATOR_KEY(&it);
+            if (vsz < 1 || !strcmp(fpath, JDBIDKEYNAME)) {
+                rv = -1;
+                break;
+            }
+            BSON_ITERATOR_FROM_BUFFER(&it2, nbuf);
+            bt2 = bson_find_fieldpath_value(fpath, &it2);
+            if (bt2 != bt) {
+                rv = -1;
+                break;
+            }
+            char *vp = (char*) bson_iterator_value(&it2);
+            memcpy(vp, bson_iterator_value(&it), vsz);
+            lo = MIN(lo, vp - nbuf);
+            hi = MAX(hi, vp - nbuf + vsz);
+        }
+    }
+    if (incqf && rv > 0) { //$inc
+        BSON_ITERATOR_INIT(&it, incqf->updateobj);
+        while ((bt = bson_iterator_next(&it)) != BSON_EOO) {
+            if (!BSON_IS_NUM_TYPE(bt)) {
+                continue;
+            }
+            BSON_ITERATOR_FROM_BUFFER(&it2, nbuf);
+            bt2 = bson_find_fieldpath_value(BSON_ITERATOR_KEY(&it), &it2);
+            if (!BSON_IS_NUM_TYPE(bt2)) {
+                continue;
+            }
+            int err;
+            if (bt2 == BSON_DOUBLE) {
+                double v = bson_iterator_double(&it2);
+                v += (bt == BSON_DOUBLE) ? bson_iterator_double(&it) : bson_iterator_long(&it);
+                err = bson_inplace_set_double(&it2, v);
+            } else {
+                err = bson_inplace_set_long(&it2, bson_iterator_long(&it2) + bson_iterator_long(&it));
+            }
+            if (err) {
+                rv = 0;
+                _ejdbsetecode(coll->jb, JBEQUPDFAILED, __FILE__, __LINE__, __func__);
+                break;
+            }
+            const char *vp = bson_iterator_value(&it2);
+            lo = MIN(lo, vp - nbuf);
+            hi = MAX(hi, vp - nbuf + ((bt2 == BSON_INT) ? 4 : 8));
+        }
+    }
+    if (rv > 0 && lo < hi) {
+        if (ctx->log) {
+            char xoid[25];
+            bson_oid_to_string(oid, xoid);
+            tcxstrprintf(ctx->log, "$UPDATE IN PLACE: %s\n", xoid);
+        }
+        rv = tctdbputcolpart(coll->tdb, oid, sizeof (*oid), JDBCOLBSON, JDBCOLBSONL, lo, nbuf + lo, hi - lo);
+    }
+    TCFREE(nbuf);
+    return rv;
+}
+
 static bool _qryupdate(_QRYCTX *ctx, void *bsbuf, int bsbufsz) {
     assert(ctx && ctx->q && (ctx->q->flags & EJQUPDATING) && bsbuf && ctx->didxctx);
 
@@ -2977,6 +4311,19 @@ static bool _qryupdate(_QRYCTX *ctx, void *bsbuf, int bsbufsz) {
         }
     }
 
+    if ((setqf || incqf) && !unsetqf && !renameqf &&
+            !addsetqf[0] && !addsetqf[1] && !pullqf[0] && !pullqf[1]) {
+        if (ctx->uinplace < 0) {
+            ctx->uinplace = _qryupdinplaceallowed(coll, setqf, incqf);
+        }
+        if (ctx->uinplace > 0) {
+            int irv = _qryupdateinplace(ctx, setqf, incqf, bsbuf, bsbufsz);
+            if (irv >= 0) {
+                return irv;
+            }
+        }
+    }
+
     if (setqf) { //$set
         bson *updobj = _qfgetupdateobj(setqf);
         update = true;
@@ -3217,8 +4564,120 @@ finish:
     return rv;
 }
 
+/**
+ * Choose execution strategy of `$in` main query field `mqf` served by index `midx`.
+ *
+ * Separate probes of `tnum` tokens cost about `tnum * log2(inum)` tree descents
+ * for index of `inum` entries, where a forward scan over sorted tokens
+ * never takes more than `inum` sequential steps. Both fetch up to `min(tnum, inum)`
+ * records in random order, so if it is comparable with the number of records
+ * a single full scan matching tokens by hash map is cheaper.
+ */
+static int _qryinmode(EJCOLL *coll, EJQF *mqf, const TDBIDX *midx) {
+    int64_t tnum = TCLISTNUM(mqf->exprlist);
+    int64_t rnum = coll->tdb->hdb->rnum;
+    int64_t inum = (midx->type == TDBITHASH) ? tchdbrnum(midx->db) : tcbdbrnum(midx->db);
+    if (mqf->orderseq != 1 && tnum >= JBINOPTMAPTHRESHOLD &&
+            tclmin(tnum, inum) * JBINRANDFETCHCOST >= rnum) {
+        _qryinmapinit(mqf);
+        if (mqf->exprmap) { //fractional number tokens cannot be hashed
+            return JBINHASHSCAN;
+        }
+    }
+    if (midx->type != TDBITHASH && !(mqf->order < 0 && (mqf->flags & EJFORDERUSED)) &&
+            tnum * (tclog2l(inum) + 1) >= inum) {
+        return JBINSKIPSCAN;
+    }
+    return JBINPROBE;
+}
+
+/**
+ * Init index cursor over B+ tree `db`.
+ * If `back` is true the cursor moves to previous entries.
+ */
+static void _idxcurinit(_IDXCUR *c, TCBDB *db, bool back) {
+    c->cur = tcbdbcurnew(db);
+    c->keys = tclistnew2(JBIDXCURBATCHMIN);
+    c->vals = tclistnew2(JBIDXCURBATCHMIN);
+    c->pos = 0;
+    c->bsz = JBIDXCURBATCHMIN;
+    c->back = back;
+}
+
+static void _idxcurdestroy(_IDXCUR *c) {
+    tcbdbcurdel(c->cur);
+    tclistdel(c->keys);
+    tclistdel(c->vals);
+}
+
+/**
+ * Drop the current batch after the cursor repositioning.
+ * Batch size starts over since jumps are usually followed by short scans.
+ */
+static void _idxcurreset(_IDXCUR *c) {
+    tclistclear(c->keys);
+    tclistclear(c->vals);
+    c->pos = 0;
+    c->bsz = JBIDXCURBATCHMIN;
+}
+
+static void _idxcurfirst(_IDXCUR *c) {
+    _idxcurreset(c);
+    tcbdbcurfirst(c->cur);
+}
+
+static void _idxcurlast(_IDXCUR *c) {
+    _idxcurreset(c);
+    tcbdbcurlast(c->cur);
+}
+
+static void _idxcurjump(_IDXCUR *c, const char *kbuf, int ksiz) {
+    _idxcurreset(c);
+    tcbdbcurjump(c->cur, kbuf, ksiz);
+}
+
+static void _idxcurjumpnum(_IDXCUR *c, const char *expr, int esiz, bool first) {
+    _idxcurreset(c);
+    tctdbqryidxcurjumpnum(c->cur, expr, esiz, first);
+}
+
+/**
+ * Returns the key of the current index entry or NULL if there are no more entries.
+ * Exhausted batch is refilled by `tcbdbcurrecs()` under single index lock.
+ */
+static const char* _idxcurkey(_IDXCUR *c, int *sp) {
+    if (c->pos >= TCLISTNUM(c->keys)) {
+        tclistclear(c->keys);
+        tclistclear(c->vals);
+        c->pos = 0;
+        if (tcbdbcurrecs(c->cur, c->keys, c->vals, c->bsz, c->back) < 1) {
+            *sp = 0;
+            return NULL;
+        }
+        if (c->bsz < JBIDXCURBATCHSZ) c->bsz <<= 1;
+    }
+    return tclistval(c->keys, c->pos, sp);
+}
+
+/* Returns the value (primary key) of the current index entry. */
+static const char* _idxcurval(_IDXCUR *c, int *sp) {
+    assert(c->pos < TCLISTNUM(c->vals));
+    return tclistval(c->vals, c->pos, sp);
+}
+
+/* Move index cursor to the next entry in its direction. */
+static void _idxcurnext(_IDXCUR *c) {
+    c->pos++;
+}
+
 /** Query */
-static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int qflags, TCXSTR *log) {
+/**
+ * Execute query `_q` over collection.
+ * If `rvisit` is set matched records are passed into it instead of being collected
+ * into the returned result set. Such queries must not use `$orderby`, `$fields` or `$do`.
+ */
+static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int qflags, TCXSTR *log,
+                           _QRYVISITOR rvisit, void *rvop) {
     assert(coll && coll->tdb && coll->tdb->hdb);
     *outcount = 0;
 
@@ -3233,6 +4692,10 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
     ctx.q = q;
     ctx.qflags = qflags;
     ctx.coll = coll;
+    ctx.fsorted = -1;
+    ctx.uinplace = -1;
+    ctx.rvisit = rvisit;
+    ctx.rvop = rvop;
     if (!_qrypreprocess(&ctx)) {
         _qryctxclear(&ctx);
         return NULL;
@@ -3249,6 +4712,8 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
     const int qfsz = TCLISTNUM(q->qflist); //number of all condition fields
     EJQF **ofs = NULL; //order fields
     EJQF **qfs = NULL; //condition fields array
+    TCLIST *fbatch = NULL; //batch of index matched primary keys fetched by file offset
+    int *fperm = NULL; //fetching order of `fbatch` records
     if (qfsz > 0) {
         TCMALLOC(qfs, qfsz * sizeof (EJQF*));
     }
@@ -3269,6 +4734,13 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
             mqf->flags |= EJFORDERUSED;
         }
     }
+    int inmode = 0; //`$in` execution strategy
+    if (midx && (mqf->tcop == TDBQCSTROREQ || mqf->tcop == TDBQCNUMOREQ)) {
+        inmode = _qryinmode(coll, mqf, midx);
+        if (inmode == JBINHASHSCAN) {
+            midx = NULL;
+        }
+    }
     for (int i = 0; i < qfsz; ++i) {
         EJQF *qf = TCLISTVALPTR(q->qflist, i);
         assert(qf);
@@ -3335,6 +4807,10 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
         tcxstrprintf(log, "SKIP: %u\n", skip);
         tcxstrprintf(log, "COUNT ONLY: %s\n", (q->flags & EJQONLYCOUNT) ? "YES" : "NO");
         tcxstrprintf(log, "MAIN IDX: '%s'\n", midx ? midx->name : "NONE");
+        if (inmode) {
+            tcxstrprintf(log, "$IN MODE: %s\n",
+                         (inmode == JBINHASHSCAN) ? "HASH SCAN" : (inmode == JBINSKIPSCAN) ? "SKIP SCAN" : "PROBE");
+        }
         tcxstrprintf(log, "ORDER FIELDS: %d\n", ofsz);
         tcxstrprintf(log, "ACTIVE CONDITIONS: %d\n", anum);
         tcxstrprintf(log, "ROOT $OR QUERIES: %d\n", ((q->orqlist) ? TCLISTNUM(q->orqlist) : 0));
@@ -3364,11 +4840,50 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
     }
     //EOF #define JBQREGREC
 
+#define JBQIDXFLUSH() \
+    if (fbatch && TCLISTNUM(fbatch) > 0) { \
+        _qryfetchorder(coll, fbatch, (mqf->flags & EJFORDERUSED), fperm); \
+        for (int _fi = 0; (all || count < max) && _fi < TCLISTNUM(fbatch); ++_fi) { \
+            const char *_pkbuf; \
+            int _pkbufsz; \
+            TCLISTVAL(_pkbuf, fbatch, fperm[_fi], _pkbufsz); \
+            if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, _pkbuf, _pkbufsz) && _qry_and_or_match(coll, q, _pkbuf, _pkbufsz)) { \
+                JBQREGREC(_pkbuf, _pkbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf)); \
+            } \
+        } \
+        tclistclear(fbatch); \
+    }
+    //EOF #define JBQIDXFLUSH
+
+#define JBQIDXREC(_pkbuf, _pkbufsz) \
+    if (fbatch) { \
+        TCLISTPUSH(fbatch, (_pkbuf), (_pkbufsz)); \
+        if (TCLISTNUM(fbatch) >= JBQFETCHBATCHSZ) { \
+            JBQIDXFLUSH(); \
+        } \
+    } else if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, (_pkbuf), (_pkbufsz)) && _qry_and_or_match(coll, q, (_pkbuf), (_pkbufsz))) { \
+        JBQREGREC((_pkbuf), (_pkbufsz), TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf)); \
+    }
+    //EOF #define JBQIDXREC
+
     bool trim = (midx && *midx->name != '\0');
-    if (anum > 0 && !(mqf->flags & EJFEXCLUDED) && !(mqf->uslots && TCLISTNUM(mqf->uslots) > 0)) {
+    if (anum > 0 && !(mqf->flags & EJFEXCLUDED) && !(mqf->uslots && TCLISTNUM(mqf->uslots) > 0) &&
+            mqf->tcop != TDBQCSTRRX && //regexp is matched on every record fetched by its prefix
+            !(midx && midx->type == TDBITHASH)) { //hash keys do not preserve value types
         anum--;
         mqf->flags |= EJFEXCLUDED;
     }
+    //Decided after the main index condition is excluded: pure index counts read no records
+    if (midx && ctx.fsorted != 0 && !(mqf->flags & EJFPKMATCHING) &&
+            !((q->flags & EJQONLYCOUNT) && !(q->flags & EJQUPDATING) && anum < 1) &&
+            (ctx.fsorted > 0 || ((all || max >= JBQFETCHBATCHSZ) && hdb->fsiz > hdb->xmsiz))) {
+        //Records are not in memory mapped area so avoid random reads in index order
+        fbatch = tclistnew2(JBQFETCHBATCHSZ);
+        TCMALLOC(fperm, JBQFETCHBATCHSZ * sizeof (*fperm));
+        if (log) {
+            tcxstrprintf(log, "FETCH BY FILE OFFSET: YES\n");
+        }
+    }
 
     if (mqf->flags & EJFPKMATCHING) { //PK matching
         if (log) {
@@ -3414,11 +4929,22 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
                 }
             }
             int tnum = TCLISTNUM(tokens);
+            TCLIST *poids = hdb->aio ? tclistnew2(MIN(tnum, JBQFETCHBATCHSZ)) : NULL;
             for (int i = 0; (all || count < max) && i < tnum; i++) {
                 bool matched = true;
                 bson_oid_t oid;
                 const char *token;
                 int tsiz;
+                if (poids && i % JBQFETCHBATCHSZ == 0) { //read the next batch of records at once
+                    tclistclear(poids);
+                    for (int j = i; j < tnum && j < i + JBQFETCHBATCHSZ; ++j) {
+                        TCLISTVAL(token, tokens, j, tsiz);
+                        if (tsiz < 1) continue;
+                        bson_oid_from_string(&oid, token);
+                        TCLISTPUSH(poids, &oid, sizeof (oid));
+                    }
+                    _qryprefetch(coll, poids);
+                }
                 TCLISTVAL(token, tokens, i, tsiz);
                 if (tsiz < 1) {
                     continue;
@@ -3447,71 +4973,127 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
                     JBQREGREC(&oid, sizeof (oid), TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
                 }
             }
+            if (poids) {
+                tclistdel(poids);
+            }
         } else {
             assert(0);
         }
+    } else if (midx->type == TDBITHASH) { /* value is equal to the key or one of the keys of hash index */
+        char nbuff[TCNUMBUFSIZ];
+        TCMAP *hkeys = tcmapnew2(TCMAPTINYBNUM);
+        if (mqf->tcop == TDBQCSTREQ) {
+            tcmapputkeep(hkeys, mqf->expr, mqf->exprsz, &yes, sizeof (yes));
+        } else if (mqf->tcop == TDBQCNUMEQ) {
+            int nsz = (mqf->ftype == BSON_DOUBLE) ?
+                      _hashidxnumkey(mqf->exprdblval, nbuff) : _hashidxnumkey(mqf->exprlongval, nbuff);
+            tcmapputkeep(hkeys, nbuff, nsz, &yes, sizeof (yes));
+        } else {
+            assert(mqf->tcop == TDBQCSTROREQ || mqf->tcop == TDBQCNUMOREQ);
+            assert(mqf->exprlist);
+            TCLIST *tokens = mqf->exprlist;
+            for (int i = 0; i < TCLISTNUM(tokens); ++i) {
+                const char *token;
+                int tsiz;
+                TCLISTVAL(token, tokens, i, tsiz);
+                if (tsiz < 1) continue;
+                if (mqf->tcop == TDBQCNUMOREQ) {
+                    tsiz = _hashidxnumkey(tcatof2(token), nbuff);
+                    token = nbuff;
+                }
+                tcmapputkeep(hkeys, token, tsiz, &yes, sizeof (yes));
+            }
+        }
+        tcmapiterinit(hkeys);
+        while ((all || count < max) && (kbuf = tcmapiternext(hkeys, &kbufsz)) != NULL) {
+            TCLIST *pks = tctdbidxgetbyhash(coll->tdb, midx, kbuf, kbufsz);
+            for (int i = 0; (all || count < max) && i < TCLISTNUM(pks); ++i) {
+                TCLISTVAL(vbuf, pks, i, vbufsz);
+                JBQIDXREC(vbuf, vbufsz);
+            }
+            tclistdel(pks);
+        }
+        JBQIDXFLUSH();
+        tcmapdel(hkeys);
     } else if (mqf->tcop == TDBQTRUE) {
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, (mqf->order < 0));
         if (mqf->order >= 0) {
-            tcbdbcurfirst(cur);
+            _idxcurfirst(&icur);
         } else {
-            tcbdbcurlast(cur);
+            _idxcurlast(&icur);
         }
-        while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+        while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
             if (trim) kbufsz -= 3;
-            vbuf = tcbdbcurval3(cur, &vbufsz);
-            if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-            }
-            if (mqf->order >= 0) {
-                tcbdbcurnext(cur);
-            } else {
-                tcbdbcurprev(cur);
-            }
+            vbuf = _idxcurval(&icur, &vbufsz);
+            JBQIDXREC(vbuf, vbufsz);
+            _idxcurnext(&icur);
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCSTREQ) { /* string is equal to */
         assert(midx->type == TDBITLEXICAL);
         char *expr = mqf->expr;
         int exprsz = mqf->exprsz;
-        BDBCUR *cur = tcbdbcurnew(midx->db);
-        tcbdbcurjump(cur, expr, exprsz + trim);
-        while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
+        _idxcurjump(&icur, expr, exprsz + trim);
+        while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
             if (trim) kbufsz -= 3;
             if (kbufsz == exprsz && !memcmp(kbuf, expr, exprsz)) {
-                vbuf = tcbdbcurval3(cur, &vbufsz);
-                if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                    JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                }
+                vbuf = _idxcurval(&icur, &vbufsz);
+                JBQIDXREC(vbuf, vbufsz);
             } else {
                 break;
             }
-            tcbdbcurnext(cur);
+            _idxcurnext(&icur);
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCSTRBW) { /* string begins with */
         assert(midx->type == TDBITLEXICAL);
         char *expr = mqf->expr;
         int exprsz = mqf->exprsz;
-        BDBCUR *cur = tcbdbcurnew(midx->db);
-        tcbdbcurjump(cur, expr, exprsz + trim);
-        while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
+        _idxcurjump(&icur, expr, exprsz + trim);
+        while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
             if (trim) kbufsz -= 3;
             if (kbufsz >= exprsz && !memcmp(kbuf, expr, exprsz)) {
-                vbuf = tcbdbcurval3(cur, &vbufsz);
-                if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                    JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                }
+                vbuf = _idxcurval(&icur, &vbufsz);
+                JBQIDXREC(vbuf, vbufsz);
+            } else {
+                break;
+            }
+            _idxcurnext(&icur);
+        }
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
+    } else if (mqf->tcop == TDBQCSTRRX) { /* string matches regexp with literal prefix */
+        assert(midx->type == TDBITLEXICAL);
+        assert(mqf->rxprefix);
+        char *expr = mqf->rxprefix;
+        int exprsz = mqf->rxprefixsz;
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
+        _idxcurjump(&icur, expr, exprsz + trim);
+        while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
+            if (trim) kbufsz -= 3;
+            if (kbufsz >= exprsz && !memcmp(kbuf, expr, exprsz)) {
+                vbuf = _idxcurval(&icur, &vbufsz);
+                JBQIDXREC(vbuf, vbufsz);
             } else {
                 break;
             }
-            tcbdbcurnext(cur);
+            _idxcurnext(&icur);
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCSTRORBW) { /* string begins with one token in */
         assert(mqf->ftype == BSON_ARRAY);
         assert(midx->type == TDBITLEXICAL);
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
         TCLIST *tokens = mqf->exprlist;
         assert(tokens);
         tclistsort(tokens);
@@ -3530,25 +5112,25 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
             int tsiz;
             TCLISTVAL(token, tokens, i, tsiz);
             if (tsiz < 1) continue;
-            tcbdbcurjump(cur, token, tsiz + trim);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            _idxcurjump(&icur, token, tsiz + trim);
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 if (trim) kbufsz -= 3;
                 if (kbufsz >= tsiz && !memcmp(kbuf, token, tsiz)) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 } else {
                     break;
                 }
-                tcbdbcurnext(cur);
+                _idxcurnext(&icur);
             }
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCSTROREQ) { /* string is equal to at least one token in */
         assert(mqf->ftype == BSON_ARRAY);
         assert(midx->type == TDBITLEXICAL);
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
         TCLIST *tokens = mqf->exprlist;
         assert(tokens);
         tclistsort(tokens);
@@ -3562,124 +5144,137 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
             tclistinvert(tokens);
         }
         int tnum = TCLISTNUM(tokens);
+        int isteps = (inmode == JBINSKIPSCAN) ? tclog2l(tcbdbrnum(midx->db)) + 1 : 0;
+        bool ijump = true;
         for (int i = 0; (all || count < max) && i < tnum; i++) {
             const char *token;
             int tsiz;
             TCLISTVAL(token, tokens, i, tsiz);
             if (tsiz < 1) continue;
-            tcbdbcurjump(cur, token, tsiz + trim);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            for (int j = 0; !ijump; ++j) { //step forward to the token while it is cheaper than jump
+                if ((kbuf = _idxcurkey(&icur, &kbufsz)) == NULL) {
+                    break;
+                }
+                if (tccmplexical(kbuf, (trim ? kbufsz - 3 : kbufsz), token, tsiz, NULL) >= 0) {
+                    break;
+                }
+                if (j >= isteps) {
+                    ijump = true;
+                } else {
+                    _idxcurnext(&icur);
+                }
+            }
+            if (ijump) {
+                _idxcurjump(&icur, token, tsiz + trim);
+                ijump = (isteps < 1);
+            }
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 if (trim) kbufsz -= 3;
                 if (kbufsz == tsiz && !memcmp(kbuf, token, tsiz)) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 } else {
                     break;
                 }
-                tcbdbcurnext(cur);
+                _idxcurnext(&icur);
             }
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCNUMEQ) { /* number is equal to */
         assert(midx->type == TDBITDECIMAL);
         char *expr = mqf->expr;
         int exprsz = mqf->exprsz;
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
         _EJDBNUM num;
         _nufetch(&num, expr, mqf->ftype);
-        tctdbqryidxcurjumpnum(cur, expr, exprsz, true);
-        while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+        _idxcurjumpnum(&icur, expr, exprsz, true);
+        while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
             if (_nucmp(&num, kbuf, mqf->ftype) == 0) {
-                vbuf = tcbdbcurval3(cur, &vbufsz);
-                if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                    JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                }
+                vbuf = _idxcurval(&icur, &vbufsz);
+                JBQIDXREC(vbuf, vbufsz);
             } else {
                 break;
             }
-            tcbdbcurnext(cur);
+            _idxcurnext(&icur);
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCNUMGT || mqf->tcop == TDBQCNUMGE) {
         /* number is greater than | number is greater than or equal to */
         assert(midx->type == TDBITDECIMAL);
         char *expr = mqf->expr;
         int exprsz = mqf->exprsz;
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
         _EJDBNUM xnum;
         _nufetch(&xnum, expr, mqf->ftype);
+        _idxcurinit(&icur, midx->db, (mqf->order < 0 && (mqf->flags & EJFORDERUSED)));
         if (mqf->order < 0 && (mqf->flags & EJFORDERUSED)) { //DESC
-            tcbdbcurlast(cur);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            _idxcurlast(&icur);
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 _EJDBNUM knum;
                 _nufetch(&knum, kbuf, mqf->ftype);
                 int cmp = _nucmp2(&knum, &xnum, mqf->ftype);
                 if (cmp < 0) break;
                 if (cmp > 0 || (mqf->tcop == TDBQCNUMGE && cmp >= 0)) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 }
-                tcbdbcurprev(cur);
+                _idxcurnext(&icur);
             }
         } else { //ASC
-            tctdbqryidxcurjumpnum(cur, expr, exprsz, true);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            _idxcurjumpnum(&icur, expr, exprsz, true);
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 _EJDBNUM knum;
                 _nufetch(&knum, kbuf, mqf->ftype);
                 int cmp = _nucmp2(&knum, &xnum, mqf->ftype);
                 if (cmp > 0 || (mqf->tcop == TDBQCNUMGE && cmp >= 0)) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 }
-                tcbdbcurnext(cur);
+                _idxcurnext(&icur);
             }
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCNUMLT || mqf->tcop == TDBQCNUMLE) {
         /* number is less than | number is less than or equal to */
         assert(midx->type == TDBITDECIMAL);
         char *expr = mqf->expr;
         int exprsz = mqf->exprsz;
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
         _EJDBNUM xnum;
         _nufetch(&xnum, expr, mqf->ftype);
+        _idxcurinit(&icur, midx->db, (mqf->order < 0));
         if (mqf->order >= 0) { //ASC
-            tcbdbcurfirst(cur);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            _idxcurfirst(&icur);
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 _EJDBNUM knum;
                 _nufetch(&knum, kbuf, mqf->ftype);
                 int cmp = _nucmp2(&knum, &xnum, mqf->ftype);
                 if (cmp > 0) break;
                 if (cmp < 0 || (cmp <= 0 && mqf->tcop == TDBQCNUMLE)) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 }
-                tcbdbcurnext(cur);
+                _idxcurnext(&icur);
             }
         } else {
-            tctdbqryidxcurjumpnum(cur, expr, exprsz, false);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            _idxcurjumpnum(&icur, expr, exprsz, false);
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 _EJDBNUM knum;
                 _nufetch(&knum, kbuf, mqf->ftype);
                 int cmp = _nucmp2(&knum, &xnum, mqf->ftype);
                 if (cmp < 0 || (cmp <= 0 && mqf->tcop == TDBQCNUMLE)) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 }
-                tcbdbcurprev(cur);
+                _idxcurnext(&icur);
             }
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCNUMBT) { /* number is between two tokens of */
         assert(mqf->ftype == BSON_ARRAY);
         assert(midx->type == TDBITDECIMAL);
@@ -3697,24 +5292,25 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
             lower = upper;
             upper = swap;
         }
-        BDBCUR *cur = tcbdbcurnew(midx->db);
-        tctdbqryidxcurjumpnum(cur, expr, exprsz, true);
-        while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
+        _idxcurjumpnum(&icur, expr, exprsz, true);
+        while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
             if (tcatof2(kbuf) > upper) break;
-            vbuf = tcbdbcurval3(cur, &vbufsz);
-            if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-            }
-            tcbdbcurnext(cur);
+            vbuf = _idxcurval(&icur, &vbufsz);
+            JBQIDXREC(vbuf, vbufsz);
+            _idxcurnext(&icur);
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
         if (!all && !(q->flags & EJQONLYCOUNT) && mqf->order < 0 && (mqf->flags & EJFORDERUSED)) { //DESC
             tclistinvert(res);
         }
     } else if (mqf->tcop == TDBQCNUMOREQ) { /* number is equal to at least one token in */
         assert(mqf->ftype == BSON_ARRAY);
         assert(midx->type == TDBITDECIMAL);
-        BDBCUR *cur = tcbdbcurnew(midx->db);
+        _IDXCUR icur;
+        _idxcurinit(&icur, midx->db, false);
         TCLIST *tokens = mqf->exprlist;
         assert(tokens);
         tclistsortex(tokens, tdbcmppkeynumasc);
@@ -3728,26 +5324,43 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
             tclistinvert(tokens);
         }
         int tnum = TCLISTNUM(tokens);
+        int isteps = (inmode == JBINSKIPSCAN) ? tclog2l(tcbdbrnum(midx->db)) + 1 : 0;
+        bool ijump = true;
         for (int i = 0; (all || count < max) && i < tnum; i++) {
             const char *token;
             int tsiz;
             TCLISTVAL(token, tokens, i, tsiz);
             if (tsiz < 1) continue;
             long double xnum = tcatof2(token);
-            tctdbqryidxcurjumpnum(cur, token, tsiz, true);
-            while ((all || count < max) && (kbuf = tcbdbcurkey3(cur, &kbufsz)) != NULL) {
+            for (int j = 0; !ijump; ++j) { //step forward to the token while it is cheaper than jump
+                if ((kbuf = _idxcurkey(&icur, &kbufsz)) == NULL) {
+                    break;
+                }
+                if (tcatof2(kbuf) >= xnum) {
+                    break;
+                }
+                if (j >= isteps) {
+                    ijump = true;
+                } else {
+                    _idxcurnext(&icur);
+                }
+            }
+            if (ijump) {
+                _idxcurjumpnum(&icur, token, tsiz, true);
+                ijump = (isteps < 1);
+            }
+            while ((all || count < max) && (kbuf = _idxcurkey(&icur, &kbufsz)) != NULL) {
                 if (tcatof2(kbuf) == xnum) {
-                    vbuf = tcbdbcurval3(cur, &vbufsz);
-                    if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, vbuf, vbufsz) && _qry_and_or_match(coll, q, vbuf, vbufsz)) {
-                        JBQREGREC(vbuf, vbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-                    }
+                    vbuf = _idxcurval(&icur, &vbufsz);
+                    JBQIDXREC(vbuf, vbufsz);
                 } else {
                     break;
                 }
-                tcbdbcurnext(cur);
+                _idxcurnext(&icur);
             }
         }
-        tcbdbcurdel(cur);
+        JBQIDXFLUSH();
+        _idxcurdestroy(&icur);
     } else if (mqf->tcop == TDBQCSTRAND || mqf->tcop == TDBQCSTROR || mqf->tcop == TDBQCSTRNUMOR) {
         /* string includes all tokens in | string includes at least one token in */
         assert(midx->type == TDBITTOKEN);
@@ -3774,10 +5387,9 @@ static TCLIST* _qryexecute(EJCOLL *coll, const EJQ *_q, uint32_t *outcount, int
         TCMAP *tres = tctdbidxgetbytokens(coll->tdb, midx, tokens, mqf->tcop, log);
         tcmapiterinit(tres);
         while ((all || count < max) && (kbuf = tcmapiternext(tres, &kbufsz)) != NULL) {
-            if (_qryallcondsmatch(q, anum, coll, qfs, qfsz, kbuf, kbufsz) && _qry_and_or_match(coll, q, kbuf, kbufsz)) {
-                JBQREGREC(kbuf, kbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
-            }
+            JBQIDXREC(kbuf, kbufsz);
         }
+        JBQIDXFLUSH();
         tcmapdel(tres);
     }
 
@@ -3817,6 +5429,58 @@ fullscan: /* Full scan */
     TCXSTR *skbuf = tcxstrnew3(sizeof (bson_oid_t) + 1);
     tcxstrclear(q->colbuf);
     tcxstrclear(q->bsbuf);
+    //Numeric conditions of non updating queries are evaluated over batches of records
+    _SCANBATCH *sbatch = NULL;
+    bool *vqfs = NULL;
+    int vnum = 0;
+    if (!updkeys) {
+        for (int i = 0; i < qfsz; ++i) {
+            if (_qryscanvec(qfs[i])) {
+                if (!vqfs) {
+                    TCCALLOC(vqfs, qfsz, sizeof (*vqfs));
+                }
+                vqfs[i] = true;
+                vnum++;
+            }
+        }
+    }
+    if (vnum > 0) {
+        TCMALLOC(sbatch, sizeof (*sbatch));
+        sbatch->pks = tclistnew2(JBQSCANBATCHSZ);
+        sbatch->bsons = tclistnew2(JBQSCANBATCHSZ);
+        if (log) {
+            tcxstrprintf(log, "BATCHED NUMERIC CONDITIONS: %d\n", vnum);
+        }
+    }
+
+#define JBQSCANFLUSH() \
+    if (sbatch && TCLISTNUM(sbatch->bsons) > 0) { \
+        memset(sbatch->sel, 1, TCLISTNUM(sbatch->bsons)); \
+        for (int _i = 0; _i < qfsz; ++_i) { \
+            if (vqfs[_i]) { \
+                _qryscanfilter(qfs[_i], sbatch); \
+            } \
+        } \
+        for (int _bi = 0; (all || count < max) && _bi < TCLISTNUM(sbatch->bsons); ++_bi) { \
+            if (sbatch->sel[_bi] == 0) { \
+                continue; \
+            } \
+            const char *_pkbuf; \
+            int _pkbufsz; \
+            TCLISTVAL(_pkbuf, sbatch->pks, _bi, _pkbufsz); \
+            tcxstrclear(q->bsbuf); \
+            TCXSTRCAT(q->bsbuf, TCLISTVALPTR(sbatch->bsons, _bi), TCLISTVALSIZ(sbatch->bsons, _bi)); \
+            if (_qryscanmatch(qfs, qfsz, (sbatch->sel[_bi] == 1) ? vqfs : NULL, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf)) && \
+                    _qry_and_or_match(coll, q, _pkbuf, _pkbufsz)) { \
+                JBQREGREC(_pkbuf, _pkbufsz, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf)); \
+            } \
+        } \
+        tclistclear(sbatch->pks); \
+        tclistclear(sbatch->bsons); \
+        tcxstrclear(q->bsbuf); \
+    }
+    //EOF #define JBQSCANFLUSH
+
     int rows = 0;
     while ((all || count < max) && tchdbiter2next(hdb, hdbiter, skbuf, q->colbuf)) {
         ++rows;
@@ -3824,19 +5488,16 @@ fullscan: /* Full scan */
         if (sz <= 0) {
             goto wfinish;
         }
-        bool matched = true;
-        for (int i = 0; i < qfsz; ++i) qfs[i]->mflags = qfs[i]->flags;
-        for (int i = 0; i < qfsz; ++i) {
-            EJQF *qf = qfs[i];
-            if (qf->mflags & EJFEXCLUDED) {
-                continue;
-            }
-            if (!_qrybsmatch(qf, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf))) {
-                matched = false;
-                break;
+        if (sbatch) {
+            TCLISTPUSH(sbatch->pks, TCXSTRPTR(skbuf), TCXSTRSIZE(skbuf));
+            TCLISTPUSH(sbatch->bsons, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
+            if (TCLISTNUM(sbatch->bsons) >= JBQSCANBATCHSZ) {
+                JBQSCANFLUSH();
             }
+            goto wfinish;
         }
-        if (matched && _qry_and_or_match(coll, q, TCXSTRPTR(skbuf), TCXSTRSIZE(skbuf))) {
+        if (_qryscanmatch(qfs, qfsz, NULL, TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf)) &&
+                _qry_and_or_match(coll, q, TCXSTRPTR(skbuf), TCXSTRSIZE(skbuf))) {
             if (updkeys) { //we are in updating mode
                 if (tcmapputkeep(updkeys, TCXSTRPTR(skbuf), TCXSTRSIZE(skbuf), &yes, sizeof (yes))) {
                     JBQREGREC(TCXSTRPTR(skbuf), TCXSTRSIZE(skbuf), TCXSTRPTR(q->bsbuf), TCXSTRSIZE(q->bsbuf));
@@ -3850,11 +5511,20 @@ wfinish:
         tcxstrclear(q->colbuf);
         tcxstrclear(q->bsbuf);
     }
+    JBQSCANFLUSH();
     tchdbiter2dispose(hdb, hdbiter);
     tcxstrdel(skbuf);
     if (updkeys) {
         tcmapdel(updkeys);
     }
+    if (sbatch) {
+        tclistdel(sbatch->pks);
+        tclistdel(sbatch->bsons);
+        TCFREE(sbatch);
+    }
+    if (vqfs) {
+        TCFREE(vqfs);
+    }
 
 sorting: /* Sorting resultset */
     if (!res || aofsz <= 0) { //No sorting needed
@@ -3933,18 +5603,7 @@ finish:
 
     //Apply deffered index changes
     if (ctx.didxctx) {
-        for (int i = TCLISTNUM(ctx.didxctx) - 1; i >= 0; --i) {
-            _DEFFEREDIDXCTX *di = TCLISTVALPTR(ctx.didxctx, i);
-            assert(di);
-            if (di->rmap) {
-                tctdbidxout2(coll->tdb, &(di->oid), sizeof (di->oid), di->rmap);
-                tcmapdel(di->rmap);
-            }
-            if (di->imap) {
-                tctdbidxput2(coll->tdb, &(di->oid), sizeof (di->oid), di->imap);
-                tcmapdel(di->imap);
-            }
-        }
+        _flushdeferredidx(coll, ctx.didxctx);
     }
     //Cleanup
     if (qfs) {
@@ -3953,12 +5612,110 @@ finish:
     if (ofs) {
         TCFREE(ofs);
     }
+    if (fbatch) {
+        tclistdel(fbatch);
+    }
+    if (fperm) {
+        TCFREE(fperm);
+    }
     ctx.res = NULL; //save res from deleting in `_qryctxclear()`
     _qryctxclear(&ctx);
+#undef JBQIDXREC
+#undef JBQIDXFLUSH
 #undef JBQREGREC
+#undef JBQSCANFLUSH
     return res;
 }
 
+static int _recoffslotcmp(const void *a, const void *b) {
+    const _RECOFFSLOT *s1 = a;
+    const _RECOFFSLOT *s2 = b;
+    return (s1->off < s2->off) ? -1 : ((s1->off > s2->off) ? 1 : (s1->pos - s2->pos));
+}
+
+/**
+ * Compute the order `perm` in which records of primary keys batch `pks` should be fetched.
+ * Records are read in the ascending order of file offsets with readahead hints issued for
+ * the regions they occupy. If `keeporder` is true only readahead hints are issued
+ * and records are fetched in the original index order. Collections reading asynchronously
+ * keep the index order and read the batch into the record cache instead.
+ */
+static void _qryfetchorder(EJCOLL *coll, const TCLIST *pks, bool keeporder, int *perm) {
+    TCHDB *hdb = coll->tdb->hdb;
+    int num = TCLISTNUM(pks);
+    for (int i = 0; i < num; ++i) {
+        perm[i] = i;
+    }
+    if (hdb->aio) { //records are read in batches into the record cache, index order is kept
+        tchdbprefetch(hdb, pks);
+        return;
+    }
+    int64_t *offs;
+    int32_t *sizs;
+    TCMALLOC(offs, num * sizeof (*offs));
+    TCMALLOC(sizs, num * sizeof (*sizs));
+    if (!tchdbrecoffs(hdb, pks, offs, sizs)) { //keep index order, records will be fetched anyway
+        goto finish;
+    }
+    _RECOFFSLOT *slots;
+    TCMALLOC(slots, num * sizeof (*slots));
+    for (int i = 0; i < num; ++i) {
+        slots[i].off = offs[i];
+        slots[i].siz = sizs[i];
+        slots[i].pos = i;
+    }
+    qsort(slots, num, sizeof (*slots), _recoffslotcmp);
+    uint64_t *roffs, *rlens; //merged regions, hinted at once to be read in one batch
+    TCMALLOC(roffs, num * sizeof (*roffs));
+    TCMALLOC(rlens, num * sizeof (*rlens));
+    int rnum = 0;
+    int64_t roff = -1, rend = -1;
+    for (int i = 0; i < num; ++i) {
+        if (!keeporder) {
+            perm[i] = slots[i].pos;
+        }
+        if (slots[i].off < 0) { //missing record
+            continue;
+        }
+        if (roff >= 0 && slots[i].off <= rend + JBQFETCHRAGAP) {
+            rend = MAX(rend, slots[i].off + slots[i].siz);
+        } else {
+            if (roff >= 0) {
+                roffs[rnum] = roff;
+                rlens[rnum++] = rend - roff;
+            }
+            roff = slots[i].off;
+            rend = roff + slots[i].siz;
+        }
+    }
+    if (roff >= 0) {
+        roffs[rnum] = roff;
+        rlens[rnum++] = rend - roff;
+    }
+    if (rnum > 0) {
+        tchdbreadahead2(hdb, roffs, rlens, rnum);
+    }
+    TCFREE(rlens);
+    TCFREE(roffs);
+    TCFREE(slots);
+finish:
+    TCFREE(offs);
+    TCFREE(sizs);
+}
+
+/**
+ * Read records of primary keys `pks` which are about to be fetched one by one
+ * in batches. Does nothing unless the collection reads asynchronously and
+ * its file exceeds the memory mapped region.
+ */
+static void _qryprefetch(EJCOLL *coll, const TCLIST *pks) {
+    TCHDB *hdb = coll->tdb->hdb;
+    if (!hdb->aio || TCLISTNUM(pks) < 2 || hdb->fsiz <= hdb->xmsiz) {
+        return;
+    }
+    tchdbprefetch(hdb, pks);
+}
+
 static void _qryctxclear(_QRYCTX *ctx) {
     if (ctx->dfields) {
         tcmapdel(ctx->dfields);
@@ -3981,6 +5738,28 @@ static void _qryctxclear(_QRYCTX *ctx) {
 static TDBIDX* _qryfindidx(EJCOLL *coll, EJQF *qf, bson *idxmeta) {
     TCTDB *tdb = coll->tdb;
     char p = '\0';
+    if (qf->fpath && !(qf->flags & EJCONDICASE) &&
+            !(qf->order && qf->orderseq == 1) && //ordered traversal needs a B+ tree index
+            (qf->tcop == TDBQCSTREQ || qf->tcop == TDBQCSTROREQ ||
+             qf->tcop == TDBQCNUMEQ || qf->tcop == TDBQCNUMOREQ)) {
+        TDBIDX *hidx = NULL;
+        for (int i = 0; i < tdb->inum; ++i) { //hash index is the cheapest for equality lookups
+            TDBIDX *idx = tdb->idxs + i;
+            if (strcmp(qf->fpath, idx->name + 1)) {
+                continue;
+            }
+            if (*idx->name == 'a') { //hash index has no keys of array values, use the token index
+                hidx = NULL;
+                break;
+            }
+            if (*idx->name == 'h') {
+                hidx = idx;
+            }
+        }
+        if (hidx) {
+            return hidx;
+        }
+    }
     switch (qf->tcop) {
         case TDBQCSTREQ:
         case TDBQCSTRBW:
@@ -3988,6 +5767,11 @@ static TDBIDX* _qryfindidx(EJCOLL *coll, EJQF *qf, bson *idxmeta) {
         case TDBQCSTRORBW:
             p = (qf->flags & EJCONDICASE) ? 'i' : 's'; //lexical string index
             break;
+        case TDBQCSTRRX:
+            if (qf->rxprefix && !(qf->flags & EJCONDICASE)) {
+                p = 's'; //lexical string index scanned by literal regexp prefix
+            }
+            break;
         case TDBQCNUMEQ:
         case TDBQCNUMGT:
         case TDBQCNUMGE:
@@ -4012,7 +5796,7 @@ static TDBIDX* _qryfindidx(EJCOLL *coll, EJQF *qf, bson *idxmeta) {
         TDBIDX *idx = tdb->idxs + i;
         assert(idx);
         if (p == 'o') {
-            if (*idx->name == 'a' || *idx->name == 'i') { //token index or icase index not the best solution here
+            if (*idx->name == 'a' || *idx->name == 'i' || *idx->name == 'h') { //token, icase or hash index not the best solution here
                 continue;
             }
         } else if (*idx->name != p) {
@@ -4040,7 +5824,7 @@ static TDBIDX* _qryfindidx(EJCOLL *coll, EJQF *qf, bson *idxmeta) {
         if (iflags & JBIDXARR) { //array token index exists so convert qf into TDBQCSTROR
             for (int i = 0; i < tdb->inum; ++i) {
                 TDBIDX *idx = tdb->idxs + i;
-                if (!strcmp(qf->fpath, idx->name + 1)) {
+                if (*idx->name == 'a' && !strcmp(qf->fpath, idx->name + 1)) {
                     if (qf->tcop == TDBQCSTREQ) {
                         qf->tcop = TDBQCSTROR;
                         qf->exprlist = tclistnew2(1);
@@ -4170,6 +5954,10 @@ static bool _qrypreprocess(_QRYCTX *ctx) {
             int64_t v = bson_iterator_long(&it);
             q->max = (uint32_t) ((v < 0) ? 0 : v);
         }
+        bt = bson_find(&it, q->hints, "$fetchsorted");
+        if (bt == BSON_BOOL) {
+            ctx->fsorted = bson_iterator_bool(&it) ? 1 : 0;
+        }
         if (!(ctx->qflags & JBQRYCOUNT)) {
             bt = bson_find(&it, q->hints, "$fields"); //Collect required fields
             if (bt == BSON_OBJECT) {
@@ -4262,7 +6050,11 @@ static bool _qrypreprocess(_QRYCTX *ctx) {
 
         bool firstorderqf = false;
         qf->idxmeta = _imetaidx(ctx->coll, qf->fpath);
-        qf->idx = _qryfindidx(ctx->coll, qf, qf->idxmeta);
+        if (qf->idxmeta && !_qryidxfilterimplied(ctx->coll, q, qf->fpath, qf->idxmeta)) {
+            qf->idx = NULL; //partial index does not cover all documents matched by query
+        } else {
+            qf->idx = _qryfindidx(ctx->coll, qf, qf->idxmeta);
+        }
         if (qf->order && qf->orderseq == 1) { //Index for first 'orderby' exists
             oqf = qf;
             firstorderqf = true;
@@ -4313,6 +6105,11 @@ static bool _qrypreprocess(_QRYCTX *ctx) {
                     iscore += scoreexact;
                 }
                 break;
+            case TDBQCSTRRX:
+                if (avgreclen > 0 && qf->rxprefixsz > avgreclen) {
+                    iscore += scoreexact;
+                }
+                break;
             case TDBQCNUMGT:
             case TDBQCNUMGE:
             case TDBQCNUMLT:
@@ -4383,9 +6180,12 @@ static bool _metasetopts(EJDB *jb, const char *colname, EJCOLLOPTS *opts) {
     bson *bsopts = bson_create();
     bson_init(bsopts);
     bson_append_bool(bsopts, "compressed", opts->compressed);
+    bson_append_bool(bsopts, "fastcompressed", opts->fastcompressed);
     bson_append_bool(bsopts, "large", opts->large);
     bson_append_int(bsopts, "cachedrecords", opts->cachedrecords);
     bson_append_int(bsopts, "records", opts->records);
+    bson_append_long(bsopts, "writebehind", opts->writebehind);
+    bson_append_int(bsopts, "bgdefrag", opts->bgdefrag);
     bson_finish(bsopts);
     rv = _metasetbson(jb, colname, strlen(colname), "opts", bsopts, false, false);
     bson_del(bsopts);
@@ -4405,6 +6205,10 @@ static bool _metagetopts(EJDB *jb, const char *colname, EJCOLLOPTS *opts) {
     if (bt == BSON_BOOL) {
         opts->compressed = bson_iterator_bool(&it);
     }
+    bt = bson_find(&it, bsopts, "fastcompressed");
+    if (bt == BSON_BOOL) {
+        opts->fastcompressed = bson_iterator_bool(&it);
+    }
     bt = bson_find(&it, bsopts, "large");
     if (bt == BSON_BOOL) {
         opts->large = bson_iterator_bool(&it);
@@ -4417,6 +6221,14 @@ static bool _metagetopts(EJDB *jb, const char *colname, EJCOLLOPTS *opts) {
     if (BSON_IS_NUM_TYPE(bt)) {
         opts->records = bson_iterator_long(&it);
     }
+    bt = bson_find(&it, bsopts, "writebehind");
+    if (BSON_IS_NUM_TYPE(bt)) {
+        opts->writebehind = bson_iterator_long(&it);
+    }
+    bt = bson_find(&it, bsopts, "bgdefrag");
+    if (BSON_IS_NUM_TYPE(bt)) {
+        opts->bgdefrag = bson_iterator_int(&it);
+    }
     bson_del(bsopts);
     return rv;
 }
@@ -4507,6 +6319,22 @@ static bson* _metagetbson2(EJCOLL *coll, const char *mkey) {
     return _metagetbson(coll->jb, coll->cname, coll->cnamesz, mkey);
 }
 
+/**Load dictionary of fast compression trained by `ejdbtraincompressdict()` or NULL */
+static TCLZDICT* _metagetlzdict(EJCOLL *coll) {
+    assert(coll);
+    TCLZDICT *dict = NULL;
+    bson *bsdict = _metagetbson2(coll, "lzdict");
+    if (!bsdict) {
+        return NULL;
+    }
+    bson_iterator it;
+    if (bson_find(&it, bsdict, "dict") == BSON_BINDATA && bson_iterator_bin_len(&it) > 0) {
+        dict = tclzdictnew(bson_iterator_bin_data(&it), bson_iterator_bin_len(&it));
+    }
+    bson_del(bsdict);
+    return dict;
+}
+
 /**Returned index meta if not NULL it must be freed by 'bson_del' */
 static bson* _imetaidx(EJCOLL *coll, const char *ipath) {
     assert(coll && ipath);
@@ -4541,6 +6369,135 @@ finish:
     return rv;
 }
 
+static void _qryfilterjb(EJQ *q, EJDB *jb) {
+    for (int i = 0; i < TCLISTNUM(q->qflist); ++i) {
+        ((EJQF*) TCLISTVALPTR(q->qflist, i))->jb = jb;
+    }
+    for (int i = 0; q->orqlist && i < TCLISTNUM(q->orqlist); ++i) {
+        _qryfilterjb(*((EJQ**) TCLISTVALPTR(q->orqlist, i)), jb);
+    }
+    for (int i = 0; q->andqlist && i < TCLISTNUM(q->andqlist); ++i) {
+        _qryfilterjb(*((EJQ**) TCLISTVALPTR(q->andqlist, i)), jb);
+    }
+}
+
+/**
+ * Get the compiled filter of partial index with meta key `ikey` and meta data `imetadata`.
+ * Filters are compiled once and cached in collection, caller must hold the collection write lock.
+ * Queries only look up the cache which is kept loaded by `_idxfiltersload()`.
+ * Returns NULL for regular indexes.
+ */
+static EJQ* _idxfilter(EJCOLL *coll, const char *ikey, int ikeysz, const void *imetadata) {
+    bson_iterator it;
+    if (bson_find_from_buffer(&it, imetadata, "ifilter") != BSON_OBJECT) {
+        return NULL;
+    }
+    int sp;
+    EJQ **fqp = coll->ifilters ? (EJQ**) tcmapget(coll->ifilters, ikey, ikeysz, &sp) : NULL;
+    if (fqp) {
+        return *fqp;
+    }
+    EJQ *fq = ejdbcreatequery2(coll->jb, bson_iterator_value(&it));
+    if (!fq) {
+        return NULL;
+    }
+    _qryfilterjb(fq, coll->jb);
+    if (!coll->ifilters) {
+        coll->ifilters = tcmapnew2(TCMAPTINYBNUM);
+    }
+    tcmapput(coll->ifilters, ikey, ikeysz, &fq, sizeof (fq));
+    return fq;
+}
+
+/* Drop cached partial index filter for index meta key `ikey`, or all filters if `ikey` is NULL */
+static void _idxfilterclear(EJCOLL *coll, const char *ikey) {
+    if (!coll->ifilters) {
+        return;
+    }
+    int sp;
+    if (ikey) {
+        EJQ **fqp = (EJQ**) tcmapget(coll->ifilters, ikey, strlen(ikey), &sp);
+        if (fqp) {
+            ejdbquerydel(*fqp);
+            tcmapout2(coll->ifilters, ikey);
+        }
+        return;
+    }
+    const char *kbuf;
+    tcmapiterinit(coll->ifilters);
+    while ((kbuf = tcmapiternext(coll->ifilters, &sp)) != NULL) {
+        ejdbquerydel(*((EJQ**) tcmapiterval(kbuf, &sp)));
+    }
+    tcmapclear(coll->ifilters);
+}
+
+/* Compile filters of all partial indexes of collection, caller must hold the collection write lock */
+static void _idxfiltersload(EJCOLL *coll) {
+    TCMAP *cmeta = tctdbget(coll->jb->metadb, coll->cname, coll->cnamesz);
+    if (!cmeta) {
+        return;
+    }
+    const char *mkey;
+    int mkeysz;
+    tcmapiterinit(cmeta);
+    while ((mkey = tcmapiternext(cmeta, &mkeysz)) != NULL && mkeysz > 0) {
+        if (*mkey != 'i' || mkeysz > BSON_MAX_FPATH_LEN + 1) {
+            continue;
+        }
+        int bsz;
+        const void *mraw = tcmapget(cmeta, mkey, mkeysz, &bsz);
+        if (mraw && bsz > 0) {
+            _idxfilter(coll, mkey, mkeysz, mraw);
+        }
+    }
+    tcmapdel(cmeta);
+}
+
+/**
+ * Returns true if all documents matched by query `q` are covered by index with meta `idxmeta`.
+ * It is the case of regular index or partial index which filter conditions are the top level
+ * conditions of query. The filter `$exists : true` condition is implied by any not negated
+ * query condition on the same field. The compiled filter of index on field `ipath` is taken
+ * from the collection cache.
+ */
+static bool _qryidxfilterimplied(EJCOLL *coll, EJQ *q, const char *ipath, bson *idxmeta) {
+    bson_iterator it;
+    if (bson_find(&it, idxmeta, "ifilter") != BSON_OBJECT) {
+        return true;
+    }
+    char ikey[BSON_MAX_FPATH_LEN + 2];
+    int ikeysz = snprintf(ikey, sizeof (ikey), "i%s", ipath);
+    int sp;
+    EJQ **fqp = coll->ifilters ? (EJQ**) tcmapget(coll->ifilters, ikey, ikeysz, &sp) : NULL;
+    if (!fqp) { //filter is not compiled, index is not used
+        return false;
+    }
+    EJQ *fq = *fqp;
+    uint32_t skipflags = (EJCONDSET | EJCONDINC | EJCONDADDSET | EJCONDPULL | EJCONDUPSERT |
+                          EJCONDOIT | EJCONDUNSET | EJCONDRENAME);
+    bool rv = !(fq->orqlist && TCLISTNUM(fq->orqlist) > 0) && !(fq->andqlist && TCLISTNUM(fq->andqlist) > 0);
+    for (int i = 0; rv && i < TCLISTNUM(fq->qflist); ++i) {
+        EJQF *fqf = TCLISTVALPTR(fq->qflist, i);
+        bool found = false;
+        for (int j = 0; !found && j < TCLISTNUM(q->qflist); ++j) {
+            EJQF *qf = TCLISTVALPTR(q->qflist, j);
+            if ((qf->flags & skipflags) || qf->tcop == TDBQTRUE || strcmp(qf->fpath, fqf->fpath)) {
+                continue;
+            }
+            if (fqf->tcop == TDBQCEXIST && !fqf->negate) {
+                found = !qf->negate && qf->tcop != TDBQCEXIST;
+            }
+            if (!found) {
+                found = (qf->tcop == fqf->tcop && qf->negate == fqf->negate &&
+                         (qf->flags & EJCONDICASE) == (fqf->flags & EJCONDICASE) &&
+                         qf->exprsz == fqf->exprsz && (qf->exprsz == 0 || !memcmp(qf->expr, fqf->expr, qf->exprsz)));
+            }
+        }
+        rv = found;
+    }
+    return rv;
+}
+
 /** Free EJQF field **/
 static void _delqfdata(const EJQ *q, const EJQF *qf) {
     assert(q && qf);
@@ -4567,6 +6524,9 @@ static void _delqfdata(const EJQ *q, const EJQF *qf) {
         regfree((regex_t *) qf->regex);
         TCFREE(qf->regex);
     }
+    if (qf->rxprefix) {
+        TCFREE(qf->rxprefix);
+    }
     if (qf->exprlist) {
         tclistdel(qf->exprlist);
     }
@@ -4694,6 +6654,55 @@ static char* _fetch_bson_str_array2(EJDB *jb, bson_iterator *it, bson_type *type
     return tokens;
 }
 
+/**
+ * Extract the literal prefix every match of the POSIX extended regular expression `rx` must start with.
+ * Only expressions anchored with '^' and having no top-level alternation are considered.
+ * Returns NULL if there is no such prefix, otherwise the allocated zero terminated prefix.
+ */
+static char* _qryrxprefix(const char *rx, int *sp) {
+    assert(rx && sp);
+    *sp = 0;
+    if (*rx != '^' || strchr(rx, '|')) {
+        return NULL;
+    }
+    TCXSTR *pbuf = tcxstrnew();
+    int csz = 0; //prefix size before the current utf8 char
+    const char *c = rx + 1;
+    while (*c != '\0') {
+        const char *lit, *next;
+        if (*c == '\\') { //escaped special char is a literal
+            if (c[1] == '\0' || !strchr(".[]()*+?{}|\\^$", c[1])) {
+                break;
+            }
+            lit = c + 1;
+            next = c + 2;
+        } else if (strchr(".[]()*+?{}|^$", *c)) {
+            break;
+        } else {
+            lit = c;
+            next = c + 1;
+        }
+        if (*next == '*' || *next == '?' || *next == '{') { //last literal is optional
+            if (*(unsigned char*) lit >= 0x80) { //drop incomplete utf8 char
+                pbuf->size = csz;
+                pbuf->ptr[csz] = '\0';
+            }
+            break;
+        }
+        if (*(unsigned char*) lit < 0x80 || *(unsigned char*) lit >= 0xC0) {
+            csz = TCXSTRSIZE(pbuf);
+        }
+        TCXSTRCAT(pbuf, lit, 1);
+        c = next;
+    }
+    if (TCXSTRSIZE(pbuf) < 1) {
+        tcxstrdel(pbuf);
+        return NULL;
+    }
+    *sp = TCXSTRSIZE(pbuf);
+    return tcxstrtomalloc(pbuf);
+}
+
 static int _parse_qobj_impl(EJDB *jb, EJQ *q, bson_iterator *it, TCLIST *qlist, TCLIST *pathStack, EJQF *pqf, int elmatchgrp) {
     assert(it && qlist && pathStack);
     int ret = 0;
@@ -4813,13 +6822,10 @@ static int _parse_qobj_impl(EJDB *jb, EJQ *q, bson_iterator *it, TCLIST *qlist,
                                 qf.tcop = TDBQCNUMOREQ;
                             } else {
                                 qf.tcop = TDBQCSTROREQ;
-                                if (TCLISTNUM(tokens) >= JBINOPTMAPTHRESHOLD) {
-                                    assert(!qf.exprmap);
-                                    qf.exprmap = tcmapnew2(TCLISTNUM(tokens));
-                                    for (int i = 0; i < TCLISTNUM(tokens); ++i) {
-                                        tcmapputkeep(qf.exprmap, TCLISTVALPTR(tokens, i), TCLISTVALSIZ(tokens, i), &yes, sizeof (yes));
-                                    }
-                                }
+                            }
+                            if (TCLISTNUM(tokens) >= JBINOPTMAPTHRESHOLD) {
+                                assert(!qf.exprmap);
+                                _qryinmapinit(&qf);
                             }
                         } else if (!strcmp("$bt", fkey)) { //between
                             qf.tcop = TDBQCNUMBT;
@@ -5077,6 +7083,9 @@ static int _parse_qobj_impl(EJDB *jb, EJQ *q, bson_iterator *it, TCLIST *qlist,
                 if (regcomp(&rxbuf, rxstr, rxopt) == 0) {
                     TCMALLOC(qf.regex, sizeof (rxbuf));
                     memcpy(qf.regex, &rxbuf, sizeof (rxbuf));
+                    if (!(rxopt & REG_ICASE)) { //literal prefix usable for lexical index scans
+                        qf.rxprefix = _qryrxprefix(rxstr, &qf.rxprefixsz);
+                    }
                 } else {
                     ret = JBEQINVALIDQRX;
                     _ejdbsetecode(jb, ret, __FILE__, __LINE__, __func__);
@@ -5287,6 +7296,37 @@ static char* _bsonitstrval(EJDB *jb, bson_iterator *it, int *vsz, TCLIST *tokens
     return ret;
 }
 
+/* Fixed decimal representation of a number used as hash index key.
+   Integral values are formatted as integers so that equal numbers of different
+   BSON types (int, long, double) are hashed into the same key. */
+static int _hashidxnumkey(long double num, char *buf) {
+    int len;
+    if (num == floorl(num) && num > (long double) INT64_MIN && num < (long double) INT64_MAX) {
+        len = bson_numstrn(buf, TCNUMBUFSIZ, (int64_t) num);
+    } else {
+        len = tcftoa(num, buf, TCNUMBUFSIZ, 6);
+    }
+    if (len >= TCNUMBUFSIZ) {
+        len = TCNUMBUFSIZ - 1;
+    }
+    return len;
+}
+
+/* Hash index key of the scalar value pointed by iterator, NULL for arrays and objects */
+static char* _bsonithashval(EJDB *jb, bson_iterator *it, int *vsz) {
+    bson_type bt = BSON_ITERATOR_TYPE(it);
+    if (bt == BSON_DOUBLE) {
+        char nbuff[TCNUMBUFSIZ];
+        *vsz = _hashidxnumkey(bson_iterator_double(it), nbuff);
+        return tcmemdup(nbuff, *vsz);
+    }
+    if (bt == BSON_ARRAY || !BSON_IS_IDXSUPPORTED_TYPE(bt)) {
+        *vsz = 0;
+        return NULL;
+    }
+    return _bsonitstrval(jb, it, vsz, NULL, 0);
+}
+
 static char* _bsonipathrowldr(
     TCLIST *tokens,
     const char *pkbuf, int pksz,
@@ -5316,9 +7356,22 @@ static char* _bsonipathrowldr(
             return res;
         }
     }
-    if (!ipath || ipathsz < 2 || *(ipath + 1) == '\0' || strchr("snai", *ipath) == NULL) {
+    if (!ipath || ipathsz < 2 || *(ipath + 1) == '\0' || strchr("snaih", *ipath) == NULL) {
         return NULL;
     }
+    _BSONIPATHROWLDR *odata = (_BSONIPATHROWLDR*) op;
+    if (odata->ifilter) { //skip documents not matched by partial index filter
+        int bsize;
+        char *bsdata = tcmaploadone(rowdata, rowdatasz, JDBCOLBSON, JDBCOLBSONL, &bsize);
+        bool matched = (bsdata && _qryormatch3(odata->coll, odata->ifilter, odata->ifilter, bsdata, bsize));
+        if (bsdata) {
+            TCFREE(bsdata);
+        }
+        if (!matched) {
+            *vsz = 0;
+            return NULL;
+        }
+    }
     //skip index type prefix char with (fpath + 1)
     res = _bsonfpathrowldr(tokens, rowdata, rowdatasz, ipath + 1, ipathsz - 1, op, vsz);
     if (*vsz == 0) { //Do not allow empty strings for index opration
@@ -5342,7 +7395,11 @@ static char* _bsonfpathrowldr(TCLIST *tokens, const char *rowdata, int rowdatasz
     }
     BSON_ITERATOR_FROM_BUFFER(&it, bsdata);
     bson_find_fieldpath_value2(fpath, fpathsz, &it);
-    ret = _bsonitstrval(odata->coll->jb, &it, vsz, tokens, (odata->icase ? JBICASE : 0));
+    if (odata->hash) {
+        ret = _bsonithashval(odata->coll->jb, &it, vsz);
+    } else {
+        ret = _bsonitstrval(odata->coll->jb, &it, vsz, tokens, (odata->icase ? JBICASE : 0));
+    }
     TCFREE(bsdata);
     return ret;
 }
@@ -5376,6 +7433,7 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
             continue;
         }
         int iflags = bson_iterator_int(&mit);
+        EJQ *fq = _idxfilter(coll, mkey, mkeysz, mraw); //partial index filter
         //OK then process index keys
         memcpy(ikey + 1, mkey + 1, mkeysz - 1);
         ikey[mkeysz] = '\0';
@@ -5384,11 +7442,18 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
         char *fvalue = NULL;
         int ofvaluesz = 0;
         char *ofvalue = NULL;
+        int hvaluesz = 0;
+        char *hvalue = NULL; //hash index key
+        int ohvaluesz = 0;
+        char *ohvalue = NULL;
         txtflags_t textflags = (iflags & JBIDXISTR) ? JBICASE : 0;
 
-        if (obsdata && obsdatasz > 0) {
+        if (obsdata && obsdatasz > 0 && (!fq || _qryormatch3(coll, fq, fq, obsdata, obsdatasz))) {
             BSON_ITERATOR_FROM_BUFFER(&oit, obsdata);
             oft = bson_find_fieldpath_value2(mkey + 1, mkeysz - 1, &oit);
+            if (iflags & JBIDXHASH) {
+                ohvalue = _bsonithashval(coll->jb, &oit, &ohvaluesz);
+            }
             TCLIST *tokens = (oft == BSON_ARRAY || (oft == BSON_STRING && (iflags & JBIDXARR))) ? tclistnew() : NULL;
             ofvalue = BSON_IS_IDXSUPPORTED_TYPE(oft) ? _bsonitstrval(coll->jb, &oit, &ofvaluesz, tokens, textflags) : NULL;
             if (tokens) {
@@ -5397,9 +7462,12 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
                 tclistdel(tokens);
             }
         }
-        if (bs) {
+        if (bs && (!fq || _qryormatch3(coll, fq, fq, bson_data(bs), bson_size(bs)))) {
             BSON_ITERATOR_INIT(&fit, bs);
             ft = bson_find_fieldpath_value2(mkey + 1, mkeysz - 1, &fit);
+            if (iflags & JBIDXHASH) {
+                hvalue = _bsonithashval(coll->jb, &fit, &hvaluesz);
+            }
             TCLIST *tokens = (ft == BSON_ARRAY || (ft == BSON_STRING && (iflags & JBIDXARR))) ? tclistnew() : NULL;
             fvalue = BSON_IS_IDXSUPPORTED_TYPE(ft) ? _bsonitstrval(coll->jb, &fit, &fvaluesz, tokens, textflags) : NULL;
             if (tokens) {
@@ -5409,13 +7477,15 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
             }
         }
         if (!fvalue && !ofvalue) {
+            if (hvalue) TCFREE(hvalue);
+            if (ohvalue) TCFREE(ohvalue);
             continue;
         }
         if (imap == NULL) {
             imap = tcmapnew2(TCMAPTINYBNUM);
             rimap = tcmapnew2(TCMAPTINYBNUM);
         }
-        for (int i = 4; i <= 7; ++i) { /* JBIDXNUM, JBIDXSTR, JBIDXARR, JBIDXISTR */
+        for (int i = 4; i <= 8; ++i) { /* JBIDXNUM, JBIDXSTR, JBIDXARR, JBIDXISTR, JBIDXHASH */
             bool rm = false;
             int itype = (1 << i);
             if (itype == JBIDXNUM && (JBIDXNUM & iflags)) {
@@ -5435,6 +7505,16 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
                     tcmapput(imap, ikey, mkeysz, fvalue, fvaluesz);
                 }
                 continue;
+            } else if (itype == JBIDXHASH && (JBIDXHASH & iflags)) {
+                ikey[0] = 'h';
+                if (ohvalue && (!hvalue || hvaluesz != ohvaluesz || memcmp(hvalue, ohvalue, hvaluesz))) {
+                    tcmapput(rimap, ikey, mkeysz, ohvalue, ohvaluesz);
+                    rm = true;
+                }
+                if (hvalue && hvaluesz > 0 && (!ohvalue || rm)) {
+                    tcmapput(imap, ikey, mkeysz, hvalue, hvaluesz);
+                }
+                continue;
             } else {
                 continue;
             }
@@ -5449,6 +7529,8 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
         }
         if (fvalue) TCFREE(fvalue);
         if (ofvalue) TCFREE(ofvalue);
+        if (hvalue) TCFREE(hvalue);
+        if (ohvalue) TCFREE(ohvalue);
     }
     tcmapdel(cmeta);
 
@@ -5461,20 +7543,8 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
             TCLISTPUSH(dlist, &dctx, sizeof (dctx));
         }
         //flush deffered indexes if number pending objects greater JBMAXDEFFEREDIDXNUM
-        if (TCLISTNUM(dlist) >= JBMAXDEFFEREDIDXNUM) {
-            for (int i = 0; i < TCLISTNUM(dlist); ++i) {
-                _DEFFEREDIDXCTX *di = TCLISTVALPTR(dlist, i);
-                assert(di);
-                if (di->rmap) {
-                    tctdbidxout2(coll->tdb, &(di->oid), sizeof (di->oid), di->rmap);
-                    tcmapdel(di->rmap);
-                }
-                if (di->imap) {
-                    tctdbidxput2(coll->tdb, &(di->oid), sizeof (di->oid), di->imap);
-                    tcmapdel(di->imap);
-                }
-            }
-            TCLISTTRUNC(dlist, 0);
+        if (TCLISTNUM(dlist) >= JBMAXDEFFEREDIDXNUM && !_flushdeferredidx(coll, dlist)) {
+            rv = false;
         }
     } else { //apply index changes immediately
         if (rimap && !tctdbidxout2(coll->tdb, oid, sizeof (*oid), rimap)) rv = false;
@@ -5485,6 +7555,151 @@ static bool _updatebsonidx(EJCOLL *coll, const bson_oid_t *oid, const bson *bs,
     return rv;
 }
 
+/* Order of deferred index changes: index key then primary key */
+static int _deferredidxcmp(const TCLISTDATUM *d1, const TCLISTDATUM *d2, void *opaque) {
+    TCBDB *bdb = opaque;
+    int ksz1 = d1->size - sizeof (bson_oid_t);
+    int ksz2 = d2->size - sizeof (bson_oid_t);
+    int rv = bdb->cmp(d1->ptr, ksz1, d2->ptr, ksz2, bdb->cmpop);
+    return rv ? rv : memcmp(d1->ptr + ksz1, d2->ptr + ksz2, sizeof (bson_oid_t));
+}
+
+/**
+ * Applies and clears deferred index changes of `dlist`.
+ * Changes are grouped by index, removal and insertion of the same index key
+ * by the same record cancel out. Remaining changes are applied in the order of index keys
+ * so B+ tree leaves are updated sequentially instead of random descents for every record.
+ * Index trees do not share state, changes of different indexes are applied in parallel.
+ * Only update queries defer index changes, records saved by `ejdbsavebson()`
+ * update their indexes one by one in the caller thread.
+ * Returns false if any index change failed, the error code of the first failed job is set.
+ */
+static bool _flushdeferredidx(EJCOLL *coll, TCLIST *dlist) {
+    TCMAP *imaps = tcmapnew2(TCMAPTINYBNUM); //index name -> map of `value '\0' hash pk` -> insertions count
+    TCXSTR *kbuf = tcxstrnew();
+    const char *ikey;
+    int ikeysz, sp;
+    for (int i = 0; i < TCLISTNUM(dlist); ++i) {
+        _DEFFEREDIDXCTX *di = TCLISTVALPTR(dlist, i);
+        assert(di);
+        uint16_t hash = tctdbidxhash((const char*) &di->oid, sizeof (di->oid));
+        char hbuf[3] = {'\0', hash >> 8, hash & 0xff};
+        for (int j = 0; j < 2; ++j) {
+            TCMAP *cols = j ? di->imap : di->rmap;
+            if (!cols) {
+                continue;
+            }
+            tcmapiterinit(cols);
+            while ((ikey = tcmapiternext(cols, &ikeysz)) != NULL) {
+                int vsz;
+                const char *vbuf = tcmapiterval(ikey, &vsz);
+                TCMAP *ops;
+                TCMAP **opsp = (TCMAP **) tcmapget(imaps, ikey, ikeysz, &sp);
+                if (opsp) {
+                    ops = *opsp;
+                } else {
+                    ops = tcmapnew();
+                    tcmapput(imaps, ikey, ikeysz, &ops, sizeof (ops));
+                }
+                tcxstrclear(kbuf);
+                TCXSTRCAT(kbuf, vbuf, vsz);
+                TCXSTRCAT(kbuf, hbuf, sizeof (hbuf));
+                TCXSTRCAT(kbuf, &di->oid, sizeof (di->oid));
+                tcmapaddint(ops, TCXSTRPTR(kbuf), TCXSTRSIZE(kbuf), j ? 1 : -1);
+            }
+            tcmapdel(cols);
+        }
+    }
+    TCLISTTRUNC(dlist, 0);
+
+    //Every index is a separate B+ tree, so changes of different indexes
+    //are applied concurrently, large batches get their own threads
+    int jnum = 0;
+    _DEFIDXJOB *jobs;
+    TCMALLOC(jobs, sizeof (*jobs) * TCMAPRNUM(imaps) + 1);
+    tcmapiterinit(imaps);
+    while ((ikey = tcmapiternext(imaps, &ikeysz)) != NULL) {
+        _DEFIDXJOB *job = jobs + jnum++;
+        memset(job, 0, sizeof (*job));
+        job->coll = coll;
+        job->iname = ikey;
+        job->inamesz = ikeysz;
+        job->ops = *(TCMAP **) tcmapiterval(ikey, &sp);
+    }
+    for (int i = 0; i < jnum; i += JBDEFIDXMAXTHREADS) {
+        int wnum = MIN(jnum - i, JBDEFIDXMAXTHREADS);
+        for (int j = i + 1; j < i + wnum; ++j) {
+            if (TCMAPRNUM(jobs[j].ops) >= JBDEFIDXTHREADMIN) {
+                jobs[j].thread = (pthread_create(&jobs[j].thr, NULL, _deferredidxjobthread, jobs + j) == 0);
+            }
+        }
+        _deferredidxjobthread(jobs + i);
+        for (int j = i + 1; j < i + wnum; ++j) {
+            if (!jobs[j].thread) {
+                _deferredidxjobthread(jobs + j);
+            } else if (pthread_join(jobs[j].thr, NULL) != 0) {
+                jobs[j].ecode = TCETHREAD;
+            }
+        }
+    }
+    bool rv = true;
+    for (int i = 0; i < jnum; ++i) {
+        if (jobs[i].ecode != TCESUCCESS) {
+            if (rv) {
+                _ejdbsetecode2(coll->jb, jobs[i].ecode, __FILE__, __LINE__, __func__, true);
+            }
+            rv = false;
+        }
+        tcmapdel(jobs[i].ops);
+    }
+    TCFREE(jobs);
+    tcmapdel(imaps);
+    tcxstrdel(kbuf);
+    return rv;
+}
+
+/* Applies deferred changes of a single index tree in the order of index keys */
+static void* _deferredidxjobthread(void *op) {
+    _DEFIDXJOB *job = op;
+    TCTDB *tdb = job->coll->tdb;
+    TCMAP *ops = job->ops;
+    TCLIST *keys = tcmapkeys(ops);
+    for (int i = 0; i < tdb->inum; ++i) {
+        TDBIDX *idx = tdb->idxs + i;
+        if (!strcmp(idx->name, job->iname)) {
+            if (idx->type == TDBITLEXICAL || idx->type == TDBITDECIMAL) {
+                ejdbqsortlist(keys, _deferredidxcmp, idx->db);
+            }
+            break;
+        }
+    }
+    TCMAP *cols = tcmapnew2(TCMAPTINYBNUM);
+    for (int i = 0; i < TCLISTNUM(keys); ++i) {
+        const char *kp;
+        int ksz, sp;
+        TCLISTVAL(kp, keys, i, ksz);
+        int delta = *(int *) tcmapget(ops, kp, ksz, &sp);
+        if (delta == 0) {
+            continue;
+        }
+        const char *pk = kp + ksz - sizeof (bson_oid_t);
+        tcmapclear(cols);
+        tcmapput(cols, job->iname, job->inamesz, kp, ksz - 3 - sizeof (bson_oid_t)); //skip '\0' and hash
+        bool ok;
+        if (delta < 0) {
+            ok = tctdbidxout2(tdb, pk, sizeof (bson_oid_t), cols);
+        } else {
+            ok = tctdbidxput2(tdb, pk, sizeof (bson_oid_t), cols);
+        }
+        if (!ok && job->ecode == TCESUCCESS) {
+            job->ecode = tctdbecode(tdb);
+        }
+    }
+    tcmapdel(cols);
+    tclistdel(keys);
+    return NULL;
+}
+
 static void _delcoldb(EJCOLL *coll) {
     assert(coll);
     tctdbdel(coll->tdb);
@@ -5496,6 +7711,43 @@ static void _delcoldb(EJCOLL *coll) {
         pthread_rwlock_destroy(coll->mmtx);
         TCFREE(coll->mmtx);
     }
+    if (coll->ifilters) {
+        _idxfilterclear(coll, NULL);
+        tcmapdel(coll->ifilters);
+        coll->ifilters = NULL;
+    }
+    if (coll->lzdict) {
+        tclzdictdel(coll->lzdict);
+        coll->lzdict = NULL;
+    }
+}
+
+/* Record and index page encoder of collections with `EJCOLLOPTS.fastcompressed` option */
+static void* _lzcodecenc(const void *ptr, int size, int *sp, void *op) {
+    EJCOLL *coll = op;
+    //records may be encoded by write-behind thread while dictionary is trained
+    TCLZDICT *dict = __atomic_load_n(&coll->lzdict, __ATOMIC_ACQUIRE);
+    int zsz;
+    char *zbuf = tclzencode(ptr, size, dict, &zsz);
+    if (!zbuf) {
+        return NULL;
+    }
+    TCREALLOC(zbuf, zbuf, zsz + 1);
+    memmove(zbuf + 1, zbuf, zsz);
+    *zbuf = dict ? JBLZDICT : JBLZPLAIN;
+    *sp = zsz + 1;
+    return zbuf;
+}
+
+/* Record and index page decoder of collections with `EJCOLLOPTS.fastcompressed` option */
+static void* _lzcodecdec(const void *ptr, int size, int *sp, void *op) {
+    EJCOLL *coll = op;
+    const char *rp = ptr;
+    TCLZDICT *dict = __atomic_load_n(&coll->lzdict, __ATOMIC_ACQUIRE);
+    if (size < 1 || (*rp == JBLZDICT && !dict) || (*rp != JBLZDICT && *rp != JBLZPLAIN)) {
+        return NULL;
+    }
+    return tclzdecode(rp + 1, size - 1, (*rp == JBLZDICT) ? dict : NULL, sp);
 }
 
 static bool _addcoldb0(const char *cname, EJDB *jb, EJCOLLOPTS *opts, EJCOLL **res) {
@@ -5508,26 +7760,35 @@ static bool _addcoldb0(const char *cname, EJDB *jb, EJCOLLOPTS *opts, EJCOLL **r
         _ejdbsetecode(jb, JBEMAXNUMCOLS, __FILE__, __LINE__, __func__);
         return false;
     }
-    rv = _createcoldb(cname, jb, opts, &cdb);
+    EJCOLL *coll;
+    TCCALLOC(coll, 1, sizeof (*coll));
+    coll->cname = tcstrdup(cname);
+    coll->cnamesz = strlen(cname);
+    coll->jb = jb;
+    if (opts && opts->fastcompressed) {
+        coll->lzdict = _metagetlzdict(coll); //codec must see the dictionary before opening
+    }
+    rv = _createcoldb(cname, jb, opts, coll, &cdb);
     if (!rv) {
+        if (coll->lzdict) {
+            tclzdictdel(coll->lzdict);
+        }
+        TCFREE(coll->cname);
+        TCFREE(coll);
         *res = NULL;
         return rv;
     }
-    EJCOLL *coll;
-    TCCALLOC(coll, 1, sizeof (*coll));
     jb->cdbs[i] = coll;
     ++jb->cdbsnum;
-    coll->cname = tcstrdup(cname);
-    coll->cnamesz = strlen(cname);
     coll->tdb = cdb;
-    coll->jb = jb;
+    _idxfiltersload(coll);
     coll->mmtx = NULL;
     _ejdbcolsetmutex(coll);
     *res = coll;
     return rv;
 }
 
-static bool _createcoldb(const char *colname, EJDB *jb, EJCOLLOPTS *opts, TCTDB **res) {
+static bool _createcoldb(const char *colname, EJDB *jb, EJCOLLOPTS *opts, EJCOLL *coll, TCTDB **res) {
     assert(jb && jb->metadb);
     if (!JBISVALCOLNAME(colname)) {
         _ejdbsetecode(jb, JBEINVALIDCOLNAME, __FILE__, __LINE__, __func__);
@@ -5537,10 +7798,22 @@ static bool _createcoldb(const char *colname, EJDB *jb, EJCOLLOPTS *opts, TCTDB
     bool rv = true;
     TCTDB *cdb = tctdbnew();
     tctdbsetmutex(cdb);
+    if (jb->idxcache.limit > 0) {
+        tctdbsetidxcachebudget(cdb, &jb->idxcache);
+    }
+    if (jb->aiodepth > 0) {
+        tctdbsetaio(cdb, jb->aiodepth); //falls back to synchronous reads if unsupported
+    }
     if (opts) {
         if (opts->cachedrecords > 0) {
             tctdbsetcache(cdb, opts->cachedrecords, 0, 0);
         }
+        if (opts->writebehind > 0) {
+            tctdbsetwritebehind(cdb, opts->writebehind);
+        }
+        if (opts->bgdefrag > 0) {
+            tctdbsetbgdefrag(cdb, 0, opts->bgdefrag);
+        }
         int bnum = 0;
         uint8_t tflags = 0;
         if (opts->records > 0) {
@@ -5549,7 +7822,10 @@ static bool _createcoldb(const char *colname, EJDB *jb, EJCOLLOPTS *opts, TCTDB
         if (opts->large) {
             tflags |= TDBTLARGE;
         }
-        if (opts->compressed) {
+        if (opts->fastcompressed) {
+            tflags |= TDBTEXCODEC;
+            tctdbsetcodecfunc(cdb, _lzcodecenc, coll, _lzcodecdec, coll);
+        } else if (opts->compressed) {
             tflags |= TDBTDEFLATE;
         }
         tctdbtune(cdb, bnum, 0, 0, tflags);
@@ -5621,3 +7897,31 @@ static bool _qrycondcheckstror(const char *vbuf, const TCLIST *tokens) {
     }
     return false;
 }
+
+/* Fill `qf->exprmap` with tokens of `$in` condition for hash matching.
+   Number tokens are keyed by int64 value and the map is not created if some of them are fractional. */
+static void _qryinmapinit(EJQF *qf) {
+    assert(qf->exprlist);
+    if (qf->exprmap) {
+        return;
+    }
+    TCLIST *tokens = qf->exprlist;
+    if (qf->tcop == TDBQCNUMOREQ) {
+        for (int i = 0; i < TCLISTNUM(tokens); ++i) {
+            long double num = tcatof2(TCLISTVALPTR(tokens, i));
+            if (num != floorl(num) || num <= (long double) INT64_MIN || num >= (long double) INT64_MAX) {
+                return;
+            }
+        }
+        qf->exprmap = tcmapnew2(TCLISTNUM(tokens));
+        for (int i = 0; i < TCLISTNUM(tokens); ++i) {
+            int64_t nval = (int64_t) tcatof2(TCLISTVALPTR(tokens, i));
+            tcmapputkeep(qf->exprmap, &nval, sizeof (nval), &yes, sizeof (yes));
+        }
+    } else {
+        qf->exprmap = tcmapnew2(TCLISTNUM(tokens));
+        for (int i = 0; i < TCLISTNUM(tokens); ++i) {
+            tcmapputkeep(qf->exprmap, TCLISTVALPTR(tokens, i), TCLISTVALSIZ(tokens, i), &yes, sizeof (yes));
+        }
+    }
+}
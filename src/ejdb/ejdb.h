@@ -39,8 +39,11 @@ typedef struct EJQ EJQ;
 typedef struct { /**< EJDB collection tuning options. */
     bool large; /**< Large collection. It can be larger than 2GB. Default false */
     bool compressed; /**< Collection records will be compressed with DEFLATE compression. Default: false */
+    bool fastcompressed; /**< Collection records and index pages will be compressed with fast LZ compression. Default: false */
     int64_t records; /**< Expected records number in the collection. Default: 128K */
     int cachedrecords; /**< Maximum number of records cached in memory. Default: 0 */
+    int64_t writebehind; /**< Maximum size in bytes of collection records buffered and written by background thread. Default: 0 */
+    int bgdefrag; /**< Pause in milliseconds between steps of background defragmentation of collection records, 0 disables it. Default: 0 */
 } EJCOLLOPTS;
 
 
@@ -67,7 +70,8 @@ enum { /** Error codes */
     JBEEI = 9015, /**< EJDB export/import error */
     JBEEJSONPARSE = 9016, /**< JSON parsing failed */
     JBETOOBIGBSON = 9017, /**< BSON size is too big */
-    JBEINVALIDCMD = 9018 /**< Invalid ejdb command specified */
+    JBEINVALIDCMD = 9018, /**< Invalid ejdb command specified */
+    JBEQAGGSPEC = 9019 /**< Invalid aggregation group specification */
 };
 
 enum { /** Database open modes */
@@ -88,7 +92,8 @@ enum { /** Index modes, index types. */
     JBIDXNUM = 1 << 4, /**< Number index. */
     JBIDXSTR = 1 << 5, /**< String index.*/
     JBIDXARR = 1 << 6, /**< Array token index. */
-    JBIDXISTR = 1 << 7 /**< Case insensitive string index */
+    JBIDXISTR = 1 << 7, /**< Case insensitive string index */
+    JBIDXHASH = 1 << 8 /**< Hash equality index for string and number values. */
 };
 
 enum { /*< Query search mode flags in ejdbqryexecute() */
@@ -144,6 +149,31 @@ EJDB_EXPORT void ejdbdel(EJDB *jb);
  */
 EJDB_EXPORT bool ejdbclose(EJDB *jb);
 
+/**
+ * Set the memory budget of index pages cached by all collections of the database.
+ * Index trees caching more than their share of the exceeded budget release pages first,
+ * pages read only by index range scans are released before pages used by key lookups.
+ * Must be called before `ejdbopen()`.
+ * @param jb Database object created with `ejdbnew'
+ * @param size Maximum total size of cached index pages in bytes. Zero disables the budget.
+ * @return If successful return true, otherwise return false.
+ */
+EJDB_EXPORT bool ejdbsetidxcache(EJDB *jb, int64_t size);
+
+/**
+ * Enable asynchronous reading of collection files.
+ * Records beyond the memory mapped region of a collection file fetched by queries
+ * are read in batches submitted at once into the collection record cache instead of
+ * one blocking read per record. Collections without `EJCOLLOPTS.cachedrecords` get a record
+ * cache of 4096 records for this. Only reads are batched, writes stay synchronous.
+ * Must be called before `ejdbopen()`. Collections silently fall back to synchronous reads
+ * if the platform does not support asynchronous I/O.
+ * @param jb Database object created with `ejdbnew'
+ * @param depth Maximum number of reads in flight per collection. Zero disables asynchronous reading.
+ * @return If successful return true, otherwise return false.
+ */
+EJDB_EXPORT bool ejdbsetaio(EJDB *jb, int depth);
+
 /**
  * Opens EJDB database.
  * @param jb   Database object created with `ejdbnew'
@@ -316,6 +346,10 @@ EJDB_EXPORT void ejdbquerydel(EJQ *q);
  *      - `JBIDXISTR` Case insensitive string index for JSON string values.
  *      - `JBIDXNUM` Index for JSON number values.
  *      - `JBIDXARR` Token index for JSON arrays and string values.
+ *      - `JBIDXHASH` Hash index for JSON string and number values.
+ *              Serves only equality and `$in` conditions, in constant time
+ *              and without the B+ tree page cache overhead of other index types.
+ *              Useful for high-cardinality identifier fields.
  *
  *  - One JSON field can have several indexes for different types.
  *
@@ -343,6 +377,31 @@ EJDB_EXPORT void ejdbquerydel(EJQ *q);
  */
 EJDB_EXPORT bool ejdbsetindex(EJCOLL *coll, const char *ipath, int flags);
 
+/**
+ * Set partial index for JSON field in EJDB collection.
+ *
+ * Same as `ejdbsetindex()` but only documents matched by the `filter` query are indexed.
+ * The filter is applied to all index types of the field and the existing indexes
+ * of the field are rebuilt. The partial index is used by queries only if every
+ * condition of the filter is also the top level condition of the query.
+ * Also a `{field : {$exists : true}}` filter condition is implied by any
+ * other not negated query condition on the same field.
+ *
+ *  Examples:
+ *      - Index error codes of failed jobs only:
+ *          `ejdbsetindex2(ccoll, "error_code", JBIDXNUM, {"status" : "failed"})`
+ *      - Index error codes of all documents again:
+ *          `ejdbsetindex2(ccoll, "error_code", JBIDXNUM, {})`
+ *
+ * @param coll Collection handle.
+ * @param ipath BSON field path.
+ * @param flags Index flags.
+ * @param filter Filter query for indexed documents. If NULL the existing filter is kept.
+ *               An empty filter removes the existing filter.
+ * @return
+ */
+EJDB_EXPORT bool ejdbsetindex2(EJCOLL *coll, const char *ipath, int flags, bson *filter);
+
 /**
  * Execute the query against EJDB collection.
  * It is better to execute update queries with specified `JBQRYCOUNT` control
@@ -405,11 +464,47 @@ EJDB_EXPORT uint32_t ejdbupdate(EJCOLL *jcoll, bson *qobj, bson *orqobjs, int or
  * @param orqobjsnum Number of OR query objects.
  * 
  * NOTE: Queries with update instruction not supported.
+ *
+ * Matched records are streamed and only unique values are kept in memory.
+ * If the query is empty and `fpath` has a string index covering all records
+ * values are read from the index key by key, one record is fetched per value.
  * 
- * @return Unique values by specified path and query (as BSON array)
+ * @return Unique values by specified path and query (as BSON array) in ascending order
  */
 EJDB_EXPORT bson* ejdbqrydistinct(EJCOLL *jcoll, const char *fpath, bson *qobj, bson *orqobjs, int orqobjsnum, uint32_t *count, TCXSTR *log);
 
+/**
+ * Groups records matched by query and computes aggregates of every group
+ * in a single pass over matched records. Only accumulators of groups are kept in memory.
+ *
+ * Group specification:
+ *  {
+ *      "_id" : "$fpath" | {"key" : "$fpath", ...} | constant | null,
+ *      "field" : {"$sum" : "$fpath" | number},
+ *      "field" : {"$avg" : "$fpath"},
+ *      "field" : {"$min" : "$fpath"},
+ *      "field" : {"$max" : "$fpath"},
+ *      "field" : {"$count" : 1},
+ *      ...
+ *  }
+ * Field references start with `$`. Missing `_id` puts all records into the single group.
+ * `$sum` and `$avg` ignore non numeric values, `$min` and `$max` ignore missing and null values.
+ *
+ * @param jcoll EJDB database collection handle.
+ * @param group Group specification.
+ * @param qobj Main BSON query object selecting aggregated records, can be `NULL`.
+ * @param orqobjs Array of additional OR query objects (joined with OR predicate).
+ * @param orqobjsnum Number of OR query objects.
+ * @param count Number of groups will be stored into.
+ * @param log Optional query execution log buffer.
+ *
+ * NOTE: Queries with update instruction not supported.
+ *
+ * @return BSON array of groups `{"_id" : group key, "field" : aggregate, ...}` ordered by `_id`
+ *         or `NULL` on error. Returned BSON must be freed by `bson_del()`.
+ */
+EJDB_EXPORT bson* ejdbqryaggregate(EJCOLL *jcoll, bson *group, bson *qobj, bson *orqobjs, int orqobjsnum, uint32_t *count, TCXSTR *log);
+
 /**
  * Synchronize content of a EJDB collection database with the file on device.
  * @param jcoll EJDB collection.
@@ -417,6 +512,20 @@ EJDB_EXPORT bson* ejdbqrydistinct(EJCOLL *jcoll, const char *fpath, bson *qobj,
  */
 EJDB_EXPORT bool ejdbsyncoll(EJCOLL *jcoll);
 
+/**
+ * Train dictionary of fast compression for collection created with `EJCOLLOPTS.fastcompressed` option.
+ * The dictionary is built from fragments repeated across records already stored in the collection
+ * and kept in the collection metadata. Records and index pages written afterwards are compressed
+ * with the dictionary, data written before stays readable. Dictionary can be trained only once.
+ *
+ * Small records sharing field names and values are compressed several times better with the dictionary.
+ *
+ * @param jcoll EJDB collection.
+ * @param size Maximum size of dictionary in bytes up to 65535. If not positive 16K is used.
+ * @return On success return true.
+ */
+EJDB_EXPORT bool ejdbtraincompressdict(EJCOLL *jcoll, int size);
+
 /**
  * Synchronize entire EJDB database and
  * all of its collections with storage.
@@ -444,19 +553,25 @@ EJDB_EXPORT bson* ejdbmeta(EJDB *jb);
 enum {
     JBJSONEXPORT = 1, //Database collections will be exported as JSON files.
     JBIMPORTUPDATE = 1 << 1, //Update existing collection entries with imported ones. Missing collections will be created.
-    JBIMPORTREPLACE = 1 << 2 //Recreate all collections and replace all collection data with imported entries.
+    JBIMPORTREPLACE = 1 << 2, //Recreate all collections and replace all collection data with imported entries.
+    JBEXPORTGZIP = 1 << 3, //Compress exported collection data files with GZIP (`.gz` suffix is appended to file names).
+    JBJSONIMPORT = 1 << 4 //Import collections from newline delimited JSON files `<cname>.json` instead of BSON dumps.
 };
 
 /**
  * Exports database collections data to the specified directory.
- * Database read lock will be taken on each collection.
+ * Database read lock is taken on all exported collections during the whole
+ * operation so exported data is a consistent snapshot of the database.
+ * Collections are exported concurrently by several threads.
  *
  * NOTE: Only data exported as BSONs can be imported with `ejdbimport()`
+ * NOTE: Files exported with `JBEXPORTGZIP` must be decompressed before import.
  *
  * @param jb EJDB database handle.
  * @param path The directory path in which data will be exported.
  * @param cnames List of collection names to export. `NULL` implies that all existing collections will be exported.
  * @param flags. Can be set to `JBJSONEXPORT` in order to export data as JSON files instead exporting into BSONs.
+ *               `JBEXPORTGZIP` can be added to compress exported data files.
  * @param log Optional operation string log buffer.
  * @return on sucess `true`
  */
@@ -467,6 +582,7 @@ EJDB_EXPORT bool ejdbexport(EJDB *jb, const char *path, TCLIST *cnames, int flag
  * Global database write lock will be applied during import operation.
  *
  * NOTE: Only data exported as BSONs can be imported with `ejdbimport()`
+ * unless `JBJSONIMPORT` is set.
  *
  * @param jb EJDB database handle.
  * @param path The directory path in which data resides.
@@ -481,6 +597,10 @@ EJDB_EXPORT bool ejdbexport(EJDB *jb, const char *path, TCLIST *cnames, int flag
  *                               Collections options will be imported.
  *
  *             `0`              Implies `JBIMPORTUPDATE`
+ *
+ *             `JBJSONIMPORT` can be combined with the flags above in order
+ *                               to stream collection data from newline delimited JSON files `<cname>.json`.
+ *                               Collection meta file `<cname>-meta.json` is optional in this mode.
  * @param log Optional operation log buffer.
  * @return
  */
@@ -497,7 +617,7 @@ EJDB_EXPORT bool ejdbimport(EJDB *jb, const char *path, TCLIST *cnames, int flag
  *    "export" : {
  *          "path" : string,                    //Export files target directory
  *          "cnames" : [string array]|null,     //List of collection names to export
- *          "mode" : int|null                   //Values: null|`JBJSONEXPORT` See ejdbexport() method
+ *          "mode" : int|null                   //Values: null|`JBJSONEXPORT`|`JBEXPORTGZIP` See ejdbexport() method
  *    }
  *
  *    Command response:
@@ -512,7 +632,7 @@ EJDB_EXPORT bool ejdbimport(EJDB *jb, const char *path, TCLIST *cnames, int flag
  *    "import" : {
  *          "path" : string                  //Import files source directory
  *          "cnames" : [string array]|null,  //List of collection names to import
- *          "mode" : int|null                //Values: null|`JBIMPORTUPDATE`|`JBIMPORTREPLACE` See ejdbimport() method
+ *          "mode" : int|null                //Values: null|`JBIMPORTUPDATE`|`JBIMPORTREPLACE` optionally with `JBJSONIMPORT` See ejdbimport() method
  *     }
  *
  *     Command response:
@@ -39,6 +39,8 @@ struct EJCOLL { /**> EJDB Collection. */
     TCTDB *tdb; /**> Collection TCTDB. */
     EJDB *jb; /**> Database handle. */
     void *mmtx; /*> Mutex for method */
+    TCMAP *ifilters; /**> Compiled filters of partial indexes: index meta key => EJQ* */
+    TCLZDICT *lzdict; /**> Dictionary of fast compression or NULL */
 };
 
 struct EJDB {
@@ -46,6 +48,8 @@ struct EJDB {
     int cdbsnum; /*> Count of collection DB. */
     TCTDB *metadb; /*> Metadata DB. */
     void *mmtx; /*> Mutex for method */
+    BDBCBUDGET idxcache; /*> Page cache budget shared by indexes of all collections */
+    int aiodepth; /*> Depth of asynchronous reads of collection files or 0 */
 };
 
 enum { /**> Query field flags */
@@ -108,6 +112,8 @@ struct EJQF { /**> Matching field and status */
     TCLIST *exprlist; /**> List representation of expression */
     TCMAP *exprmap; /**> Hash map for expression tokens used in $in matching operation. */
     void *regex; /**> Regular expression object */
+    char *rxprefix; /**> Literal prefix required by anchored regular expression, NULL if none */
+    int rxprefixsz; /**> Size of the regular expression literal prefix */
     EJDB *jb; /**> Reference to the EJDB during query processing */
     EJQ *q; /**> Query object in which this field embedded */
     double exprdblval; /**> Double value representation */
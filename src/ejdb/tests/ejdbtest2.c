@@ -6,6 +6,8 @@
  */
 
 #include "myconf.h"
+#include <signal.h>
+#include <sys/resource.h>
 #include "ejdb_private.h"
 #include "CUnit/Basic.h"
 
@@ -5833,6 +5835,2144 @@ void testTicket117(void) {
 }
 
 
+void testRegexPrefixIdx(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "rxprefix", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "color", JBIDXSTR));
+
+    const char *colors[] = {"Red", "Green", "Greeen", "Grey", "Blue", "green"};
+    for (int i = 0; i < sizeof (colors) / sizeof (colors[0]); ++i) {
+        bson_oid_t oid;
+        bson brec;
+        bson_init(&brec);
+        bson_append_string(&brec, "color", colors[i]);
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+
+    const char *rxs[] = {"^Gre+n", "^Gr[a-z]", "^Grey?", "een$", "^gre"};
+    const char *rxopts[] = {"", "", "", "", "i"};
+    const int rxcounts[] = {2, 3, 3, 3, 4};
+    const char *rxidx[] = {"MAIN IDX: 'scolor'", "MAIN IDX: 'scolor'", "MAIN IDX: 'scolor'",
+                           "MAIN IDX: 'NONE'", "MAIN IDX: 'NONE'"};
+    for (int i = 0; i < sizeof (rxs) / sizeof (rxs[0]); ++i) {
+        bson bsq;
+        bson_init_as_query(&bsq);
+        bson_append_regex(&bsq, "color", rxs[i], rxopts[i]);
+        bson_finish(&bsq);
+        CU_ASSERT_FALSE_FATAL(bsq.err);
+
+        TCXSTR *log = tcxstrnew();
+        uint32_t count = 0;
+        EJQ *q1 = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+        bson_destroy(&bsq);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(q1);
+        TCLIST *q1res = ejdbqryexecute(coll, q1, &count, 0, log);
+        CU_ASSERT_PTR_NOT_NULL(q1res);
+        CU_ASSERT_EQUAL(count, rxcounts[i]);
+        CU_ASSERT_EQUAL(TCLISTNUM(q1res), rxcounts[i]);
+        CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), rxidx[i]));
+
+        ejdbquerydel(q1);
+        tclistdel(q1res);
+        tcxstrdel(log);
+    }
+}
+
+void testFetchSorted(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "fetchsorted", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "n", JBIDXNUM));
+    for (int i = 0; i < 3000; ++i) {
+        bson_oid_t oid;
+        bson brec;
+        bson_init(&brec);
+        bson_append_int(&brec, "n", (i * 7919) % 3000);
+        bson_append_string(&brec, "s", "fetch sorted test record");
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    for (int o = 0; o < 2; ++o) {
+        uint32_t counts[2];
+        for (int fs = 0; fs < 2; ++fs) {
+            bson bsq;
+            bson_init_as_query(&bsq);
+            bson_append_start_object(&bsq, "n");
+            bson_append_int(&bsq, "$gte", 500);
+            bson_append_finish_object(&bsq);
+            bson_finish(&bsq);
+            CU_ASSERT_FALSE_FATAL(bsq.err);
+
+            bson bshints;
+            bson_init_as_query(&bshints);
+            bson_append_bool(&bshints, "$fetchsorted", fs);
+            if (o) {
+                bson_append_start_object(&bshints, "$orderby");
+                bson_append_int(&bshints, "n", -1);
+                bson_append_finish_object(&bshints);
+            }
+            bson_finish(&bshints);
+            CU_ASSERT_FALSE_FATAL(bshints.err);
+
+            TCXSTR *log = tcxstrnew();
+            EJQ *q1 = ejdbcreatequery(jb, &bsq, NULL, 0, &bshints);
+            bson_destroy(&bsq);
+            bson_destroy(&bshints);
+            CU_ASSERT_PTR_NOT_NULL_FATAL(q1);
+            TCLIST *q1res = ejdbqryexecute(coll, q1, &counts[fs], 0, log);
+            CU_ASSERT_PTR_NOT_NULL_FATAL(q1res);
+            CU_ASSERT_EQUAL(counts[fs], 2500);
+            CU_ASSERT_EQUAL(TCLISTNUM(q1res), 2500);
+            CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "MAIN IDX: 'nn'"));
+            if (fs) {
+                CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "FETCH BY FILE OFFSET: YES"));
+            } else {
+                CU_ASSERT_PTR_NULL(strstr(TCXSTRPTR(log), "FETCH BY FILE OFFSET: YES"));
+            }
+            int64_t sum = 0;
+            for (int i = 0; i < TCLISTNUM(q1res); ++i) {
+                bson_iterator it;
+                bson_find_from_buffer(&it, TCLISTVALPTR(q1res, i), "n");
+                int n = bson_iterator_int(&it);
+                if (o) { //index order must be kept
+                    CU_ASSERT_EQUAL(n, 2999 - i);
+                }
+                sum += n;
+            }
+            CU_ASSERT_EQUAL(sum, (int64_t) (500 + 2999) * 2500 / 2);
+            ejdbquerydel(q1);
+            tclistdel(q1res);
+            tcxstrdel(log);
+        }
+    }
+    //Counting by a single indexed condition reads no records
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "n");
+    bson_append_int(&bsq, "$gte", 500);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    bson bshints;
+    bson_init_as_query(&bshints);
+    bson_append_bool(&bshints, "$fetchsorted", true);
+    bson_finish(&bshints);
+    TCXSTR *log = tcxstrnew();
+    uint32_t count = 0;
+    EJQ *q1 = ejdbcreatequery(jb, &bsq, NULL, 0, &bshints);
+    bson_destroy(&bsq);
+    bson_destroy(&bshints);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q1);
+    ejdbqryexecute(coll, q1, &count, JBQRYCOUNT, log);
+    CU_ASSERT_EQUAL(count, 2500);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "MAIN IDX: 'nn'"));
+    CU_ASSERT_PTR_NULL(strstr(TCXSTRPTR(log), "FETCH BY FILE OFFSET: YES"));
+    ejdbquerydel(q1);
+    tcxstrdel(log);
+}
+
+static uint64_t partialidxrnum(EJCOLL *coll, const char *iname) {
+    for (int i = 0; i < coll->tdb->inum; ++i) {
+        TDBIDX *idx = coll->tdb->idxs + i;
+        if (!strcmp(idx->name, iname)) {
+            return tcbdbrnum((TCBDB*) idx->db);
+        }
+    }
+    return 0;
+}
+
+static uint32_t partialidxcount(EJCOLL *coll, bson *bsq, const char *iname) {
+    TCXSTR *log = tcxstrnew();
+    uint32_t count = 0;
+    EJQ *q1 = ejdbcreatequery(jb, bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q1);
+    TCLIST *q1res = ejdbqryexecute(coll, q1, &count, JBQRYCOUNT, log);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), iname));
+    ejdbquerydel(q1);
+    if (q1res) {
+        tclistdel(q1res);
+    }
+    tcxstrdel(log);
+    return count;
+}
+
+void testPartialIndex(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "partialidx", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oids[100];
+    for (int i = 0; i < 100; ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_int(&brec, "i", i);
+        bson_append_string(&brec, "status", (i % 10) ? "ok" : "failed");
+        if (i % 10 == 0) {
+            bson_append_int(&brec, "error_code", i);
+        }
+        if (i % 20 == 0) {
+            bson_append_int(&brec, "retries", i / 20);
+        }
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oids[i]));
+        bson_destroy(&brec);
+    }
+    bson bsf;
+    bson_init_as_query(&bsf);
+    bson_append_string(&bsf, "status", "failed");
+    bson_finish(&bsf);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex2(coll, "error_code", JBIDXNUM, &bsf));
+    bson_destroy(&bsf);
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nerror_code"), 10);
+
+    bson_init_as_query(&bsf);
+    bson_append_start_object(&bsf, "retries");
+    bson_append_bool(&bsf, "$exists", true);
+    bson_append_finish_object(&bsf);
+    bson_finish(&bsf);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex2(coll, "retries", JBIDXNUM, &bsf));
+    bson_destroy(&bsf);
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nretries"), 5);
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "failed");
+    bson_append_start_object(&bsq, "error_code");
+    bson_append_int(&bsq, "$gte", 50);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'nerror_code'"), 5);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq); //filter is not implied so full scan
+    bson_append_start_object(&bsq, "error_code");
+    bson_append_int(&bsq, "$gte", 50);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'NONE'"), 5);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq); //$exists filter implied by field condition
+    bson_append_int(&bsq, "retries", 2);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'nretries'"), 1);
+    bson_destroy(&bsq);
+
+    //Documents leaving and entering the index filter
+    for (int i = 0; i < 2; ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_oid(&brec, "_id", &oids[i]);
+        bson_append_int(&brec, "i", i);
+        bson_append_string(&brec, "status", (i == 0) ? "ok" : "failed");
+        bson_append_int(&brec, "error_code", 100 + i);
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE(ejdbsavebson(coll, &brec, &oids[i]));
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nerror_code"), 10);
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nretries"), 4);
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "failed");
+    bson_append_start_object(&bsq, "error_code");
+    bson_append_int(&bsq, "$gte", 100);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'nerror_code'"), 1);
+    bson_destroy(&bsq);
+
+    CU_ASSERT_TRUE(ejdbrmbson(coll, &oids[1]));
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nerror_code"), 9);
+
+    //Rebuild keeps the filter
+    CU_ASSERT_TRUE(ejdbsetindex(coll, "error_code", JBIDXNUM | JBIDXREBLD));
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nerror_code"), 9);
+
+    //Changed filter
+    bson_init_as_query(&bsf);
+    bson_append_string(&bsf, "status", "ok");
+    bson_finish(&bsf);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex2(coll, "error_code", JBIDXNUM, &bsf));
+    bson_destroy(&bsf);
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nerror_code"), 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll->ifilters);
+    CU_ASSERT_PTR_NOT_NULL(tcmapget2(coll->ifilters, "ierror_code")); //compiled once for writes and queries
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "ok");
+    bson_append_start_object(&bsq, "error_code");
+    bson_append_int(&bsq, "$gte", 50);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'nerror_code'"), 1);
+    bson_destroy(&bsq);
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "failed");
+    bson_append_start_object(&bsq, "error_code");
+    bson_append_int(&bsq, "$gte", 50);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'NONE'"), 5);
+    bson_destroy(&bsq);
+
+    //Empty filter makes the index regular
+    bson_init_as_query(&bsf);
+    bson_finish(&bsf);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex2(coll, "error_code", JBIDXNUM, &bsf));
+    bson_destroy(&bsf);
+    CU_ASSERT_EQUAL(partialidxrnum(coll, "nerror_code"), 10);
+    CU_ASSERT_PTR_NULL(tcmapget2(coll->ifilters, "ierror_code"));
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "error_code");
+    bson_append_int(&bsq, "$gte", 50);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'nerror_code'"), 6);
+    bson_destroy(&bsq);
+}
+
+void testHashIndex(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "hashidx", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oids[200];
+    char uid[32];
+    for (int i = 0; i < 200; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(uid, "u%d", i);
+        bson_append_string(&brec, "uid", uid);
+        if (i % 2) {
+            bson_append_int(&brec, "n", i);
+        } else {
+            bson_append_double(&brec, "n", i);
+        }
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oids[i]));
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "uid", JBIDXHASH));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "n", JBIDXHASH));
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "uid", "u42");
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'huid'"), 1);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "uid");
+    bson_append_start_array(&bsq, "$in");
+    bson_append_string(&bsq, "0", "u1");
+    bson_append_string(&bsq, "1", "u199");
+    bson_append_string(&bsq, "2", "u1");
+    bson_append_string(&bsq, "3", "u500");
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'huid'"), 2);
+    bson_destroy(&bsq);
+
+    //Integral numbers are matched regardless of BSON number type
+    bson_init_as_query(&bsq);
+    bson_append_double(&bsq, "n", 7);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'hn'"), 1);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "n");
+    bson_append_start_array(&bsq, "$in");
+    bson_append_int(&bsq, "0", 8);
+    bson_append_int(&bsq, "1", 9);
+    bson_append_int(&bsq, "2", 1000);
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'hn'"), 2);
+    bson_destroy(&bsq);
+
+    //String value equal to number key is rejected by the record match
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "n", "7");
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'hn'"), 0);
+    bson_destroy(&bsq);
+
+    //Hash index is not used for ordering
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "uid", "u42");
+    bson_finish(&bsq);
+    bson bshints;
+    bson_init_as_query(&bshints);
+    bson_append_start_object(&bshints, "$orderby");
+    bson_append_int(&bshints, "uid", 1);
+    bson_append_finish_object(&bshints);
+    bson_finish(&bshints);
+    TCXSTR *log = tcxstrnew();
+    uint32_t count = 0;
+    EJQ *q1 = ejdbcreatequery(jb, &bsq, NULL, 0, &bshints);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q1);
+    TCLIST *q1res = ejdbqryexecute(coll, q1, &count, 0, log);
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "MAIN IDX: 'NONE'"));
+    ejdbquerydel(q1);
+    tclistdel(q1res);
+    tcxstrdel(log);
+    bson_destroy(&bshints);
+    bson_destroy(&bsq);
+
+    //Index follows updates and removals
+    bson brec;
+    bson_init(&brec);
+    bson_append_oid(&brec, "_id", &oids[42]);
+    bson_append_string(&brec, "uid", "x42");
+    bson_append_int(&brec, "n", 42);
+    bson_finish(&brec);
+    CU_ASSERT_TRUE(ejdbsavebson(coll, &brec, &oids[42]));
+    bson_destroy(&brec);
+    CU_ASSERT_TRUE(ejdbrmbson(coll, &oids[43]));
+
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "uid");
+    bson_append_start_array(&bsq, "$in");
+    bson_append_string(&bsq, "0", "u42");
+    bson_append_string(&bsq, "1", "x42");
+    bson_append_string(&bsq, "2", "u43");
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'huid'"), 1);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_int(&bsq, "n", 42);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'hn'"), 1);
+    bson_destroy(&bsq);
+
+    //Rebuild and drop
+    CU_ASSERT_TRUE(ejdbsetindex(coll, "uid", JBIDXHASH | JBIDXREBLD));
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "uid", "x42");
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'huid'"), 1);
+    CU_ASSERT_TRUE(ejdbsetindex(coll, "uid", JBIDXHASH | JBIDXDROP));
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'NONE'"), 1);
+    bson_destroy(&bsq);
+
+    //Array values are found through the token index of the same field
+    for (int i = 0; i < 20; ++i) {
+        bson_init(&brec);
+        if (i % 2) {
+            bson_append_string(&brec, "tags", "red");
+        } else {
+            bson_append_start_array(&brec, "tags");
+            bson_append_string(&brec, "0", "red");
+            bson_append_string(&brec, "1", "blue");
+            bson_append_finish_array(&brec);
+        }
+        bson_finish(&brec);
+        bson_oid_t oid;
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "tags", JBIDXHASH));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "tags", JBIDXARR));
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "tags", "red");
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'atags'"), 20);
+    bson_destroy(&bsq);
+}
+
+static void inmodesquery(EJCOLL *coll, const char *fpath, int tnum, int step, bool numeric,
+                         const char *mode, uint32_t expected) {
+    char key[32];
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, fpath);
+    bson_append_start_array(&bsq, "$in");
+    for (int i = 0; i < tnum; ++i) {
+        bson_numstrn(key, sizeof(key), i);
+        if (numeric) {
+            bson_append_int(&bsq, key, i * step);
+        } else {
+            char val[32];
+            sprintf(val, "k%04d", i * step);
+            bson_append_string(&bsq, key, val);
+        }
+    }
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, mode), expected);
+    bson_destroy(&bsq);
+}
+
+void testInModes(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "inmodes", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    char key[32];
+    bson_oid_t oid;
+    for (int i = 0; i < 1000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(key, "k%04d", i);
+        bson_append_string(&brec, "k", key);
+        bson_append_int(&brec, "v", i);
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "k", JBIDXSTR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "v", JBIDXNUM));
+
+    //Few tokens: one index probe per token
+    inmodesquery(coll, "k", 5, 3, false, "$IN MODE: PROBE", 5);
+    inmodesquery(coll, "v", 5, 3, true, "$IN MODE: PROBE", 5);
+    //Dense tokens: single forward pass over index
+    inmodesquery(coll, "k", 150, 3, false, "$IN MODE: SKIP SCAN", 150);
+    inmodesquery(coll, "v", 150, 3, true, "$IN MODE: SKIP SCAN", 150);
+    //Tokens past the end of index
+    inmodesquery(coll, "v", 150, 9, true, "$IN MODE: SKIP SCAN", 112);
+    //Tokens cover large part of collection: hash semi-join within fullscan
+    inmodesquery(coll, "k", 400, 2, false, "$IN MODE: HASH SCAN", 400);
+    inmodesquery(coll, "v", 400, 3, true, "$IN MODE: HASH SCAN", 334);
+}
+
+void testInplaceUpdate(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "inplaceupd", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oids[10];
+    char name[32];
+    for (int i = 0; i < 10; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(name, "n%d", i);
+        bson_append_string(&brec, "name", name);
+        bson_append_int(&brec, "cnt", i);
+        bson_append_long(&brec, "total", i);
+        bson_append_double(&brec, "score", i);
+        bson_append_bool(&brec, "flag", false);
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oids[i]));
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "name", JBIDXSTR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "total", JBIDXNUM));
+
+    //Not indexed fixed size fields are patched in place
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "name", "n3");
+    bson_append_start_object(&bsq, "$inc");
+    bson_append_int(&bsq, "cnt", 10);
+    bson_append_double(&bsq, "score", 0.5);
+    bson_append_finish_object(&bsq);
+    bson_append_start_object(&bsq, "$set");
+    bson_append_bool(&bsq, "flag", true);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    TCXSTR *log = tcxstrnew();
+    CU_ASSERT_EQUAL(ejdbupdate(coll, &bsq, NULL, 0, NULL, log), 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "$UPDATE IN PLACE"));
+    tcxstrdel(log);
+    bson_destroy(&bsq);
+
+    bson_iterator it;
+    bson *rec = ejdbloadbson(coll, &oids[3]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rec);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "cnt"), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 13);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "score"), BSON_DOUBLE);
+    CU_ASSERT_DOUBLE_EQUAL(bson_iterator_double(&it), 3.5, 0.001);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "flag"), BSON_BOOL);
+    CU_ASSERT_TRUE(bson_iterator_bool(&it));
+    bson_del(rec);
+
+    //Indexed field is updated with index maintenance
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "name", "n4");
+    bson_append_start_object(&bsq, "$inc");
+    bson_append_int(&bsq, "total", 100);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    log = tcxstrnew();
+    CU_ASSERT_EQUAL(ejdbupdate(coll, &bsq, NULL, 0, NULL, log), 1);
+    CU_ASSERT_PTR_NULL(strstr(TCXSTRPTR(log), "$UPDATE IN PLACE"));
+    tcxstrdel(log);
+    bson_destroy(&bsq);
+    bson_init_as_query(&bsq);
+    bson_append_long(&bsq, "total", 104);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(partialidxcount(coll, &bsq, "MAIN IDX: 'ntotal'"), 1);
+    bson_destroy(&bsq);
+
+    //Missing field or changed type falls back to record rewrite
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "name", "n5");
+    bson_append_start_object(&bsq, "$set");
+    bson_append_int(&bsq, "extra", 1);
+    bson_append_long(&bsq, "cnt", 50);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    log = tcxstrnew();
+    CU_ASSERT_EQUAL(ejdbupdate(coll, &bsq, NULL, 0, NULL, log), 1);
+    CU_ASSERT_PTR_NULL(strstr(TCXSTRPTR(log), "$UPDATE IN PLACE"));
+    tcxstrdel(log);
+    bson_destroy(&bsq);
+    rec = ejdbloadbson(coll, &oids[5]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rec);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "extra"), BSON_INT);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "cnt"), BSON_LONG);
+    CU_ASSERT_EQUAL(bson_iterator_long(&it), 50);
+    bson_del(rec);
+
+    //In place update is rolled back with transaction
+    CU_ASSERT_TRUE_FATAL(ejdbtranbegin(coll));
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "name", "n6");
+    bson_append_start_object(&bsq, "$inc");
+    bson_append_int(&bsq, "cnt", 1000);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    log = tcxstrnew();
+    CU_ASSERT_EQUAL(ejdbupdate(coll, &bsq, NULL, 0, NULL, log), 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "$UPDATE IN PLACE"));
+    tcxstrdel(log);
+    bson_destroy(&bsq);
+    rec = ejdbloadbson(coll, &oids[6]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rec);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "cnt"), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 1006);
+    bson_del(rec);
+    CU_ASSERT_TRUE_FATAL(ejdbtranabort(coll));
+    rec = ejdbloadbson(coll, &oids[6]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rec);
+    CU_ASSERT_EQUAL(bson_find(&it, rec, "cnt"), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 6);
+    bson_del(rec);
+}
+
+static void distinctmode(EJCOLL *coll, const char *fpath, bson *qobj, const char *mode, uint32_t ecount) {
+    uint32_t count = 0;
+    TCXSTR *log = tcxstrnew();
+    bson *res = ejdbqrydistinct(coll, fpath, qobj, NULL, 0, &count, log);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(res);
+    CU_ASSERT_EQUAL(count, ecount);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), mode));
+    //Values are unique and sorted in ascending order
+    bson_iterator it, pit;
+    BSON_ITERATOR_INIT(&it, res);
+    uint32_t num = 0;
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if (num++ > 0) {
+            CU_ASSERT_TRUE(bson_compare_it_current(&pit, &it) < 0);
+        }
+        pit = it;
+    }
+    CU_ASSERT_EQUAL(num, ecount);
+    bson_del(res);
+    tcxstrdel(log);
+}
+
+void testDistinctModes(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "distinct2", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oid;
+    char cat[32];
+    for (int i = 0; i < 1000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(cat, "c%d", i % 7);
+        bson_append_string(&brec, "cat", cat);
+        if (i % 100 == 0) {
+            bson_append_double(&brec, "num", (i % 200 == 0) ? 2.0 : 2.5);
+        } else {
+            bson_append_int(&brec, "num", i % 5);
+        }
+        bson_finish(&brec);
+        CU_ASSERT_FALSE_FATAL(brec.err);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    distinctmode(coll, "cat", NULL, "DISTINCT MODE: HASH SCAN", 7);
+    //Numbers equal by value are reported once: 0, 1, 2, 2.5, 3, 4
+    distinctmode(coll, "num", NULL, "DISTINCT MODE: HASH SCAN", 6);
+
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "cat", JBIDXSTR));
+    distinctmode(coll, "cat", NULL, "DISTINCT MODE: INDEX WALK 'scat'", 7);
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_int(&bsq, "num", 3);
+    bson_finish(&bsq);
+    distinctmode(coll, "cat", &bsq, "DISTINCT MODE: HASH SCAN", 7);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "cat", "c3");
+    bson_finish(&bsq);
+    distinctmode(coll, "cat", &bsq, "DISTINCT MODE: HASH SCAN", 1);
+    bson_destroy(&bsq);
+
+    //Record without indexed value disables the index walk
+    bson brec;
+    bson_init(&brec);
+    bson_append_int(&brec, "num", 100);
+    bson_finish(&brec);
+    CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+    bson_destroy(&brec);
+    distinctmode(coll, "cat", NULL, "DISTINCT MODE: HASH SCAN", 7);
+
+    //Non string value stored as string index key disables the index walk
+    CU_ASSERT_TRUE(ejdbrmbson(coll, &oid));
+    bson_init(&brec);
+    bson_append_int(&brec, "cat", 100);
+    bson_finish(&brec);
+    CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+    bson_destroy(&brec);
+    distinctmode(coll, "cat", NULL, "DISTINCT MODE: HASH SCAN", 8);
+
+    //Non string value sharing the index key with a string value is not lost
+    CU_ASSERT_TRUE(ejdbrmbson(coll, &oid));
+    bson_init(&brec);
+    bson_append_string(&brec, "cat", "5");
+    bson_finish(&brec);
+    CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+    bson_destroy(&brec);
+    distinctmode(coll, "cat", NULL, "DISTINCT MODE: INDEX WALK 'scat'", 8);
+    bson_init(&brec);
+    bson_append_int(&brec, "cat", 5);
+    bson_finish(&brec);
+    CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+    bson_destroy(&brec);
+    distinctmode(coll, "cat", NULL, "DISTINCT MODE: HASH SCAN", 9);
+}
+
+void testAggregate(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "grouping", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oid;
+    char grp[32];
+    for (int i = 0; i < 100; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(grp, "g%d", i % 4);
+        bson_append_string(&brec, "grp", grp);
+        bson_append_int(&brec, "v", i);
+        if (i % 2 == 0) {
+            bson_append_double(&brec, "w", i / 4.0);
+        }
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    bson bsg;
+    bson_init(&bsg);
+    bson_append_string(&bsg, "_id", "$grp");
+    bson_append_start_object(&bsg, "total");
+    bson_append_string(&bsg, "$sum", "$v");
+    bson_append_finish_object(&bsg);
+    bson_append_start_object(&bsg, "avgw");
+    bson_append_string(&bsg, "$avg", "$w");
+    bson_append_finish_object(&bsg);
+    bson_append_start_object(&bsg, "minv");
+    bson_append_string(&bsg, "$min", "$v");
+    bson_append_finish_object(&bsg);
+    bson_append_start_object(&bsg, "maxw");
+    bson_append_string(&bsg, "$max", "$w");
+    bson_append_finish_object(&bsg);
+    bson_append_start_object(&bsg, "n");
+    bson_append_int(&bsg, "$count", 1);
+    bson_append_finish_object(&bsg);
+    bson_finish(&bsg);
+
+    uint32_t count = 0;
+    TCXSTR *log = tcxstrnew();
+    bson *res = ejdbqryaggregate(coll, &bsg, NULL, NULL, 0, &count, log);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(res);
+    CU_ASSERT_EQUAL(count, 4);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "AGGREGATED RECORDS: 100"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "AGGREGATED GROUPS: 4"));
+    bson_iterator it, sit;
+    BSON_ITERATOR_INIT(&it, res);
+    for (int g = 0; g < 4; ++g) {
+        CU_ASSERT_EQUAL_FATAL(bson_iterator_next(&it), BSON_OBJECT);
+        int total = 0, wnum = 0, minv = INT_MAX;
+        double wsum = 0, maxw = -1;
+        for (int i = g; i < 100; i += 4) {
+            total += i;
+            minv = MIN(minv, i);
+            if (i % 2 == 0) {
+                wsum += i / 4.0;
+                maxw = MAX(maxw, i / 4.0);
+                wnum++;
+            }
+        }
+        sprintf(grp, "g%d", g);
+        BSON_ITERATOR_SUBITERATOR(&it, &sit);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("_id", &sit), BSON_STRING);
+        CU_ASSERT_STRING_EQUAL(bson_iterator_string(&sit), grp);
+        BSON_ITERATOR_SUBITERATOR(&it, &sit);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("total", &sit), BSON_INT);
+        CU_ASSERT_EQUAL(bson_iterator_int(&sit), total);
+        BSON_ITERATOR_SUBITERATOR(&it, &sit);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("minv", &sit), BSON_INT);
+        CU_ASSERT_EQUAL(bson_iterator_int(&sit), minv);
+        BSON_ITERATOR_SUBITERATOR(&it, &sit);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("n", &sit), BSON_INT);
+        CU_ASSERT_EQUAL(bson_iterator_int(&sit), 25);
+        BSON_ITERATOR_SUBITERATOR(&it, &sit);
+        if (wnum > 0) {
+            CU_ASSERT_EQUAL(bson_find_fieldpath_value("avgw", &sit), BSON_DOUBLE);
+            CU_ASSERT_DOUBLE_EQUAL(bson_iterator_double(&sit), wsum / wnum, 0.000001);
+            BSON_ITERATOR_SUBITERATOR(&it, &sit);
+            CU_ASSERT_EQUAL(bson_find_fieldpath_value("maxw", &sit), BSON_DOUBLE);
+            CU_ASSERT_DOUBLE_EQUAL(bson_iterator_double(&sit), maxw, 0.000001);
+        } else { //odd groups have no `w` values
+            CU_ASSERT_EQUAL(bson_find_fieldpath_value("avgw", &sit), BSON_NULL);
+            BSON_ITERATOR_SUBITERATOR(&it, &sit);
+            CU_ASSERT_EQUAL(bson_find_fieldpath_value("maxw", &sit), BSON_NULL);
+        }
+    }
+    CU_ASSERT_EQUAL(bson_iterator_next(&it), BSON_EOO);
+    bson_del(res);
+    bson_destroy(&bsg);
+
+    //Single group over matched records
+    bson_init(&bsg);
+    bson_append_null(&bsg, "_id");
+    bson_append_start_object(&bsg, "total");
+    bson_append_string(&bsg, "$sum", "$v");
+    bson_append_finish_object(&bsg);
+    bson_finish(&bsg);
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "v");
+    bson_append_int(&bsq, "$gte", 90);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    tcxstrclear(log);
+    res = ejdbqryaggregate(coll, &bsg, &bsq, NULL, 0, &count, log);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(res);
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "AGGREGATED RECORDS: 10"));
+    BSON_ITERATOR_INIT(&it, res);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("0._id", &it), BSON_NULL);
+    BSON_ITERATOR_INIT(&it, res);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("0.total", &it), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 945);
+    bson_del(res);
+    bson_destroy(&bsg);
+
+    //Missing `_id` is the same single group
+    bson_init(&bsg);
+    bson_append_start_object(&bsg, "total");
+    bson_append_string(&bsg, "$sum", "$v");
+    bson_append_finish_object(&bsg);
+    bson_finish(&bsg);
+    res = ejdbqryaggregate(coll, &bsg, &bsq, NULL, 0, &count, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(res);
+    CU_ASSERT_EQUAL(count, 1);
+    BSON_ITERATOR_INIT(&it, res);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("0._id", &it), BSON_NULL);
+    BSON_ITERATOR_INIT(&it, res);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("0.total", &it), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 945);
+    bson_del(res);
+    bson_destroy(&bsq);
+    bson_destroy(&bsg);
+
+    //Invalid accumulator
+    bson_init(&bsg);
+    bson_append_string(&bsg, "_id", "$grp");
+    bson_append_start_object(&bsg, "x");
+    bson_append_string(&bsg, "$median", "$v");
+    bson_append_finish_object(&bsg);
+    bson_finish(&bsg);
+    res = ejdbqryaggregate(coll, &bsg, NULL, NULL, 0, &count, NULL);
+    CU_ASSERT_PTR_NULL(res);
+    CU_ASSERT_EQUAL(ejdbecode(jb), JBEQAGGSPEC);
+    bson_destroy(&bsg);
+    tcxstrdel(log);
+}
+
+static uint32_t scanbatchcount(EJCOLL *coll, bson *qobj, bson *hints) {
+    uint32_t count = 0;
+    TCXSTR *log = tcxstrnew();
+    EJQ *q = ejdbcreatequery(jb, qobj, NULL, 0, hints);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    TCLIST *res = ejdbqryexecute(coll, q, &count, 0, log);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(res);
+    CU_ASSERT_EQUAL(TCLISTNUM(res), count);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "RUN FULLSCAN"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "BATCHED NUMERIC CONDITIONS"));
+    tclistdel(res);
+    ejdbquerydel(q);
+    tcxstrdel(log);
+    return count;
+}
+
+void testScanBatchNumeric(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "scanbatch", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oid;
+    uint32_t egt = 0, eneg = 0, ebt = 0, enested = 0;
+    for (int i = 0; i < 1000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        switch (i % 10) {
+            case 1:
+                bson_append_double(&brec, "v", i + 0.5);
+                egt += (i + 0.5 > 500);
+                ebt += (i + 0.5 >= 100 && i + 0.5 <= 200);
+                break;
+            case 2: //missing
+                break;
+            case 3:
+                bson_append_null(&brec, "v");
+                break;
+            case 4:
+                bson_append_start_array(&brec, "v");
+                bson_append_int(&brec, "0", i);
+                bson_append_int(&brec, "1", i + 1);
+                bson_append_finish_array(&brec);
+                egt += (i + 1 > 500);
+                eneg++; //array elements not matching the negated condition
+                ebt += (i + 1 >= 100 && i <= 200);
+                break;
+            case 5:
+                bson_append_string(&brec, "v", "x");
+                break;
+            case 6:
+                bson_append_long(&brec, "v", i);
+                egt += (i > 500);
+                ebt += (i >= 100 && i <= 200);
+                break;
+            default:
+                bson_append_int(&brec, "v", i);
+                egt += (i > 500);
+                ebt += (i >= 100 && i <= 200);
+                break;
+        }
+        if (i % 10 != 4) {
+            eneg += (i % 10 == 2 || i % 10 == 3 || i % 10 == 5 || (i % 10 == 1 ? i + 0.5 : i) <= 500);
+        }
+        bson_append_start_object(&brec, "m");
+        bson_append_int(&brec, "v", i);
+        bson_append_finish_object(&brec);
+        enested += (i >= 990 && i % 10 != 2 && i % 10 != 3 && i % 10 != 5 && (i % 10 == 4 || i < 995));
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "v");
+    bson_append_int(&bsq, "$gt", 500);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(scanbatchcount(coll, &bsq, NULL), egt);
+
+    bson bshints;
+    bson_init_as_query(&bshints);
+    bson_append_int(&bshints, "$max", 10);
+    bson_finish(&bshints);
+    CU_ASSERT_EQUAL(scanbatchcount(coll, &bsq, &bshints), 10);
+    bson_destroy(&bshints);
+    bson_destroy(&bsq);
+
+    //Negated condition matches missing, null and non numeric values, arrays are matched as before
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "v");
+    bson_append_start_object(&bsq, "$not");
+    bson_append_int(&bsq, "$gt", 500);
+    bson_append_finish_object(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(scanbatchcount(coll, &bsq, NULL), eneg);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "v");
+    bson_append_start_array(&bsq, "$bt");
+    bson_append_int(&bsq, "0", 200);
+    bson_append_int(&bsq, "1", 100);
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(scanbatchcount(coll, &bsq, NULL), ebt);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "m.v");
+    bson_append_int(&bsq, "$gte", 990);
+    bson_append_finish_object(&bsq);
+    bson_append_start_object(&bsq, "v");
+    bson_append_double(&bsq, "$lt", 995);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(scanbatchcount(coll, &bsq, NULL), enested);
+    bson_destroy(&bsq);
+}
+
+void testFieldPathSections(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "fpsections", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oid;
+    bson brec;
+    bson_init(&brec);
+    for (int i = 0; i < 50; ++i) { //wide document, queried fields are at the end
+        char key[32];
+        sprintf(key, "field%d", i);
+        bson_append_int(&brec, key, i);
+    }
+    bson_append_start_array(&brec, "a");
+    bson_append_start_object(&brec, "0");
+    bson_append_int(&brec, "b", 1);
+    bson_append_finish_object(&brec);
+    bson_append_finish_array(&brec);
+    bson_append_start_object(&brec, "ab");
+    bson_append_string(&brec, "cd", "Hello world");
+    bson_append_finish_object(&brec);
+    bson_finish(&brec);
+    CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+    bson_destroy(&brec);
+
+    struct {
+        const char *fpath;
+        const char *op;
+        const char *val;
+        uint32_t count;
+    } cases[] = {
+        {"a.b", NULL, NULL, 1},
+        {"ab.cd", "$begin", "Hello", 1},
+        {"ab.cd", "$begin", "Hello world!", 0},
+        {"ab.cd", "$icase", "HELLO WORLD", 1},
+        {"ab.c", NULL, NULL, 0},
+        {"a.bc", NULL, NULL, 0},
+        {"ab", NULL, NULL, 0}, //must not step into array `a`
+        {"field4", NULL, NULL, 1},
+        {"field49", NULL, NULL, 1},
+        {"field490", NULL, NULL, 0}
+    };
+    for (int i = 0; i < sizeof (cases) / sizeof (cases[0]); ++i) {
+        bson bsq;
+        bson_init_as_query(&bsq);
+        if (cases[i].op) {
+            bson_append_start_object(&bsq, cases[i].fpath);
+            bson_append_string(&bsq, cases[i].op, cases[i].val);
+            bson_append_finish_object(&bsq);
+        } else {
+            bson_append_int(&bsq, cases[i].fpath, cases[i].fpath[0] == 'f' ? atoi(cases[i].fpath + 5) : 1);
+        }
+        bson_finish(&bsq);
+        EJQ *q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+        uint32_t count = 0;
+        TCLIST *res = ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+        CU_ASSERT_EQUAL(count, cases[i].count);
+        if (res) {
+            tclistdel(res);
+        }
+        ejdbquerydel(q);
+        bson_destroy(&bsq);
+    }
+}
+
+void testICaseFormat(void) {
+    char sbuf[512];
+    char *buf = NULL;
+    int len = tcicaseformat("Hello WORLD\t[Z]@", 16, sbuf, sizeof (sbuf), &buf);
+    CU_ASSERT_EQUAL(len, 16);
+    CU_ASSERT_TRUE(buf == sbuf);
+    CU_ASSERT_STRING_EQUAL(buf, "hello world\t[z]@");
+    //Control chars are ignored
+    len = tcicaseformat("\x01" "AB\x7f", 4, sbuf, sizeof (sbuf), &buf);
+    CU_ASSERT_EQUAL(len, 2);
+    CU_ASSERT_STRING_EQUAL(buf, "ab");
+    if (buf != sbuf) {
+        TCFREE(buf);
+    }
+    len = tcicaseformat("ПРИВЕТ Мир", strlen("ПРИВЕТ Мир"), sbuf, sizeof (sbuf), &buf);
+    CU_ASSERT_EQUAL(len, strlen("привет мир"));
+    CU_ASSERT_STRING_EQUAL(buf, "привет мир");
+    if (buf != sbuf) {
+        TCFREE(buf);
+    }
+    //Long ASCII string fits into placeholder
+    char lstr[400];
+    memset(lstr, 'Q', sizeof (lstr) - 1);
+    lstr[sizeof (lstr) - 1] = '\0';
+    len = tcicaseformat(lstr, sizeof (lstr) - 1, sbuf, sizeof (sbuf), &buf);
+    CU_ASSERT_EQUAL(len, sizeof (lstr) - 1);
+    CU_ASSERT_TRUE(buf == sbuf);
+    CU_ASSERT_EQUAL(buf[0], 'q');
+    CU_ASSERT_EQUAL(buf[len - 1], 'q');
+    CU_ASSERT_EQUAL(buf[len], '\0');
+    len = tcicaseformat(lstr, sizeof (lstr) - 1, NULL, 0, &buf);
+    CU_ASSERT_EQUAL(len, sizeof (lstr) - 1);
+    CU_ASSERT_EQUAL(buf[len - 1], 'q');
+    TCFREE(buf);
+
+    EJCOLL *coll = ejdbcreatecoll(jb, "icasefmt", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    const char *names[] = {"John.Smith@Example.com", "JOHN.SMITH@EXAMPLE.COM", "Jöhn.Smith@Example.com", "john.smith"};
+    bson_oid_t oid;
+    for (int i = 0; i < sizeof (names) / sizeof (names[0]); ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_string(&brec, "email", names[i]);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    for (int idx = 0; idx < 2; ++idx) {
+        if (idx) {
+            CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "email", JBIDXISTR));
+        }
+        bson bsq;
+        bson_init_as_query(&bsq);
+        bson_append_start_object(&bsq, "email");
+        bson_append_string(&bsq, "$icase", "john.SMITH@example.com");
+        bson_append_finish_object(&bsq);
+        bson_finish(&bsq);
+        EJQ *q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+        uint32_t count = 0;
+        TCLIST *res = ejdbqryexecute(coll, q, &count, 0, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(res);
+        CU_ASSERT_EQUAL(count, 3); //diacritics are stripped
+        tclistdel(res);
+        ejdbquerydel(q);
+        bson_destroy(&bsq);
+    }
+}
+
+static uint32_t deferredidxcount(EJCOLL *coll, bson *qobj, const char *idxname) {
+    uint32_t count = 0;
+    TCXSTR *log = tcxstrnew();
+    EJQ *q = ejdbcreatequery(jb, qobj, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    TCLIST *res = ejdbqryexecute(coll, q, &count, JBQRYCOUNT, log);
+    if (idxname) {
+        char buf[64];
+        sprintf(buf, "MAIN IDX: '%s'", idxname);
+        CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), buf));
+    }
+    if (res) {
+        tclistdel(res);
+    }
+    ejdbquerydel(q);
+    tcxstrdel(log);
+    return count;
+}
+
+void testDeferredIdxBatch(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "deferredidx", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "status", JBIDXSTR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "score", JBIDXNUM));
+    bson_oid_t oid;
+    for (int i = 0; i < 10000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_string(&brec, "status", "new");
+        bson_append_int(&brec, "score", i);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    //Update more records than flushed at once
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "score");
+    bson_append_int(&bsq, "$lt", 6000);
+    bson_append_finish_object(&bsq);
+    bson_append_start_object(&bsq, "$set");
+    bson_append_string(&bsq, "status", "done");
+    bson_append_int(&bsq, "score", 1);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "nscore"), 6000);
+    bson_destroy(&bsq);
+
+    struct {
+        const char *field;
+        const char *sval;
+        int ival;
+        const char *idxname;
+        uint32_t count;
+    } cases[] = {
+        {"status", "done", 0, "sstatus", 6000},
+        {"status", "new", 0, "sstatus", 4000},
+        {"score", NULL, 1, "nscore", 6000},
+        {"score", NULL, 0, "nscore", 0},
+        {"score", NULL, 7000, "nscore", 1}
+    };
+    for (int i = 0; i < sizeof (cases) / sizeof (cases[0]); ++i) {
+        bson_init_as_query(&bsq);
+        if (cases[i].sval) {
+            bson_append_string(&bsq, cases[i].field, cases[i].sval);
+        } else {
+            bson_append_int(&bsq, cases[i].field, cases[i].ival);
+        }
+        bson_finish(&bsq);
+        CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, cases[i].idxname), cases[i].count);
+        bson_destroy(&bsq);
+    }
+
+    //Revert status of all records
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "$set");
+    bson_append_string(&bsq, "status", "new");
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, NULL), 10000);
+    bson_destroy(&bsq);
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "new");
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "sstatus"), 10000);
+    bson_destroy(&bsq);
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "done");
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "sstatus"), 0);
+    bson_destroy(&bsq);
+}
+
+static void idxcurcheck(EJCOLL *coll, bson *qobj, int order, int max, int lo, int hi, uint32_t expcount) {
+    uint32_t count = 0;
+    bson bshints;
+    bson_init_as_query(&bshints);
+    bson_append_start_object(&bshints, "$orderby");
+    bson_append_int(&bshints, "n", order);
+    bson_append_finish_object(&bshints);
+    if (max > 0) {
+        bson_append_int(&bshints, "$max", max);
+    }
+    bson_finish(&bshints);
+    TCXSTR *log = tcxstrnew();
+    EJQ *q = ejdbcreatequery(jb, qobj, NULL, 0, &bshints);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    TCLIST *res = ejdbqryexecute(coll, q, &count, 0, log);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "MAIN IDX: 'nn'"));
+    CU_ASSERT_EQUAL(count, expcount);
+    CU_ASSERT_EQUAL(TCLISTNUM(res), expcount);
+    int64_t prev = (order > 0) ? INT64_MIN : INT64_MAX;
+    for (int i = 0; i < TCLISTNUM(res); ++i) {
+        bson_iterator it;
+        CU_ASSERT_EQUAL_FATAL(bson_find_from_buffer(&it, TCLISTVALPTR(res, i), "n"), BSON_INT);
+        int64_t n = bson_iterator_int(&it);
+        CU_ASSERT_TRUE(n >= lo && n <= hi);
+        CU_ASSERT_TRUE((order > 0) ? (n >= prev) : (n <= prev));
+        prev = n;
+    }
+    tclistdel(res);
+    ejdbquerydel(q);
+    tcxstrdel(log);
+    bson_destroy(&bshints);
+}
+
+void testIdxCursorBatch(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "idxcursor", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "n", JBIDXNUM));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "s", JBIDXSTR));
+    bson_oid_t oid;
+    char sbuf[16];
+    for (int i = 0; i < 3000; ++i) { //every `n` value is stored twice
+        bson brec;
+        bson_init(&brec);
+        bson_append_int(&brec, "n", i % 1500);
+        sprintf(sbuf, "k%04d", i);
+        bson_append_string(&brec, "s", sbuf);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    struct {
+        const char *op;
+        int lo;
+        int hi;
+        int order;
+        int max;
+        uint32_t count;
+    } cases[] = {
+        {NULL, 0, 1499, 1, 0, 3000},
+        {NULL, 0, 1499, -1, 0, 3000},
+        {"$gte", 100, 1499, 1, 0, 2800},
+        {"$gte", 100, 1499, -1, 0, 2800},
+        {"$gt", 1498, 1499, -1, 0, 4},
+        {"$gt", 1400, 1499, -1, 10, 10},
+        {"$lt", 0, 1199, 1, 0, 2400},
+        {"$lt", 0, 1199, -1, 0, 2400},
+        {"$lte", 1190, 1200, -1, 22, 22},
+        {"$bt", 200, 1300, 1, 0, 2202},
+        {"$bt", 200, 1300, -1, 0, 2202}
+    };
+    for (int i = 0; i < sizeof (cases) / sizeof (cases[0]); ++i) {
+        bson bsq;
+        bson_init_as_query(&bsq);
+        if (cases[i].op && !strcmp(cases[i].op, "$bt")) {
+            bson_append_start_object(&bsq, "n");
+            bson_append_start_array(&bsq, "$bt");
+            bson_append_int(&bsq, "0", cases[i].lo);
+            bson_append_int(&bsq, "1", cases[i].hi);
+            bson_append_finish_array(&bsq);
+            bson_append_finish_object(&bsq);
+        } else if (cases[i].op) {
+            bson_append_start_object(&bsq, "n");
+            if (cases[i].op[1] == 'g') {
+                bson_append_int(&bsq, cases[i].op, (cases[i].op[3] == 'e') ? cases[i].lo : cases[i].lo - 1);
+            } else {
+                bson_append_int(&bsq, cases[i].op, (cases[i].op[3] == 'e') ? cases[i].hi : cases[i].hi + 1);
+            }
+            bson_append_finish_object(&bsq);
+        }
+        bson_finish(&bsq);
+        idxcurcheck(coll, &bsq, cases[i].order, cases[i].max, cases[i].lo, cases[i].hi, cases[i].count);
+        bson_destroy(&bsq);
+    }
+
+    //Prefix scan over the string index
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "s");
+    bson_append_string(&bsq, "$begin", "k1");
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "ss"), 1000);
+    bson_destroy(&bsq);
+}
+
+void testBDBLeafFormat(void) {
+    const char *paths[] = {"dbt2_leafplain.bdb", "dbt2_leafprefix.bdb"};
+    int64_t fsiz[2];
+    char kbuf[64];
+    char vbuf[16];
+    for (int fmt = 0; fmt < 2; ++fmt) {
+        TCBDB *bdb = tcbdbnew();
+        CU_ASSERT_TRUE_FATAL(tcbdbtune(bdb, 16, 16, -1, -1, -1, 0));
+        CU_ASSERT_TRUE_FATAL(tcbdbopen(bdb, paths[fmt], BDBOWRITER | BDBOCREAT | BDBOTRUNC));
+        CU_ASSERT_EQUAL(bdb->lfmt, 1);
+        if (fmt == 0) {
+            bdb->lfmt = 0; //as written by the previous versions
+        }
+        for (int i = 0; i < 2000; ++i) {
+            int ksiz = sprintf(kbuf, "com.softmotions.ejdb.record.%05d", (i * 7) % 2000);
+            int vsiz = sprintf(vbuf, "%d", i);
+            CU_ASSERT_TRUE(tcbdbputdup(bdb, kbuf, ksiz, vbuf, vsiz));
+            if (i % 5 == 0) {
+                CU_ASSERT_TRUE(tcbdbputdup(bdb, kbuf, ksiz, "dup", 3));
+            }
+        }
+        CU_ASSERT_TRUE(tcbdbclose(bdb));
+        CU_ASSERT_TRUE_FATAL(tcbdbopen(bdb, paths[fmt], BDBOREADER));
+        CU_ASSERT_EQUAL(bdb->lfmt, fmt);
+        CU_ASSERT_EQUAL(tcbdbrnum(bdb), 2400);
+        fsiz[fmt] = tcbdbfsiz(bdb);
+        BDBCUR *cur = tcbdbcurnew(bdb);
+        CU_ASSERT_TRUE(tcbdbcurfirst(cur));
+        for (int i = 0; i < 2000; ++i) {
+            int ksiz = sprintf(kbuf, "com.softmotions.ejdb.record.%05d", i);
+            int sp;
+            const char *ckbuf = tcbdbcurkey3(cur, &sp);
+            CU_ASSERT_PTR_NOT_NULL_FATAL(ckbuf);
+            CU_ASSERT_TRUE(sp == ksiz && !memcmp(ckbuf, kbuf, ksiz));
+            int j = 0;
+            while (j < 2000 && (j * 7) % 2000 != i) ++j;
+            int vsiz = sprintf(vbuf, "%d", j);
+            const char *cvbuf = tcbdbcurval3(cur, &sp);
+            CU_ASSERT_TRUE(sp == vsiz && !memcmp(cvbuf, vbuf, vsiz));
+            CU_ASSERT_EQUAL(tcbdbvnum(bdb, kbuf, ksiz), (j % 5 == 0) ? 2 : 1);
+            for (int k = (j % 5 == 0) ? 2 : 1; k > 0; --k) {
+                tcbdbcurnext(cur);
+            }
+        }
+        int sp;
+        CU_ASSERT_PTR_NULL(tcbdbcurkey3(cur, &sp));
+        tcbdbcurdel(cur);
+        CU_ASSERT_TRUE(tcbdbclose(bdb));
+        tcbdbdel(bdb);
+    }
+    CU_ASSERT_TRUE(fsiz[1] < fsiz[0]);
+}
+
+static uint32_t tokenplcount(EJCOLL *coll, const char *op, const char **tags, int tnum) {
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "tags");
+    bson_append_start_array(&bsq, op);
+    char nbuf[TCNUMBUFSIZ];
+    for (int i = 0; i < tnum; ++i) {
+        bson_numstrn(nbuf, TCNUMBUFSIZ, i);
+        bson_append_string(&bsq, nbuf, tags[i]);
+    }
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    uint32_t count = deferredidxcount(coll, &bsq, "atags");
+    bson_destroy(&bsq);
+    return count;
+}
+
+void testTokenPostings(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "tokenpl", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "tags", JBIDXARR));
+    bson_oid_t oids[3000];
+    for (int i = 0; i < 3000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_start_array(&brec, "tags");
+        bson_append_string(&brec, "0", "all");
+        if (i % 3 == 0) bson_append_string(&brec, "1", "three");
+        if (i % 5 == 0) bson_append_string(&brec, "2", "five");
+        bson_append_finish_array(&brec);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oids[i]));
+        bson_destroy(&brec);
+        if (i == 1500) { //part of postings is stored, the rest is in the inverted cache
+            CU_ASSERT_TRUE(ejdbsyncoll(coll));
+        }
+    }
+    const char *t35[] = {"three", "five"};
+    const char *t3a[] = {"three", "all", "missing"};
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t35, 2), 1400);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t35, 2), 200);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t3a, 2), 1000);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t3a, 3), 0);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t3a, 3), 3000);
+    CU_ASSERT_TRUE(ejdbsyncoll(coll));
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t35, 2), 1400);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t35, 2), 200);
+
+    //Remove every even record from the stored posting lists
+    for (int i = 0; i < 3000; i += 2) {
+        CU_ASSERT_TRUE(ejdbrmbson(coll, &oids[i]));
+    }
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t35, 2), 700);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t35, 2), 100);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t3a, 2), 500);
+    CU_ASSERT_TRUE(ejdbsyncoll(coll));
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t35, 2), 700);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t35, 2), 100);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t3a, 3), 1500);
+
+    //Stored posting lists are front coded
+    TCTDB *tdb = coll->tdb;
+    TCBDB *idb = NULL;
+    for (int i = 0; i < tdb->inum; ++i) {
+        if (!strcmp(tdb->idxs[i].name, "atags")) idb = tdb->idxs[i].db;
+    }
+    CU_ASSERT_PTR_NOT_NULL_FATAL(idb);
+    int vsiz;
+    const char *vbuf = tcbdbget3(idb, "all", 3, &vsiz);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(vbuf);
+    CU_ASSERT_TRUE(vsiz < 1500 * 6);
+
+    //Small batches are appended to the stored list unsorted
+    int osiz = vsiz;
+    char *obuf = tcmemdup(vbuf, vsiz);
+    bson_oid_t noids[10];
+    for (int i = 0; i < 10; ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_start_array(&brec, "tags");
+        bson_append_string(&brec, "0", "all");
+        bson_append_string(&brec, "1", "fresh");
+        bson_append_finish_array(&brec);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &noids[i]));
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_TRUE(ejdbsyncoll(coll));
+    vbuf = tcbdbget3(idb, "all", 3, &vsiz);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(vbuf);
+    CU_ASSERT_EQUAL(vsiz, osiz + 10 * (2 + sizeof (bson_oid_t)));
+    CU_ASSERT_EQUAL(memcmp(vbuf, obuf, osiz), 0);
+    TCFREE(obuf);
+    const char *taf[] = {"all", "fresh"};
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", taf, 2), 10);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t3a, 3), 1510);
+
+    //Removal compacts the tail into the sorted list
+    CU_ASSERT_TRUE(ejdbrmbson(coll, &noids[3]));
+    CU_ASSERT_TRUE(ejdbsyncoll(coll));
+    vbuf = tcbdbget3(idb, "all", 3, &vsiz);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(vbuf);
+    CU_ASSERT_TRUE(vsiz < osiz + 9 * (2 + sizeof (bson_oid_t)));
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", taf, 2), 9);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$stror", t3a, 3), 1509);
+    CU_ASSERT_EQUAL(tokenplcount(coll, "$strand", t35, 2), 100);
+}
+
+void testDeferredIdxParallel(void) {
+    EJCOLL *coll = ejdbcreatecoll(jb, "idxparallel", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "status", JBIDXSTR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "label", JBIDXISTR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "score", JBIDXNUM));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "tags", JBIDXARR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "code", JBIDXHASH));
+    bson_oid_t oid;
+    char nbuf[64];
+    for (int i = 0; i < 8000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        bson_append_string(&brec, "status", "new");
+        bson_append_string(&brec, "label", "Draft");
+        bson_append_int(&brec, "score", i);
+        bson_append_start_array(&brec, "tags");
+        bson_append_string(&brec, "0", "red");
+        bson_append_string(&brec, "1", (i % 2) ? "odd" : "even");
+        bson_append_finish_array(&brec);
+        sprintf(nbuf, "c%d", i % 10);
+        bson_append_string(&brec, "code", nbuf);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    //Every field of every matched record changes, all index trees get large batches
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "score");
+    bson_append_int(&bsq, "$gte", 2000);
+    bson_append_finish_object(&bsq);
+    bson_append_start_object(&bsq, "$set");
+    bson_append_string(&bsq, "status", "done");
+    bson_append_string(&bsq, "label", "FINAL");
+    bson_append_int(&bsq, "score", -1);
+    bson_append_start_array(&bsq, "tags");
+    bson_append_string(&bsq, "0", "blue");
+    bson_append_finish_array(&bsq);
+    bson_append_string(&bsq, "code", "closed");
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "nscore"), 6000);
+    bson_destroy(&bsq);
+
+    struct {
+        const char *field;
+        const char *sval;
+        int ival;
+        const char *idxname;
+        uint32_t count;
+    } cases[] = {
+        {"status", "done", 0, "sstatus", 6000},
+        {"status", "new", 0, "sstatus", 2000},
+        {"label", "final", 0, "ilabel", 6000},
+        {"label", "draft", 0, "ilabel", 2000},
+        {"score", NULL, -1, "nscore", 6000},
+        {"score", NULL, 1999, "nscore", 1},
+        {"score", NULL, 2000, "nscore", 0},
+        {"tags", "blue", 0, "atags", 6000},
+        {"tags", "red", 0, "atags", 2000},
+        {"tags", "odd", 0, "atags", 1000},
+        {"code", "closed", 0, "hcode", 6000},
+        {"code", "c3", 0, "hcode", 200}
+    };
+    for (int i = 0; i < sizeof (cases) / sizeof (cases[0]); ++i) {
+        bson_init_as_query(&bsq);
+        if (*cases[i].idxname == 'i') {
+            bson_append_start_object(&bsq, cases[i].field);
+            bson_append_string(&bsq, "$icase", cases[i].sval);
+            bson_append_finish_object(&bsq);
+        } else if (cases[i].sval) {
+            bson_append_string(&bsq, cases[i].field, cases[i].sval);
+        } else {
+            bson_append_int(&bsq, cases[i].field, cases[i].ival);
+        }
+        bson_finish(&bsq);
+        CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, cases[i].idxname), cases[i].count);
+        bson_destroy(&bsq);
+    }
+
+    //Failures of index trees updated in other threads are reported to the caller
+    const char *roidx[] = {"sstatus", "nscore"};
+    const char *rofield[] = {"status", "score"};
+    int rotype[] = {JBIDXSTR, JBIDXNUM};
+    for (int i = 0; i < 2; ++i) {
+        TDBIDX *idx = NULL;
+        for (int j = 0; j < coll->tdb->inum; ++j) {
+            if (!strcmp(coll->tdb->idxs[j].name, roidx[i])) {
+                idx = coll->tdb->idxs + j;
+            }
+        }
+        CU_ASSERT_PTR_NOT_NULL_FATAL(idx);
+        TCBDB *idb = idx->db;
+        idb->wmode = false;
+        tctdbsetecode(jb->metadb, TCESUCCESS, __FILE__, __LINE__, __func__);
+        bson_init_as_query(&bsq);
+        bson_append_start_object(&bsq, "$set");
+        bson_append_string(&bsq, "status", i ? "failed" : "retried");
+        bson_append_int(&bsq, "score", i + 100);
+        bson_append_finish_object(&bsq);
+        bson_finish(&bsq);
+        EJQ *q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+        uint32_t count = 0;
+        ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+        CU_ASSERT_EQUAL(count, 8000);
+        CU_ASSERT_EQUAL(ejdbecode(jb), TCEINVALID);
+        ejdbquerydel(q);
+        bson_destroy(&bsq);
+        idb->wmode = true;
+        CU_ASSERT_TRUE(ejdbsetindex(coll, rofield[i], rotype[i] | JBIDXREBLD));
+    }
+}
+
+void testIdxCacheBudget(void) {
+    CU_ASSERT_FALSE(ejdbsetidxcache(jb, 1024 * 1024)); //database is opened already
+    EJDB *cjb = ejdbnew();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cjb);
+    CU_ASSERT_TRUE(ejdbsetidxcache(cjb, 256 * 1024));
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_idxcache", JBOWRITER | JBOCREAT | JBOTRUNC));
+    EJCOLL *coll = ejdbcreatecoll(cjb, "idxcache", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "name", JBIDXSTR));
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "n", JBIDXNUM));
+    bson_oid_t oid;
+    char nbuf[64];
+    for (int i = 0; i < 30000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(nbuf, "cached index page record %06d", i);
+        bson_append_string(&brec, "name", nbuf);
+        bson_append_int(&brec, "n", i);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        bson_destroy(&brec);
+    }
+    TCBDB *bdb = NULL;
+    int64_t lcsize = 0;
+    for (int i = 0; i < coll->tdb->inum; ++i) {
+        TCBDB *idb = coll->tdb->idxs[i].db;
+        CU_ASSERT_TRUE(idb->cbudget == &cjb->idxcache);
+        lcsize += idb->lcsize;
+        if (!strcmp(coll->tdb->idxs[i].name, "sname")) bdb = idb;
+    }
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bdb);
+    CU_ASSERT_EQUAL(cjb->idxcache.num, 2);
+    CU_ASSERT_EQUAL(cjb->idxcache.size, lcsize);
+    CU_ASSERT_TRUE(cjb->idxcache.size <= cjb->idxcache.limit + 64 * 1024);
+    CU_ASSERT_TRUE(bdb->lnum > TCMAPRNUM(bdb->leafc));
+
+    //Leaf of a looked up key gets a second chance against leaves visited by cursor steps
+    bson bsq;
+    for (int i = 0; i < 10; ++i) {
+        bson_init_as_query(&bsq);
+        bson_append_string(&bsq, "name", "cached index page record 000100");
+        bson_finish(&bsq);
+        CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "sname"), 1);
+        bson_destroy(&bsq);
+    }
+    BDBCUR *cur = tcbdbcurnew(bdb);
+    CU_ASSERT_TRUE(tcbdbcurjump(cur, "cached index page record 000100", 32));
+    uint64_t hotid = cur->id;
+    //each walk loads a quarter more leaves than cached
+    int wnum = TCMAPRNUM(bdb->leafc) * 5 / 4;
+    int rsz;
+    CU_ASSERT_TRUE(tcbdbcurjump(cur, "cached index page record 010000", 31));
+    for (int i = 0; i < wnum && cur->id != hotid; ++i) {
+        uint64_t id = cur->id;
+        while (cur->id == id && tcbdbcurnext(cur));
+    }
+    CU_ASSERT_PTR_NOT_NULL(tcmapget(bdb->leafc, &hotid, sizeof (hotid), &rsz));
+    CU_ASSERT_TRUE(cjb->idxcache.size <= cjb->idxcache.limit + 64 * 1024);
+    //but not a second one without lookups
+    for (int i = 0; i < wnum; ++i) {
+        uint64_t id = cur->id;
+        while (cur->id == id && tcbdbcurnext(cur));
+    }
+    CU_ASSERT_PTR_NULL(tcmapget(bdb->leafc, &hotid, sizeof (hotid), &rsz));
+    tcbdbcurdel(cur);
+
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    CU_ASSERT_EQUAL(cjb->idxcache.num, 0);
+    CU_ASSERT_EQUAL(cjb->idxcache.size, 0);
+    ejdbdel(cjb);
+}
+
+void testFastCompression(void) {
+    EJDB *cjb = ejdbnew();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cjb);
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_lz", JBOWRITER | JBOCREAT | JBOTRUNC));
+    EJCOLLOPTS lzopts = {0};
+    lzopts.fastcompressed = true;
+    EJCOLL *pcoll = ejdbcreatecoll(cjb, "plain", NULL);
+    EJCOLL *coll = ejdbcreatecoll(cjb, "lzcompressed", &lzopts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pcoll);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_FALSE(ejdbtraincompressdict(pcoll, 0)); //not a fast compressed collection
+    CU_ASSERT_EQUAL(ejdbecode(cjb), TCEINVALID);
+    CU_ASSERT_FALSE(ejdbtraincompressdict(coll, 0)); //nothing to learn from
+    CU_ASSERT_EQUAL(ejdbecode(cjb), TCENOREC);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "name", JBIDXSTR));
+
+    bson_oid_t oid, oid1 = {{0}}, oid2 = {{0}};
+    char nbuf[64];
+    for (int i = 0; i < 3000; ++i) {
+        if (i == 1000) {
+            CU_ASSERT_TRUE_FATAL(ejdbtraincompressdict(coll, 4096));
+            CU_ASSERT_PTR_NOT_NULL(coll->lzdict);
+            CU_ASSERT_FALSE(ejdbtraincompressdict(coll, 4096)); //trained already
+        }
+        bson brec;
+        bson_init(&brec);
+        sprintf(nbuf, "compressed record %06d", i);
+        bson_append_string(&brec, "name", nbuf);
+        bson_append_string(&brec, "status", (i % 3) ? "active" : "blocked");
+        bson_append_string(&brec, "address", "Lenina street, Novosibirsk, Russian Federation");
+        bson_append_int(&brec, "age", i % 90);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(pcoll, &brec, &oid));
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, &oid));
+        if (i == 10) oid1 = oid;
+        if (i == 2000) oid2 = oid;
+        bson_destroy(&brec);
+    }
+    CU_ASSERT_TRUE(coll->tdb->hdb->fsiz - coll->tdb->hdb->frec <
+                   (pcoll->tdb->hdb->fsiz - pcoll->tdb->hdb->frec) * 3 / 4);
+
+    bson *meta = ejdbmeta(cjb);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(meta);
+    bson_iterator it;
+    BSON_ITERATOR_INIT(&it, meta);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("collections.0.options.fastcompressed", &it), BSON_BOOL);
+    CU_ASSERT_TRUE(bson_iterator_bool(&it));
+    bson_del(meta);
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+
+    //Records written before and after training are readable after reopening
+    cjb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_lz", JBOWRITER));
+    coll = ejdbgetcoll(cjb, "lzcompressed");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_PTR_NOT_NULL(coll->lzdict);
+    bson *bv = ejdbloadbson(coll, &oid1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+    BSON_ITERATOR_INIT(&it, bv);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("name", &it), BSON_STRING);
+    CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "compressed record 000010");
+    bson_del(bv);
+    bv = ejdbloadbson(coll, &oid2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+    BSON_ITERATOR_INIT(&it, bv);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("address", &it), BSON_STRING);
+    CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "Lenina street, Novosibirsk, Russian Federation");
+    bson_del(bv);
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "name");
+    bson_append_string(&bsq, "$begin", "compressed record 001");
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "sname"), 1000);
+    bson_destroy(&bsq);
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "blocked");
+    bson_finish(&bsq);
+    uint32_t count = 0;
+    EJQ *q = ejdbcreatequery(cjb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+    CU_ASSERT_EQUAL(count, 1000);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+}
+
+void testWriteBehind(void) {
+    EJDB *cjb = ejdbnew();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cjb);
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_wb", JBOWRITER | JBOCREAT | JBOTRUNC));
+    EJCOLLOPTS wbopts = {0};
+    wbopts.compressed = true;
+    wbopts.writebehind = 64 * 1024;
+    EJCOLL *coll = ejdbcreatecoll(cjb, "buffered", &wbopts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll->tdb->hdb->wbrecs);
+    CU_ASSERT_TRUE_FATAL(ejdbsetindex(coll, "name", JBIDXSTR));
+
+    bson_oid_t oids[2000];
+    char nbuf[64];
+    for (int i = 0; i < 2000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(nbuf, "buffered record %06d", i);
+        bson_append_string(&brec, "name", nbuf);
+        bson_append_string(&brec, "status", (i % 4) ? "active" : "blocked");
+        bson_append_int(&brec, "age", i % 90);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, oids + i));
+        bson_destroy(&brec);
+    }
+    //Update records many times, the last value wins
+    for (int j = 0; j < 3; ++j) {
+        for (int i = 0; i < 500; ++i) {
+            bson brec;
+            bson_init(&brec);
+            bson_append_oid(&brec, JDBIDKEYNAME, oids + i);
+            sprintf(nbuf, "buffered record %06d", i);
+            bson_append_string(&brec, "name", nbuf);
+            bson_append_string(&brec, "status", "updated");
+            bson_append_int(&brec, "age", j);
+            bson_finish(&brec);
+            CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, oids + i));
+            bson_destroy(&brec);
+        }
+    }
+    CU_ASSERT_EQUAL(coll->tdb->hdb->rnum, 2000);
+    bson_iterator it;
+    bson *bv = ejdbloadbson(coll, oids + 10);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+    BSON_ITERATOR_INIT(&it, bv);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("age", &it), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 2);
+    bson_del(bv);
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "status", "updated");
+    bson_finish(&bsq);
+    uint32_t count = 0;
+    EJQ *q = ejdbcreatequery(cjb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+    CU_ASSERT_EQUAL(count, 500);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+
+    CU_ASSERT_TRUE(ejdbsyncoll(coll));
+    CU_ASSERT_EQUAL(TCMAPRNUM(coll->tdb->hdb->wbrecs), 0);
+    CU_ASSERT_EQUAL(coll->tdb->hdb->wbsize, 0);
+    CU_ASSERT_EQUAL(coll->tdb->hdb->rnum, 2000);
+
+    bson *meta = ejdbmeta(cjb);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(meta);
+    BSON_ITERATOR_INIT(&it, meta);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("collections.0.options.writebehind", &it), BSON_LONG);
+    CU_ASSERT_EQUAL(bson_iterator_long(&it), 64 * 1024);
+    bson_del(meta);
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+
+    //Buffered records are written on close
+    cjb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_wb", JBOWRITER));
+    coll = ejdbgetcoll(cjb, "buffered");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_EQUAL(coll->tdb->hdb->wbmax, 64 * 1024);
+    CU_ASSERT_EQUAL(coll->tdb->hdb->rnum, 2000);
+    bv = ejdbloadbson(coll, oids + 499);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+    BSON_ITERATOR_INIT(&it, bv);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("status", &it), BSON_STRING);
+    CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "updated");
+    bson_del(bv);
+    bv = ejdbloadbson(coll, oids + 1999);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+    BSON_ITERATOR_INIT(&it, bv);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("name", &it), BSON_STRING);
+    CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "buffered record 001999");
+    bson_del(bv);
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "name");
+    bson_append_string(&bsq, "$begin", "buffered record 001");
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    CU_ASSERT_EQUAL(deferredidxcount(coll, &bsq, "sname"), 1000);
+    bson_destroy(&bsq);
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+
+    //Asynchronous stores go through the buffer too
+    TCHDB *hdb = tchdbnew();
+    tchdbsetmutex(hdb);
+    CU_ASSERT_TRUE_FATAL(tchdbsetwritebehind(hdb, 64 * 1024));
+    CU_ASSERT_TRUE_FATAL(tchdbopen(hdb, "dbt2_wb_hdb", HDBOWRITER | HDBOCREAT | HDBOTRUNC));
+    CU_ASSERT_TRUE(tchdbput2(hdb, "key", "old"));
+    CU_ASSERT_TRUE(tchdbputasync2(hdb, "key", "new"));
+    CU_ASSERT_TRUE(tchdbputasync2(hdb, "key2", "async"));
+    char *val = tchdbget2(hdb, "key");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+    CU_ASSERT_STRING_EQUAL(val, "new");
+    TCFREE(val);
+    CU_ASSERT_EQUAL(tchdbrnum(hdb), 2);
+    CU_ASSERT_TRUE(tchdbsync(hdb));
+    val = tchdbget2(hdb, "key");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+    CU_ASSERT_STRING_EQUAL(val, "new");
+    TCFREE(val);
+    CU_ASSERT_EQUAL(tchdbrnum(hdb), 2);
+    CU_ASSERT_TRUE(tchdbclose(hdb));
+    tchdbdel(hdb);
+
+    //Records of a failed flush stay buffered until they are written
+    hdb = tchdbnew();
+    tchdbsetmutex(hdb);
+    CU_ASSERT_TRUE_FATAL(tchdbsetwritebehind(hdb, 64 * 1024 * 1024));
+    CU_ASSERT_TRUE_FATAL(tchdbopen(hdb, "dbt2_wb_hdb", HDBOWRITER | HDBOCREAT | HDBOTRUNC));
+    CU_ASSERT_TRUE(tchdbput2(hdb, "key", "old"));
+    CU_ASSERT_TRUE(tchdbsync(hdb));
+    struct stat sbuf;
+    CU_ASSERT_EQUAL_FATAL(stat("dbt2_wb_hdb", &sbuf), 0);
+    struct rlimit orlim, rlim;
+    CU_ASSERT_EQUAL_FATAL(getrlimit(RLIMIT_FSIZE, &orlim), 0);
+    void (*osig)(int) = signal(SIGXFSZ, SIG_IGN);
+    rlim = orlim;
+    rlim.rlim_cur = sbuf.st_size;
+    CU_ASSERT_EQUAL_FATAL(setrlimit(RLIMIT_FSIZE, &rlim), 0);
+    char *big;
+    TCMALLOC(big, 64 * 1024);
+    char kbuf[64];
+    for (int i = 0; i < 64; ++i) {
+        memset(big, 'a' + i % 26, 64 * 1024 - 1);
+        big[64 * 1024 - 1] = '\0';
+        sprintf(kbuf, "big%02d", i);
+        CU_ASSERT_TRUE(tchdbput2(hdb, kbuf, big));
+    }
+    CU_ASSERT_FALSE(tchdbsync(hdb));
+    for (int i = 0; i < 3 && !tchdbput2(hdb, "big63", "newer"); ++i); //a background failure is reported once
+    CU_ASSERT_EQUAL(tchdbrnum(hdb), 65);
+    CU_ASSERT_EQUAL(setrlimit(RLIMIT_FSIZE, &orlim), 0);
+    signal(SIGXFSZ, osig);
+    bool synced = false;
+    for (int i = 0; i < 3 && !(synced = tchdbsync(hdb)); ++i);
+    CU_ASSERT_TRUE(synced);
+    CU_ASSERT_EQUAL(TCMAPRNUM(hdb->wbrecs), 0);
+    CU_ASSERT_EQUAL(tchdbrnum(hdb), 65);
+    for (int i = 0; i < 63; ++i) {
+        sprintf(kbuf, "big%02d", i);
+        val = tchdbget2(hdb, kbuf);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+        CU_ASSERT_EQUAL(strlen(val), 64 * 1024 - 1);
+        CU_ASSERT_EQUAL(val[0], 'a' + i % 26);
+        TCFREE(val);
+    }
+    val = tchdbget2(hdb, "big63");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+    CU_ASSERT_STRING_EQUAL(val, "newer");
+    TCFREE(val);
+    TCFREE(big);
+    CU_ASSERT_TRUE(tchdbclose(hdb));
+    tchdbdel(hdb);
+    hdb = tchdbnew();
+    CU_ASSERT_TRUE_FATAL(tchdbopen(hdb, "dbt2_wb_hdb", HDBOREADER));
+    CU_ASSERT_EQUAL(tchdbrnum(hdb), 65);
+    val = tchdbget2(hdb, "big00");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+    CU_ASSERT_EQUAL(strlen(val), 64 * 1024 - 1);
+    TCFREE(val);
+    CU_ASSERT_TRUE(tchdbclose(hdb));
+    tchdbdel(hdb);
+}
+
+void testBackgroundDefrag(void) {
+    EJDB *cjb = ejdbnew();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cjb);
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_df", JBOWRITER | JBOCREAT | JBOTRUNC));
+    EJCOLLOPTS dfopts = {0};
+    dfopts.bgdefrag = 1;
+    EJCOLL *coll = ejdbcreatecoll(cjb, "churn", &dfopts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_PTR_NOT_NULL(coll->tdb->hdb->dfthr);
+    TCHDB *hdb = coll->tdb->hdb;
+
+    bson_oid_t oids[3000];
+    char nbuf[512];
+    for (int i = 0; i < 3000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(nbuf, "churn record %06d", i);
+        bson_append_string(&brec, "name", nbuf);
+        memset(nbuf, 'a' + i % 26, 200);
+        nbuf[200] = '\0';
+        bson_append_string(&brec, "payload", nbuf);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, oids + i));
+        bson_destroy(&brec);
+    }
+    //Leave holes all over the file
+    for (int i = 0; i < 3000; ++i) {
+        if (i % 3) {
+            CU_ASSERT_TRUE_FATAL(ejdbrmbson(coll, oids + i));
+        }
+    }
+    CU_ASSERT_TRUE(ejdbsyncoll(coll));
+    uint64_t fsiz = hdb->fsiz;
+    for (int i = 0; i < 200 && hdb->dfpasses == 0; ++i) {
+        tcsleep(0.05);
+    }
+    CU_ASSERT_TRUE(hdb->dfpasses > 0);
+    CU_ASSERT_TRUE(hdb->dfmoved > 0);
+    CU_ASSERT_TRUE(hdb->dftrunc > 0);
+    CU_ASSERT_TRUE(hdb->fsiz < fsiz);
+
+    bson *meta = ejdbmeta(cjb);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(meta);
+    bson_iterator it;
+    BSON_ITERATOR_INIT(&it, meta);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("collections.0.options.bgdefrag", &it), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), 1);
+    BSON_ITERATOR_INIT(&it, meta);
+    CU_ASSERT_EQUAL(bson_find_fieldpath_value("collections.0.defrag.passes", &it), BSON_LONG);
+    CU_ASSERT_TRUE(bson_iterator_long(&it) > 0);
+    bson_del(meta);
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+
+    //Moved records are intact
+    cjb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_df", JBOREADER));
+    coll = ejdbgetcoll(cjb, "churn");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_PTR_NULL(coll->tdb->hdb->dfthr);
+    CU_ASSERT_EQUAL(coll->tdb->hdb->rnum, 1000);
+    for (int i = 0; i < 3000; i += 3) {
+        bson *bv = ejdbloadbson(coll, oids + i);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+        BSON_ITERATOR_INIT(&it, bv);
+        CU_ASSERT_EQUAL_FATAL(bson_find_fieldpath_value("name", &it), BSON_STRING);
+        sprintf(nbuf, "churn record %06d", i);
+        CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), nbuf);
+        bson_del(bv);
+    }
+    CU_ASSERT_PTR_NULL(ejdbloadbson(coll, oids + 1));
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+}
+
+void testAsyncRead(void) {
+    EJDB *cjb = ejdbnew();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cjb);
+    CU_ASSERT_FALSE(ejdbsetaio(cjb, -1));
+    CU_ASSERT_TRUE_FATAL(ejdbsetaio(cjb, 32));
+    CU_ASSERT_TRUE_FATAL(ejdbopen(cjb, "dbt2_aio", JBOWRITER | JBOCREAT | JBOTRUNC));
+    CU_ASSERT_FALSE(ejdbsetaio(cjb, 16));
+    EJCOLL *coll = ejdbcreatecoll(cjb, "items", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    //Platforms without io_uring keep synchronous reads
+    TCHDB *hdb = coll->tdb->hdb;
+    bool aio = (hdb->aio != NULL);
+
+    bson_oid_t oids[1000];
+    char nbuf[64];
+    for (int i = 0; i < 1000; ++i) {
+        bson brec;
+        bson_init(&brec);
+        sprintf(nbuf, "item %04d", i);
+        bson_append_string(&brec, "name", nbuf);
+        bson_append_int(&brec, "num", i);
+        bson_finish(&brec);
+        CU_ASSERT_TRUE_FATAL(ejdbsavebson(coll, &brec, oids + i));
+        bson_destroy(&brec);
+    }
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_start_object(&bsq, "_id");
+    bson_append_start_array(&bsq, "$in");
+    for (int i = 0; i < 1000; i += 2) {
+        char oidstr[25];
+        bson_oid_to_string(oids + i, oidstr);
+        bson_numstrn(nbuf, sizeof (nbuf), i / 2);
+        bson_append_string(&bsq, nbuf, oidstr);
+    }
+    bson_append_finish_array(&bsq);
+    bson_append_finish_object(&bsq);
+    bson_finish(&bsq);
+    uint32_t count = 0;
+    EJQ *q = ejdbcreatequery(cjb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+    CU_ASSERT_EQUAL(count, 500);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+    CU_ASSERT_TRUE(ejdbclose(cjb));
+    ejdbdel(cjb);
+
+    //Records beyond the mapped region are read in batches into the record cache
+    hdb = tchdbnew();
+    tchdbsetmutex(hdb);
+    CU_ASSERT_TRUE_FATAL(tchdbsetxmsiz(hdb, 4096));
+    CU_ASSERT_EQUAL(tchdbsetaio(hdb, 32), aio);
+    CU_ASSERT_TRUE_FATAL(tchdbopen(hdb, "dbt2_aio_hdb", HDBOWRITER | HDBOCREAT | HDBOTRUNC));
+    CU_ASSERT_FALSE(tchdbsetaio(hdb, 32));
+    char vbuf[300];
+    memset(vbuf, 'v', sizeof (vbuf));
+    TCLIST *keys = tclistnew();
+    for (int i = 0; i < 2000; ++i) {
+        int ksiz = sprintf(nbuf, "key%05d", i);
+        CU_ASSERT_TRUE_FATAL(tchdbput(hdb, nbuf, ksiz, vbuf, 100 + i % 200));
+        if (i % 7 == 0) {
+            TCLISTPUSH(keys, nbuf, ksiz);
+        }
+    }
+    TCLISTPUSH(keys, "missing", 7);
+    CU_ASSERT_TRUE(hdb->fsiz > hdb->xmsiz);
+    int knum = TCLISTNUM(keys);
+    int64_t offs[knum], aoffs[knum];
+    int32_t sizs[knum], asizs[knum];
+    CU_ASSERT_TRUE_FATAL(tchdbrecoffs(hdb, keys, aoffs, asizs));
+    uint64_t roffs[knum], rlens[knum];
+    for (int i = 0; i < knum - 1; ++i) {
+        roffs[i] = aoffs[i];
+        rlens[i] = asizs[i];
+    }
+    CU_ASSERT_TRUE(tchdbreadahead2(hdb, roffs, rlens, knum - 1));
+    CU_ASSERT_TRUE(tchdbprefetch(hdb, keys));
+    if (aio) {
+        CU_ASSERT_EQUAL(tcmdbrnum(hdb->recc), knum - 1);
+    }
+    for (int i = 0; i < knum - 1; ++i) {
+        int ksiz = sprintf(nbuf, "key%05d", i * 7);
+        int vsiz;
+        char *val = tchdbget(hdb, nbuf, ksiz, &vsiz);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+        CU_ASSERT_EQUAL(vsiz, 100 + (i * 7) % 200);
+        CU_ASSERT_FALSE(memcmp(val, vbuf, vsiz));
+        TCFREE(val);
+    }
+    CU_ASSERT_PTR_NULL(tchdbget2(hdb, "missing"));
+    //Prefetched records are not served stale after an update
+    CU_ASSERT_TRUE(tchdbprefetch(hdb, keys));
+    CU_ASSERT_TRUE(tchdbput2(hdb, "key00007", "updated"));
+    char *val = tchdbget2(hdb, "key00007");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(val);
+    CU_ASSERT_STRING_EQUAL(val, "updated");
+    TCFREE(val);
+    CU_ASSERT_TRUE(tchdbclose(hdb));
+    tchdbdel(hdb);
+
+    hdb = tchdbnew();
+    CU_ASSERT_TRUE_FATAL(tchdbopen(hdb, "dbt2_aio_hdb", HDBOREADER));
+    CU_ASSERT_PTR_NULL(hdb->aio);
+    CU_ASSERT_TRUE_FATAL(tchdbrecoffs(hdb, keys, offs, sizs));
+    for (int i = 0; i < knum; ++i) {
+        CU_ASSERT_EQUAL(aoffs[i], offs[i]);
+        CU_ASSERT_EQUAL(asizs[i], sizs[i]);
+    }
+    CU_ASSERT_TRUE(offs[0] > 0);
+    CU_ASSERT_TRUE(offs[knum - 1] < 0);
+    CU_ASSERT_TRUE(tchdbclose(hdb));
+    tchdbdel(hdb);
+    tclistdel(keys);
+}
+
 int main() {
     setlocale(LC_ALL, "en_US.UTF-8");
     CU_pSuite pSuite = NULL;
@@ -5923,6 +8063,27 @@ int main() {
             (NULL == CU_add_test(pSuite, "testDistinct", testDistinct)) ||
 			(NULL == CU_add_test(pSuite, "testSlice", testSlice)) ||
 			(NULL == CU_add_test(pSuite, "testTicket117", testTicket117)) ||
+            (NULL == CU_add_test(pSuite, "testRegexPrefixIdx", testRegexPrefixIdx)) ||
+            (NULL == CU_add_test(pSuite, "testFetchSorted", testFetchSorted)) ||
+            (NULL == CU_add_test(pSuite, "testPartialIndex", testPartialIndex)) ||
+            (NULL == CU_add_test(pSuite, "testHashIndex", testHashIndex)) ||
+            (NULL == CU_add_test(pSuite, "testInModes", testInModes)) ||
+            (NULL == CU_add_test(pSuite, "testInplaceUpdate", testInplaceUpdate)) ||
+            (NULL == CU_add_test(pSuite, "testDistinctModes", testDistinctModes)) ||
+            (NULL == CU_add_test(pSuite, "testAggregate", testAggregate)) ||
+            (NULL == CU_add_test(pSuite, "testScanBatchNumeric", testScanBatchNumeric)) ||
+            (NULL == CU_add_test(pSuite, "testFieldPathSections", testFieldPathSections)) ||
+            (NULL == CU_add_test(pSuite, "testICaseFormat", testICaseFormat)) ||
+            (NULL == CU_add_test(pSuite, "testDeferredIdxBatch", testDeferredIdxBatch)) ||
+            (NULL == CU_add_test(pSuite, "testIdxCursorBatch", testIdxCursorBatch)) ||
+            (NULL == CU_add_test(pSuite, "testBDBLeafFormat", testBDBLeafFormat)) ||
+            (NULL == CU_add_test(pSuite, "testTokenPostings", testTokenPostings)) ||
+            (NULL == CU_add_test(pSuite, "testDeferredIdxParallel", testDeferredIdxParallel)) ||
+            (NULL == CU_add_test(pSuite, "testIdxCacheBudget", testIdxCacheBudget)) ||
+            (NULL == CU_add_test(pSuite, "testFastCompression", testFastCompression)) ||
+            (NULL == CU_add_test(pSuite, "testWriteBehind", testWriteBehind)) ||
+            (NULL == CU_add_test(pSuite, "testBackgroundDefrag", testBackgroundDefrag)) ||
+            (NULL == CU_add_test(pSuite, "testAsyncRead", testAsyncRead)) ||
             (NULL == CU_add_test(pSuite, "testMetaInfo", testMetaInfo))
     ) {
         CU_cleanup_registry();
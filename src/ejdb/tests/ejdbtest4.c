@@ -330,6 +330,274 @@ void testBSONExportImport2() {
     bson_del(nmeta);
 }
 
+void testBSONImportBulk() {
+    EJDB *jb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(jb, "dbt4_bulk", JBOWRITER | JBOCREAT | JBOTRUNC));
+    EJCOLL *coll = ejdbcreatecoll(jb, "bulk", NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    CU_ASSERT_TRUE(ejdbsetindex(coll, "n", JBIDXNUM));
+    CU_ASSERT_TRUE(ejdbsetindex(coll, "s", JBIDXSTR));
+    bson_oid_t oid;
+    char sval[32];
+    for (int i = 0; i < 3000; ++i) {
+        bson bv1;
+        bson_init(&bv1);
+        bson_append_int(&bv1, "n", i);
+        sprintf(sval, "s%d", i % 10);
+        bson_append_string(&bv1, "s", sval);
+        bson_finish(&bv1);
+        CU_ASSERT_TRUE(ejdbsavebson(coll, &bv1, &oid));
+        bson_destroy(&bv1);
+    }
+    //Document larger than import read buffer
+    int bigsz = 5 * 1024 * 1024;
+    char *big = malloc(bigsz + 1);
+    memset(big, 'x', bigsz);
+    big[bigsz] = '\0';
+    bson bv1;
+    bson_init(&bv1);
+    bson_append_int(&bv1, "n", 5000);
+    bson_append_string(&bv1, "big", big);
+    bson_finish(&bv1);
+    CU_ASSERT_TRUE(ejdbsavebson(coll, &bv1, &oid));
+    bson_destroy(&bv1);
+    free(big);
+
+    CU_ASSERT_TRUE(ejdbexport(jb, "testBSONImportBulk", NULL, 0, NULL));
+    ejdbclose(jb);
+    ejdbdel(jb);
+
+    jb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(jb, "dbt4_bulk", JBOWRITER | JBOCREAT | JBOTRUNC));
+    TCXSTR *log = tcxstrnew();
+    CU_ASSERT_TRUE(ejdbimport(jb, "testBSONImportBulk", NULL, JBIMPORTREPLACE, log));
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "3001 objects imported into 'bulk'"));
+    tcxstrdel(log);
+
+    coll = ejdbgetcoll(jb, "bulk");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "s", "s7");
+    bson_finish(&bsq);
+    EJQ *q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    uint32_t count = 0;
+    log = tcxstrnew();
+    ejdbqryexecute(coll, q, &count, JBQRYCOUNT, log);
+    CU_ASSERT_EQUAL(count, 300);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "MAIN IDX: 'ss'"));
+    tcxstrdel(log);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_int(&bsq, "n", 5000);
+    bson_finish(&bsq);
+    q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    log = tcxstrnew();
+    TCLIST *res = ejdbqryexecute(coll, q, &count, 0, log);
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "MAIN IDX: 'nn'"));
+    if (TCLISTNUM(res) == 1) {
+        bson_iterator it;
+        CU_ASSERT_EQUAL(bson_find_from_buffer(&it, TCLISTVALPTR(res, 0), "big"), BSON_STRING);
+        CU_ASSERT_EQUAL(bson_iterator_string_len(&it), bigsz + 1);
+    }
+    tclistdel(res);
+    tcxstrdel(log);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+    ejdbclose(jb);
+    ejdbdel(jb);
+}
+
+void testBSONExportParallel() {
+    EJDB *jb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(jb, "dbt4_pexport", JBOWRITER | JBOCREAT | JBOTRUNC));
+    char cname[32];
+    bson_oid_t oid;
+    for (int c = 0; c < 6; ++c) {
+        sprintf(cname, "pcoll%d", c);
+        EJCOLL *coll = ejdbcreatecoll(jb, cname, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+        for (int i = 0; i < 100 * (c + 1); ++i) {
+            bson bv1;
+            bson_init(&bv1);
+            bson_append_int(&bv1, "n", i);
+            bson_append_string(&bv1, "c", cname);
+            bson_finish(&bv1);
+            CU_ASSERT_TRUE(ejdbsavebson(coll, &bv1, &oid));
+            bson_destroy(&bv1);
+        }
+    }
+    TCXSTR *log = tcxstrnew();
+    CU_ASSERT_TRUE(ejdbexport(jb, "testBSONExportParallel", NULL, 0, log));
+    CU_ASSERT_PTR_NULL(strstr(TCXSTRPTR(log), "ERROR"));
+    tcxstrdel(log);
+
+    int zsiz;
+    char *zbuf = tcgzipencode("{}", 2, &zsiz);
+    if (zbuf) { //GZIP compression is available
+        TCFREE(zbuf);
+        TCLIST *cnames = tclistnew();
+        tclistpush2(cnames, "pcoll0");
+        CU_ASSERT_TRUE(ejdbexport(jb, "testBSONExportParallel", cnames, JBJSONEXPORT | JBEXPORTGZIP, NULL));
+        tclistdel(cnames);
+        zbuf = tcreadfile("testBSONExportParallel/pcoll0.json.gz", 0, &zsiz);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(zbuf);
+        int jsiz;
+        char *jbuf = tcgzipdecode(zbuf, zsiz, &jsiz);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(jbuf);
+        CU_ASSERT_EQUAL(*jbuf, '{');
+        CU_ASSERT_PTR_NOT_NULL(strstr(jbuf, "\"c\" : \"pcoll0\""));
+        TCFREE(jbuf);
+        TCFREE(zbuf);
+    }
+    ejdbclose(jb);
+    ejdbdel(jb);
+
+    jb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(jb, "dbt4_pexport", JBOWRITER | JBOCREAT | JBOTRUNC));
+    log = tcxstrnew();
+    CU_ASSERT_TRUE(ejdbimport(jb, "testBSONExportParallel", NULL, JBIMPORTREPLACE, log));
+    char msg[64];
+    for (int c = 0; c < 6; ++c) {
+        sprintf(msg, "%d objects imported into 'pcoll%d'", 100 * (c + 1), c);
+        CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), msg));
+        sprintf(cname, "pcoll%d", c);
+        EJCOLL *coll = ejdbgetcoll(jb, cname);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+        bson bsq;
+        bson_init_as_query(&bsq);
+        bson_append_string(&bsq, "c", cname);
+        bson_finish(&bsq);
+        EJQ *q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+        uint32_t count = 0;
+        ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+        CU_ASSERT_EQUAL(count, 100 * (c + 1));
+        ejdbquerydel(q);
+        bson_destroy(&bsq);
+    }
+    tcxstrdel(log);
+    ejdbclose(jb);
+    ejdbdel(jb);
+}
+
+void testJSONImport() {
+    EJDB *jb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(jb, "dbt4_jimport", JBOWRITER | JBOCREAT | JBOTRUNC));
+
+    //Hand written feed: escapes, unicode, nested values, ObjectId keys
+    mkdir("testJSONImport", 00755);
+    TCXSTR *feed = tcxstrnew();
+    tcxstrcat2(feed, "{\"_id\" : \"51b0d1fd7c0a6e9df1e4b2a1\", \"name\" : \"caf\\u00e9 \\\"x\\\"\\n\", \"n\" : -12, \"l\" : 5000000000}\n");
+    tcxstrcat2(feed, "{\"d\":1.5e2,\"t\":true,\"f\":false,\"z\":null,\"a\":[1,\"two\",{\"three\":3},[]],\"o\":{\"p\":{\"q\":\"\\ud83d\\ude00\"}}}\r\n");
+    tcxstrcat2(feed, "\n  {}\n");
+    char pad[201];
+    memset(pad, 'p', 200);
+    pad[200] = '\0';
+    for (int i = 0; i < 20000; ++i) { //crosses import read buffer boundary
+        tcxstrprintf(feed, "{\"i\" : %d, \"s\" : \"value%d\", \"pad\" : \"", i, i % 10);
+        tcxstrcat2(feed, pad);
+        tcxstrcat2(feed, "\"}\n");
+    }
+    CU_ASSERT_TRUE(tcwritefile("testJSONImport/events.json", TCXSTRPTR(feed), TCXSTRSIZE(feed)));
+    tcxstrdel(feed);
+
+    TCXSTR *log = tcxstrnew();
+    CU_ASSERT_TRUE(ejdbimport(jb, "testJSONImport", NULL, JBJSONIMPORT, log));
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "20003 objects imported into 'events'"));
+    tcxstrdel(log);
+
+    EJCOLL *coll = ejdbgetcoll(jb, "events");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bson_oid_t oid;
+    bson_oid_from_string(&oid, "51b0d1fd7c0a6e9df1e4b2a1");
+    bson *bv = ejdbloadbson(coll, &oid);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bv);
+    bson_iterator it;
+    CU_ASSERT_EQUAL(bson_find(&it, bv, "name"), BSON_STRING);
+    CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "caf\xc3\xa9 \"x\"\n");
+    CU_ASSERT_EQUAL(bson_find(&it, bv, "n"), BSON_INT);
+    CU_ASSERT_EQUAL(bson_iterator_int(&it), -12);
+    CU_ASSERT_EQUAL(bson_find(&it, bv, "l"), BSON_LONG);
+    CU_ASSERT_EQUAL(bson_iterator_long(&it), 5000000000LL);
+    bson_del(bv);
+
+    bson bsq;
+    bson_init_as_query(&bsq);
+    bson_append_bool(&bsq, "t", true);
+    bson_finish(&bsq);
+    EJQ *q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    uint32_t count = 0;
+    TCLIST *res = ejdbqryexecute(coll, q, &count, 0, NULL);
+    CU_ASSERT_EQUAL(count, 1);
+    if (TCLISTNUM(res) == 1) {
+        const void *bsdata = TCLISTVALPTR(res, 0);
+        CU_ASSERT_EQUAL(bson_find_from_buffer(&it, bsdata, "d"), BSON_DOUBLE);
+        CU_ASSERT_DOUBLE_EQUAL(bson_iterator_double(&it), 150.0, 0.0001);
+        CU_ASSERT_EQUAL(bson_find_from_buffer(&it, bsdata, "f"), BSON_BOOL);
+        CU_ASSERT_EQUAL(bson_find_from_buffer(&it, bsdata, "z"), BSON_NULL);
+        BSON_ITERATOR_FROM_BUFFER(&it, bsdata);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("a.1", &it), BSON_STRING);
+        CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "two");
+        BSON_ITERATOR_FROM_BUFFER(&it, bsdata);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("a.2.three", &it), BSON_INT);
+        BSON_ITERATOR_FROM_BUFFER(&it, bsdata);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("a.3", &it), BSON_ARRAY);
+        BSON_ITERATOR_FROM_BUFFER(&it, bsdata);
+        CU_ASSERT_EQUAL(bson_find_fieldpath_value("o.p.q", &it), BSON_STRING);
+        CU_ASSERT_STRING_EQUAL(bson_iterator_string(&it), "\xf0\x9f\x98\x80");
+    }
+    tclistdel(res);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+
+    bson_init_as_query(&bsq);
+    bson_append_string(&bsq, "s", "value3");
+    bson_finish(&bsq);
+    q = ejdbcreatequery(jb, &bsq, NULL, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    ejdbqryexecute(coll, q, &count, JBQRYCOUNT, NULL);
+    CU_ASSERT_EQUAL(count, 2000);
+    ejdbquerydel(q);
+    bson_destroy(&bsq);
+
+    //JSON export is importable as JSON feed with the same object ids
+    CU_ASSERT_TRUE(ejdbexport(jb, "testJSONImport2", NULL, JBJSONEXPORT, NULL));
+    ejdbclose(jb);
+    ejdbdel(jb);
+
+    jb = ejdbnew();
+    CU_ASSERT_TRUE_FATAL(ejdbopen(jb, "dbt4_jimport", JBOWRITER | JBOCREAT | JBOTRUNC));
+    log = tcxstrnew();
+    CU_ASSERT_TRUE(ejdbimport(jb, "testJSONImport2", NULL, JBJSONIMPORT | JBIMPORTREPLACE, log));
+    CU_ASSERT_PTR_NOT_NULL(strstr(TCXSTRPTR(log), "20003 objects imported into 'events'"));
+    tcxstrdel(log);
+    coll = ejdbgetcoll(jb, "events");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(coll);
+    bv = ejdbloadbson(coll, &oid);
+    CU_ASSERT_PTR_NOT_NULL(bv);
+    if (bv) {
+        bson_del(bv);
+    }
+
+    //Malformed feed
+    mkdir("testJSONImport3", 00755);
+    const char *bad = "{\"a\" : 1}\n{\"b\" : [1, 2}\n";
+    CU_ASSERT_TRUE(tcwritefile("testJSONImport3/bad.json", bad, strlen(bad)));
+    log = tcxstrnew();
+    CU_ASSERT_FALSE(ejdbimport(jb, "testJSONImport3", NULL, JBJSONIMPORT, log));
+    CU_ASSERT_EQUAL(ejdbecode(jb), JBEEJSONPARSE);
+    tcxstrdel(log);
+    ejdbclose(jb);
+    ejdbdel(jb);
+}
+
 int init_suite(void) {
     return 0;
 }
@@ -357,7 +625,10 @@ int main() {
     if (
             (NULL == CU_add_test(pSuite, "testTicket53", testTicket53)) ||
             (NULL == CU_add_test(pSuite, "testBSONExportImport", testBSONExportImport)) ||
-            (NULL == CU_add_test(pSuite, "testBSONExportImport2", testBSONExportImport2))
+            (NULL == CU_add_test(pSuite, "testBSONExportImport2", testBSONExportImport2)) ||
+            (NULL == CU_add_test(pSuite, "testBSONImportBulk", testBSONImportBulk)) ||
+            (NULL == CU_add_test(pSuite, "testBSONExportParallel", testBSONExportParallel)) ||
+            (NULL == CU_add_test(pSuite, "testJSONImport", testJSONImport))
             ) {
         CU_cleanup_registry();
         return CU_get_error();
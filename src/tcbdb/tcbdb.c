@@ -26,6 +26,8 @@
 #define BDBNODEIDBASE  ((1LL<<48)+1)     // base number of node ID
 #define BDBLEVELMAX    64                // max level of B+ tree
 #define BDBCACHEOUT    8                 // number of pages in a process of cacheout
+#define BDBCACHESCAN   128               // number of leaves looked through for scanned ones
+#define BDBCACHEKEEP   1                 // number of the most recently used leaves never released
 
 #define BDBDEFLMEMB    128               // default number of members in each leaf
 #define BDBMINLMEMB    4                 // minimum number of members in each leaf
@@ -39,6 +41,11 @@
 #define BDBDEFLSMAX    16384             // default maximum size of each leaf
 #define BDBMINLSMAX    512               // minimum maximum size of each leaf
 
+enum { // enumeration for formats of serialized leaves
+    BDBLFPLAIN = 0, // keys are stored entirely
+    BDBLFPREFIX = 1 // keys are front coded against the previous key of the leaf
+};
+
 typedef struct { // type of structure for a record
     int ksiz; // size of the key region
     int vsiz; // size of the value region
@@ -51,8 +58,10 @@ typedef struct { // type of structure for a leaf page
     int size; // predicted size of serialized buffer
     uint64_t prev; // ID number of the previous leaf
     uint64_t next; // ID number of the next leaf
+    int csize; // size charged to the leaf cache
     bool dirty; // whether to be written back
     bool dead; // whether to be removed
+    bool hot; // whether found by a key lookup since passed by the cache adjustment
 } BDBLEAF;
 
 typedef struct { // type of structure for a page index
@@ -96,6 +105,13 @@ typedef struct { // type of structure for a duplication callback
   ((TC_bdb)->mmtx ? tcbdbunlockcache(TC_bdb) : true)
 #define BDBTHREADYIELD(TC_bdb)                          \
   do { if((TC_bdb)->mmtx) sched_yield(); } while(false)
+#define BDBCACHEOVER(TC_bdb)                                            \
+  (TCMAPRNUM((TC_bdb)->leafc) > (TC_bdb)->lcnum ||                      \
+   (!(TC_bdb)->cbudget && TCMAPRNUM((TC_bdb)->nodec) > (TC_bdb)->ncnum) || \
+   ((TC_bdb)->cbudget && tcbdbcacheexcess(TC_bdb) > 0))
+#define BDBLEAFCSIZE(TC_leaf)                                           \
+  ((int)sizeof(BDBLEAF) + (TC_leaf)->size +                             \
+   TCPTRLISTNUM((TC_leaf)->recs) * (int)(sizeof(BDBREC) + sizeof(void *)))
 
 
 /* private function prototypes */
@@ -111,6 +127,7 @@ static BDBLEAF *tcbdbgethistleaf(TCBDB *bdb, const char *kbuf, int ksiz, uint64_
 static bool tcbdbleafaddrec(TCBDB *bdb, BDBLEAF *leaf, int dmode,
         const char *kbuf, int ksiz, const char *vbuf, int vsiz);
 static BDBLEAF *tcbdbleafdivide(TCBDB *bdb, BDBLEAF *leaf);
+static void tcbdbleafcharge(TCBDB *bdb, BDBLEAF *leaf);
 static bool tcbdbleafkill(TCBDB *bdb, BDBLEAF *leaf);
 static BDBNODE *tcbdbnodenew(TCBDB *bdb, uint64_t heir);
 static bool tcbdbnodecacheout(TCBDB *bdb, BDBNODE *node);
@@ -122,6 +139,7 @@ static bool tcbdbnodesubidx(TCBDB *bdb, BDBNODE *node, uint64_t pid);
 static uint64_t tcbdbsearchleaf(TCBDB *bdb, const char *kbuf, int ksiz);
 static BDBREC *tcbdbsearchrec(TCBDB *bdb, BDBLEAF *leaf, const char *kbuf, int ksiz, int *ip);
 static void tcbdbremoverec(TCBDB *bdb, BDBLEAF *leaf, BDBREC *rec, int ri);
+static int64_t tcbdbcacheexcess(TCBDB *bdb);
 static bool tcbdbcacheadjust(TCBDB *bdb);
 static void tcbdbcachepurge(TCBDB *bdb);
 static bool tcbdbopenimpl(TCBDB *bdb, const char *path, int omode);
@@ -274,6 +292,17 @@ bool tcbdbsetcache(TCBDB *bdb, int32_t lcnum, int32_t ncnum) {
     return true;
 }
 
+/* Set the shared size budget of the leaf cache of a B+ tree database object. */
+bool tcbdbsetcachebudget(TCBDB *bdb, BDBCBUDGET *budget) {
+    assert(bdb);
+    if (bdb->open) {
+        tcbdbsetecode(bdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    bdb->cbudget = budget;
+    return true;
+}
+
 /* Set the size of the extra mapped memory of a B+ tree database object. */
 bool tcbdbsetxmsiz(TCBDB *bdb, int64_t xmsiz) {
     assert(bdb);
@@ -473,7 +502,7 @@ void *tcbdbget(TCBDB *bdb, const void *kbuf, int ksiz, int *sp) {
     } else {
         rv = NULL;
     }
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) {
@@ -502,7 +531,7 @@ const void *tcbdbget3(TCBDB *bdb, const void *kbuf, int ksiz, int *sp) {
         return NULL;
     }
     const char *rv = tcbdbgetimpl(bdb, kbuf, ksiz, sp);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = NULL;
@@ -521,7 +550,7 @@ TCLIST *tcbdbget4(TCBDB *bdb, const void *kbuf, int ksiz) {
         return NULL;
     }
     TCLIST *rv = tcbdbgetlist(bdb, kbuf, ksiz);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) {
@@ -543,7 +572,7 @@ int tcbdbvnum(TCBDB *bdb, const void *kbuf, int ksiz) {
         return 0;
     }
     int rv = tcbdbgetnum(bdb, kbuf, ksiz);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = 0;
@@ -584,7 +613,7 @@ TCLIST *tcbdbrange(TCBDB *bdb, const void *bkbuf, int bksiz, bool binc,
         return keys;
     }
     tcbdbrangeimpl(bdb, bkbuf, bksiz, binc, ekbuf, eksiz, einc, max, keys);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         tcbdbcacheadjust(bdb);
@@ -612,7 +641,7 @@ TCLIST *tcbdbfwmkeys(TCBDB *bdb, const void *pbuf, int psiz, int max) {
         return keys;
     }
     tcbdbrangefwm(bdb, pbuf, psiz, max, keys);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         tcbdbcacheadjust(bdb);
@@ -924,7 +953,7 @@ bool tcbdbcurfirst(BDBCUR *cur) {
         return false;
     }
     bool rv = tcbdbcurfirstimpl(cur);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = false;
@@ -944,7 +973,7 @@ bool tcbdbcurlast(BDBCUR *cur) {
         return false;
     }
     bool rv = tcbdbcurlastimpl(cur);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = false;
@@ -964,7 +993,7 @@ bool tcbdbcurjump(BDBCUR *cur, const void *kbuf, int ksiz) {
         return false;
     }
     bool rv = tcbdbcurjumpimpl(cur, kbuf, ksiz, true);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = false;
@@ -995,7 +1024,7 @@ bool tcbdbcurprev(BDBCUR *cur) {
         return false;
     }
     bool rv = tcbdbcurprevimpl(cur);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = false;
@@ -1020,7 +1049,7 @@ bool tcbdbcurnext(BDBCUR *cur) {
         return false;
     }
     bool rv = tcbdbcurnextimpl(cur);
-    bool adj = TCMAPRNUM(bdb->leafc) > bdb->lcnum || TCMAPRNUM(bdb->nodec) > bdb->ncnum;
+    bool adj = BDBCACHEOVER(bdb);
     BDBUNLOCKMETHOD(bdb);
     if (adj && BDBLOCKMETHOD(bdb, true)) {
         if (!bdb->tran && !tcbdbcacheadjust(bdb)) rv = false;
@@ -1232,6 +1261,87 @@ bool tcbdbcurrec(BDBCUR *cur, TCXSTR *kxstr, TCXSTR *vxstr) {
     return rv;
 }
 
+/* Get records starting at the position of a cursor object and move the cursor past them. */
+int tcbdbcurrecs(BDBCUR *cur, TCLIST *keys, TCLIST *vals, int max, bool back) {
+    assert(cur && keys && vals && max >= 0);
+    TCBDB *bdb = cur->bdb;
+    if (!BDBLOCKMETHOD(bdb, false)) return 0;
+    if (!bdb->open) {
+        tcbdbsetecode(bdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        BDBUNLOCKMETHOD(bdb);
+        return 0;
+    }
+    int num = 0;
+    while (num < max && cur->id > 0) {
+        if (cur->clock != bdb->clock) {
+            if (!tcbdbleafcheck(bdb, cur->id)) {
+                tcbdbsetecode(bdb, TCENOREC, __FILE__, __LINE__, __func__);
+                cur->id = 0;
+                cur->kidx = 0;
+                cur->vidx = 0;
+                break;
+            }
+            cur->clock = bdb->clock;
+        }
+        BDBLEAF *leaf = tcbdbleafload(bdb, cur->id);
+        if (!leaf) break;
+        TCPTRLIST *recs = leaf->recs;
+        int rnum = TCPTRLISTNUM(recs);
+        if (leaf->dead || cur->kidx < 0 || cur->kidx >= rnum) { //the leaf has been modified
+            if (!tcbdbcuradjust(cur, !back)) break;
+            continue;
+        }
+        BDBREC *rec = TCPTRLISTVAL(recs, cur->kidx);
+        int vnum = rec->rest ? TCLISTNUM(rec->rest) + 1 : 1;
+        if (cur->vidx < 0 || cur->vidx >= vnum) {
+            if (!tcbdbcuradjust(cur, !back)) break;
+            continue;
+        }
+        bool edge = false;
+        while (num < max && !edge) {
+            char *dbuf = (char *) rec + sizeof (*rec);
+            TCLISTPUSH(keys, dbuf, rec->ksiz);
+            if (cur->vidx > 0) {
+                int vsiz;
+                const char *vbuf = tclistval(rec->rest, cur->vidx - 1, &vsiz);
+                TCLISTPUSH(vals, vbuf, vsiz);
+            } else {
+                TCLISTPUSH(vals, dbuf + rec->ksiz + TCALIGNPAD(rec->ksiz), rec->vsiz);
+            }
+            num++;
+            if (back) {
+                if (cur->vidx > 0) {
+                    cur->vidx--;
+                } else if (cur->kidx > 0) {
+                    rec = TCPTRLISTVAL(recs, --cur->kidx);
+                    vnum = rec->rest ? TCLISTNUM(rec->rest) + 1 : 1;
+                    cur->vidx = vnum - 1;
+                } else {
+                    edge = true;
+                }
+            } else {
+                if (cur->vidx < vnum - 1) {
+                    cur->vidx++;
+                } else if (cur->kidx < rnum - 1) {
+                    rec = TCPTRLISTVAL(recs, ++cur->kidx);
+                    vnum = rec->rest ? TCLISTNUM(rec->rest) + 1 : 1;
+                    cur->vidx = 0;
+                } else {
+                    edge = true;
+                }
+            }
+        }
+        if (edge && !(back ? tcbdbcurprevimpl(cur) : tcbdbcurnextimpl(cur))) break;
+    }
+    bool adj = BDBCACHEOVER(bdb);
+    BDBUNLOCKMETHOD(bdb);
+    if (adj && BDBLOCKMETHOD(bdb, true)) {
+        if (!bdb->tran) tcbdbcacheadjust(bdb);
+        BDBUNLOCKMETHOD(bdb);
+    }
+    return num;
+}
+
 
 
 /*************************************************************************************************
@@ -1619,6 +1729,7 @@ static void tcbdbclear(TCBDB *bdb) {
     bdb->lmemb = BDBDEFLMEMB;
     bdb->nmemb = BDBDEFNMEMB;
     bdb->opts = 0;
+    bdb->lfmt = BDBLFPLAIN;
     bdb->root = 0;
     bdb->first = 0;
     bdb->last = 0;
@@ -1631,6 +1742,8 @@ static void tcbdbclear(TCBDB *bdb) {
     bdb->cmpop = NULL;
     bdb->lcnum = BDBDEFLCNUM;
     bdb->ncnum = BDBDEFNCNUM;
+    bdb->cbudget = NULL;
+    bdb->lcsize = 0;
     bdb->lsmax = BDBDEFLSMAX;
     bdb->lschk = 0;
     bdb->capnum = 0;
@@ -1675,7 +1788,8 @@ static void tcbdbdumpmeta(TCBDB *bdb) {
     } else {
         *(uint8_t *) (wp++) = 0xff;
     }
-    wp += 7;
+    *(uint8_t *) (wp++) = bdb->lfmt;
+    wp += 6;
     uint32_t lnum;
     lnum = bdb->lmemb;
     lnum = TCHTOIL(lnum);
@@ -1729,7 +1843,8 @@ static void tcbdbloadmeta(TCBDB *bdb) {
     } else if (cnum == 0x3) {
         bdb->cmp = tccmpint64;
     }
-    rp += 7;
+    bdb->lfmt = *(uint8_t *) (rp++);
+    rp += 6;
     uint32_t lnum;
     memcpy(&lnum, rp, sizeof (lnum));
     rp += sizeof (lnum);
@@ -1771,11 +1886,15 @@ static BDBLEAF *tcbdbleafnew(TCBDB *bdb, uint64_t prev, uint64_t next) {
     lent.size = 0;
     lent.prev = prev;
     lent.next = next;
+    lent.csize = 0;
     lent.dirty = true;
     lent.dead = false;
+    lent.hot = false;
     tcmapputkeep(bdb->leafc, &(lent.id), sizeof (lent.id), &lent, sizeof (lent));
     int rsiz;
-    return (BDBLEAF *) tcmapget(bdb->leafc, &(lent.id), sizeof (lent.id), &rsiz);
+    BDBLEAF *leaf = (BDBLEAF *) tcmapget(bdb->leafc, &(lent.id), sizeof (lent.id), &rsiz);
+    tcbdbleafcharge(bdb, leaf);
+    return leaf;
 }
 
 /* Remove a leaf from the cache.
@@ -1794,6 +1913,8 @@ static bool tcbdbleafcacheout(TCBDB *bdb, BDBLEAF *leaf) {
         TCFREE(rec);
     }
     tcptrlistdel(recs);
+    bdb->lcsize -= leaf->csize;
+    if (bdb->cbudget && bdb->open) __atomic_sub_fetch(&bdb->cbudget->size, leaf->csize, __ATOMIC_RELAXED);
     tcmapout(bdb->leafc, &(leaf->id), sizeof (leaf->id));
     return !err;
 }
@@ -1806,7 +1927,7 @@ static bool tcbdbleafsave(TCBDB *bdb, BDBLEAF *leaf) {
     assert(bdb && leaf);
     TCDODEBUG(bdb->cnt_saveleaf++);
     TCXSTR *rbuf = tcxstrnew3(BDBPAGEBUFSIZ);
-    char hbuf[(sizeof (uint64_t) + 1)*3];
+    char hbuf[(sizeof (uint64_t) + 1)*4];
     char *wp = hbuf;
     uint64_t llnum;
     int step;
@@ -1819,12 +1940,24 @@ static bool tcbdbleafsave(TCBDB *bdb, BDBLEAF *leaf) {
     TCXSTRCAT(rbuf, hbuf, wp - hbuf);
     TCPTRLIST *recs = leaf->recs;
     int ln = TCPTRLISTNUM(recs);
+    bool prefix = (bdb->lfmt == BDBLFPREFIX);
+    const char *pkbuf = NULL;
+    int pksiz = 0;
     for (int i = 0; i < ln; i++) {
         BDBREC *rec = TCPTRLISTVAL(recs, i);
         char *dbuf = (char *) rec + sizeof (*rec);
+        int psiz = 0;
         int lnum;
         wp = hbuf;
-        lnum = rec->ksiz;
+        if (prefix) {
+            int max = tclmin(pksiz, rec->ksiz);
+            while (psiz < max && pkbuf[psiz] == dbuf[psiz]) psiz++;
+            TCSETVNUMBUF(step, wp, psiz);
+            wp += step;
+            pkbuf = dbuf;
+            pksiz = rec->ksiz;
+        }
+        lnum = rec->ksiz - psiz;
         TCSETVNUMBUF(step, wp, lnum);
         wp += step;
         lnum = rec->vsiz;
@@ -1835,7 +1968,7 @@ static bool tcbdbleafsave(TCBDB *bdb, BDBLEAF *leaf) {
         TCSETVNUMBUF(step, wp, rnum);
         wp += step;
         TCXSTRCAT(rbuf, hbuf, wp - hbuf);
-        TCXSTRCAT(rbuf, dbuf, rec->ksiz);
+        TCXSTRCAT(rbuf, dbuf + psiz, rec->ksiz - psiz);
         TCXSTRCAT(rbuf, dbuf + rec->ksiz + TCALIGNPAD(rec->ksiz), rec->vsiz);
         for (int j = 0; j < rnum; j++) {
             const char *vbuf;
@@ -1903,12 +2036,27 @@ static BDBLEAF *tcbdbleafload(TCBDB *bdb, uint64_t id) {
     lent.next = llnum;
     rp += step;
     rsiz -= step;
+    lent.csize = 0;
     lent.dirty = false;
     lent.dead = false;
+    lent.hot = false;
     lent.recs = tcptrlistnew2(bdb->lmemb + 1);
     lent.size = 0;
     bool err = false;
+    bool prefix = (bdb->lfmt == BDBLFPREFIX);
+    const char *pkbuf = NULL;
+    int pksiz = 0;
     while (rsiz >= 3) {
+        int psiz = 0;
+        if (prefix) {
+            TCREADVNUMBUF(rp, psiz, step);
+            rp += step;
+            rsiz -= step;
+            if (psiz > pksiz) {
+                err = true;
+                break;
+            }
+        }
         int ksiz;
         TCREADVNUMBUF(rp, ksiz, step);
         rp += step;
@@ -1925,20 +2073,25 @@ static BDBLEAF *tcbdbleafload(TCBDB *bdb, uint64_t id) {
             err = true;
             break;
         }
-        int psiz = TCALIGNPAD(ksiz);
+        int ssiz = ksiz;
+        ksiz += psiz;
+        int apsiz = TCALIGNPAD(ksiz);
         BDBREC *nrec;
-        TCMALLOC(nrec, sizeof (*nrec) + ksiz + psiz + vsiz + 1);
+        TCMALLOC(nrec, sizeof (*nrec) + ksiz + apsiz + vsiz + 1);
         char *dbuf = (char *) nrec + sizeof (*nrec);
-        memcpy(dbuf, rp, ksiz);
+        if (psiz > 0) memcpy(dbuf, pkbuf, psiz);
+        memcpy(dbuf + psiz, rp, ssiz);
         dbuf[ksiz] = '\0';
         nrec->ksiz = ksiz;
-        rp += ksiz;
-        rsiz -= ksiz;
-        memcpy(dbuf + ksiz + psiz, rp, vsiz);
-        dbuf[ksiz + psiz + vsiz] = '\0';
+        rp += ssiz;
+        rsiz -= ssiz;
+        memcpy(dbuf + ksiz + apsiz, rp, vsiz);
+        dbuf[ksiz + apsiz + vsiz] = '\0';
         nrec->vsiz = vsiz;
         rp += vsiz;
         rsiz -= vsiz;
+        pkbuf = dbuf;
+        pksiz = ksiz;
         lent.size += ksiz;
         lent.size += vsiz;
         if (rnum > 0) {
@@ -1975,8 +2128,11 @@ static BDBLEAF *tcbdbleafload(TCBDB *bdb, uint64_t id) {
             TCFREE(rec);
         }
         tcptrlistdel(lent.recs);
+        leaf = (BDBLEAF *) tcmapget(bdb->leafc, &(lent.id), sizeof (lent.id), &rsiz);
+    } else {
+        leaf = (BDBLEAF *) tcmapget(bdb->leafc, &(lent.id), sizeof (lent.id), &rsiz);
+        tcbdbleafcharge(bdb, leaf);
     }
-    leaf = (BDBLEAF *) tcmapget(bdb->leafc, &(lent.id), sizeof (lent.id), &rsiz);
     if (clk) BDBUNLOCKCACHE(bdb);
     return leaf;
 }
@@ -2285,9 +2441,24 @@ static BDBLEAF *tcbdbleafdivide(TCBDB *bdb, BDBLEAF *leaf) {
     TCPTRLISTTRUNC(recs, TCPTRLISTNUM(recs) - TCPTRLISTNUM(newrecs));
     leaf->size -= nsiz;
     newleaf->size = nsiz;
+    tcbdbleafcharge(bdb, leaf);
+    tcbdbleafcharge(bdb, newleaf);
     return newleaf;
 }
 
+/* Update the size of a cached leaf charged to the leaf cache.
+   `bdb' specifies the B+ tree database object.
+   `leaf' specifies the leaf object. */
+static void tcbdbleafcharge(TCBDB *bdb, BDBLEAF *leaf) {
+    assert(bdb && leaf);
+    int csize = BDBLEAFCSIZE(leaf);
+    int delta = csize - leaf->csize;
+    if (delta == 0) return;
+    leaf->csize = csize;
+    bdb->lcsize += delta;
+    if (bdb->cbudget && bdb->open) __atomic_add_fetch(&bdb->cbudget->size, delta, __ATOMIC_RELAXED);
+}
+
 /* Cut off the path to a leaf and mark it dead.
    `bdb' specifies the B+ tree database object.
    `leaf' specifies the leaf object.
@@ -2751,28 +2922,70 @@ static void tcbdbremoverec(TCBDB *bdb, BDBLEAF *leaf, BDBREC *rec, int ri) {
     bdb->rnum--;
 }
 
+/* Get the size of cached leaves to be released to keep the shared leaf cache budget.
+   `bdb' specifies the B+ tree database object.
+   The return value is the size to be released or 0 if the budget is kept.
+   Only databases caching more than their even share of an exceeded budget release leaves. */
+static int64_t tcbdbcacheexcess(TCBDB *bdb) {
+    BDBCBUDGET *budget = bdb->cbudget;
+    if (!budget || budget->limit < 1 || TCMAPRNUM(bdb->leafc) <= BDBCACHEOUT) return 0;
+    int64_t over = __atomic_load_n64(&budget->size, __ATOMIC_RELAXED) - budget->limit;
+    if (over <= 0) return 0;
+    int64_t share = budget->limit / tclmax(__atomic_load_n(&budget->num, __ATOMIC_RELAXED), 1);
+    return tclmax(tclmin(over, bdb->lcsize - share), 0);
+}
+
 /* Adjust the caches for leaves and nodes.
    `bdb' specifies the B+ tree database object.
-   The return value is true if successful, else, it is false. */
+   The return value is true if successful, else, it is false.
+   Leaves visited by cursor steps only are released first, leaves found by key lookups are
+   moved behind them with the mark cleared and released only if no such leaves are left near
+   the head of the cache.  The most recently used leaf is never released.
+   Nodes are not charged to the leaf budget and stay cached while the budget is set. */
 static bool tcbdbcacheadjust(TCBDB *bdb) {
     bool err = false;
-    if (TCMAPRNUM(bdb->leafc) > bdb->lcnum) {
+    int64_t dsize = tcbdbcacheexcess(bdb);
+    if (TCMAPRNUM(bdb->leafc) > bdb->lcnum || dsize > 0) {
         TCDODEBUG(bdb->cnt_adjleafc++);
         int ecode = tchdbecode(bdb->hdb);
         bool clk = BDBLOCKCACHE(bdb);
         TCMAP *leafc = bdb->leafc;
+        int dnum = (TCMAPRNUM(leafc) > bdb->lcnum) ? tclmax(TCMAPRNUM(leafc) - bdb->lcnum, BDBCACHEOUT) : 0;
+        int64_t lcmin = bdb->lcsize - dsize;
+        // records of the last leaf may be referred to by the current operation
+        int lnum = TCMAPRNUM(leafc) - BDBCACHEKEEP;
+        int snum = tclmin(lnum, BDBCACHESCAN);
+        int vnum = 0;
+        int rsiz;
         tcmapiterinit(leafc);
-        int dnum = tclmax(TCMAPRNUM(bdb->leafc) - bdb->lcnum, BDBCACHEOUT);
-        for (int i = 0; i < dnum; i++) {
-            int rsiz;
-            if (!tcbdbleafcacheout(bdb, (BDBLEAF *) tcmapiterval(tcmapiternext(leafc, &rsiz), &rsiz)))
-                err = true;
+        for (; vnum < snum && (dnum > 0 || bdb->lcsize > lcmin) && TCMAPRNUM(leafc) > BDBCACHEOUT; vnum++) {
+            const char *kbuf = tcmapiternext(leafc, &rsiz);
+            if (!kbuf) break;
+            BDBLEAF *leaf = (BDBLEAF *) tcmapiterval(kbuf, &rsiz);
+            if (leaf->hot) { // second chance until found by a key lookup again
+                leaf->hot = false;
+                tcmapmove(leafc, kbuf, sizeof (leaf->id), false);
+                continue;
+            }
+            if (!tcbdbleafcacheout(bdb, leaf)) err = true;
+            dnum--;
+        }
+        // the rest is ordered as not scanned leaves, the last leaf and moved hot leaves
+        int rnum = TCMAPRNUM(leafc);
+        int kbeg = lnum - vnum;
+        tcmapiterinit(leafc);
+        for (int i = 0; i < rnum && (dnum > 0 || bdb->lcsize > lcmin) && TCMAPRNUM(leafc) > BDBCACHEOUT; i++) {
+            const char *kbuf = tcmapiternext(leafc, &rsiz);
+            if (!kbuf) break;
+            if (i >= kbeg && i < kbeg + BDBCACHEKEEP) continue;
+            if (!tcbdbleafcacheout(bdb, (BDBLEAF *) tcmapiterval(kbuf, &rsiz))) err = true;
+            dnum--;
         }
         if (clk) BDBUNLOCKCACHE(bdb);
         if (!err && tchdbecode(bdb->hdb) != ecode)
             tcbdbsetecode(bdb, ecode, __FILE__, __LINE__, __func__);
     }
-    if (TCMAPRNUM(bdb->nodec) > bdb->ncnum) {
+    if (!bdb->cbudget && TCMAPRNUM(bdb->nodec) > bdb->ncnum) {
         TCDODEBUG(bdb->cnt_adjnodec++);
         int ecode = tchdbecode(bdb->hdb);
         bool clk = BDBLOCKCACHE(bdb);
@@ -2810,6 +3023,8 @@ static void tcbdbcachepurge(TCBDB *bdb) {
             TCFREE(rec);
         }
         tcptrlistdel(recs);
+        bdb->lcsize -= leaf->csize;
+        if (bdb->cbudget && bdb->open) __atomic_sub_fetch(&bdb->cbudget->size, leaf->csize, __ATOMIC_RELAXED);
         tcmapout(bdb->leafc, tmp, tsiz);
     }
     tcmapiterinit(bdb->nodec);
@@ -2856,6 +3071,7 @@ static bool tcbdbopenimpl(TCBDB *bdb, const char *path, int omode) {
     bdb->lnum = 0;
     bdb->nnum = 0;
     bdb->rnum = 0;
+    bdb->lcsize = 0;
     bdb->leafc = tcmapnew2(bdb->lcnum * 2 + 1);
     bdb->nodec = tcmapnew2(bdb->ncnum * 2 + 1);
     if (bdb->wmode && tchdbrnum(bdb->hdb) < 1) {
@@ -2870,6 +3086,7 @@ static bool tcbdbopenimpl(TCBDB *bdb, const char *path, int omode) {
             bdb->cmp = tccmplexical;
             bdb->cmpop = NULL;
         }
+        bdb->lfmt = BDBLFPREFIX;
         tcbdbdumpmeta(bdb);
         if (!tcbdbleafsave(bdb, leaf)) {
             tcmapdel(bdb->nodec);
@@ -2886,6 +3103,13 @@ static bool tcbdbopenimpl(TCBDB *bdb, const char *path, int omode) {
         tchdbclose(bdb->hdb);
         return false;
     }
+    if (bdb->lfmt > BDBLFPREFIX) {
+        tcbdbsetecode(bdb, TCEMETA, __FILE__, __LINE__, __func__);
+        tcmapdel(bdb->nodec);
+        tcmapdel(bdb->leafc);
+        tchdbclose(bdb->hdb);
+        return false;
+    }
     if (bdb->lmemb < BDBMINLMEMB || bdb->nmemb < BDBMINNMEMB || bdb->root < 1 || bdb->first < 1 || bdb->last < 1) {
         tcbdbsetecode(bdb, TCEMETA, __FILE__, __LINE__, __func__);
         tcmapdel(bdb->nodec);
@@ -2907,6 +3131,10 @@ static bool tcbdbopenimpl(TCBDB *bdb, const char *path, int omode) {
     bdb->tran = false;
     bdb->rbopaque = NULL;
     bdb->clock = 1;
+    if (bdb->cbudget) {
+        __atomic_add_fetch(&bdb->cbudget->num, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bdb->cbudget->size, bdb->lcsize, __ATOMIC_RELAXED);
+    }
     return true;
 }
 
@@ -2925,6 +3153,10 @@ static bool tcbdbcloseimpl(TCBDB *bdb) {
         bdb->rbopaque = NULL;
         if (!tchdbtranvoid(bdb->hdb)) err = true;
     }
+    if (bdb->cbudget) {
+        __atomic_sub_fetch(&bdb->cbudget->size, bdb->lcsize, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&bdb->cbudget->num, 1, __ATOMIC_RELAXED);
+    }
     bdb->open = false;
     const char *vbuf;
     int vsiz;
@@ -2964,10 +3196,12 @@ static bool tcbdbputimpl(TCBDB *bdb, const void *kbuf, int ksiz, const void *vbu
         if (!(leaf = tcbdbleafload(bdb, pid))) return false;
         hlid = 0;
     }
+    leaf->hot = true;
     if (!tcbdbleafaddrec(bdb, leaf, dmode, kbuf, ksiz, vbuf, vsiz)) {
         if (!bdb->tran) tcbdbcacheadjust(bdb);
         return false;
     }
+    tcbdbleafcharge(bdb, leaf);
     int rnum = TCPTRLISTNUM(leaf->recs);
     if (rnum > bdb->lmemb || (rnum > 1 && leaf->size > bdb->lsmax)) {
         if (hlid > 0 && hlid != tcbdbsearchleaf(bdb, kbuf, ksiz)) return false;
@@ -3059,6 +3293,7 @@ static bool tcbdboutimpl(TCBDB *bdb, const char *kbuf, int ksiz) {
         if (!(leaf = tcbdbleafload(bdb, pid))) return false;
         hlid = 0;
     }
+    leaf->hot = true;
     int ri;
     BDBREC *rec = tcbdbsearchrec(bdb, leaf, kbuf, ksiz, &ri);
     if (!rec) {
@@ -3067,6 +3302,7 @@ static bool tcbdboutimpl(TCBDB *bdb, const char *kbuf, int ksiz) {
     }
     tcbdbremoverec(bdb, leaf, rec, ri);
     leaf->dirty = true;
+    tcbdbleafcharge(bdb, leaf);
     if (TCPTRLISTNUM(leaf->recs) < 1) {
         if (hlid > 0 && hlid != tcbdbsearchleaf(bdb, kbuf, ksiz)) return false;
         if (bdb->hnum > 0 && !tcbdbleafkill(bdb, leaf)) return false;
@@ -3090,6 +3326,7 @@ static bool tcbdboutlist(TCBDB *bdb, const char *kbuf, int ksiz) {
         if (!(leaf = tcbdbleafload(bdb, pid))) return false;
         hlid = 0;
     }
+    leaf->hot = true;
     int ri;
     BDBREC *rec = tcbdbsearchrec(bdb, leaf, kbuf, ksiz, &ri);
     if (!rec) {
@@ -3110,6 +3347,7 @@ static bool tcbdboutlist(TCBDB *bdb, const char *kbuf, int ksiz) {
     TCFREE(tcptrlistremove(leaf->recs, ri));
     leaf->size -= rsiz;
     leaf->dirty = true;
+    tcbdbleafcharge(bdb, leaf);
     bdb->rnum -= rnum;
     if (TCPTRLISTNUM(leaf->recs) < 1) {
         if (hlid > 0 && hlid != tcbdbsearchleaf(bdb, kbuf, ksiz)) return false;
@@ -3136,6 +3374,7 @@ static const char *tcbdbgetimpl(TCBDB *bdb, const char *kbuf, int ksiz, int *sp)
         if (pid < 1) return NULL;
         if (!(leaf = tcbdbleafload(bdb, pid))) return NULL;
     }
+    leaf->hot = true;
     BDBREC *rec = tcbdbsearchrec(bdb, leaf, kbuf, ksiz, NULL);
     if (!rec) {
         tcbdbsetecode(bdb, TCENOREC, __FILE__, __LINE__, __func__);
@@ -3159,6 +3398,7 @@ static int tcbdbgetnum(TCBDB *bdb, const char *kbuf, int ksiz) {
         if (pid < 1) return 0;
         if (!(leaf = tcbdbleafload(bdb, pid))) return 0;
     }
+    leaf->hot = true;
     BDBREC *rec = tcbdbsearchrec(bdb, leaf, kbuf, ksiz, NULL);
     if (!rec) {
         tcbdbsetecode(bdb, TCENOREC, __FILE__, __LINE__, __func__);
@@ -3181,6 +3421,7 @@ static TCLIST *tcbdbgetlist(TCBDB *bdb, const char *kbuf, int ksiz) {
         if (pid < 1) return NULL;
         if (!(leaf = tcbdbleafload(bdb, pid))) return NULL;
     }
+    leaf->hot = true;
     BDBREC *rec = tcbdbsearchrec(bdb, leaf, kbuf, ksiz, NULL);
     if (!rec) {
         tcbdbsetecode(bdb, TCENOREC, __FILE__, __LINE__, __func__);
@@ -3510,6 +3751,7 @@ static bool tcbdbcurjumpimpl(BDBCUR *cur, const char *kbuf, int ksiz, bool forwa
         cur->vidx = 0;
         return false;
     }
+    leaf->hot = true;
     if (leaf->dead || TCPTRLISTNUM(leaf->recs) < 1) {
         cur->id = pid;
         cur->kidx = 0;
@@ -3752,6 +3994,7 @@ static bool tcbdbcurputimpl(BDBCUR *cur, const char *vbuf, int vsiz, int cpmode)
             break;
     }
     leaf->dirty = true;
+    tcbdbleafcharge(bdb, leaf);
     return true;
 }
 
@@ -3833,6 +4076,7 @@ static bool tcbdbcuroutimpl(BDBCUR *cur) {
     }
     bdb->rnum--;
     leaf->dirty = true;
+    tcbdbleafcharge(bdb, leaf);
     return tcbdbcuradjust(cur, true) || tchdbecode(bdb->hdb) == TCENOREC;
 }
 
@@ -3910,7 +4154,7 @@ static bool tcbdbforeachimpl(TCBDB *bdb, TCITER iter, void *op) {
                         break;
                     }
                 }
-            } else if (TCMAPRNUM(bdb->leafc) > bdb->lcnum && !tcbdbcacheadjust(bdb)) {
+            } else if (BDBCACHEOVER(bdb) && !tcbdbcacheadjust(bdb)) {
                 err = true;
                 break;
             }
@@ -3961,6 +4205,7 @@ void tcbdbprintmeta(TCBDB *bdb) {
     wp += sprintf(wp, " cmpop=%p", (void *) bdb->cmpop);
     wp += sprintf(wp, " lcnum=%u", bdb->lcnum);
     wp += sprintf(wp, " ncnum=%u", bdb->ncnum);
+    wp += sprintf(wp, " lcsize=%" PRId64 "", (int64_t) bdb->lcsize);
     wp += sprintf(wp, " lsmax=%u", bdb->lsmax);
     wp += sprintf(wp, " lschk=%u", bdb->lschk);
     wp += sprintf(wp, " capnum=%" PRIu64 "", (uint64_t) bdb->capnum);
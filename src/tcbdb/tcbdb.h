@@ -39,6 +39,12 @@ __TCBDB_CLINKAGEBEGIN
  *************************************************************************************************/
 
 
+typedef struct { /* type of structure for a leaf cache budget shared by B+ tree databases */
+    int64_t limit; /* maximum total size of cached leaves */
+    volatile int64_t size; /* total size of cached leaves */
+    volatile int32_t num; /* number of opened databases sharing the budget */
+} BDBCBUDGET;
+
 typedef struct { /* type of structure for a B+ tree database */
     void *mmtx; /* mutex for method */
     void *cmtx; /* mutex for cache */
@@ -48,6 +54,7 @@ typedef struct { /* type of structure for a B+ tree database */
     uint32_t lmemb; /* number of members in each leaf */
     uint32_t nmemb; /* number of members in each node */
     uint8_t opts; /* options */
+    uint8_t lfmt; /* format of serialized leaves */
     uint64_t root; /* ID number of the root page */
     uint64_t first; /* ID number of the first leaf */
     uint64_t last; /* ID number of the last leaf */
@@ -60,6 +67,8 @@ typedef struct { /* type of structure for a B+ tree database */
     void *cmpop; /* opaque object for the comparison function */
     uint32_t lcnum; /* maximum number of cached leaves */
     uint32_t ncnum; /* maximum number of cached nodes */
+    BDBCBUDGET *cbudget; /* leaf cache budget shared with other databases */
+    int64_t lcsize; /* total size of cached leaves */
     uint32_t lsmax; /* maximum size of each leaf */
     uint32_t lschk; /* counter for leaf size checking */
     uint64_t capnum; /* capacity number of records */
@@ -210,6 +219,19 @@ EJDB_EXPORT bool tcbdbtune(TCBDB *bdb, int32_t lmemb, int32_t nmemb,
 EJDB_EXPORT bool tcbdbsetcache(TCBDB *bdb, int32_t lcnum, int32_t ncnum);
 
 
+/* Set the shared size budget of the leaf cache of a B+ tree database object.
+   `bdb' specifies the B+ tree database object which is not opened.
+   `budget' specifies the budget object shared by databases or `NULL' to disable the budget.
+   Its `limit' member is the maximum total size of leaves cached by all the databases sharing it.
+   If successful, the return value is true, else, it is false.
+   Note that the budget should be set before the database is opened and should outlive it.
+   Databases caching more than their share of the budget release leaves first, leaves visited
+   by cursor steps only are released before leaves found by key lookups and cursor jumps.
+   Non-leaf nodes are not charged to the budget and are kept cached regardless of the number of
+   cached nodes set by `tcbdbsetcache'. */
+EJDB_EXPORT bool tcbdbsetcachebudget(TCBDB *bdb, BDBCBUDGET *budget);
+
+
 /* Set the size of the extra mapped memory of a B+ tree database object.
    `bdb' specifies the B+ tree database object which is not opened.
    `xmsiz' specifies the size of the extra mapped memory.  If it is not more than 0, the extra
@@ -816,6 +838,19 @@ EJDB_EXPORT const void *tcbdbcurval3(BDBCUR *cur, int *sp);
 EJDB_EXPORT bool tcbdbcurrec(BDBCUR *cur, TCXSTR *kxstr, TCXSTR *vxstr);
 
 
+/* Get records starting at the position of a cursor object and move the cursor past them.
+   `cur' specifies the cursor object.
+   `keys' specifies the list object into which keys of records are pushed.
+   `vals' specifies the list object into which values of records are pushed.
+   `max' specifies the maximum number of records to get.
+   `back' specifies whether the cursor moves to previous records.
+   The return value is the number of records pushed into `keys' and `vals'.  The database is
+   locked once for the whole batch and every leaf page is loaded once so long range scans do not
+   pay locking and leaf cache lookups for each record.  After the call the cursor is at the record
+   following the last returned one, or at invalid position if there are no more records. */
+EJDB_EXPORT int tcbdbcurrecs(BDBCUR *cur, TCLIST *keys, TCLIST *vals, int max, bool back);
+
+
 
 /*************************************************************************************************
  * features for experts
@@ -59,7 +59,13 @@
 #define HDBFBPMGFREQ   4096              // frequency to merge the free block pool
 #define HDBDRPUNIT     65536             // unit size of the delayed record pool
 #define HDBDRPLAT      2048              // latitude size of the delayed record pool
+#define HDBWBDELAY     50                // milliseconds to coalesce records of the write-behind buffer
 #define HDBDFRSRAT     2                 // step ratio of auto defragmentation
+#define HDBDFBGSTEP    UINT8_MAX         // default step number of a background defragmentation chunk
+#define HDBDFBGUNIT    64                // free blocks to start background defragmentation by itself
+#define HDBDFBGWAIT    1000              // milliseconds between checks of background defragmentation
+#define HDBAIOBSIZ     16384             // size of a buffer of asynchronous reading
+#define HDBAIORCNUM    4096              // number of cached records for asynchronous reading
 #define HDBFBMAXSIZ    (INT32_MAX/4)     // maximum size of a free block pool
 #define HDBCACHEOUT    128               // number of records in a process of cacheout
 #define HDBWALSUFFIX   "wal"             // suffix of write ahead logging file
@@ -85,6 +91,13 @@ typedef struct { // type of structure for a free block
     uint32_t rsiz; // size of the block
 } HDBFB;
 
+typedef struct { // type of structure for a record of the write-behind buffer being written
+    const char *kbuf; // pointer to the key
+    int ksiz; // size of the key
+    uint64_t bidx; // index of the bucket array
+    uint8_t hash; // second hash value
+} HDBWBREC;
+
 enum { // enumeration for magic data
     HDBMAGICREC = 0xc8, // for data block
     HDBMAGICFB = 0xb0 // for free block
@@ -143,6 +156,10 @@ enum {
 #define HDBUNLOCKSMEMPTR(TC_hdb) while(false)
 #endif
 
+#define HDBLOCKAIO(TC_hdb)                              \
+  ((TC_hdb)->aiomtx ? pthread_mutex_lock((pthread_mutex_t *) (TC_hdb)->aiomtx) == 0 : true)
+#define HDBUNLOCKAIO(TC_hdb)                            \
+  ((TC_hdb)->aiomtx ? (void) pthread_mutex_unlock((pthread_mutex_t *) (TC_hdb)->aiomtx) : (void) 0)
 #define HDBLOCKWAL(TC_hdb)                              \
   ((TC_hdb)->mmtx ? tchdblockwal(TC_hdb) : true)
 #define HDBUNLOCKWAL(TC_hdb)                            \
@@ -181,6 +198,23 @@ static bool tchdbremoverec(TCHDB *hdb, TCHREC *rec, char *rbuf, uint64_t bidx, o
 static bool tchdbshiftrec(TCHDB *hdb, TCHREC *rec, char *rbuf, off_t destoff);
 static int tcreckeycmp(const char *abuf, int asiz, const char *bbuf, int bsiz);
 static bool tchdbflushdrp(TCHDB *hdb);
+static bool tchdbflushdrpool(TCHDB *hdb);
+static bool tchdbwbput(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx, uint8_t hash,
+        const char *vbuf, int vsiz);
+static int tchdbwbget(TCHDB *hdb, const char *kbuf, int ksiz, TCXSTR *xstr);
+static bool tchdbwbflush(TCHDB *hdb);
+static int tchdbwbreccmp(const void *a, const void *b);
+static void tchdbwbstart(TCHDB *hdb);
+static void tchdbwbstop(TCHDB *hdb);
+static void *tchdbwbthread(void *op);
+static bool tchdbautodefrag(TCHDB *hdb);
+static bool tchdbdfchunk(TCHDB *hdb, bool *done);
+static void tchdbdfstart(TCHDB *hdb);
+static void tchdbdfstop(TCHDB *hdb);
+static void *tchdbdfthread(void *op);
+static void tchdbcondwait(void *cnd, void *mtx, int msec);
+static bool tchdbparserec(TCHDB *hdb, TCHREC *rec, const char *rbuf, int rsiz);
+static bool tchdbprefetchimpl(TCHDB *hdb, const TCLIST *keys, int *kidx);
 static void tchdbcacheadjust(TCHDB *hdb);
 static bool tchdbwalinit(TCHDB *hdb);
 static bool tchdbwalwrite(TCHDB *hdb, uint64_t off, int64_t size);
@@ -190,6 +224,8 @@ static bool tchdbopenimpl(TCHDB *hdb, const char *path, int omode);
 static bool tchdbcloseimpl(TCHDB *hdb);
 static bool tchdbputimpl(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx, uint8_t hash,
         const char *vbuf, int vsiz, int dmode);
+static bool tchdbputpartimpl(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx, uint8_t hash,
+        int off, const char *vbuf, int vsiz);
 static void tchdbdrpappend(TCHDB *hdb, const char *kbuf, int ksiz, const char *vbuf, int vsiz,
         uint8_t hash);
 static bool tchdbputasyncimpl(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx,
@@ -258,6 +294,27 @@ TCHDB *tchdbnew(void) {
 void tchdbdel(TCHDB *hdb) {
     assert(hdb);
     if (!INVALIDHANDLE(hdb->fd)) tchdbclose(hdb);
+    if (hdb->wbmtx) {
+        pthread_cond_destroy(hdb->wbcnd);
+        pthread_mutex_destroy(hdb->wbfmtx);
+        pthread_mutex_destroy(hdb->wbmtx);
+        TCFREE(hdb->wbcnd);
+        TCFREE(hdb->wbfmtx);
+        TCFREE(hdb->wbmtx);
+    }
+    if (hdb->aio) {
+        tcaiodel(hdb->aio);
+        if (hdb->aiomtx) {
+            pthread_mutex_destroy(hdb->aiomtx);
+            TCFREE(hdb->aiomtx);
+        }
+    }
+    if (hdb->dfmtx) {
+        pthread_cond_destroy(hdb->dfcnd);
+        pthread_mutex_destroy(hdb->dfmtx);
+        TCFREE(hdb->dfcnd);
+        TCFREE(hdb->dfmtx);
+    }
     if (hdb->mmtx) {
         pthread_mutex_destroy(hdb->wmtx);
         pthread_mutex_destroy(hdb->dmtx);
@@ -384,6 +441,90 @@ bool tchdbsetdfunit(TCHDB *hdb, int32_t dfunit) {
     return true;
 }
 
+/* Set the size of the write-behind buffer of a hash database object. */
+bool tchdbsetwritebehind(TCHDB *hdb, int64_t size) {
+    assert(hdb);
+    if (!INVALIDHANDLE(hdb->fd) || !hdb->mmtx) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    if (!hdb->wbmtx) {
+        TCMALLOC(hdb->wbmtx, sizeof (pthread_mutex_t));
+        TCMALLOC(hdb->wbfmtx, sizeof (pthread_mutex_t));
+        TCMALLOC(hdb->wbcnd, sizeof (pthread_cond_t));
+        bool err = false;
+        if (pthread_mutex_init(hdb->wbmtx, NULL) != 0) err = true;
+        if (pthread_mutex_init(hdb->wbfmtx, NULL) != 0) err = true;
+        if (pthread_cond_init(hdb->wbcnd, NULL) != 0) err = true;
+        if (err) {
+            tchdbsetecode(hdb, TCETHREAD, __FILE__, __LINE__, __func__);
+            TCFREE(hdb->wbcnd);
+            TCFREE(hdb->wbfmtx);
+            TCFREE(hdb->wbmtx);
+            hdb->wbcnd = NULL;
+            hdb->wbfmtx = NULL;
+            hdb->wbmtx = NULL;
+            return false;
+        }
+    }
+    hdb->wbmax = (size > 0) ? size : 0;
+    return true;
+}
+
+/* Set the background defragmentation of a hash database object. */
+bool tchdbsetbgdefrag(TCHDB *hdb, int32_t step, int32_t delay) {
+    assert(hdb);
+    if (!INVALIDHANDLE(hdb->fd) || !hdb->mmtx) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    if (!hdb->dfmtx) {
+        TCMALLOC(hdb->dfmtx, sizeof (pthread_mutex_t));
+        TCMALLOC(hdb->dfcnd, sizeof (pthread_cond_t));
+        bool err = false;
+        if (pthread_mutex_init(hdb->dfmtx, NULL) != 0) err = true;
+        if (pthread_cond_init(hdb->dfcnd, NULL) != 0) err = true;
+        if (err) {
+            tchdbsetecode(hdb, TCETHREAD, __FILE__, __LINE__, __func__);
+            TCFREE(hdb->dfcnd);
+            TCFREE(hdb->dfmtx);
+            hdb->dfcnd = NULL;
+            hdb->dfmtx = NULL;
+            return false;
+        }
+    }
+    hdb->dfstep = (step > 0) ? step : HDBDFBGSTEP;
+    hdb->dfdelay = (delay >= 0) ? delay : -1;
+    return true;
+}
+
+/* Set the asynchronous reading of a hash database object. */
+bool tchdbsetaio(TCHDB *hdb, int32_t depth) {
+    assert(hdb);
+    if (!INVALIDHANDLE(hdb->fd) || depth < 1 || hdb->aio) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    TCAIO *aio = tcaionew(depth, HDBAIOBSIZ);
+    if (!aio) {
+        tchdbsetecode(hdb, TCEMISC, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    if (hdb->mmtx) {
+        TCMALLOC(hdb->aiomtx, sizeof (pthread_mutex_t));
+        if (pthread_mutex_init(hdb->aiomtx, NULL) != 0) {
+            tchdbsetecode(hdb, TCETHREAD, __FILE__, __LINE__, __func__);
+            TCFREE(hdb->aiomtx);
+            hdb->aiomtx = NULL;
+            tcaiodel(aio);
+            return false;
+        }
+    }
+    hdb->aio = aio;
+    if (hdb->rcnum < 1) hdb->rcnum = HDBAIORCNUM; //records read in batches are served from the cache
+    return true;
+}
+
 /* Open a database file and connect a hash database object.
    #METHOD WLOCK */
 bool tchdbopen(TCHDB *hdb, const char *path, int omode) {
@@ -419,6 +560,8 @@ bool tchdbopen(TCHDB *hdb, const char *path, int omode) {
     bool rv = tchdbopenimpl(hdb, path, omode);
     if (rv) {
         hdb->rpath = rpath;
+        if (hdb->wbmax > 0 && (omode & HDBOWRITER)) tchdbwbstart(hdb);
+        if (hdb->dfdelay >= 0 && (omode & HDBOWRITER)) tchdbdfstart(hdb);
     } else {
         tcpathunlock(rpath);
         TCFREE(rpath);
@@ -430,6 +573,8 @@ bool tchdbopen(TCHDB *hdb, const char *path, int omode) {
 /* Close a database object. */
 bool tchdbclose(TCHDB *hdb) {
     assert(hdb);
+    if (hdb->wbthr) tchdbwbstop(hdb);
+    if (hdb->dfthr) tchdbdfstop(hdb);
     if (!HDBLOCKMETHOD(hdb, true)) return false;
     if (INVALIDHANDLE(hdb->fd)) {
         tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
@@ -437,6 +582,11 @@ bool tchdbclose(TCHDB *hdb) {
         return false;
     }
     bool rv = tchdbcloseimpl(hdb);
+    if (hdb->wbrecs) {
+        tcmapdel(hdb->wbrecs);
+        hdb->wbrecs = NULL;
+        hdb->wbsize = 0;
+    }
     tcpathunlock(hdb->rpath);
     TCFREE(hdb->rpath);
     hdb->rpath = NULL;
@@ -456,6 +606,11 @@ bool tchdbput(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int vsiz
         HDBUNLOCKMETHOD(hdb);
         return false;
     }
+    if (hdb->wbrecs && !hdb->tran) {
+        bool rv = tchdbwbput(hdb, kbuf, ksiz, bidx, hash, vbuf, vsiz);
+        HDBUNLOCKMETHOD(hdb);
+        return rv;
+    }
     if (hdb->async && !tchdbflushdrp(hdb)) {
         HDBUNLOCKMETHOD(hdb);
         return false;
@@ -487,7 +642,7 @@ bool tchdbput(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int vsiz
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -543,7 +698,7 @@ bool tchdbputkeep(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -614,7 +769,7 @@ bool tchdbputcat(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int v
         HDBUNLOCKMETHOD(hdb);
         if (hdb->dfunit > 0) {
             uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-            if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+            if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
                 rv = false;
             }
         }
@@ -625,7 +780,7 @@ bool tchdbputcat(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int v
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -651,6 +806,11 @@ bool tchdbputasync(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int
         HDBUNLOCKMETHOD(hdb);
         return false;
     }
+    if (hdb->wbrecs && !hdb->tran) { //the buffer already defers the write
+        bool rv = tchdbwbput(hdb, kbuf, ksiz, bidx, hash, vbuf, vsiz);
+        HDBUNLOCKMETHOD(hdb);
+        return rv;
+    }
     if (hdb->zmode) {
         if (hdb->opts & HDBTDEFLATE) {
             zbuf = _tc_deflate(vbuf, vsiz, &vsiz, _TCZMRAW);
@@ -679,6 +839,31 @@ bool tchdbputasync2(TCHDB *hdb, const char *kstr, const char *vstr) {
     return tchdbputasync(hdb, kstr, strlen(kstr), vstr, strlen(vstr));
 }
 
+/* Overwrite a part of the value of an existing record of a hash database object in place. */
+bool tchdbputpart(TCHDB *hdb, const void *kbuf, int ksiz, int off, const void *vbuf, int vsiz) {
+    assert(hdb && kbuf && ksiz >= 0 && off >= 0 && vbuf && vsiz >= 0);
+    if (!HDBLOCKMETHOD(hdb, false)) return false;
+    uint8_t hash;
+    uint64_t bidx = tchdbbidx(hdb, kbuf, ksiz, &hash);
+    if (INVALIDHANDLE(hdb->fd) || !(hdb->omode & HDBOWRITER) || hdb->zmode) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    if (hdb->async && !tchdbflushdrp(hdb)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    if (!HDBLOCKRECORD(hdb, bidx, true)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    bool rv = tchdbputpartimpl(hdb, kbuf, ksiz, bidx, hash, off, vbuf, vsiz);
+    HDBUNLOCKRECORD(hdb, bidx);
+    HDBUNLOCKMETHOD(hdb);
+    return rv;
+}
+
 /* Remove a record of a hash database object. */
 bool tchdbout(TCHDB *hdb, const void *kbuf, int ksiz) {
     assert(hdb && kbuf && ksiz >= 0);
@@ -703,7 +888,7 @@ bool tchdbout(TCHDB *hdb, const void *kbuf, int ksiz) {
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -727,7 +912,17 @@ void *tchdbget(TCHDB *hdb, const void *kbuf, int ksiz, int *sp) {
         HDBUNLOCKMETHOD(hdb);
         return NULL;
     }
-    if (hdb->async && !tchdbflushdrp(hdb)) {
+    if (hdb->wbrecs) {
+        TCXSTR *xstr = tcxstrnew();
+        int vsiz = tchdbwbget(hdb, kbuf, ksiz, xstr);
+        if (vsiz >= 0) {
+            HDBUNLOCKMETHOD(hdb);
+            *sp = vsiz;
+            return tcxstrtomalloc(xstr);
+        }
+        tcxstrdel(xstr);
+    }
+    if (hdb->async && !tchdbflushdrpool(hdb)) {
         HDBUNLOCKMETHOD(hdb);
         return NULL;
     }
@@ -751,7 +946,14 @@ int tchdbgetintoxstr(TCHDB *hdb, const void *kbuf, int ksiz, TCXSTR *xstr) {
         HDBUNLOCKMETHOD(hdb);
         return -1;
     }
-    if (hdb->async && !tchdbflushdrp(hdb)) {
+    if (hdb->wbrecs) {
+        int vsiz = tchdbwbget(hdb, kbuf, ksiz, xstr);
+        if (vsiz >= 0) {
+            HDBUNLOCKMETHOD(hdb);
+            return vsiz;
+        }
+    }
+    if (hdb->async && !tchdbflushdrpool(hdb)) {
         HDBUNLOCKMETHOD(hdb);
         return -1;
     }
@@ -766,6 +968,144 @@ int tchdbgetintoxstr(TCHDB *hdb, const void *kbuf, int ksiz, TCXSTR *xstr) {
 
 }
 
+/* Get the file offsets of records of a hash database object. */
+bool tchdbrecoffs(TCHDB *hdb, const TCLIST *keys, int64_t *offs, int32_t *sizs) {
+    assert(hdb && keys && offs);
+    if (!HDBLOCKMETHOD(hdb, false)) return false;
+    if (INVALIDHANDLE(hdb->fd)) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    if (hdb->async && !tchdbflushdrp(hdb)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    bool err = false;
+    char rbuf[HDBIOBUFSIZ];
+    int knum = TCLISTNUM(keys);
+    for (int i = 0; i < knum && !err; i++) {
+        const char *kbuf;
+        int ksiz;
+        TCLISTVAL(kbuf, keys, i, ksiz);
+        offs[i] = -1;
+        if (sizs) sizs[i] = 0;
+        uint8_t hash;
+        uint64_t bidx = tchdbbidx(hdb, kbuf, ksiz, &hash);
+        if (!HDBLOCKRECORD(hdb, bidx, false)) {
+            err = true;
+            break;
+        }
+        off_t off = tchdbgetbucket(hdb, bidx);
+        if (off == -1) err = true;
+        TCHREC rec;
+        while (off > 0) {
+            rec.off = off;
+            if (!tchdbreadrec(hdb, &rec, rbuf)) {
+                err = true;
+                break;
+            }
+            if (hash > rec.hash) {
+                off = rec.left;
+            } else if (hash < rec.hash) {
+                off = rec.right;
+            } else {
+                if (!rec.kbuf && !tchdbreadrecbody(hdb, &rec)) {
+                    err = true;
+                    break;
+                }
+                int kcmp = tcreckeycmp(kbuf, ksiz, rec.kbuf, rec.ksiz);
+                TCFREE(rec.bbuf);
+                if (kcmp > 0) {
+                    off = rec.left;
+                } else if (kcmp < 0) {
+                    off = rec.right;
+                } else {
+                    offs[i] = rec.off;
+                    if (sizs) sizs[i] = rec.rsiz;
+                    break;
+                }
+            }
+        }
+        HDBUNLOCKRECORD(hdb, bidx);
+    }
+    HDBUNLOCKMETHOD(hdb);
+    return !err;
+}
+
+/* Advise that a region of the database file of a hash database object will be read soon. */
+bool tchdbreadahead(TCHDB *hdb, uint64_t off, uint64_t len) {
+    assert(hdb);
+    return tchdbreadahead2(hdb, &off, &len, 1);
+}
+
+/* Advise that regions of the database file of a hash database object will be read soon. */
+bool tchdbreadahead2(TCHDB *hdb, const uint64_t *offs, const uint64_t *lens, int num) {
+    assert(hdb && offs && lens && num >= 0);
+    if (!HDBLOCKMETHOD(hdb, false)) return false;
+    if (INVALIDHANDLE(hdb->fd)) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+#ifndef _WIN32
+    if (!HDBLOCKSMEMPTR(hdb, false)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    uint64_t msiz = tclmin(hdb->xmsiz, __atomic_load_n64(&hdb->xfsiz, __ATOMIC_ACQUIRE));
+    uint64_t psiz = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < num; i++) {
+        uint64_t off = offs[i];
+        uint64_t end = off + lens[i];
+        if (off < msiz) { //mapped region
+            uint64_t moff = off - off % psiz;
+            madvise(hdb->map + moff, tclmin(end, msiz) - moff, MADV_WILLNEED);
+            off = tclmin(end, msiz);
+        }
+        if (off < end) {
+            posix_fadvise(hdb->fd, off, end - off, POSIX_FADV_WILLNEED);
+        }
+    }
+    HDBUNLOCKSMEMPTR(hdb);
+#endif
+    HDBUNLOCKMETHOD(hdb);
+    return true;
+}
+
+/* Read records of a hash database object into the record cache in batches. */
+bool tchdbprefetch(TCHDB *hdb, const TCLIST *keys) {
+    assert(hdb && keys);
+    if (!HDBLOCKMETHOD(hdb, false)) return false;
+    if (INVALIDHANDLE(hdb->fd)) {
+        tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    if (hdb->async && !tchdbflushdrp(hdb)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    if (!hdb->aio || !hdb->recc || !HDBLOCKAIO(hdb)) {
+        HDBUNLOCKMETHOD(hdb);
+        return true;
+    }
+    bool err = false;
+    int kidx = 0;
+    while (!err && kidx < TCLISTNUM(keys)) {
+        //writers wait for one batch, so no record changes between its read and caching
+        if (!HDBLOCKALLRECORDS(hdb, false)) {
+            err = true;
+            break;
+        }
+        if (!tchdbprefetchimpl(hdb, keys, &kidx)) err = true;
+        HDBUNLOCKALLRECORDS(hdb);
+    }
+    HDBUNLOCKAIO(hdb);
+    HDBUNLOCKMETHOD(hdb);
+    return !err;
+}
+
 /* Retrieve a string record in a hash database object. */
 char *tchdbget2(TCHDB *hdb, const char *kstr) {
     assert(hdb && kstr);
@@ -784,7 +1124,19 @@ int tchdbget3(TCHDB *hdb, const void *kbuf, int ksiz, void *vbuf, int max) {
         HDBUNLOCKMETHOD(hdb);
         return -1;
     }
-    if (hdb->async && !tchdbflushdrp(hdb)) {
+    if (hdb->wbrecs) {
+        TCXSTR *xstr = tcxstrnew();
+        int vsiz = tchdbwbget(hdb, kbuf, ksiz, xstr);
+        if (vsiz >= 0) {
+            HDBUNLOCKMETHOD(hdb);
+            vsiz = tclmin(vsiz, max);
+            memcpy(vbuf, TCXSTRPTR(xstr), vsiz);
+            tcxstrdel(xstr);
+            return vsiz;
+        }
+        tcxstrdel(xstr);
+    }
+    if (hdb->async && !tchdbflushdrpool(hdb)) {
         HDBUNLOCKMETHOD(hdb);
         return -1;
     }
@@ -809,7 +1161,14 @@ int tchdbvsiz(TCHDB *hdb, const void *kbuf, int ksiz) {
         HDBUNLOCKMETHOD(hdb);
         return -1;
     }
-    if (hdb->async && !tchdbflushdrp(hdb)) {
+    if (hdb->wbrecs) {
+        int vsiz = tchdbwbget(hdb, kbuf, ksiz, NULL);
+        if (vsiz >= 0) {
+            HDBUNLOCKMETHOD(hdb);
+            return vsiz;
+        }
+    }
+    if (hdb->async && !tchdbflushdrpool(hdb)) {
         HDBUNLOCKMETHOD(hdb);
         return -1;
     }
@@ -1050,7 +1409,7 @@ int tchdbaddint(TCHDB *hdb, const void *kbuf, int ksiz, int num) {
         HDBUNLOCKMETHOD(hdb);
         if (hdb->dfunit > 0) {
             uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-            if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+            if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
                 rv = false;
             }
         }
@@ -1061,7 +1420,7 @@ int tchdbaddint(TCHDB *hdb, const void *kbuf, int ksiz, int num) {
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -1124,7 +1483,7 @@ double tchdbadddouble(TCHDB *hdb, const void *kbuf, int ksiz, double num) {
         HDBUNLOCKMETHOD(hdb);
         if (hdb->dfunit > 0) {
             uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-            if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+            if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
                 rv = false;
             }
         }
@@ -1135,7 +1494,7 @@ double tchdbadddouble(TCHDB *hdb, const void *kbuf, int ksiz, double num) {
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -1160,6 +1519,12 @@ bool tchdbsync(TCHDB *hdb) {
         HDBUNLOCKMETHOD(hdb);
         return false;
     }
+    if (hdb->dfecode != TCESUCCESS) {
+        tchdbsetecode(hdb, hdb->dfecode, __FILE__, __LINE__, __func__);
+        hdb->dfecode = TCESUCCESS;
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
     bool rv = tchdbmemsync(hdb, true);
     HDBUNLOCKMETHOD(hdb);
     return rv;
@@ -1894,7 +2259,7 @@ bool tchdbputproc(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int
         HDBUNLOCKMETHOD(hdb);
         if (hdb->dfunit > 0) {
             uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-            if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+            if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
                 rv = false;
             }
         }
@@ -1922,7 +2287,7 @@ bool tchdbputproc(TCHDB *hdb, const void *kbuf, int ksiz, const void *vbuf, int
     HDBUNLOCKMETHOD(hdb);
     if (hdb->dfunit > 0) {
         uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
-        if (dfcnt > hdb->dfunit && !tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1)) {
+        if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
             rv = false;
         }
     }
@@ -2340,6 +2705,30 @@ static void tchdbclear(TCHDB *hdb) {
     hdb->drpool = NULL;
     hdb->drpdef = NULL;
     hdb->drpoff = 0;
+    hdb->wbrecs = NULL;
+    hdb->wbflush = NULL;
+    hdb->wbfgen = 0;
+    hdb->wbmtx = NULL;
+    hdb->wbfmtx = NULL;
+    hdb->wbcnd = NULL;
+    hdb->wbthr = NULL;
+    hdb->wbmax = 0;
+    hdb->wbsize = 0;
+    hdb->wbecode = TCESUCCESS;
+    hdb->wbquit = false;
+    hdb->dfmtx = NULL;
+    hdb->dfcnd = NULL;
+    hdb->dfthr = NULL;
+    hdb->dfstep = 0;
+    hdb->dfdelay = -1;
+    hdb->dfecode = TCESUCCESS;
+    hdb->dfreq = false;
+    hdb->dfquit = false;
+    hdb->dfpasses = 0;
+    hdb->dfmoved = 0;
+    hdb->dftrunc = 0;
+    hdb->aio = NULL;
+    hdb->aiomtx = NULL;
     hdb->recc = NULL;
     hdb->rcnum = 0;
     hdb->enc = NULL;
@@ -2419,23 +2808,18 @@ static bool tchdbsetflag(TCHDB *hdb, int flag, bool sign) {
     if (!HDBLOCKSMEMPTR(hdb, false)) {
         return rv;
     }
-    if (!HDBLOCKDB(hdb)) {
-        HDBUNLOCKSMEMPTR(hdb);
-        return rv;
-    }
     if (!hdb->map)
         goto out;
 
-    char *fp = (char*) hdb->map + HDBFLAGSOFF;
+    //fatal errors are flagged while the database lock is held, so the flag byte is set atomically
+    uint8_t *fp = (uint8_t *) hdb->map + HDBFLAGSOFF;
     if (sign) {
-        *fp |= (uint8_t) flag;
+        hdb->flags = __atomic_or_fetch(fp, (uint8_t) flag, __ATOMIC_ACQ_REL);
     } else {
-        *fp &= ~(uint8_t) flag;
+        hdb->flags = __atomic_and_fetch(fp, (uint8_t) ~flag, __ATOMIC_ACQ_REL);
     }
-    hdb->flags = *fp;
     rv = true;
 out:
-    HDBUNLOCKDB(hdb);
     HDBUNLOCKSMEMPTR(hdb);
     return rv;
 }
@@ -2698,10 +3082,10 @@ static void tchdbfbpmerge(TCHDB *hdb) {
 static void tchdbfbpinsert(TCHDB *hdb, uint64_t off, uint32_t rsiz) {
     assert(hdb && off > 0 && rsiz > 0);
     TCDODEBUG(hdb->cnt_insertfbp++);
+    __atomic_add_fetch(&hdb->dfcnt, 1, __ATOMIC_RELEASE);
     if (hdb->fpow < 1) {
         return;
     }
-    __atomic_add_fetch(&hdb->dfcnt, 1, __ATOMIC_RELEASE);
     HDBFB *pv = hdb->fbpool;
     if (hdb->fbpnum >= hdb->fbpmax * HDBFBPALWRAT) {
         tchdbfbpmerge(hdb);
@@ -3147,7 +3531,22 @@ static bool tchdbreadrec(TCHDB *hdb, TCHREC *rec, char *rbuf) {
         HDBUNLOCKDB(hdb);
     }
     HDBUNLOCKSMEMPTR(hdb);
+    return tchdbparserec(hdb, rec, rbuf, rsiz);
+}
 
+/* Parse a record read from the file.
+   `hdb' specifies the hash database object.
+   `rec' specifies the record object whose offset is set.
+   `rbuf' specifies the buffer holding the beginning of the record.
+   `rsiz' specifies the size of the region of the buffer.
+   The key and the value are set if the buffer holds them.
+   The return value is true if successful, else, it is false. */
+static bool tchdbparserec(TCHDB *hdb, TCHREC *rec, const char *rbuf, int rsiz) {
+    assert(hdb && rec && rbuf);
+    if (rsiz < (int) (sizeof (uint8_t) + sizeof (uint32_t))) {
+        tchdbsetecode(hdb, TCERHEAD, __FILE__, __LINE__, __func__);
+        return false;
+    }
     const char *rp = rbuf;
     rec->magic = *(uint8_t *) (rp++);
     if (rec->magic == HDBMAGICFB) {
@@ -3399,12 +3798,28 @@ static int tcreckeycmp(const char *abuf, int asiz, const char *bbuf, int bsiz) {
     return memcmp(abuf, bbuf, asiz);
 }
 
-/* Flush the delayed record pool.
+/* Flush the write-behind buffer and the delayed record pool.
    `hdb' specifies the hash database object.
    The return value is true if successful, else, it is false.
     #METHOD ANY LOCK
  */
 static bool tchdbflushdrp(TCHDB *hdb) {
+    assert(hdb);
+    if (hdb->wbecode != TCESUCCESS) {
+        tchdbsetecode(hdb, hdb->wbecode, __FILE__, __LINE__, __func__);
+        hdb->wbecode = TCESUCCESS;
+        return false;
+    }
+    if (hdb->wbrecs && !tchdbwbflush(hdb)) return false;
+    return tchdbflushdrpool(hdb);
+}
+
+/* Flush the delayed record pool.
+   `hdb' specifies the hash database object.
+   The return value is true if successful, else, it is false.
+    #METHOD ANY LOCK
+ */
+static bool tchdbflushdrpool(TCHDB *hdb) {
     assert(hdb);
     bool err = false;
     if (!HDBLOCKDB(hdb)) return false;
@@ -3477,6 +3892,509 @@ static bool tchdbflushdrp(TCHDB *hdb) {
     return !err;
 }
 
+/* Store a record into the write-behind buffer.
+   `hdb' specifies the hash database object.
+   `kbuf' specifies the pointer to the region of the key.
+   `ksiz' specifies the size of the region of the key.
+   `bidx' specifies the index of the bucket array.
+   `hash' specifies the hash value for the collision tree.
+   `vbuf' specifies the pointer to the region of the value.
+   `vsiz' specifies the size of the region of the value.
+   The return value is true if successful, else, it is false.
+    #METHOD RLOCK
+ */
+static bool tchdbwbput(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx, uint8_t hash,
+        const char *vbuf, int vsiz) {
+    assert(hdb && kbuf && ksiz >= 0 && vbuf && vsiz >= 0);
+    if (hdb->wbecode != TCESUCCESS) {
+        tchdbsetecode(hdb, hdb->wbecode, __FILE__, __LINE__, __func__);
+        hdb->wbecode = TCESUCCESS;
+        return false;
+    }
+    if (hdb->drpool && !tchdbflushdrpool(hdb)) return false;
+    pthread_mutex_lock(hdb->wbmtx);
+    uint8_t flag = 0;
+    int osiz;
+    const char *obuf;
+    bool looked = false;
+    uint64_t fgen = 0;
+    while (true) {
+        obuf = tcmapget(hdb->wbrecs, kbuf, ksiz, &osiz);
+        if (obuf) {
+            flag = *(uint8_t *) obuf;
+            hdb->wbsize -= ksiz + osiz;
+            break;
+        }
+        if (hdb->wbflush && tcmapget(hdb->wbflush, kbuf, ksiz, &osiz)) {
+            flag = 0;
+            break;
+        }
+        //the file is not read under the buffer mutex, so the lookup is valid only if no flush
+        //finished meanwhile
+        if (looked && fgen == hdb->wbfgen) break;
+        fgen = hdb->wbfgen;
+        pthread_mutex_unlock(hdb->wbmtx);
+        if (!HDBLOCKRECORD(hdb, bidx, false)) return false;
+        flag = 0;
+        if (tchdbvsizimpl(hdb, kbuf, ksiz, bidx, hash) < 0) {
+            if (tchdbecode(hdb) != TCENOREC) {
+                HDBUNLOCKRECORD(hdb, bidx);
+                return false;
+            }
+            flag = 1;
+        }
+        HDBUNLOCKRECORD(hdb, bidx);
+        looked = true;
+        pthread_mutex_lock(hdb->wbmtx);
+    }
+    tcmapput4(hdb->wbrecs, kbuf, ksiz, &flag, sizeof (flag), vbuf, vsiz);
+    hdb->wbsize += ksiz + sizeof (flag) + vsiz;
+    if (flag && !obuf) {
+        if (!HDBLOCKDB(hdb)) {
+            pthread_mutex_unlock(hdb->wbmtx);
+            return false;
+        }
+        hdb->rnum++;
+        HDBUNLOCKDB(hdb);
+    }
+    hdb->async = true;
+    bool full = hdb->wbsize >= hdb->wbmax;
+    if (hdb->wbsize >= hdb->wbmax / 2) pthread_cond_signal(hdb->wbcnd);
+    pthread_mutex_unlock(hdb->wbmtx);
+    return full ? tchdbwbflush(hdb) : true;
+}
+
+/* Retrieve a record from the write-behind buffer.
+   `hdb' specifies the hash database object.
+   `kbuf' specifies the pointer to the region of the key.
+   `ksiz' specifies the size of the region of the key.
+   `xstr' specifies the extensible string object to which the value is appended.  If it is `NULL',
+   only the size of the value is retrieved.
+   If the buffer holds the record, the return value is the size of the value, else, it is -1.
+    #METHOD ANY LOCK
+ */
+static int tchdbwbget(TCHDB *hdb, const char *kbuf, int ksiz, TCXSTR *xstr) {
+    assert(hdb && kbuf && ksiz >= 0);
+    pthread_mutex_lock(hdb->wbmtx);
+    int vsiz;
+    const char *vbuf = tcmapget(hdb->wbrecs, kbuf, ksiz, &vsiz);
+    if (!vbuf && hdb->wbflush) vbuf = tcmapget(hdb->wbflush, kbuf, ksiz, &vsiz);
+    if (!vbuf) {
+        pthread_mutex_unlock(hdb->wbmtx);
+        return -1;
+    }
+    vsiz -= sizeof (uint8_t);
+    if (xstr) TCXSTRCAT(xstr, vbuf + sizeof (uint8_t), vsiz);
+    pthread_mutex_unlock(hdb->wbmtx);
+    return vsiz;
+}
+
+/* Write the records of the write-behind buffer into the database file.
+   `hdb' specifies the hash database object.
+   The records are written in the order of their buckets to keep the access to the bucket array
+   and the record region sequential.
+   The return value is true if successful, else, it is false.
+    #METHOD ANY LOCK
+ */
+static bool tchdbwbflush(TCHDB *hdb) {
+    assert(hdb);
+    pthread_mutex_lock(hdb->wbfmtx);
+    pthread_mutex_lock(hdb->wbmtx);
+    TCMAP *recs = hdb->wbrecs;
+    int rnum = TCMAPRNUM(recs);
+    if (rnum < 1) {
+        pthread_mutex_unlock(hdb->wbmtx);
+        pthread_mutex_unlock(hdb->wbfmtx);
+        return true;
+    }
+    hdb->wbrecs = tcmapnew2(tclmax(rnum, HDBDEFBNUM / 16));
+    hdb->wbflush = recs;
+    hdb->wbsize = 0;
+    pthread_mutex_unlock(hdb->wbmtx);
+    HDBWBREC *wrecs;
+    TCMALLOC(wrecs, rnum * sizeof (*wrecs));
+    int wnum = 0;
+    const char *kbuf;
+    int ksiz;
+    tcmapiterinit(recs);
+    while ((kbuf = tcmapiternext(recs, &ksiz)) != NULL) {
+        HDBWBREC *wrec = wrecs + wnum++;
+        wrec->kbuf = kbuf;
+        wrec->ksiz = ksiz;
+        wrec->bidx = tchdbbidx(hdb, kbuf, ksiz, &wrec->hash);
+    }
+    qsort(wrecs, wnum, sizeof (*wrecs), tchdbwbreccmp);
+    bool err = false;
+    int i = 0;
+    for (; i < wnum && !err; i++) {
+        HDBWBREC *wrec = wrecs + i;
+        int vsiz;
+        const char *vbuf = tcmapiterval(wrec->kbuf, &vsiz);
+        uint8_t flag = *(uint8_t *) vbuf;
+        vbuf += sizeof (flag);
+        vsiz -= sizeof (flag);
+        char *zbuf = NULL;
+        if (hdb->zmode) {
+            if (hdb->opts & HDBTDEFLATE) {
+                zbuf = _tc_deflate(vbuf, vsiz, &vsiz, _TCZMRAW);
+            } else if (hdb->opts & HDBTBZIP) {
+                zbuf = _tc_bzcompress(vbuf, vsiz, &vsiz);
+            } else if (hdb->opts & HDBTTCBS) {
+                zbuf = tcbsencode(vbuf, vsiz, &vsiz);
+            } else {
+                zbuf = hdb->enc(vbuf, vsiz, &vsiz, hdb->encop);
+            }
+            if (!zbuf) {
+                tchdbsetecode(hdb, TCEMISC, __FILE__, __LINE__, __func__);
+                err = true;
+                break;
+            }
+        }
+        if (!HDBLOCKRECORD(hdb, wrec->bidx, true)) {
+            if (zbuf) TCFREE(zbuf);
+            err = true;
+            break;
+        }
+        if (flag) {
+            if (!HDBLOCKDB(hdb)) {
+                HDBUNLOCKRECORD(hdb, wrec->bidx);
+                if (zbuf) TCFREE(zbuf);
+                err = true;
+                break;
+            }
+            hdb->rnum--;
+            HDBUNLOCKDB(hdb);
+        }
+        if (!tchdbputimpl(hdb, wrec->kbuf, wrec->ksiz, wrec->bidx, wrec->hash,
+                (zbuf ? zbuf : vbuf), vsiz, HDBPDOVER)) {
+            if (flag && HDBLOCKDB(hdb)) { //the record is still counted in advance
+                hdb->rnum++;
+                HDBUNLOCKDB(hdb);
+            }
+            HDBUNLOCKRECORD(hdb, wrec->bidx);
+            if (zbuf) TCFREE(zbuf);
+            err = true;
+            break;
+        }
+        HDBUNLOCKRECORD(hdb, wrec->bidx);
+        if (zbuf) TCFREE(zbuf);
+    }
+    pthread_mutex_lock(hdb->wbmtx);
+    for (; i < wnum; i++) { //records not written are buffered again unless stored anew meanwhile
+        HDBWBREC *wrec = wrecs + i;
+        int vsiz;
+        const char *vbuf = tcmapiterval(wrec->kbuf, &vsiz);
+        int osiz;
+        uint8_t *obuf = (uint8_t *) tcmapget(hdb->wbrecs, wrec->kbuf, wrec->ksiz, &osiz);
+        if (obuf) {
+            *obuf |= *(uint8_t *) vbuf; //a record not yet in the file is still new
+        } else {
+            tcmapput(hdb->wbrecs, wrec->kbuf, wrec->ksiz, vbuf, vsiz);
+            hdb->wbsize += wrec->ksiz + vsiz;
+        }
+    }
+    hdb->wbflush = NULL;
+    hdb->wbfgen++;
+    pthread_mutex_unlock(hdb->wbmtx);
+    TCFREE(wrecs);
+    tcmapdel(recs);
+    pthread_mutex_unlock(hdb->wbfmtx);
+    return !err;
+}
+
+/* Compare two records of the write-behind buffer by the index of the bucket array.
+   `a' specifies the pointer to one record.
+   `b' specifies the pointer to the other record.
+   The return value is positive if the former is big, negative if the latter is big, 0 if both
+   are equivalent. */
+static int tchdbwbreccmp(const void *a, const void *b) {
+    assert(a && b);
+    uint64_t abidx = ((HDBWBREC *) a)->bidx;
+    uint64_t bbidx = ((HDBWBREC *) b)->bidx;
+    return (abidx > bbidx) ? 1 : ((abidx < bbidx) ? -1 : 0);
+}
+
+/* Start the write-behind thread of a hash database object.
+   `hdb' specifies the hash database object.
+   If the thread can not be started, records are written directly.
+    #METHOD WLOCK
+ */
+static void tchdbwbstart(TCHDB *hdb) {
+    assert(hdb && hdb->wbmtx);
+    hdb->wbrecs = tcmapnew2(HDBDEFBNUM / 16);
+    hdb->wbflush = NULL;
+    hdb->wbfgen = 0;
+    hdb->wbsize = 0;
+    hdb->wbecode = TCESUCCESS;
+    hdb->wbquit = false;
+    TCMALLOC(hdb->wbthr, sizeof (pthread_t));
+    if (pthread_create(hdb->wbthr, NULL, tchdbwbthread, hdb) != 0) {
+        TCFREE(hdb->wbthr);
+        hdb->wbthr = NULL;
+        tcmapdel(hdb->wbrecs);
+        hdb->wbrecs = NULL;
+    }
+}
+
+/* Stop the write-behind thread of a hash database object.
+   `hdb' specifies the hash database object.
+   The records left in the buffer are written by the caller. */
+static void tchdbwbstop(TCHDB *hdb) {
+    assert(hdb && hdb->wbthr);
+    pthread_mutex_lock(hdb->wbmtx);
+    hdb->wbquit = true;
+    pthread_cond_signal(hdb->wbcnd);
+    pthread_mutex_unlock(hdb->wbmtx);
+    pthread_join(*(pthread_t *) hdb->wbthr, NULL);
+    TCFREE(hdb->wbthr);
+    hdb->wbthr = NULL;
+}
+
+/* Write the write-behind buffer in background.
+   `op' specifies the hash database object.
+   The return value is always `NULL'. */
+static void *tchdbwbthread(void *op) {
+    TCHDB *hdb = op;
+    assert(hdb);
+    pthread_mutex_lock(hdb->wbmtx);
+    while (!hdb->wbquit) {
+        if (hdb->wbsize < hdb->wbmax / 2 || hdb->wbecode != TCESUCCESS) {
+            tchdbcondwait(hdb->wbcnd, hdb->wbmtx, HDBWBDELAY);
+            if (hdb->wbquit) break;
+        }
+        bool pending = TCMAPRNUM(hdb->wbrecs) > 0;
+        pthread_mutex_unlock(hdb->wbmtx);
+        if (pending && HDBLOCKMETHOD(hdb, false)) {
+            if (!tchdbwbflush(hdb)) hdb->wbecode = tchdbecode(hdb);
+            HDBUNLOCKMETHOD(hdb);
+            if (hdb->dfunit > 0) {
+                uint32_t dfcnt = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE);
+                if (dfcnt > hdb->dfunit && !tchdbautodefrag(hdb)) {
+                    hdb->wbecode = tchdbecode(hdb);
+                }
+            }
+        }
+        pthread_mutex_lock(hdb->wbmtx);
+    }
+    pthread_mutex_unlock(hdb->wbmtx);
+    return NULL;
+}
+
+/* Run the auto defragmentation of a hash database object.
+   `hdb' specifies the hash database object.
+   If the background defragmentation is running, it is woken up instead.
+   The return value is true if successful, else, it is false.
+    #METHOD NOT LOCKED
+ */
+static bool tchdbautodefrag(TCHDB *hdb) {
+    assert(hdb);
+    if (hdb->dfthr) {
+        pthread_mutex_lock(hdb->dfmtx);
+        hdb->dfreq = true;
+        pthread_cond_signal(hdb->dfcnd);
+        pthread_mutex_unlock(hdb->dfmtx);
+        return true;
+    }
+    return tchdbdefrag(hdb, hdb->dfunit * HDBDFRSRAT + 1);
+}
+
+/* Perform a chunk of the background defragmentation of a hash database object.
+   `hdb' specifies the hash database object.
+   `done' specifies the pointer to the variable into which whether a pass over the whole file is
+   completed is assigned.
+   The return value is true if successful, else, it is false.
+    #METHOD NOT LOCKED
+ */
+static bool tchdbdfchunk(TCHDB *hdb, bool *done) {
+    assert(hdb && done);
+    *done = true;
+    if (!HDBLOCKMETHOD(hdb, false)) return false;
+    if (INVALIDHANDLE(hdb->fd)) {
+        HDBUNLOCKMETHOD(hdb);
+        return true;
+    }
+    if (hdb->drpool && !tchdbflushdrpool(hdb)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    if (!HDBLOCKALLRECORDS(hdb, true)) {
+        HDBUNLOCKMETHOD(hdb);
+        return false;
+    }
+    uint64_t passes = hdb->dfpasses;
+    bool rv = tchdbdefragimpl(hdb, hdb->dfstep);
+    *done = (hdb->dfpasses != passes);
+    HDBUNLOCKALLRECORDS(hdb);
+    HDBUNLOCKMETHOD(hdb);
+    return rv;
+}
+
+/* Start the background defragmentation thread of a hash database object.
+   `hdb' specifies the hash database object.
+   If the thread can not be started, the auto defragmentation runs in writing threads.
+    #METHOD WLOCK
+ */
+static void tchdbdfstart(TCHDB *hdb) {
+    assert(hdb && hdb->dfmtx);
+    hdb->dfecode = TCESUCCESS;
+    hdb->dfreq = false;
+    hdb->dfquit = false;
+    TCMALLOC(hdb->dfthr, sizeof (pthread_t));
+    if (pthread_create(hdb->dfthr, NULL, tchdbdfthread, hdb) != 0) {
+        TCFREE(hdb->dfthr);
+        hdb->dfthr = NULL;
+    }
+}
+
+/* Stop the background defragmentation thread of a hash database object.
+   `hdb' specifies the hash database object.
+   The thread finishes its current chunk, an interrupted pass is continued by the next one. */
+static void tchdbdfstop(TCHDB *hdb) {
+    assert(hdb && hdb->dfthr);
+    pthread_mutex_lock(hdb->dfmtx);
+    hdb->dfquit = true;
+    pthread_cond_signal(hdb->dfcnd);
+    pthread_mutex_unlock(hdb->dfmtx);
+    pthread_join(*(pthread_t *) hdb->dfthr, NULL);
+    TCFREE(hdb->dfthr);
+    hdb->dfthr = NULL;
+}
+
+/* Defragment a hash database object in background.
+   `op' specifies the hash database object.
+   The return value is always `NULL'. */
+static void *tchdbdfthread(void *op) {
+    TCHDB *hdb = op;
+    assert(hdb);
+    uint32_t unit = (hdb->dfunit > 0) ? hdb->dfunit : HDBDFBGUNIT;
+    pthread_mutex_lock(hdb->dfmtx);
+    while (!hdb->dfquit) {
+        if (!hdb->dfreq) {
+            tchdbcondwait(hdb->dfcnd, hdb->dfmtx, HDBDFBGWAIT);
+            if (hdb->dfquit) break;
+        }
+        bool run = hdb->dfreq;
+        hdb->dfreq = false;
+        if (!run && hdb->dfecode == TCESUCCESS) {
+            run = __atomic_load_n(&hdb->dfcnt, __ATOMIC_ACQUIRE) > unit;
+        }
+        if (!run) continue;
+        bool done = false;
+        while (!done && !hdb->dfquit) {
+            pthread_mutex_unlock(hdb->dfmtx);
+            bool rv = tchdbdfchunk(hdb, &done);
+            pthread_mutex_lock(hdb->dfmtx);
+            if (!rv) {
+                hdb->dfecode = tchdbecode(hdb);
+                break;
+            }
+            if (done || hdb->dfquit) break;
+            if (hdb->dfdelay > 0) {
+                tchdbcondwait(hdb->dfcnd, hdb->dfmtx, hdb->dfdelay);
+            } else {
+                pthread_mutex_unlock(hdb->dfmtx);
+                HDBTHREADYIELD(hdb);
+                pthread_mutex_lock(hdb->dfmtx);
+            }
+        }
+    }
+    pthread_mutex_unlock(hdb->dfmtx);
+    return NULL;
+}
+
+/* Wait for a condition variable with timeout.
+   `cnd' specifies the condition variable.
+   `mtx' specifies the mutex locked by the caller.
+   `msec' specifies the timeout in milliseconds. */
+static void tchdbcondwait(void *cnd, void *mtx, int msec) {
+    assert(cnd && mtx && msec >= 0);
+    double deadline = tctime() + msec / 1000.0;
+    struct timespec ts;
+    ts.tv_sec = (time_t) deadline;
+    ts.tv_nsec = (long) ((deadline - ts.tv_sec) * 1000000000.0);
+    pthread_cond_timedwait(cnd, mtx, &ts);
+}
+
+/* Read a batch of records of a hash database object into the record cache.
+   `hdb' specifies the hash database object.
+   `keys' specifies a list object of the keys of the records.
+   `kidx' specifies the pointer to the index of the first key of the batch.  It is set to the index
+   of the first key of the next batch.
+   The first record of the bucket of each key beyond the mapped region is read by one submission
+   of the asynchronous reader and parsed from its buffer.  Records not found there, records larger
+   than the buffer and records in the mapped region are left to the usual retrieval.
+   The return value is true if successful, else, it is false.
+    #METHOD RLOCK + ALLRECORDS RLOCK
+ */
+static bool tchdbprefetchimpl(TCHDB *hdb, const TCLIST *keys, int *kidx) {
+    assert(hdb && hdb->aio && hdb->recc && keys && kidx);
+    TCAIO *aio = hdb->aio;
+    uint64_t msiz = tclmin(hdb->xmsiz, __atomic_load_n64(&hdb->xfsiz, __ATOMIC_ACQUIRE));
+    uint64_t fsiz = hdb->fsiz;
+    int knum = TCLISTNUM(keys);
+    int qnum = 0;
+    while (*kidx < knum && qnum < aio->depth) {
+        int i = (*kidx)++;
+        const char *kbuf;
+        int ksiz;
+        TCLISTVAL(kbuf, keys, i, ksiz);
+        if (tcmdbvsiz(hdb->recc, kbuf, ksiz) >= 0) continue;
+        uint8_t hash;
+        uint64_t bidx = tchdbbidx(hdb, kbuf, ksiz, &hash);
+        off_t off = tchdbgetbucket(hdb, bidx);
+        if (off < (off_t) msiz || off >= (off_t) fsiz) continue;
+        if (!tcaioread(aio, hdb->fd, off, tclmin(aio->bsiz, fsiz - off), i)) break;
+        qnum++;
+    }
+    if (qnum < 1) return true;
+    bool err = !tcaiowait(aio);
+    const char *rbuf;
+    int64_t tag;
+    int rsiz;
+    while ((rbuf = tcaionext(aio, &tag, &rsiz)) != NULL) {
+        if (err || rsiz < 1) continue;
+        const char *kbuf;
+        int ksiz;
+        TCLISTVAL(kbuf, keys, tag, ksiz);
+        uint8_t hash;
+        uint64_t bidx = tchdbbidx(hdb, kbuf, ksiz, &hash);
+        TCHREC rec;
+        rec.off = tchdbgetbucket(hdb, bidx);
+        if (!tchdbparserec(hdb, &rec, rbuf, rsiz)) {
+            err = true;
+            continue;
+        }
+        if (rec.magic != HDBMAGICREC || rec.hash != hash || !rec.vbuf ||
+                tcreckeycmp(kbuf, ksiz, rec.kbuf, rec.ksiz) != 0) {
+            continue;
+        }
+        if (tcmdbrnum(hdb->recc) >= hdb->rcnum) tchdbcacheadjust(hdb);
+        if (hdb->zmode) {
+            int zsiz;
+            char *zbuf;
+            if (hdb->opts & HDBTDEFLATE) {
+                zbuf = _tc_inflate(rec.vbuf, rec.vsiz, &zsiz, _TCZMRAW);
+            } else if (hdb->opts & HDBTBZIP) {
+                zbuf = _tc_bzdecompress(rec.vbuf, rec.vsiz, &zsiz);
+            } else if (hdb->opts & HDBTTCBS) {
+                zbuf = tcbsdecode(rec.vbuf, rec.vsiz, &zsiz);
+            } else {
+                zbuf = hdb->dec(rec.vbuf, rec.vsiz, &zsiz, hdb->decop);
+            }
+            if (!zbuf) {
+                tchdbsetecode(hdb, TCEMISC, __FILE__, __LINE__, __func__);
+                err = true;
+                continue;
+            }
+            tcmdbput4(hdb->recc, kbuf, ksiz, "=", 1, zbuf, zsiz);
+            TCFREE(zbuf);
+        } else {
+            tcmdbput4(hdb->recc, kbuf, ksiz, "=", 1, rec.vbuf, rec.vsiz);
+        }
+    }
+    return !err;
+}
+
 /* Adjust the caches for leaves and nodes.
    `hdb' specifies the hash tree database object. */
 static void tchdbcacheadjust(TCHDB *hdb) {
@@ -4202,6 +5120,55 @@ static bool tchdbputimpl(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx,
     return tchdbwriterec(hdb, &rec, bidx, entoff, true);
 }
 
+/* Overwrite a part of the value of a record in place.
+   `hdb' specifies the hash database object.
+   `kbuf' specifies the pointer to the region of the key.
+   `ksiz' specifies the size of the region of the key.
+   `bidx' specifies the index of the bucket array.
+   `hash' specifies the hash value for the collision tree.
+   `off' specifies the offset of the region to overwrite in the value.
+   `vbuf' specifies the pointer to the region of the new bytes.
+   `vsiz' specifies the size of the region of the new bytes.
+   If successful, the return value is true, else, it is false.
+   #METHOD RLOCK + BNUM WLOCK */
+static bool tchdbputpartimpl(TCHDB *hdb, const char *kbuf, int ksiz, uint64_t bidx, uint8_t hash,
+        int off, const char *vbuf, int vsiz) {
+    assert(hdb && kbuf && ksiz >= 0 && off >= 0 && vbuf && vsiz >= 0);
+    if (hdb->recc) tcmdbout(hdb->recc, kbuf, ksiz);
+    off_t roff = tchdbgetbucket(hdb, bidx);
+    if (roff == -1) return false;
+    TCHREC rec;
+    char rbuf[HDBIOBUFSIZ];
+    while (roff > 0) {
+        rec.off = roff;
+        if (!tchdbreadrec(hdb, &rec, rbuf)) return false;
+        if (hash > rec.hash) {
+            roff = rec.left;
+        } else if (hash < rec.hash) {
+            roff = rec.right;
+        } else {
+            if (!rec.kbuf && !tchdbreadrecbody(hdb, &rec)) return false;
+            int kcmp = tcreckeycmp(kbuf, ksiz, rec.kbuf, rec.ksiz);
+            TCFREE(rec.bbuf);
+            rec.kbuf = NULL;
+            rec.bbuf = NULL;
+            if (kcmp > 0) {
+                roff = rec.left;
+            } else if (kcmp < 0) {
+                roff = rec.right;
+            } else {
+                if ((int64_t) off + vsiz > rec.vsiz) {
+                    tchdbsetecode(hdb, TCEINVALID, __FILE__, __LINE__, __func__);
+                    return false;
+                }
+                return tchdbseekwrite(hdb, rec.boff + rec.ksiz + off, vbuf, vsiz);
+            }
+        }
+    }
+    tchdbsetecode(hdb, TCENOREC, __FILE__, __LINE__, __func__);
+    return false;
+}
+
 /* Append a record to the delayed record pool.
    `hdb' specifies the hash database object.
    `kbuf' specifies the pointer to the region of the key.
@@ -5229,6 +6196,7 @@ static bool tchdbdefragimpl(TCHDB *hdb, int64_t step) {
     while (true) {
         if (hdb->dfcur >= hdb->fsiz) {
             hdb->dfcur = hdb->frec;
+            hdb->dfpasses++;
             return true;
         }
         if (step-- < 1) return true;
@@ -5274,6 +6242,7 @@ static bool tchdbdefragimpl(TCHDB *hdb, int64_t step) {
                 }
             }
             dest += rec.rsiz;
+            hdb->dfmoved += rec.rsiz;
             step--;
         } else {
             if (hdb->iter == cur) hdb->iter += rec.rsiz;
@@ -5312,6 +6281,8 @@ static bool tchdbdefragimpl(TCHDB *hdb, int64_t step) {
         }
         tchdbfbptrim(hdb, base, cur, 0, 0);
         hdb->dfcur = hdb->frec;
+        hdb->dfpasses++;
+        hdb->dftrunc += hdb->fsiz - dest;
         hdb->fsiz = dest;
         uint64_t llnum = hdb->fsiz;
         llnum = TCHTOILL(llnum);
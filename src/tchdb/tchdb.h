@@ -65,6 +65,30 @@ typedef struct { /* type of structure for a hash database */
     char *map; /* pointer to the mapped memory */
     TCXSTR *drpool; /* delayed record pool */
     TCXSTR *drpdef; /* deferred records of the delayed record pool */
+    TCMAP *wbrecs; /* write-behind buffer of records */
+    TCMAP *wbflush; /* records of the write-behind buffer being written */
+    void *wbmtx; /* mutex for the write-behind buffer */
+    void *wbfmtx; /* mutex for writing of the write-behind buffer */
+    void *wbcnd; /* condition for the write-behind thread */
+    void *wbthr; /* write-behind thread */
+    int64_t wbmax; /* maximum size of the write-behind buffer */
+    int64_t wbsize; /* size of records in the write-behind buffer */
+    uint64_t wbfgen; /* number of finished flushes of the write-behind buffer */
+    volatile int wbecode; /* error code of the write-behind thread */
+    volatile bool wbquit; /* whether the write-behind thread is stopping */
+    void *dfmtx; /* mutex for the background defragmentation */
+    void *dfcnd; /* condition for the background defragmentation thread */
+    void *dfthr; /* background defragmentation thread */
+    int32_t dfstep; /* number of steps of a chunk of the background defragmentation */
+    int32_t dfdelay; /* pause in milliseconds between chunks of the background defragmentation */
+    volatile int dfecode; /* error code of the background defragmentation thread */
+    volatile bool dfreq; /* whether the background defragmentation is requested */
+    volatile bool dfquit; /* whether the background defragmentation thread is stopping */
+    uint64_t dfpasses; /* number of passes of defragmentation over the whole file */
+    uint64_t dfmoved; /* total size of records moved by defragmentation */
+    uint64_t dftrunc; /* total size of the file truncated by defragmentation */
+    TCAIO *aio; /* asynchronous reader of the file or `NULL' */
+    void *aiomtx; /* mutex for the asynchronous reader */
     TCCODEC enc; /* pointer to the encoding function */
     TCCODEC dec; /* pointer to the decoding function */
     TCMDB *recc; /* cache for records */
@@ -233,6 +257,53 @@ EJDB_EXPORT bool tchdbsetxmsiz(TCHDB *hdb, int64_t xmsiz);
 EJDB_EXPORT bool tchdbsetdfunit(TCHDB *hdb, int32_t dfunit);
 
 
+/* Set the size of the write-behind buffer of a hash database object.
+   `hdb' specifies the hash database object which is not opened.
+   `size' specifies the maximum size of records kept in the buffer.  If it is not more than 0, the
+   write-behind buffer is disabled.  It is disabled by default.
+   If successful, the return value is true, else, it is false.
+   Records stored with `tchdbput' are kept in the buffer and a background thread writes them into
+   the file in order of their buckets, the last value of a record stored many times is written
+   once.  Retrieving functions see buffered records, the other functions write the buffer first,
+   so `tchdbsync' is a barrier for buffered records.  Buffered records are lost if the process
+   dies.  The buffer is used only if the database is opened as a writer.
+   Note that the mutual exclusion control should be set before, and the buffer should be set
+   before the database is opened. */
+EJDB_EXPORT bool tchdbsetwritebehind(TCHDB *hdb, int64_t size);
+
+
+/* Set the background defragmentation of a hash database object.
+   `hdb' specifies the hash database object which is not opened.
+   `step' specifies the number of steps of a chunk.  If it is not more than 0, the default value
+   is specified.  The default value is 255.
+   `delay' specifies the pause in milliseconds between chunks.  If it is negative, the background
+   defragmentation is disabled.  It is disabled by default.
+   If successful, the return value is true, else, it is false.
+   A background thread moves records into free blocks and truncates the file chunk by chunk, each
+   chunk holds the locks of records only for `step' steps, so other threads are not stalled.  The
+   thread runs when the unit step number of auto defragmentation is reached, which no longer runs
+   in writing threads, or when free blocks appear while it is not set.  Progress is kept in the
+   `dfpasses', `dfmoved' and `dftrunc' members.  The thread is used only if the database is opened
+   as a writer.
+   Note that the mutual exclusion control should be set before, and the background
+   defragmentation should be set before the database is opened. */
+EJDB_EXPORT bool tchdbsetbgdefrag(TCHDB *hdb, int32_t step, int32_t delay);
+
+
+/* Set the asynchronous reading of a hash database object.
+   `hdb' specifies the hash database object which is not opened.
+   `depth' specifies the maximum number of reads in flight.
+   If successful, the return value is true, else, it is false.  It fails if asynchronous I/O is
+   not supported by the platform, the database works with synchronous reads then.
+   `tchdbprefetch' reads records beyond the mapped region in batches into the record cache.  If
+   the record cache was not set by `tchdbsetcache', this function enables it with the maximum
+   number of 4096 records.  On Linux io_uring is used with buffers registered once.  Only reads are
+   batched, writes including the flushes of the write-behind buffer stay synchronous.
+   Note that the mutual exclusion control should be set before, and the asynchronous reading
+   should be set before the database is opened. */
+EJDB_EXPORT bool tchdbsetaio(TCHDB *hdb, int32_t depth);
+
+
 /* Open a database file and connect a hash database object.
    `hdb' specifies the hash database object which is not opened.
    `path' specifies the path of the database file.
@@ -337,6 +408,19 @@ EJDB_EXPORT bool tchdbputasync(TCHDB *hdb, const void *kbuf, int ksiz, const voi
 EJDB_EXPORT bool tchdbputasync2(TCHDB *hdb, const char *kstr, const char *vstr);
 
 
+/* Overwrite a part of the value of an existing record of a hash database object in place.
+   `hdb' specifies the hash database object connected as a writer.
+   `kbuf' specifies the pointer to the region of the key.
+   `ksiz' specifies the size of the region of the key.
+   `off' specifies the offset of the region to overwrite in the value.
+   `vbuf' specifies the pointer to the region of the new bytes.
+   `vsiz' specifies the size of the region of the new bytes.
+   If successful, the return value is true, else, it is false.
+   The size of the value is never changed. If there is no corresponding record or the region
+   exceeds the value, this function fails. It also fails if the database is compressed. */
+EJDB_EXPORT bool tchdbputpart(TCHDB *hdb, const void *kbuf, int ksiz, int off, const void *vbuf, int vsiz);
+
+
 /* Remove a record of a hash database object.
    `hdb' specifies the hash database object connected as a writer.
    `kbuf' specifies the pointer to the region of the key.
@@ -378,6 +462,47 @@ EJDB_EXPORT void *tchdbget(TCHDB *hdb, const void *kbuf, int ksiz, int *sp);
 EJDB_EXPORT int tchdbgetintoxstr(TCHDB *hdb, const void *kbuf, int ksiz, TCXSTR *xstr);
 
 
+/* Get the file offsets of records of a hash database object.
+   `hdb' specifies the hash database object.
+   `keys' specifies a list object of the keys of the records.
+   `offs' specifies the array into which the offset of each record is written.  The offset of a
+   missing record is -1.
+   `sizs' specifies the array into which the size of each record is written.  If it is `NULL', it
+   is not used.
+   If successful, the return value is true, else, it is false.
+   Record values are not read, so this function is cheap enough to be used for ordering a batch of
+   following retrievals by file position. */
+EJDB_EXPORT bool tchdbrecoffs(TCHDB *hdb, const TCLIST *keys, int64_t *offs, int32_t *sizs);
+
+
+/* Advise that a region of the database file of a hash database object will be read soon.
+   `hdb' specifies the hash database object.
+   `off' specifies the offset of the region.
+   `len' specifies the length of the region.
+   If successful, the return value is true, else, it is false. */
+EJDB_EXPORT bool tchdbreadahead(TCHDB *hdb, uint64_t off, uint64_t len);
+
+
+/* Advise that regions of the database file of a hash database object will be read soon.
+   `hdb' specifies the hash database object.
+   `offs' specifies the array of the offsets of the regions.
+   `lens' specifies the array of the lengths of the regions.
+   `num' specifies the number of the regions.
+   If successful, the return value is true, else, it is false. */
+EJDB_EXPORT bool tchdbreadahead2(TCHDB *hdb, const uint64_t *offs, const uint64_t *lens, int num);
+
+
+/* Read records of a hash database object into the record cache in batches.
+   `hdb' specifies the hash database object.
+   `keys' specifies a list object of the keys of the records.
+   If successful, the return value is true, else, it is false.
+   Records beyond the mapped region are read with one submission per batch of the asynchronous
+   reader, so retrieving them afterwards needs no reading of the file.  Records which are not
+   found, which are larger than a buffer of the reader or which are in the mapped region are
+   retrieved as usual.  The function does nothing without asynchronous reading. */
+EJDB_EXPORT bool tchdbprefetch(TCHDB *hdb, const TCLIST *keys);
+
+
 /* Retrieve a string record in a hash database object.
    `hdb' specifies the hash database object.
    `kstr' specifies the string of the key.
@@ -38,6 +38,12 @@
 #define TDBIDXICCMAX   (64LL<<20)        // maximum size of the index cache
 #define TDBIDXICCSYNC  0.01              // ratio of cache synchronization
 #define TDBIDXQGUNIT   3                 // unit number of the q-gram index
+#define TDBIDXHPKSIZ   12                // expected size of a primary key in a hash index entry
+#define TDBIDXBULKMAX  (256LL<<20)       // maximum size of a sorted run of the bulk index load
+#define TDBIDXPLMAGIC  "\0\0\0"           // leading bytes of a sorted token posting list
+#define TDBIDXPLMAGICSIZ 3                // size of the leading bytes of a sorted posting list
+#define TDBIDXPLTAILMIN 512              // minimum size of the unsorted tail of a compacted posting list
+#define TDBIDXPLTAILRAT 4                // ratio of the sorted part to the tail of a compacted list
 #define TDBFTSUNITMAX  32                // maximum number of full-text search units
 #define TDBFTSOCRUNIT  8192              // maximum number of full-text search units
 #define TDBFTSBMNUM    524287            // number of elements of full-text search bitmap
@@ -96,6 +102,8 @@ static bool tctdbopenimpl(TCTDB *tdb, const char *path, int omode);
 static bool tctdbcloseimpl(TCTDB *tdb);
 static bool tctdbputimpl(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols, int dmode);
 static bool tctdboutimpl(TCTDB *tdb, const char *pkbuf, int pksiz);
+static bool tctdbputcolpartimpl(TCTDB *tdb, const void *pkbuf, int pksiz, const void *nbuf, int nsiz,
+        int off, const void *vbuf, int vsiz);
 static TCMAP *tctdbgetimpl(TCTDB *tdb, const void *pkbuf, int pksiz);
 static char *tctdbgetonecol(TCTDB *tdb, const void *pkbuf, int pksiz,
         const void *nbuf, int nsiz, int *sp);
@@ -124,7 +132,11 @@ static int tdbcmpsortrecstrasc(const TDBSORTREC *a, const TDBSORTREC *b);
 static int tdbcmpsortrecstrdesc(const TDBSORTREC *a, const TDBSORTREC *b);
 static int tdbcmpsortrecnumasc(const TDBSORTREC *a, const TDBSORTREC *b);
 static int tdbcmpsortrecnumdesc(const TDBSORTREC *a, const TDBSORTREC *b);
-static uint16_t tctdbidxhash(const char *pkbuf, int pksiz);
+static void tctdbidxbulkadd(TCLIST *run, const char *pkbuf, int pksiz, uint16_t hash,
+        const char *vbuf, int vsiz);
+static int tctdbidxbulkcmplexical(const TCLISTDATUM *a, const TCLISTDATUM *b);
+static int tctdbidxbulkcmpdecimal(const TCLISTDATUM *a, const TCLISTDATUM *b);
+static bool tctdbidxbulkflush(TCTDB *tdb, TDBIDX *idx, TCLIST *run);
 static bool tctdbidxputone(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz, uint16_t hash,
         const char *vbuf, int vsiz);
 static bool tctdbidxputtoken(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz,
@@ -139,8 +151,18 @@ static bool tctdbidxouttoken(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pks
 static bool tctdbidxouttoken2(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz, TCLIST *tokens);
 static bool tctdbidxoutqgram(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz,
         const char *vbuf, int vsiz);
+static bool tctdbidxputhash(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz,
+        const char *vbuf, int vsiz);
+static bool tctdbidxouthash(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz,
+        const char *vbuf, int vsiz);
 static bool tctdbidxsyncicc(TCTDB *tdb, TDBIDX *idx, bool all);
 static int tctdbidxcmpkey(const char **a, const char **b);
+static int tctdbidxplsortsiz(const char *buf, int size);
+static bool tctdbidxreadpl(const char *buf, int size, TCLIST *pks, int *usp);
+static void tctdbidxwritepl(const TCLIST *pks, TCXSTR *xstr);
+static bool tctdbidxoutpl(TCTDB *tdb, TDBIDX *idx, const char *tbuf, int tsiz,
+        const char *pkbuf, int pksiz);
+static int tctdbidxcmppk(const char *abuf, int asiz, const char *bbuf, int bsiz);
 
 static TCMAP *tctdbidxgetbyfts(TCTDB *tdb, TDBIDX *idx, TDBCOND *cond, TCXSTR *hint);
 static void tctdbidxgetbyftsunion(TDBIDX *idx, const TCLIST *tokens, bool sign,
@@ -250,6 +272,17 @@ bool tctdbsetcache(TCTDB *tdb, int32_t rcnum, int32_t lcnum, int32_t ncnum) {
     return tchdbsetcache(tdb->hdb, rcnum);
 }
 
+/* Set the shared size budget of leaves cached by column indices of a table database object. */
+bool tctdbsetidxcachebudget(TCTDB *tdb, BDBCBUDGET *budget) {
+    assert(tdb);
+    if (tdb->open) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    tdb->icbudget = budget;
+    return true;
+}
+
 /* Set the size of the extra mapped memory of a table database object. */
 bool tctdbsetxmsiz(TCTDB *tdb, int64_t xmsiz) {
     assert(tdb);
@@ -270,6 +303,36 @@ bool tctdbsetdfunit(TCTDB *tdb, int32_t dfunit) {
     return tchdbsetdfunit(tdb->hdb, dfunit);
 }
 
+/* Set the size of the write-behind buffer of records of a table database object. */
+bool tctdbsetwritebehind(TCTDB *tdb, int64_t size) {
+    assert(tdb);
+    if (tdb->open) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    return tchdbsetwritebehind(tdb->hdb, size);
+}
+
+/* Set the background defragmentation of records of a table database object. */
+bool tctdbsetbgdefrag(TCTDB *tdb, int32_t step, int32_t delay) {
+    assert(tdb);
+    if (tdb->open) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    return tchdbsetbgdefrag(tdb->hdb, step, delay);
+}
+
+/* Set the asynchronous reading of records of a table database object. */
+bool tctdbsetaio(TCTDB *tdb, int32_t depth) {
+    assert(tdb);
+    if (tdb->open) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    return tchdbsetaio(tdb->hdb, depth);
+}
+
 /* Open a database file and connect a table database object. */
 bool tctdbopen(TCTDB *tdb, const char *path, int omode) {
     assert(tdb && path);
@@ -409,6 +472,43 @@ bool tctdbputcat3(TCTDB *tdb, const char *pkstr, const char *cstr) {
     return rv;
 }
 
+/* Store a record into a table database object in asynchronous fashion. */
+bool tctdbputasync(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols) {
+    assert(tdb && pkbuf && pksiz >= 0 && cols);
+    int vsiz;
+    if (tcmapget(cols, "", 0, &vsiz)) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    if (!TDBLOCKMETHOD(tdb, true)) return false;
+    if (!tdb->open || !tdb->wmode || tdb->inum > 0) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        TDBUNLOCKMETHOD(tdb);
+        return false;
+    }
+    int csiz;
+    char *cbuf = tcmapdump(cols, &csiz);
+    bool rv = tchdbputasync(tdb->hdb, pkbuf, pksiz, cbuf, csiz);
+    TCFREE(cbuf);
+    TDBUNLOCKMETHOD(tdb);
+    return rv;
+}
+
+/* Overwrite a part of a column of the existing record in a table database object in place. */
+bool tctdbputcolpart(TCTDB *tdb, const void *pkbuf, int pksiz, const void *nbuf, int nsiz,
+        int off, const void *vbuf, int vsiz) {
+    assert(tdb && pkbuf && pksiz >= 0 && nbuf && nsiz >= 0 && off >= 0 && vbuf && vsiz >= 0);
+    if (!TDBLOCKMETHOD(tdb, true)) return false;
+    if (!tdb->open || !tdb->wmode) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        TDBUNLOCKMETHOD(tdb);
+        return false;
+    }
+    bool rv = tctdbputcolpartimpl(tdb, pkbuf, pksiz, nbuf, nsiz, off, vbuf, vsiz);
+    TDBUNLOCKMETHOD(tdb);
+    return rv;
+}
+
 /* Remove a record of a table database object. */
 bool tctdbout(TCTDB *tdb, const void *pkbuf, int pksiz) {
     assert(tdb && pkbuf && pksiz >= 0);
@@ -745,6 +845,9 @@ uint64_t tctdbfsiz(TCTDB *tdb) {
             case TDBITQGRAM:
                 rv += tcbdbfsiz(idx->db);
                 break;
+            case TDBITHASH:
+                rv += tchdbfsiz(idx->db);
+                break;
         }
     }
     TDBUNLOCKMETHOD(tdb);
@@ -1246,6 +1349,12 @@ bool tctdbmemsync(TCTDB *tdb, bool phys) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbmemsync(idx->db, phys)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -1625,6 +1734,8 @@ int tctdbstrtoindextype(const char *str) {
         type = TDBITTOKEN;
     } else if (!tcstricmp(str, "QGR") || !tcstricmp(str, "QGRAM") || !tcstricmp(str, "FTS")) {
         type = TDBITQGRAM;
+    } else if (!tcstricmp(str, "HSH") || !tcstricmp(str, "HASH")) {
+        type = TDBITHASH;
     } else if (!tcstricmp(str, "OPT") || !tcstricmp(str, "OPTIMIZE")) {
         type = TDBITOPT;
     } else if (!tcstricmp(str, "VOID") || !tcstricmp(str, "NULL")) {
@@ -1821,6 +1932,7 @@ static void tctdbclear(TCTDB *tdb) {
     tdb->opts = 0;
     tdb->lcnum = TDBDEFLCNUM;
     tdb->ncnum = TDBDEFNCNUM;
+    tdb->icbudget = NULL;
     tdb->iccmax = TDBIDXICCMAX;
     tdb->iccsync = TDBIDXICCSYNC;
     tdb->idxs = NULL;
@@ -1906,6 +2018,7 @@ static bool tctdbopenimpl(TCTDB *tdb, const char *path, int omode) {
             if (tdb->mmtx) tcbdbsetmutex(bdb);
             if (enc && dec) tcbdbsetcodecfunc(bdb, enc, encop, dec, decop);
             tcbdbsetcache(bdb, tdb->lcnum, tdb->ncnum);
+            tcbdbsetcachebudget(bdb, tdb->icbudget);
             tcbdbsetxmsiz(bdb, tchdbxmsiz(tdb->hdb));
             tcbdbsetdfunit(bdb, tchdbdfunit(tdb->hdb));
             tcbdbsetlsmax(bdb, TDBIDXLSMAX);
@@ -1930,6 +2043,22 @@ static bool tctdbopenimpl(TCTDB *tdb, const char *path, int omode) {
             } else {
                 tcbdbdel(bdb);
             }
+        } else if (!strcmp(ep, "hsh")) {
+            TCHDB *ihdb = tchdbnew();
+            if (!INVALIDHANDLE(dbgfd)) tchdbsetdbgfd(ihdb, dbgfd);
+            if (tdb->mmtx) tchdbsetmutex(ihdb);
+            if (enc && dec) tchdbsetcodecfunc(ihdb, enc, encop, dec, decop);
+            tchdbsetxmsiz(ihdb, tchdbxmsiz(tdb->hdb));
+            tchdbsetdfunit(ihdb, tchdbdfunit(tdb->hdb));
+            if (tchdbopen(ihdb, ipath, homode & ~(HDBOCREAT | HDBOTRUNC))) {
+                idxs[inum].name = tcstrdup(name);
+                idxs[inum].type = TDBITHASH;
+                idxs[inum].db = ihdb;
+                idxs[inum].cc = NULL;
+                inum++;
+            } else {
+                tchdbdel(ihdb);
+            }
         }
         TCFREE(name);
         TCFREE(stem);
@@ -1982,6 +2111,13 @@ static bool tctdbcloseimpl(TCTDB *tdb) {
                 }
                 tcbdbdel(idx->db);
                 break;
+            case TDBITHASH:
+                if (!tchdbclose(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                tchdbdel(idx->db);
+                break;
         }
         TCFREE(idx->name);
     }
@@ -2096,6 +2232,55 @@ static TCMAP *tctdbgetimpl(TCTDB *tdb, const void *pkbuf, int pksiz) {
     return cols;
 }
 
+/* Overwrite a part of a column of a record in a table database object in place.
+   `tdb' specifies the table database object.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   `nbuf' specifies the pointer to the region of the column name.
+   `nsiz' specifies the size of the region of the column name.
+   `off' specifies the offset of the region to overwrite in the column value.
+   `vbuf' specifies the pointer to the region of the new bytes.
+   `vsiz' specifies the size of the region of the new bytes.
+   If successful, the return value is true, else, it is false. */
+static bool tctdbputcolpartimpl(TCTDB *tdb, const void *pkbuf, int pksiz, const void *nbuf, int nsiz,
+        int off, const void *vbuf, int vsiz) {
+    assert(tdb && pkbuf && pksiz >= 0 && nbuf && nsiz >= 0 && off >= 0 && vbuf && vsiz >= 0);
+    for (int i = 0; i < tdb->inum; i++) {
+        const char *iname = tdb->idxs[i].name;
+        if (strlen(iname) == nsiz && !memcmp(iname, nbuf, nsiz)) {
+            tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+            return false;
+        }
+    }
+    int csiz;
+    char *cbuf = tchdbget(tdb->hdb, pkbuf, pksiz, &csiz);
+    if (!cbuf) return false;
+    int coff = -1;
+    const char *rp = cbuf;
+    const char *ep = cbuf + csiz;
+    while (rp < ep) {
+        int step, ksiz, csz;
+        TCREADVNUMBUF(rp, ksiz, step);
+        rp += step;
+        const char *kbuf = rp;
+        rp += ksiz;
+        if (rp > ep) break;
+        TCREADVNUMBUF(rp, csz, step);
+        rp += step;
+        if (ksiz == nsiz && !memcmp(kbuf, nbuf, nsiz)) {
+            if ((int64_t) off + vsiz <= csz) coff = (rp - cbuf) + off;
+            break;
+        }
+        rp += csz;
+    }
+    TCFREE(cbuf);
+    if (coff < 0) {
+        tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+        return false;
+    }
+    return tchdbputpart(tdb->hdb, pkbuf, pksiz, coff, vbuf, vsiz);
+}
+
 /* Retrieve the value of a column of a record in a table database object.
    `tdb' specifies the table database object.
    `pkbuf' specifies the pointer to the region of the primary key.
@@ -2186,6 +2371,12 @@ static bool tctdboptimizeimpl(TCTDB *tdb, int64_t bnum, int8_t apow, int8_t fpow
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbvanish(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     const char *path = tchdbpath(tdb->hdb);
@@ -2271,6 +2462,12 @@ static bool tctdboptimizeimpl(TCTDB *tdb, int64_t bnum, int8_t apow, int8_t fpow
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdboptimize(idx->db, -1, -1, -1, UINT8_MAX)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -2306,6 +2503,12 @@ static bool tctdbvanishimpl(TCTDB *tdb) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbvanish(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -2359,6 +2562,27 @@ static bool tctdbcopyimpl(TCTDB *tdb, const char *path) {
                     }
                 }
                 break;
+            case TDBITHASH:
+                if (*path == '@') {
+                    if (!tchdbcopy(idx->db, path)) {
+                        tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                        err = true;
+                    }
+                } else {
+                    ipath = tchdbpath(idx->db);
+                    if (tcstrfwm(ipath, opath)) {
+                        char *tpath = tcsprintf("%s%s", path, ipath + strlen(opath));
+                        if (!tchdbcopy(idx->db, tpath)) {
+                            tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                            err = true;
+                        }
+                        TCFREE(tpath);
+                    } else {
+                        tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+                        err = true;
+                    }
+                }
+                break;
         }
     }
     return !err;
@@ -2395,6 +2619,12 @@ bool tctdbtranbeginimpl(TCTDB *tdb) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbtranbegin(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -2431,6 +2661,12 @@ bool tctdbtrancommitimpl(TCTDB *tdb) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbtrancommit(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -2466,6 +2702,12 @@ bool tctdbtranabortimpl(TCTDB *tdb) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbtranabort(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -2545,6 +2787,12 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
                             err = true;
                         }
                         break;
+                    case TDBITHASH:
+                        if (!tchdboptimize(idx->db, -1, -1, -1, UINT8_MAX)) {
+                            tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                            err = true;
+                        }
+                        break;
                 }
                 done = true;
                 break;
@@ -2568,6 +2816,15 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
                     }
                     TCFREE(path);
                     break;
+                case TDBITHASH:
+                    path = tcstrdup(tchdbpath(idx->db));
+                    tchdbdel(idx->db);
+                    if (path && !tcunlinkfile(path)) {
+                        tctdbsetecode(tdb, TCEUNLINK, __FILE__, __LINE__, __func__);
+                        err = true;
+                    }
+                    TCFREE(path);
+                    break;
             }
             TCFREE(idx->name);
             tdb->inum--;
@@ -2606,6 +2863,12 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
     if (opts & TDBTBZIP) bopts |= BDBTBZIP;
     if (opts & TDBTTCBS) bopts |= BDBTTCBS;
     if (opts & TDBTEXCODEC) bopts |= BDBTEXCODEC;
+    uint8_t hopts = 0;
+    if (opts & TDBTLARGE) hopts |= HDBTLARGE;
+    if (opts & TDBTDEFLATE) hopts |= HDBTDEFLATE;
+    if (opts & TDBTBZIP) hopts |= HDBTBZIP;
+    if (opts & TDBTTCBS) hopts |= HDBTTCBS;
+    if (opts & TDBTEXCODEC) hopts |= HDBTEXCODEC;
     switch (type) {
         case TDBITLEXICAL:
             idx->db = tcbdbnew();
@@ -2616,6 +2879,7 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
             if (enc && dec) tcbdbsetcodecfunc(idx->db, enc, encop, dec, decop);
             tcbdbtune(idx->db, TDBIDXLMEMB, TDBIDXNMEMB, bbnum, -1, -1, bopts);
             tcbdbsetcache(idx->db, tdb->lcnum, tdb->ncnum);
+            tcbdbsetcachebudget(idx->db, tdb->icbudget);
             tcbdbsetxmsiz(idx->db, bxmsiz);
             tcbdbsetdfunit(idx->db, tchdbdfunit(tdb->hdb));
             tcbdbsetlsmax(idx->db, TDBIDXLSMAX);
@@ -2635,6 +2899,7 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
             if (enc && dec) tcbdbsetcodecfunc(idx->db, enc, encop, dec, decop);
             tcbdbtune(idx->db, TDBIDXLMEMB, TDBIDXNMEMB, bbnum, -1, -1, bopts);
             tcbdbsetcache(idx->db, tdb->lcnum, tdb->ncnum);
+            tcbdbsetcachebudget(idx->db, tdb->icbudget);
             tcbdbsetxmsiz(idx->db, bxmsiz);
             tcbdbsetdfunit(idx->db, tchdbdfunit(tdb->hdb));
             tcbdbsetlsmax(idx->db, TDBIDXLSMAX);
@@ -2654,6 +2919,7 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
             if (enc && dec) tcbdbsetcodecfunc(idx->db, enc, encop, dec, decop);
             tcbdbtune(idx->db, TDBIDXLMEMB, TDBIDXNMEMB, bbnum, -1, -1, bopts);
             tcbdbsetcache(idx->db, tdb->lcnum, tdb->ncnum);
+            tcbdbsetcachebudget(idx->db, tdb->icbudget);
             tcbdbsetxmsiz(idx->db, bxmsiz);
             tcbdbsetdfunit(idx->db, tchdbdfunit(tdb->hdb));
             tcbdbsetlsmax(idx->db, TDBIDXLSMAX);
@@ -2673,6 +2939,7 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
             if (enc && dec) tcbdbsetcodecfunc(idx->db, enc, encop, dec, decop);
             tcbdbtune(idx->db, TDBIDXLMEMB, TDBIDXNMEMB, bbnum, -1, -1, bopts);
             tcbdbsetcache(idx->db, tdb->lcnum, tdb->ncnum);
+            tcbdbsetcachebudget(idx->db, tdb->icbudget);
             tcbdbsetxmsiz(idx->db, bxmsiz);
             tcbdbsetdfunit(idx->db, tchdbdfunit(tdb->hdb));
             tcbdbsetlsmax(idx->db, TDBIDXLSMAX);
@@ -2682,6 +2949,29 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
             }
             tdb->inum++;
             break;
+        case TDBITHASH:
+            if (*name == '\0') { //primary keys are already hashed by the main database
+                tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
+                err = true;
+                break;
+            }
+            idx->db = tchdbnew();
+            idx->cc = NULL;
+            idx->name = tcstrdup(name);
+            tcxstrprintf(pbuf, "%chsh", MYEXTCHR);
+            if (!INVALIDHANDLE(dbgfd)) tchdbsetdbgfd(idx->db, dbgfd);
+            if (tdb->mmtx) tchdbsetmutex(idx->db);
+            if (enc && dec) tchdbsetcodecfunc(idx->db, enc, encop, dec, decop);
+            tchdbtune(idx->db, tchdbbnum(tdb->hdb), -1, -1, hopts);
+            tchdbsetxmsiz(idx->db, bxmsiz);
+            tchdbsetdfunit(idx->db, tchdbdfunit(tdb->hdb));
+            if (!tchdbopen(idx->db, TCXSTRPTR(pbuf), HDBOWRITER | HDBOCREAT | HDBOTRUNC |
+                    (homode & (HDBONOLCK | HDBOLCKNB | HDBOTSYNC)))) {
+                tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                err = true;
+            }
+            tdb->inum++;
+            break;
         default:
             tctdbsetecode(tdb, TCEINVALID, __FILE__, __LINE__, __func__);
             err = true;
@@ -2695,7 +2985,10 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
         TCXSTR *kxstr = tcxstrnew();
         TCXSTR *vxstr = tcxstrnew();
         int nsiz = strlen(name);
-        while (tchdbiternext3(hdb, kxstr, vxstr)) {
+        //keys of B+ tree indexes are sorted in runs and appended in their order
+        TCLIST *run = (nsiz > 0 && (type == TDBITLEXICAL || type == TDBITDECIMAL)) ? tclistnew() : NULL;
+        int64_t rsiz = 0;
+        while (!err && tchdbiternext3(hdb, kxstr, vxstr)) {
             TCLIST *tokens = (type == TDBITTOKEN) ? tclistnew() : NULL;
             int vsiz;
             const char *pkbuf = TCXSTRPTR(kxstr);
@@ -2723,7 +3016,13 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
                 switch (type) {
                     case TDBITLEXICAL:
                     case TDBITDECIMAL:
-                        if (vbuf && !tctdbidxputone(tdb, idx, pkbuf, pksiz, tctdbidxhash(pkbuf, pksiz), vbuf, vsiz)) err = true;
+                        if (!vbuf) break;
+                        tctdbidxbulkadd(run, pkbuf, pksiz, tctdbidxhash(pkbuf, pksiz), vbuf, vsiz);
+                        rsiz += vsiz + pksiz + sizeof (int32_t) + 3;
+                        if (rsiz >= TDBIDXBULKMAX) {
+                            if (!tctdbidxbulkflush(tdb, idx, run)) err = true;
+                            rsiz = 0;
+                        }
                         break;
                     case TDBITTOKEN:
                         if (tokens && !tctdbidxputtoken2(tdb, idx, pkbuf, pksiz, tokens)) err = true;
@@ -2731,11 +3030,18 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
                     case TDBITQGRAM:
                         if (vbuf && !tctdbidxputqgram(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
                         break;
+                    case TDBITHASH:
+                        if (vbuf && !tctdbidxputhash(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
+                        break;
                 }
             }
             if (vbuf) TCFREE(vbuf);
             if (tokens) tclistdel(tokens);
         }
+        if (run) {
+            if (!err && !tctdbidxbulkflush(tdb, idx, run)) err = true;
+            tclistdel(run);
+        }
         tcxstrdel(vxstr);
         tcxstrdel(kxstr);
     }
@@ -2743,6 +3049,93 @@ static bool tctdbsetindeximpl(TCTDB *tdb, const char *name, int type, TDBRVALOAD
     return !err;
 }
 
+/* Add a column of a record into a run of the bulk load of an index.
+   `run' specifies the list object of the run.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   `hash' specifies the hash value of the primary key.
+   `vbuf' specifies the pointer to the region of the column value.
+   `vsiz' specifies the size of the region of the column value.
+   Each element holds the size of the index key, the index key as `tctdbidxputone' makes it and
+   the primary key. */
+static void tctdbidxbulkadd(TCLIST *run, const char *pkbuf, int pksiz, uint16_t hash,
+        const char *vbuf, int vsiz) {
+    assert(run && pkbuf && pksiz >= 0 && vbuf && vsiz >= 0);
+    char stack[TDBCOLBUFSIZ], *rbuf;
+    int32_t ksiz = vsiz + 3;
+    int rsiz = sizeof (ksiz) + ksiz + pksiz;
+    if (rsiz <= sizeof (stack)) {
+        rbuf = stack;
+    } else {
+        TCMALLOC(rbuf, rsiz);
+    }
+    char *wp = rbuf;
+    memcpy(wp, &ksiz, sizeof (ksiz));
+    wp += sizeof (ksiz);
+    memcpy(wp, vbuf, vsiz);
+    wp += vsiz;
+    *(wp++) = '\0';
+    *(wp++) = hash >> 8;
+    *(wp++) = hash & 0xff;
+    memcpy(wp, pkbuf, pksiz);
+    TCLISTPUSH(run, rbuf, rsiz);
+    if (rbuf != stack) TCFREE(rbuf);
+}
+
+/* Compare two elements of a run of the bulk load of a lexical index.
+   `a' specifies an element.
+   `b' specifies of the other element.
+   The return value is positive if the former is big, negative if the latter is big, 0 if both
+   are equivalent. */
+static int tctdbidxbulkcmplexical(const TCLISTDATUM *a, const TCLISTDATUM *b) {
+    assert(a && b);
+    int32_t asiz, bsiz;
+    memcpy(&asiz, a->ptr, sizeof (asiz));
+    memcpy(&bsiz, b->ptr, sizeof (bsiz));
+    return tccmplexical(a->ptr + sizeof (asiz), asiz, b->ptr + sizeof (bsiz), bsiz, NULL);
+}
+
+/* Compare two elements of a run of the bulk load of a decimal index.
+   `a' specifies an element.
+   `b' specifies of the other element.
+   The return value is positive if the former is big, negative if the latter is big, 0 if both
+   are equivalent. */
+static int tctdbidxbulkcmpdecimal(const TCLISTDATUM *a, const TCLISTDATUM *b) {
+    assert(a && b);
+    int32_t asiz, bsiz;
+    memcpy(&asiz, a->ptr, sizeof (asiz));
+    memcpy(&bsiz, b->ptr, sizeof (bsiz));
+    return tccmpdecimal(a->ptr + sizeof (asiz), asiz, b->ptr + sizeof (bsiz), bsiz, NULL);
+}
+
+/* Store a run of the bulk load into an index of a table database object.
+   `tdb' specifies the table database object.
+   `idx' specifies the index object.
+   `run' specifies the list object of the run.  It is cleared.
+   The run is sorted by the comparison function of the index, so each key lands next to the
+   previous one and the tree grows at its last leaf instead of at random leaves.
+   If successful, the return value is true, else, it is false. */
+static bool tctdbidxbulkflush(TCTDB *tdb, TDBIDX *idx, TCLIST *run) {
+    assert(tdb && idx && run);
+    tclistsortex(run, (idx->type == TDBITDECIMAL) ? tctdbidxbulkcmpdecimal : tctdbidxbulkcmplexical);
+    bool err = false;
+    int rnum = TCLISTNUM(run);
+    for (int i = 0; i < rnum && !err; i++) {
+        const char *rbuf;
+        int rsiz;
+        TCLISTVAL(rbuf, run, i, rsiz);
+        int32_t ksiz;
+        memcpy(&ksiz, rbuf, sizeof (ksiz));
+        const char *kbuf = rbuf + sizeof (ksiz);
+        if (!tcbdbputdup(idx->db, kbuf, ksiz, kbuf + ksiz, rsiz - sizeof (ksiz) - ksiz)) {
+            tctdbsetecode(tdb, tcbdbecode(idx->db), __FILE__, __LINE__, __func__);
+            err = true;
+        }
+    }
+    tclistclear(run);
+    return !err;
+}
+
 /* Generate a unique ID number.
    `tdb' specifies the table database object.
    `inc' specifies the increment of the seed.
@@ -4456,7 +4849,7 @@ static int tdbcmpsortrecnumdesc(const TDBSORTREC *a, const TDBSORTREC *b) {
    `pkbuf' specifies the pointer to the region of the primary key.
    `pksiz' specifies the size of the region of the primary key.
    The return value is the hash value. */
-static uint16_t tctdbidxhash(const char *pkbuf, int pksiz) {
+uint16_t tctdbidxhash(const char *pkbuf, int pksiz) {
     assert(pkbuf && pksiz && pksiz >= 0);
     uint32_t hash = 19780211;
     while (pksiz--) {
@@ -4525,6 +4918,9 @@ bool tctdbidxput(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols) {
                 case TDBITQGRAM:
                     if (!tctdbidxputqgram(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
                     break;
+                case TDBITHASH:
+                    if (!tctdbidxputhash(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
+                    break;
             }
         }
     }
@@ -4589,6 +4985,9 @@ bool tctdbidxput2(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols) {
                 case TDBITQGRAM:
                     if (!tctdbidxputqgram(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
                     break;
+                case TDBITHASH:
+                    if (!tctdbidxputhash(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
+                    break;
             }
         }
     }
@@ -4866,6 +5265,9 @@ bool tctdbidxout(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols) {
                 case TDBITQGRAM:
                     if (!tctdbidxoutqgram(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
                     break;
+                case TDBITHASH:
+                    if (!tctdbidxouthash(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
+                    break;
             }
         }
     }
@@ -4930,6 +5332,9 @@ bool tctdbidxout2(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols) {
                 case TDBITQGRAM:
                     if (!tctdbidxoutqgram(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
                     break;
+                case TDBITHASH:
+                    if (!tctdbidxouthash(tdb, idx, pkbuf, pksiz, vbuf, vsiz)) err = true;
+                    break;
             }
         }
     }
@@ -5006,7 +5411,6 @@ static bool tctdbidxouttoken(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pks
         const char *vbuf, int vsiz) {
     assert(tdb && idx && pkbuf && pksiz >= 0 && vbuf && vsiz >= 0);
     bool err = false;
-    TCBDB *db = idx->db;
     TCMAP *cc = idx->cc;
     uint64_t pkid = 0;
     for (int i = 0; i < pksiz; i++) {
@@ -5066,40 +5470,7 @@ static bool tctdbidxouttoken(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pks
                     err = true;
                 }
             }
-            cbuf = tcbdbget3(db, sp, len, &csiz);
-            if (cbuf) {
-                while (csiz > 0) {
-                    const char *pv = cbuf;
-                    bool ok = true;
-                    if (*cbuf == '\0') {
-                        cbuf++;
-                        csiz--;
-                        int tsiz, step;
-                        TCREADVNUMBUF(cbuf, tsiz, step);
-                        cbuf += step;
-                        csiz -= step;
-                        if (tsiz == pksiz && !memcmp(cbuf, pkbuf, tsiz)) ok = false;
-                        cbuf += tsiz;
-                        csiz -= tsiz;
-                    } else {
-                        int64_t tid;
-                        int step;
-                        TCREADVNUMBUF64(cbuf, tid, step);
-                        if (tid == pkid) ok = false;
-                        cbuf += step;
-                        csiz -= step;
-                    }
-                    if (ok) TCXSTRCAT(xstr, pv, cbuf - pv);
-                }
-                if (csiz != 0) {
-                    tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
-                    err = true;
-                }
-                if (!tcbdbout(db, sp, len)) {
-                    tctdbsetecode(tdb, tcbdbecode(db), __FILE__, __LINE__, __func__);
-                    err = true;
-                }
-            }
+            if (!tctdbidxoutpl(tdb, idx, (const char *) sp, len, pkbuf, pksiz)) err = true;
             tcmapput(cc, sp, len, TCXSTRPTR(xstr), TCXSTRSIZE(xstr));
         }
         sp = ep;
@@ -5113,7 +5484,6 @@ static bool tctdbidxouttoken2(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pk
         TCLIST *tokens) {
     assert(tdb && idx && pkbuf && pksiz >= 0 && tokens);
     bool err = false;
-    TCBDB *db = idx->db;
     TCMAP *cc = idx->cc;
     uint64_t pkid = 0;
     for (int i = 0; i < pksiz; i++) {
@@ -5165,40 +5535,7 @@ static bool tctdbidxouttoken2(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pk
                 err = true;
             }
         }
-        cbuf = tcbdbget3(db, sp, len, &csiz);
-        if (cbuf) {
-            while (csiz > 0) {
-                const char *pv = cbuf;
-                bool ok = true;
-                if (*cbuf == '\0') {
-                    cbuf++;
-                    csiz--;
-                    int tsiz, step;
-                    TCREADVNUMBUF(cbuf, tsiz, step);
-                    cbuf += step;
-                    csiz -= step;
-                    if (tsiz == pksiz && !memcmp(cbuf, pkbuf, tsiz)) ok = false;
-                    cbuf += tsiz;
-                    csiz -= tsiz;
-                } else {
-                    int64_t tid;
-                    int step;
-                    TCREADVNUMBUF64(cbuf, tid, step);
-                    if (tid == pkid) ok = false;
-                    cbuf += step;
-                    csiz -= step;
-                }
-                if (ok) TCXSTRCAT(xstr, pv, cbuf - pv);
-            }
-            if (csiz != 0) {
-                tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
-                err = true;
-            }
-            if (!tcbdbout(db, sp, len)) {
-                tctdbsetecode(tdb, tcbdbecode(db), __FILE__, __LINE__, __func__);
-                err = true;
-            }
-        }
+        if (!tctdbidxoutpl(tdb, idx, (const char *) sp, len, pkbuf, pksiz)) err = true;
         tcmapput(cc, sp, len, TCXSTRPTR(xstr), TCXSTRSIZE(xstr));
     }
     tcxstrdel(xstr);
@@ -5333,6 +5670,81 @@ static bool tctdbidxoutqgram(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pks
     return !err;
 }
 
+/* Add a column of a record into a hash equality index of a table database object.
+   `tdb' specifies the table database object.
+   `idx' specifies the index object.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   `vbuf' specifies the pointer to the region of the column value.
+   `vsiz' specifies the size of the region of the column value.
+   If successful, the return value is true, else, it is false. */
+static bool tctdbidxputhash(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz,
+        const char *vbuf, int vsiz) {
+    assert(tdb && idx && pkbuf && pksiz >= 0 && vbuf && vsiz >= 0);
+    bool err = false;
+    char stack[TDBCOLBUFSIZ], *rbuf;
+    int rsiz = pksiz + TCNUMBUFSIZ;
+    if (rsiz <= sizeof (stack)) {
+        rbuf = stack;
+    } else {
+        TCMALLOC(rbuf, rsiz);
+    }
+    TCSETVNUMBUF(rsiz, rbuf, pksiz);
+    memcpy(rbuf + rsiz, pkbuf, pksiz);
+    rsiz += pksiz;
+    if (!tchdbputcat(idx->db, vbuf, vsiz, rbuf, rsiz)) {
+        tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+        err = true;
+    }
+    if (rbuf != stack) TCFREE(rbuf);
+    return !err;
+}
+
+/* Remove a column of a record from a hash equality index of a table database object.
+   `tdb' specifies the table database object.
+   `idx' specifies the index object.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   `vbuf' specifies the pointer to the region of the column value.
+   `vsiz' specifies the size of the region of the column value.
+   If successful, the return value is true, else, it is false. */
+static bool tctdbidxouthash(TCTDB *tdb, TDBIDX *idx, const char *pkbuf, int pksiz,
+        const char *vbuf, int vsiz) {
+    assert(tdb && idx && pkbuf && pksiz >= 0 && vbuf && vsiz >= 0);
+    bool err = false;
+    int csiz;
+    char *cbuf = tchdbget(idx->db, vbuf, vsiz, &csiz);
+    if (!cbuf) return true;
+    char *rp = cbuf;
+    char *ep = cbuf + csiz;
+    while (rp < ep) {
+        int tsiz, step;
+        TCREADVNUMBUF(rp, tsiz, step);
+        if (tsiz == pksiz && !memcmp(rp + step, pkbuf, tsiz)) {
+            memmove(rp, rp + step + tsiz, ep - (rp + step + tsiz));
+            csiz -= step + tsiz;
+            break;
+        }
+        rp += step + tsiz;
+    }
+    if (rp > ep) {
+        tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+        err = true;
+    } else if (csiz < 1) {
+        if (!tchdbout(idx->db, vbuf, vsiz)) {
+            tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+            err = true;
+        }
+    } else if (rp < ep) {
+        if (!tchdbput(idx->db, vbuf, vsiz, cbuf, csiz)) {
+            tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+            err = true;
+        }
+    }
+    TCFREE(cbuf);
+    return !err;
+}
+
 /* Synchronize updated contents of an inverted cache of a table database object.
    `tdb' specifies the table database object.
    `idx' specifies the index object.
@@ -5361,17 +5773,45 @@ static bool tctdbidxsyncicc(TCTDB *tdb, TDBIDX *idx, bool all) {
         sum += sizeof (TCMAPREC) + sizeof (void *) +ksiz + vsiz;
     }
     qsort(keys, knum, sizeof (*keys), (int(*)(const void *, const void *))tctdbidxcmpkey);
+    TCLIST *pks = (idx->type == TDBITTOKEN) ? tclistnew() : NULL;
+    TCXSTR *xstr = pks ? tcxstrnew() : NULL;
     for (int i = 0; i < knum; i++) {
         const char *kbuf = keys[i];
         int ksiz = strlen(kbuf);
         int vsiz;
         const char *vbuf = tcmapget(cc, kbuf, ksiz, &vsiz);
-        if (vsiz > 0 && !tcbdbputcat(db, kbuf, ksiz, vbuf, vsiz)) {
+        bool compact = false;
+        int csiz = 0;
+        const char *cbuf = NULL;
+        if (vsiz > 0 && pks) { //cached postings are appended until the unsorted tail grows too large
+            cbuf = tcbdbget3(db, kbuf, ksiz, &csiz);
+            int ssiz = cbuf ? tctdbidxplsortsiz(cbuf, csiz) : 0;
+            int usiz = csiz - ssiz + vsiz;
+            compact = usiz >= TDBIDXPLTAILMIN && usiz >= ssiz / TDBIDXPLTAILRAT;
+        }
+        if (compact) { //merge the stored and the cached postings into the sorted posting list
+            tclistclear(pks);
+            if ((cbuf && !tctdbidxreadpl(cbuf, csiz, pks, NULL)) || !tctdbidxreadpl(vbuf, vsiz, pks, NULL)) {
+                tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+                err = true;
+            }
+            tclistsort(pks);
+            tcxstrclear(xstr);
+            tctdbidxwritepl(pks, xstr);
+            if (!tcbdbput(db, kbuf, ksiz, TCXSTRPTR(xstr), TCXSTRSIZE(xstr))) {
+                tctdbsetecode(tdb, tcbdbecode(db), __FILE__, __LINE__, __func__);
+                err = true;
+            }
+        } else if (vsiz > 0 && !tcbdbputcat(db, kbuf, ksiz, vbuf, vsiz)) {
             tctdbsetecode(tdb, tcbdbecode(db), __FILE__, __LINE__, __func__);
             err = true;
         }
         tcmapout(cc, kbuf, ksiz);
     }
+    if (pks) {
+        tcxstrdel(xstr);
+        tclistdel(pks);
+    }
     TCFREE(keys);
     return !err;
 }
@@ -5395,6 +5835,232 @@ static int tctdbidxcmpkey(const char **a, const char **b) {
     return 0;
 }
 
+/* Get the size of the sorted part of a posting list of a token inverted index.
+   `buf' specifies the pointer to the region of the posting list.
+   `size' specifies the size of the region.
+   The return value is the size of the leading sorted part including its header.  The rest of the
+   list are entries appended by the inverted cache. */
+static int tctdbidxplsortsiz(const char *buf, int size) {
+    assert(buf && size >= 0);
+    if (size <= TDBIDXPLMAGICSIZ || memcmp(buf, TDBIDXPLMAGIC, TDBIDXPLMAGICSIZ)) return 0;
+    int bsiz, step;
+    TCREADVNUMBUF(buf + TDBIDXPLMAGICSIZ, bsiz, step);
+    int ssiz = TDBIDXPLMAGICSIZ + step + bsiz;
+    return (ssiz <= size) ? ssiz : size;
+}
+
+/* Read a posting list of a token inverted index.
+   `buf' specifies the pointer to the region of the posting list.
+   `size' specifies the size of the region.
+   `pks' specifies the list object into which the primary keys are pushed.
+   `usp' specifies the pointer to the variable into which the size of the unsorted part of the
+   list is assigned.  If it is `NULL', it is not used.
+   A stored list starts with a sorted front coded part which is followed by plain concatenations of
+   entries appended by the inverted cache.  Entries of the inverted cache and lists of the former
+   index databases are plain concatenations only.
+   If successful, the return value is true, else, it is false. */
+static bool tctdbidxreadpl(const char *buf, int size, TCLIST *pks, int *usp) {
+    assert(buf && size >= 0 && pks);
+    int ssiz = tctdbidxplsortsiz(buf, size);
+    if (ssiz > 0) {
+        int bsiz, step;
+        TCREADVNUMBUF(buf + TDBIDXPLMAGICSIZ, bsiz, step);
+        if (ssiz != TDBIDXPLMAGICSIZ + step + bsiz) return false;
+        const char *rp = buf + TDBIDXPLMAGICSIZ + step;
+        const char *pbuf = NULL;
+        int psiz = 0;
+        while (bsiz > 0) {
+            int csiz, rsiz;
+            TCREADVNUMBUF(rp, csiz, step);
+            rp += step;
+            bsiz -= step;
+            TCREADVNUMBUF(rp, rsiz, step);
+            rp += step;
+            bsiz -= step;
+            if (csiz > psiz || rsiz > bsiz) return false;
+            char *pkbuf;
+            TCMALLOC(pkbuf, csiz + rsiz + 1);
+            if (csiz > 0) memcpy(pkbuf, pbuf, csiz);
+            memcpy(pkbuf + csiz, rp, rsiz);
+            pkbuf[csiz + rsiz] = '\0';
+            tclistpushmalloc(pks, pkbuf, csiz + rsiz);
+            pbuf = TCLISTVALPTR(pks, TCLISTNUM(pks) - 1);
+            psiz = csiz + rsiz;
+            rp += rsiz;
+            bsiz -= rsiz;
+        }
+        if (bsiz != 0) return false;
+        buf += ssiz;
+        size -= ssiz;
+    }
+    if (usp) *usp = size;
+    while (size > 0) {
+        if (*buf == '\0') {
+            buf++;
+            size--;
+            int tsiz, step;
+            TCREADVNUMBUF(buf, tsiz, step);
+            buf += step;
+            size -= step;
+            if (tsiz > size) return false;
+            TCLISTPUSH(pks, buf, tsiz);
+            buf += tsiz;
+            size -= tsiz;
+        } else {
+            int64_t tid;
+            int step;
+            TCREADVNUMBUF64(buf, tid, step);
+            char pkbuf[TCNUMBUFSIZ];
+            int pksiz = sprintf(pkbuf, "%" PRId64 "", (int64_t) tid);
+            TCLISTPUSH(pks, pkbuf, pksiz);
+            buf += step;
+            size -= step;
+        }
+    }
+    return size == 0;
+}
+
+/* Serialize a posting list of a token inverted index.
+   `pks' specifies the sorted list object of the primary keys.  Duplicated keys are skipped.
+   `xstr' specifies the string object into which the posting list is appended.
+   Every key is stored as the size of the prefix shared with the previous key followed by the
+   rest of the key, so object IDs created close in time take a few bytes each.  The keys are
+   preceded by their total size, entries appended later are not sorted. */
+static void tctdbidxwritepl(const TCLIST *pks, TCXSTR *xstr) {
+    assert(pks && xstr);
+    TCXSTR *body = tcxstrnew();
+    const char *pbuf = NULL;
+    int psiz = 0;
+    int pnum = TCLISTNUM(pks);
+    for (int i = 0; i < pnum; i++) {
+        const char *pkbuf;
+        int pksiz;
+        TCLISTVAL(pkbuf, pks, i, pksiz);
+        if (pbuf && pksiz == psiz && !memcmp(pkbuf, pbuf, pksiz)) continue;
+        int csiz = 0;
+        int max = tclmin(psiz, pksiz);
+        while (csiz < max && pbuf[csiz] == pkbuf[csiz]) csiz++;
+        char hbuf[TCNUMBUFSIZ * 2];
+        int hsiz, step;
+        TCSETVNUMBUF(step, hbuf, csiz);
+        hsiz = step;
+        TCSETVNUMBUF(step, hbuf + hsiz, pksiz - csiz);
+        hsiz += step;
+        TCXSTRCAT(body, hbuf, hsiz);
+        TCXSTRCAT(body, pkbuf + csiz, pksiz - csiz);
+        pbuf = pkbuf;
+        psiz = pksiz;
+    }
+    char hbuf[TCNUMBUFSIZ];
+    int step;
+    TCSETVNUMBUF(step, hbuf, TCXSTRSIZE(body));
+    TCXSTRCAT(xstr, TDBIDXPLMAGIC, TDBIDXPLMAGICSIZ);
+    TCXSTRCAT(xstr, hbuf, step);
+    TCXSTRCAT(xstr, TCXSTRPTR(body), TCXSTRSIZE(body));
+    tcxstrdel(body);
+}
+
+/* Remove a primary key from the stored posting list of a token.
+   `tdb' specifies the table database object.
+   `idx' specifies the index object.
+   `tbuf' specifies the pointer to the region of the token.
+   `tsiz' specifies the size of the region of the token.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   If successful, the return value is true, else, it is false. */
+static bool tctdbidxoutpl(TCTDB *tdb, TDBIDX *idx, const char *tbuf, int tsiz,
+        const char *pkbuf, int pksiz) {
+    assert(tdb && idx && tbuf && tsiz >= 0 && pkbuf && pksiz >= 0);
+    TCBDB *db = idx->db;
+    int csiz;
+    const char *cbuf = tcbdbget3(db, tbuf, tsiz, &csiz);
+    if (!cbuf) return true;
+    bool err = false;
+    TCLIST *pks = tclistnew();
+    int usiz = 0;
+    if (!tctdbidxreadpl(cbuf, csiz, pks, &usiz)) {
+        tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+        err = true;
+    }
+    if (usiz > 0) tclistsort(pks); //the appended tail is compacted with the rest
+    int pnum = TCLISTNUM(pks);
+    int lo = 0;
+    int hi = pnum;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (tctdbidxcmppk(TCLISTVALPTR(pks, mid), TCLISTVALSIZ(pks, mid), pkbuf, pksiz) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    while (hi < pnum && TCLISTVALSIZ(pks, hi) == pksiz && !memcmp(TCLISTVALPTR(pks, hi), pkbuf, pksiz)) {
+        hi++;
+    }
+    if (hi == lo) {
+        tclistdel(pks);
+        return !err;
+    }
+    for (int i = hi - 1; i >= lo; i--) {
+        TCFREE(tclistremove2(pks, i));
+    }
+    pnum -= hi - lo;
+    if (pnum < 1) {
+        if (!tcbdbout(db, tbuf, tsiz)) {
+            tctdbsetecode(tdb, tcbdbecode(db), __FILE__, __LINE__, __func__);
+            err = true;
+        }
+    } else {
+        TCXSTR *xstr = tcxstrnew();
+        tctdbidxwritepl(pks, xstr);
+        if (!tcbdbput(db, tbuf, tsiz, TCXSTRPTR(xstr), TCXSTRSIZE(xstr))) {
+            tctdbsetecode(tdb, tcbdbecode(db), __FILE__, __LINE__, __func__);
+            err = true;
+        }
+        tcxstrdel(xstr);
+    }
+    tclistdel(pks);
+    return !err;
+}
+
+/* Compare two primary keys in the order of sorted posting lists.
+   The return value is positive if the former is big, negative if the latter is big, 0 if both
+   are equivalent. */
+static int tctdbidxcmppk(const char *abuf, int asiz, const char *bbuf, int bsiz) {
+    assert(abuf && asiz >= 0 && bbuf && bsiz >= 0);
+    int rv = memcmp(abuf, bbuf, tclmin(asiz, bsiz));
+    return rv ? rv : asiz - bsiz;
+}
+
+/* Retrieve records by a hash equality index of a table database object.
+   `tdb' specifies the table database object.
+   `idx' specifies the index object.
+   `vbuf' specifies the pointer to the region of the column value.
+   `vsiz' specifies the size of the region of the column value.
+   The return value is a list object of the primary keys of the corresponding records. */
+TCLIST *tctdbidxgetbyhash(TCTDB *tdb, const TDBIDX *idx, const void *vbuf, int vsiz) {
+    assert(tdb && idx && vbuf && vsiz >= 0);
+    int csiz;
+    char *cbuf = tchdbget(idx->db, vbuf, vsiz, &csiz);
+    if (!cbuf) return tclistnew2(1);
+    TCLIST *res = tclistnew2(csiz / (TDBIDXHPKSIZ + 1) + 1);
+    const char *rp = cbuf;
+    const char *ep = cbuf + csiz;
+    while (rp < ep) {
+        int tsiz, step;
+        TCREADVNUMBUF(rp, tsiz, step);
+        rp += step;
+        if (rp + tsiz > ep) {
+            tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+            break;
+        }
+        TCLISTPUSH(res, rp, tsiz);
+        rp += tsiz;
+    }
+    TCFREE(cbuf);
+    return res;
+}
+
 /* Retrieve records by a token inverted index of a table database object.
    `tdb' specifies the table database object.
    `idx' specifies the index object.
@@ -5408,105 +6074,76 @@ TCMAP *tctdbidxgetbytokens(TCTDB *tdb, const TDBIDX *idx, const TCLIST *tokens,
     TCBDB *db = idx->db;
     TCMAP *cc = idx->cc;
     int tnum = TCLISTNUM(tokens);
-    TCMAP *res = tcmapnew();
+    TCLIST *acc = NULL;
     int cnt = 0;
     for (int i = 0; i < tnum; i++) {
         const char *token;
         int tsiz;
         TCLISTVAL(token, tokens, i, tsiz);
         if (tsiz < 1) continue;
-        int onum = 0;
-        TCMAP *wring = (cnt > 0 && op == TDBQCSTRAND) ? tcmapnew() : NULL;
+        TCLIST *pks = tclistnew();
+        bool sorted = true;
         int csiz;
         const char *cbuf = tcmapget(cc, token, tsiz, &csiz);
-        if (cbuf) {
-            while (csiz > 0) {
-                if (*cbuf == '\0') {
-                    cbuf++;
-                    csiz--;
-                    int tsiz, step;
-                    TCREADVNUMBUF(cbuf, tsiz, step);
-                    cbuf += step;
-                    csiz -= step;
-                    if (cnt < 1) {
-                        tcmapput(res, cbuf, tsiz, "", 0);
-                    } else if (wring) {
-                        int rsiz;
-                        if (tcmapget(res, cbuf, tsiz, &rsiz)) tcmapput(wring, cbuf, tsiz, "", 0);
-                    } else {
-                        tcmapput(res, cbuf, tsiz, "", 0);
-                    }
-                    cbuf += tsiz;
-                    csiz -= tsiz;
-                } else {
-                    int64_t tid;
-                    int step;
-                    TCREADVNUMBUF64(cbuf, tid, step);
-                    char pkbuf[TCNUMBUFSIZ];
-                    int pksiz = sprintf(pkbuf, "%" PRId64 "", (int64_t) tid);
-                    if (cnt < 1) {
-                        tcmapput(res, pkbuf, pksiz, "", 0);
-                    } else if (wring) {
-                        int rsiz;
-                        if (tcmapget(res, pkbuf, pksiz, &rsiz)) tcmapput(wring, pkbuf, pksiz, "", 0);
-                    } else {
-                        tcmapput(res, pkbuf, pksiz, "", 0);
-                    }
-                    cbuf += step;
-                    csiz -= step;
-                }
-                onum++;
-            }
+        if (cbuf && csiz > 0) {
+            if (!tctdbidxreadpl(cbuf, csiz, pks, NULL)) tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+            sorted = false;
         }
         cbuf = tcbdbget3(db, token, tsiz, &csiz);
         if (cbuf) {
-            while (csiz > 0) {
-                if (*cbuf == '\0') {
-                    cbuf++;
-                    csiz--;
-                    int tsiz, step;
-                    TCREADVNUMBUF(cbuf, tsiz, step);
-                    cbuf += step;
-                    csiz -= step;
-                    if (cnt < 1) {
-                        tcmapput(res, cbuf, tsiz, "", 0);
-                    } else if (wring) {
-                        int rsiz;
-                        if (tcmapget(res, cbuf, tsiz, &rsiz)) tcmapput(wring, cbuf, tsiz, "", 0);
-                    } else {
-                        tcmapput(res, cbuf, tsiz, "", 0);
-                    }
-                    cbuf += tsiz;
-                    csiz -= tsiz;
+            int usiz = 0;
+            if (!tctdbidxreadpl(cbuf, csiz, pks, &usiz)) tctdbsetecode(tdb, TCEMISC, __FILE__, __LINE__, __func__);
+            if (usiz > 0) sorted = false; //the appended tail is sorted in memory only
+        }
+        int onum = TCLISTNUM(pks);
+        if (!sorted) tclistsort(pks);
+        if (cnt < 1) {
+            acc = pks;
+        } else { //merge two sorted lists
+            TCLIST *mres = tclistnew2((op == TDBQCSTRAND) ? tclmin(TCLISTNUM(acc), onum) : TCLISTNUM(acc) + onum);
+            int anum = TCLISTNUM(acc);
+            int ai = 0, pi = 0;
+            while (ai < anum || pi < onum) {
+                int cmp;
+                if (ai >= anum) {
+                    if (op == TDBQCSTRAND) break;
+                    cmp = 1;
+                } else if (pi >= onum) {
+                    if (op == TDBQCSTRAND) break;
+                    cmp = -1;
                 } else {
-                    int64_t tid;
-                    int step;
-                    TCREADVNUMBUF64(cbuf, tid, step);
-                    char pkbuf[TCNUMBUFSIZ];
-                    int pksiz = sprintf(pkbuf, "%" PRId64 "", (int64_t) tid);
-                    if (cnt < 1) {
-                        tcmapput(res, pkbuf, pksiz, "", 0);
-                    } else if (wring) {
-                        int rsiz;
-                        if (tcmapget(res, pkbuf, pksiz, &rsiz)) tcmapput(wring, pkbuf, pksiz, "", 0);
-                    } else {
-                        tcmapput(res, pkbuf, pksiz, "", 0);
-                    }
-                    cbuf += step;
-                    csiz -= step;
+                    cmp = tctdbidxcmppk(TCLISTVALPTR(acc, ai), TCLISTVALSIZ(acc, ai),
+                            TCLISTVALPTR(pks, pi), TCLISTVALSIZ(pks, pi));
+                }
+                if (cmp == 0) {
+                    TCLISTPUSH(mres, TCLISTVALPTR(acc, ai), TCLISTVALSIZ(acc, ai));
+                    ai++;
+                    pi++;
+                } else if (cmp < 0) {
+                    if (op != TDBQCSTRAND) TCLISTPUSH(mres, TCLISTVALPTR(acc, ai), TCLISTVALSIZ(acc, ai));
+                    ai++;
+                } else {
+                    if (op != TDBQCSTRAND) TCLISTPUSH(mres, TCLISTVALPTR(pks, pi), TCLISTVALSIZ(pks, pi));
+                    pi++;
                 }
-                onum++;
             }
-        }
-        if (wring) {
-            tcmapdel(res);
-            res = wring;
+            tclistdel(acc);
+            tclistdel(pks);
+            acc = mres;
         }
         if (hint) {
             tcxstrprintf(hint, "token occurrence: \"%s\" %d\n", token, onum);
         }
         cnt++;
     }
+    TCMAP *res = acc ? tcmapnew2(TCLISTNUM(acc) + 1) : tcmapnew();
+    if (acc) {
+        int anum = TCLISTNUM(acc);
+        for (int i = 0; i < anum; i++) {
+            tcmapput(res, TCLISTVALPTR(acc, i), TCLISTVALSIZ(acc, i), "", 0);
+        }
+        tclistdel(acc);
+    }
     return res;
 }
 
@@ -6204,6 +6841,12 @@ static bool tctdbdefragimpl(TCTDB *tdb, int64_t step) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbdefrag(idx->db, step)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
@@ -6231,6 +6874,12 @@ static bool tctdbcacheclearimpl(TCTDB *tdb) {
                     err = true;
                 }
                 break;
+            case TDBITHASH:
+                if (!tchdbcacheclear(idx->db)) {
+                    tctdbsetecode(tdb, tchdbecode(idx->db), __FILE__, __LINE__, __func__);
+                    err = true;
+                }
+                break;
         }
     }
     return !err;
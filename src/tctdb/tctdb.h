@@ -55,6 +55,7 @@ typedef struct { /* type of structure for a table database */
     uint8_t opts; /* options */
     int32_t lcnum; /* max number of cached leaves */
     int32_t ncnum; /* max number of cached nodes */
+    BDBCBUDGET *icbudget; /* leaf cache budget shared by column indices */
     int64_t iccmax; /* maximum size of the inverted cache */
     double iccsync; /* synchronization ratio of the inverted cache */
     TDBIDX *idxs; /* column indices */
@@ -90,6 +91,7 @@ enum { /* enumeration for index types */
     TDBITDECIMAL, /* decimal string */
     TDBITTOKEN, /* token inverted index */
     TDBITQGRAM, /* q-gram inverted index */
+    TDBITHASH, /* hash equality index */
     TDBITOPT = 9998, /* optimize */
     TDBITVOID = 9999, /* void */
     TDBITKEEP = 1 << 24 /* keep existing index */
@@ -264,6 +266,15 @@ EJDB_EXPORT bool tctdbtune(TCTDB *tdb, int64_t bnum, int8_t apow, int8_t fpow, u
 EJDB_EXPORT bool tctdbsetcache(TCTDB *tdb, int32_t rcnum, int32_t lcnum, int32_t ncnum);
 
 
+/* Set the shared size budget of leaves cached by column indices of a table database object.
+   `tdb' specifies the table database object which is not opened.
+   `budget' specifies the budget object or `NULL' to disable the budget.  It can be shared
+   with other table and B+ tree database objects.
+   If successful, the return value is true, else, it is false.
+   Note that the budget should be set before the database is opened and should outlive it. */
+EJDB_EXPORT bool tctdbsetidxcachebudget(TCTDB *tdb, BDBCBUDGET *budget);
+
+
 /* Set the size of the extra mapped memory of a table database object.
    `tdb' specifies the table database object which is not opened.
    `xmsiz' specifies the size of the extra mapped memory.  If it is not more than 0, the extra
@@ -282,6 +293,40 @@ EJDB_EXPORT bool tctdbsetxmsiz(TCTDB *tdb, int64_t xmsiz);
 EJDB_EXPORT bool tctdbsetdfunit(TCTDB *tdb, int32_t dfunit);
 
 
+/* Set the size of the write-behind buffer of records of a table database object.
+   `tdb' specifies the table database object which is not opened.
+   `size' specifies the maximum size of records kept in the buffer.  If it is not more than 0, the
+   write-behind buffer is disabled.  It is disabled by default.
+   If successful, the return value is true, else, it is false.
+   See `tchdbsetwritebehind' for the semantics of the buffer.
+   Note that the mutual exclusion control should be set before, and the buffer should be set
+   before the database is opened. */
+EJDB_EXPORT bool tctdbsetwritebehind(TCTDB *tdb, int64_t size);
+
+
+/* Set the background defragmentation of records of a table database object.
+   `tdb' specifies the table database object which is not opened.
+   `step' specifies the number of steps of a chunk.  If it is not more than 0, the default value
+   is specified.
+   `delay' specifies the pause in milliseconds between chunks.  If it is negative, the background
+   defragmentation is disabled.  It is disabled by default.
+   If successful, the return value is true, else, it is false.
+   See `tchdbsetbgdefrag' for the semantics of the background defragmentation.
+   Note that the mutual exclusion control should be set before, and the background
+   defragmentation should be set before the database is opened. */
+EJDB_EXPORT bool tctdbsetbgdefrag(TCTDB *tdb, int32_t step, int32_t delay);
+
+
+/* Set the asynchronous reading of records of a table database object.
+   `tdb' specifies the table database object which is not opened.
+   `depth' specifies the maximum number of reads in flight.
+   If successful, the return value is true, else, it is false.
+   See `tchdbsetaio' for the semantics of the asynchronous reading.
+   Note that the mutual exclusion control should be set before, and the asynchronous reading
+   should be set before the database is opened. */
+EJDB_EXPORT bool tctdbsetaio(TCTDB *tdb, int32_t depth);
+
+
 /* Open a database file and connect a table database object.
    `tdb' specifies the table database object which is not opened.
    `path' specifies the path of the database file.
@@ -400,6 +445,34 @@ EJDB_EXPORT bool tctdbputcat2(TCTDB *tdb, const void *pkbuf, int pksiz, const vo
 EJDB_EXPORT bool tctdbputcat3(TCTDB *tdb, const char *pkstr, const char *cstr);
 
 
+/* Store a record into a table database object in asynchronous fashion.
+   `tdb' specifies the table database object connected as a writer.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   `cols' specifies a map object containing columns.
+   If successful, the return value is true, else, it is false.
+   If a record with the same key exists in the database, it is overwritten. Records passed to
+   this function are accumulated into the inner buffer of the underlying hash database and wrote
+   into the file at a blast. Indexes are not maintained, so this function fails if the database
+   has any index. */
+EJDB_EXPORT bool tctdbputasync(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols);
+
+/* Overwrite a part of a column of the existing record in a table database object in place.
+   `tdb' specifies the table database object connected as a writer.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   `nbuf' specifies the pointer to the region of the column name.
+   `nsiz' specifies the size of the region of the column name.
+   `off' specifies the offset of the region to overwrite in the column value.
+   `vbuf' specifies the pointer to the region of the new bytes.
+   `vsiz' specifies the size of the region of the new bytes.
+   If successful, the return value is true, else, it is false.
+   The size of the column is never changed and column indexes are not updated, so indexed
+   columns are rejected. This function fails if the underlying database is compressed. */
+EJDB_EXPORT bool tctdbputcolpart(TCTDB *tdb, const void *pkbuf, int pksiz, const void *nbuf, int nsiz,
+        int off, const void *vbuf, int vsiz);
+
+
 /* Remove a record of a table database object.
    `tdb' specifies the table database object connected as a writer.
    `pkbuf' specifies the pointer to the region of the primary key.
@@ -1113,6 +1186,12 @@ bool tctdbidxput2(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols);
 bool tctdbidxout(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols);
 bool tctdbidxout2(TCTDB *tdb, const void *pkbuf, int pksiz, TCMAP *cols);
 
+/* Get the hash value of a record stored in keys of lexical and decimal indices.
+   `pkbuf' specifies the pointer to the region of the primary key.
+   `pksiz' specifies the size of the region of the primary key.
+   The return value is the hash value. */
+uint16_t tctdbidxhash(const char *pkbuf, int pksiz);
+
 /* Jump a cursor to the record of a key.
    `cur' specifies the cursor object.
    `expr' specifies the expression.
@@ -1146,6 +1225,18 @@ int tdbcmppkeynumdesc(const TCLISTDATUM *a, const TCLISTDATUM *b);
    The return value is a map object of the primary keys of the corresponding records. */
 TCMAP *tctdbidxgetbytokens(TCTDB *tdb, const TDBIDX *idx, const TCLIST *tokens, int op, TCXSTR *hint);
 
+
+/* Retrieve records by a hash equality index of a table database object.
+   `tdb' specifies the table database object.
+   `idx' specifies the index object of `TDBITHASH' type.
+   `vbuf' specifies the pointer to the region of the column value.
+   `vsiz' specifies the size of the region of the column value.
+   The return value is a list object of the primary keys of the records whose column is equal to
+   the value.  It is empty if no record corresponds.
+   Because the object of the return value is created with the function `tclistnew', it should be
+   deleted with the function `tclistdel' when it is no longer in use. */
+TCLIST *tctdbidxgetbyhash(TCTDB *tdb, const TDBIDX *idx, const void *vbuf, int vsiz);
+
 bool tctdbtranbeginimpl(TCTDB *tdb);
 
 bool tctdbtrancommitimpl(TCTDB *tdb);
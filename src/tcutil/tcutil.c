@@ -7429,6 +7429,220 @@ bool tcunlock(HANDLE fd) {
 #endif
 }
 
+#if TCUSEIOURING
+
+/* kernel rings of io_uring */
+typedef struct {
+    int fd; /* descriptor of the io_uring instance */
+    unsigned *sqhead; /* head of the submission ring */
+    unsigned *sqtail; /* tail of the submission ring */
+    unsigned *sqmask; /* mask of indexes of the submission ring */
+    unsigned *sqarray; /* array of indexes of submission entries */
+    unsigned *cqhead; /* head of the completion ring */
+    unsigned *cqtail; /* tail of the completion ring */
+    unsigned *cqmask; /* mask of indexes of the completion ring */
+    struct io_uring_sqe *sqes; /* submission entries */
+    struct io_uring_cqe *cqes; /* completion entries */
+    void *sqmap; /* mapped submission ring */
+    size_t sqmsiz; /* size of the mapped submission ring */
+    void *cqmap; /* mapped completion ring or `NULL' if it is shared with the submission ring */
+    size_t cqmsiz; /* size of the mapped completion ring */
+    size_t sqesiz; /* size of the mapped submission entries */
+} TCAIORING;
+
+/* Move the completed reads of an asynchronous reader into the queue of completed reads.
+   `aio' specifies the reader object. */
+static void tcaioreap(TCAIO *aio) {
+    TCAIORING *ring = aio->ring;
+    unsigned head = *ring->cqhead;
+    unsigned tail = __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = ring->cqes + (head & *ring->cqmask);
+        int bidx = (int) cqe->user_data;
+        aio->rsizs[bidx] = (cqe->res >= 0) ? cqe->res : -1;
+        aio->dbufs[aio->dnum++] = bidx;
+        aio->inum--;
+        head++;
+    }
+    __atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+}
+
+/* Submit queued reads of an asynchronous reader and wait for completions.
+   `aio' specifies the reader object.
+   `wnum' specifies the number of completions to wait for.
+   If successful, the return value is true, else, it is false. */
+static bool tcaioenter(TCAIO *aio, int wnum) {
+    TCAIORING *ring = aio->ring;
+    while (aio->qnum > 0 || (wnum > 0 && aio->inum > 0)) {
+        int rv = syscall(__NR_io_uring_enter, ring->fd, aio->qnum, tclmin(wnum, aio->qnum + aio->inum),
+                         (wnum > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rv < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return false;
+        }
+        aio->qnum -= rv;
+        aio->inum += rv;
+        int inum = aio->inum;
+        tcaioreap(aio);
+        wnum -= inum - aio->inum;
+    }
+    tcaioreap(aio);
+    return true;
+}
+
+#endif
+
+/* Create an asynchronous reader of files. */
+TCAIO *tcaionew(int depth, int bsiz) {
+    assert(depth > 0 && bsiz > 0);
+#if TCUSEIOURING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof (params));
+    int fd = syscall(__NR_io_uring_setup, depth, &params);
+    if (fd < 0) return NULL;
+    TCAIORING *ring;
+    TCCALLOC(ring, 1, sizeof (*ring));
+    ring->fd = fd;
+    ring->sqmsiz = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    ring->cqmsiz = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sqmsiz = tclmax(ring->sqmsiz, ring->cqmsiz);
+    }
+    ring->sqmap = mmap(NULL, ring->sqmsiz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQ_RING);
+    void *cqmap = ring->sqmap;
+    if (ring->sqmap != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cqmap = mmap(NULL, ring->cqmsiz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd, IORING_OFF_CQ_RING);
+        cqmap = ring->cqmap;
+    }
+    ring->sqesiz = params.sq_entries * sizeof (struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesiz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->sqmap == MAP_FAILED || cqmap == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqesiz);
+        if (ring->cqmap && ring->cqmap != MAP_FAILED) munmap(ring->cqmap, ring->cqmsiz);
+        if (ring->sqmap != MAP_FAILED) munmap(ring->sqmap, ring->sqmsiz);
+        close(fd);
+        TCFREE(ring);
+        return NULL;
+    }
+    char *sqp = ring->sqmap;
+    ring->sqhead = (unsigned *) (sqp + params.sq_off.head);
+    ring->sqtail = (unsigned *) (sqp + params.sq_off.tail);
+    ring->sqmask = (unsigned *) (sqp + params.sq_off.ring_mask);
+    ring->sqarray = (unsigned *) (sqp + params.sq_off.array);
+    char *cqp = cqmap;
+    ring->cqhead = (unsigned *) (cqp + params.cq_off.head);
+    ring->cqtail = (unsigned *) (cqp + params.cq_off.tail);
+    ring->cqmask = (unsigned *) (cqp + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cqp + params.cq_off.cqes);
+    TCAIO *aio;
+    TCMALLOC(aio, sizeof (*aio));
+    aio->depth = tclmin(depth, params.sq_entries);
+    aio->bsiz = bsiz;
+    TCMALLOC(aio->bufs, (size_t) aio->depth * bsiz);
+    TCMALLOC(aio->fbufs, aio->depth * sizeof (*aio->fbufs));
+    TCMALLOC(aio->dbufs, aio->depth * sizeof (*aio->dbufs));
+    TCMALLOC(aio->tags, aio->depth * sizeof (*aio->tags));
+    TCMALLOC(aio->rsizs, aio->depth * sizeof (*aio->rsizs));
+    struct iovec *iovs;
+    TCMALLOC(iovs, aio->depth * sizeof (*iovs));
+    for (int i = 0; i < aio->depth; ++i) {
+        aio->fbufs[i] = aio->depth - i - 1;
+        iovs[i].iov_base = aio->bufs + (size_t) i * bsiz;
+        iovs[i].iov_len = bsiz;
+    }
+    //registering may exceed the limit of locked memory, plain reads use the same buffers then
+    aio->fixed = (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iovs, aio->depth) == 0);
+    TCFREE(iovs);
+    aio->fnum = aio->depth;
+    aio->dnum = 0;
+    aio->dcur = 0;
+    aio->qnum = 0;
+    aio->inum = 0;
+    aio->ring = ring;
+    return aio;
+#else
+    return NULL;
+#endif
+}
+
+/* Delete an asynchronous reader of files. */
+void tcaiodel(TCAIO *aio) {
+    assert(aio);
+#if TCUSEIOURING
+    tcaiowait(aio);
+    TCAIORING *ring = aio->ring;
+    munmap(ring->sqes, ring->sqesiz);
+    if (ring->cqmap) munmap(ring->cqmap, ring->cqmsiz);
+    munmap(ring->sqmap, ring->sqmsiz);
+    close(ring->fd);
+    TCFREE(ring);
+#endif
+    TCFREE(aio->rsizs);
+    TCFREE(aio->tags);
+    TCFREE(aio->dbufs);
+    TCFREE(aio->fbufs);
+    TCFREE(aio->bufs);
+    TCFREE(aio);
+}
+
+/* Queue reading of a region of a file. */
+bool tcaioread(TCAIO *aio, HANDLE fd, uint64_t off, int len, int64_t tag) {
+    assert(aio && !INVALIDHANDLE(fd) && len >= 0);
+#if TCUSEIOURING
+    if (aio->fnum < 1 || len > aio->bsiz) return false;
+    TCAIORING *ring = aio->ring;
+    int bidx = aio->fbufs[--aio->fnum];
+    aio->tags[bidx] = tag;
+    unsigned tail = *ring->sqtail;
+    unsigned sidx = tail & *ring->sqmask;
+    struct io_uring_sqe *sqe = ring->sqes + sidx;
+    memset(sqe, 0, sizeof (*sqe));
+    sqe->opcode = aio->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = off;
+    sqe->addr = (uintptr_t) (aio->bufs + (size_t) bidx * aio->bsiz);
+    sqe->len = len;
+    sqe->buf_index = aio->fixed ? bidx : 0;
+    sqe->user_data = bidx;
+    ring->sqarray[sidx] = sidx;
+    __atomic_store_n(ring->sqtail, tail + 1, __ATOMIC_RELEASE);
+    aio->qnum++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Submit queued reads and wait for all reads in flight. */
+bool tcaiowait(TCAIO *aio) {
+    assert(aio);
+#if TCUSEIOURING
+    return tcaioenter(aio, aio->qnum + aio->inum);
+#else
+    return false;
+#endif
+}
+
+/* Get the data of the next completed read. */
+const char *tcaionext(TCAIO *aio, int64_t *tagp, int *sp) {
+    assert(aio && tagp && sp);
+    if (aio->dcur >= aio->dnum) {
+        for (int i = 0; i < aio->dnum; i++) {
+            aio->fbufs[aio->fnum++] = aio->dbufs[i];
+        }
+        aio->dnum = 0;
+        aio->dcur = 0;
+        return NULL;
+    }
+    int bidx = aio->dbufs[aio->dcur++];
+    *tagp = aio->tags[bidx];
+    *sp = aio->rsizs[bidx];
+    return aio->bufs + (size_t) bidx * aio->bsiz;
+}
+
 /* Execute a shell command. */
 int tcsystem(const char **args, int anum) {
     assert(args && anum >= 0);
@@ -9700,12 +9914,25 @@ void tcptrlistclear(TCPTRLIST *ptrlist) {
 #define TCBWTCNTMIN    64               // minimum element number of counting sort
 #define TCBWTCNTLV     4                // maximum recursion level of counting sort
 #define TCBWTBUFNUM    16384            // number of elements of BWT buffer
+#define TCLZHBITS      12               // number of bits of hash values of LZ encoding
+#define TCLZMINMATCH   4                // minimum length of matches of LZ encoding
+#define TCLZMAXDIST    65535            // maximum distance of matches of LZ encoding
+#define TCLZLASTLITS   5                // number of trailing bytes kept as literals
+#define TCLZTRKGRAM    8                // length of fragments counted by dictionary training
+#define TCLZTRSEGSIZ   64               // size of segments taken by dictionary training
+#define TCLZTRSAMPMAX  (1024 * 1024)    // maximum total size of samples of dictionary training
 
 typedef struct { // type of structure for a BWT character
     int fchr; // character code of the first character
     int tchr; // character code of the last character
 } TCBWTREC;
 
+typedef struct { // type of structure for a sample segment of LZ dictionary training
+    int idx; // index of the sample
+    int off; // offset of the segment in the sample
+    uint64_t score; // number of repeated fragments in the segment
+} TCLZSEG;
+
 
 /* private function prototypes */
 static void tcglobalinit(void);
@@ -9722,6 +9949,8 @@ static void tcmtfencode(char *ptr, int size);
 static void tcmtfdecode(char *ptr, int size);
 static int tcgammaencode(const char *ptr, int size, char *obuf);
 static int tcgammadecode(const char *ptr, int size, char *obuf);
+static char *tclzputlen(char *wp, int len);
+static int tclzsegcmp(const void *a, const void *b);
 
 int tcfilerrno2tcerr(int tcerrdef) {
 #ifdef _WIN32
@@ -10162,6 +10391,262 @@ char *tcbsdecode(const char *ptr, int size, int *sp) {
     return result;
 }
 
+/* Get the hash value of a 4-byte sequence for LZ encoding. */
+#define TCLZHASH(TC_ptr) \
+    ((uint32_t)(((uint32_t)((unsigned char *)(TC_ptr))[0] | \
+                 ((uint32_t)((unsigned char *)(TC_ptr))[1] << 8) | \
+                 ((uint32_t)((unsigned char *)(TC_ptr))[2] << 16) | \
+                 ((uint32_t)((unsigned char *)(TC_ptr))[3] << 24)) * 2654435761U) >> (32 - TCLZHBITS))
+
+/* Create a dictionary object of LZ encoding. */
+TCLZDICT *tclzdictnew(const char *ptr, int size) {
+    assert(ptr && size >= 0);
+    if (size > TCLZMAXDIST) {
+        ptr += size - TCLZMAXDIST;
+        size = TCLZMAXDIST;
+    }
+    TCLZDICT *dict;
+    TCMALLOC(dict, sizeof (*dict));
+    TCMEMDUP(dict->buf, ptr, size);
+    dict->size = size;
+    TCCALLOC(dict->htab, 1 << TCLZHBITS, sizeof (*dict->htab));
+    for (int i = 0; i + TCLZMINMATCH <= size; i++) {
+        dict->htab[TCLZHASH(dict->buf + i)] = i + 1;
+    }
+    return dict;
+}
+
+/* Delete a dictionary object of LZ encoding. */
+void tclzdictdel(TCLZDICT *dict) {
+    assert(dict);
+    TCFREE(dict->htab);
+    TCFREE(dict->buf);
+    TCFREE(dict);
+}
+
+/* Build the content of a dictionary of LZ encoding from sample objects. */
+char *tclzdicttrain(const TCLIST *samples, int size, int *sp) {
+    assert(samples && size > 0 && sp);
+    //Count fragments of samples, every sample counts a fragment once per segment
+    uint32_t *counts;
+    TCCALLOC(counts, 1 << 16, sizeof (*counts));
+    int snum = TCLISTNUM(samples);
+    int tsiz = 0;
+    for (int i = 0; i < snum && tsiz < TCLZTRSAMPMAX; i++) {
+        const unsigned char *rp = (const unsigned char *) TCLISTVALPTR(samples, i);
+        int rsiz = TCLISTVALSIZ(samples, i);
+        tsiz += rsiz;
+        for (int j = 0; j + TCLZTRKGRAM <= rsiz; j++) {
+            uint32_t hash = 19780211;
+            for (int k = 0; k < TCLZTRKGRAM; k++) hash = hash * 37 + rp[j + k];
+            counts[hash & 0xffff]++;
+        }
+    }
+    //Score segments by the number of repeated fragments they contain
+    int anum = 0, asiz = 256;
+    TCLZSEG *segs;
+    TCMALLOC(segs, sizeof (*segs) * asiz);
+    tsiz = 0;
+    for (int i = 0; i < snum && tsiz < TCLZTRSAMPMAX; i++) {
+        const unsigned char *rp = (const unsigned char *) TCLISTVALPTR(samples, i);
+        int rsiz = TCLISTVALSIZ(samples, i);
+        tsiz += rsiz;
+        for (int off = 0; off + TCLZTRSEGSIZ <= rsiz; off += TCLZTRSEGSIZ / 2) {
+            uint64_t score = 0;
+            for (int j = off; j + TCLZTRKGRAM <= off + TCLZTRSEGSIZ; j++) {
+                uint32_t hash = 19780211;
+                for (int k = 0; k < TCLZTRKGRAM; k++) hash = hash * 37 + rp[j + k];
+                uint32_t cnt = counts[hash & 0xffff];
+                if (cnt > 1) score += cnt;
+            }
+            if (score < 1) continue;
+            if (anum >= asiz) {
+                asiz *= 2;
+                TCREALLOC(segs, segs, sizeof (*segs) * asiz);
+            }
+            segs[anum].idx = i;
+            segs[anum].off = off;
+            segs[anum].score = score;
+            anum++;
+        }
+    }
+    //Take the best segments, fragments already taken do not score again
+    qsort(segs, anum, sizeof (*segs), tclzsegcmp);
+    char *buf;
+    TCMALLOC(buf, size + 1);
+    int wsiz = 0;
+    for (int i = 0; i < anum && wsiz + TCLZTRSEGSIZ <= size; i++) {
+        const unsigned char *rp = (const unsigned char *) TCLISTVALPTR(samples, segs[i].idx) + segs[i].off;
+        uint64_t score = 0;
+        for (int j = 0; j + TCLZTRKGRAM <= TCLZTRSEGSIZ; j++) {
+            uint32_t hash = 19780211;
+            for (int k = 0; k < TCLZTRKGRAM; k++) hash = hash * 37 + rp[j + k];
+            uint32_t cnt = counts[hash & 0xffff];
+            if (cnt > 1) score += cnt;
+        }
+        if (score * 2 < segs[i].score) continue;
+        for (int j = 0; j + TCLZTRKGRAM <= TCLZTRSEGSIZ; j++) {
+            uint32_t hash = 19780211;
+            for (int k = 0; k < TCLZTRKGRAM; k++) hash = hash * 37 + rp[j + k];
+            counts[hash & 0xffff] = 0;
+        }
+        memcpy(buf + wsiz, rp, TCLZTRSEGSIZ);
+        wsiz += TCLZTRSEGSIZ;
+    }
+    TCFREE(segs);
+    TCFREE(counts);
+    if (wsiz < 1) {
+        TCFREE(buf);
+        return NULL;
+    }
+    buf[wsiz] = '\0';
+    *sp = wsiz;
+    return buf;
+}
+
+/* Compare two sample segments of LZ dictionary training by their scores in descending order. */
+static int tclzsegcmp(const void *a, const void *b) {
+    const TCLZSEG *sa = a;
+    const TCLZSEG *sb = b;
+    if (sa->score != sb->score) return (sa->score > sb->score) ? -1 : 1;
+    return (sa->idx != sb->idx) ? sa->idx - sb->idx : sa->off - sb->off;
+}
+
+/* Write an extended length of LZ encoding.
+   `wp' specifies the pointer to the output buffer.
+   `len' specifies the length exceeding the token.
+   The return value is the pointer to the end of the written region. */
+static char *tclzputlen(char *wp, int len) {
+    while (len >= 0xff) {
+        *(wp++) = (char) 0xff;
+        len -= 0xff;
+    }
+    *(wp++) = len;
+    return wp;
+}
+
+/* Compress a serial object with LZ encoding. */
+char *tclzencode(const char *ptr, int size, const TCLZDICT *dict, int *sp) {
+    assert(ptr && size >= 0 && sp);
+    const unsigned char *src = (const unsigned char *) ptr;
+    const unsigned char *dbuf = dict ? (const unsigned char *) dict->buf : NULL;
+    int dsiz = dict ? dict->size : 0;
+    uint32_t htab[1 << TCLZHBITS]; //positions plus one, dictionary content precedes the source
+    if (dict) {
+        memcpy(htab, dict->htab, sizeof (htab));
+    } else {
+        memset(htab, 0, sizeof (htab));
+    }
+    char *result;
+    TCMALLOC(result, size + size / 0xff + 16 + TCNUMBUFSIZ);
+    char *wp = result;
+    int step;
+    TCSETVNUMBUF(step, wp, size);
+    wp += step;
+    int ip = 0, anchor = 0;
+    int mlimit = size - TCLZLASTLITS;
+    while (ip < mlimit) {
+        uint32_t hash = TCLZHASH(src + ip);
+        int cand = (int) htab[hash] - 1;
+        htab[hash] = dsiz + ip + 1;
+        int pos = dsiz + ip;
+        if (cand < 0 || pos - cand > TCLZMAXDIST) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        int mlen = 0;
+        while (ip + mlen < size) {
+            int cp = cand + mlen;
+            unsigned char c = (cp < dsiz) ? dbuf[cp] : src[cp - dsiz];
+            if (c != src[ip + mlen]) break;
+            mlen++;
+        }
+        if (mlen < TCLZMINMATCH) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        int llen = ip - anchor;
+        int dist = pos - cand;
+        char *tp = wp++;
+        *tp = ((llen < 15 ? llen : 15) << 4) | (mlen - TCLZMINMATCH < 15 ? mlen - TCLZMINMATCH : 15);
+        if (llen >= 15) wp = tclzputlen(wp, llen - 15);
+        memcpy(wp, src + anchor, llen);
+        wp += llen;
+        *(wp++) = dist & 0xff;
+        *(wp++) = dist >> 8;
+        if (mlen - TCLZMINMATCH >= 15) wp = tclzputlen(wp, mlen - TCLZMINMATCH - 15);
+        ip += mlen;
+        anchor = ip;
+        if (ip - 2 > 0 && ip - 2 < mlimit) htab[TCLZHASH(src + ip - 2)] = dsiz + ip - 2 + 1;
+    }
+    int llen = size - anchor;
+    char *tp = wp++;
+    *tp = (llen < 15 ? llen : 15) << 4;
+    if (llen >= 15) wp = tclzputlen(wp, llen - 15);
+    memcpy(wp, src + anchor, llen);
+    wp += llen;
+    *sp = wp - result;
+    return result;
+}
+
+/* Decompress a serial object compressed with LZ encoding. */
+char *tclzdecode(const char *ptr, int size, const TCLZDICT *dict, int *sp) {
+    assert(ptr && size >= 0 && sp);
+    const unsigned char *rp = (const unsigned char *) ptr;
+    const unsigned char *ep = rp + size;
+    const char *dbuf = dict ? dict->buf : NULL;
+    int dsiz = dict ? dict->size : 0;
+    if (size < 1) return NULL;
+    int osiz, step;
+    TCREADVNUMBUF(rp, osiz, step);
+    if (osiz < 0 || step >= size) return NULL;
+    rp += step;
+    char *result;
+    TCMALLOC(result, osiz + 1);
+    int op = 0;
+    while (rp < ep) {
+        int token = *(rp++);
+        int llen = token >> 4;
+        if (llen == 15) {
+            int c;
+            do {
+                if (rp >= ep) goto error;
+                c = *(rp++);
+                llen += c;
+            } while (c == 0xff);
+        }
+        if (llen > ep - rp || llen > osiz - op) goto error;
+        memcpy(result + op, rp, llen);
+        rp += llen;
+        op += llen;
+        if (rp >= ep) break;
+        if (ep - rp < 2) goto error;
+        int dist = rp[0] | (rp[1] << 8);
+        rp += 2;
+        int mlen = (token & 15) + TCLZMINMATCH;
+        if ((token & 15) == 15) {
+            int c;
+            do {
+                if (rp >= ep) goto error;
+                c = *(rp++);
+                mlen += c;
+            } while (c == 0xff);
+        }
+        if (dist < 1 || dist > op + dsiz || mlen > osiz - op) goto error;
+        int cp = op - dist;
+        for (int i = 0; i < mlen; i++, cp++) {
+            result[op++] = (cp < 0) ? dbuf[dsiz + cp] : result[cp];
+        }
+    }
+    if (op != osiz) goto error;
+    result[op] = '\0';
+    *sp = op;
+    return result;
+error:
+    TCFREE(result);
+    return NULL;
+}
+
 /* Encode a serial object with BWT encoding. */
 char *tcbwtencode(const char *ptr, int size, int *idxp) {
     assert(ptr && size >= 0 && idxp);
@@ -10751,6 +11236,27 @@ int tcicaseformat(const char *str, int strl, void *placeholder, int placeholders
         }
         return 0;
     }
+    //ASCII strings without ignorable control chars are folded by plain lowercasing
+    const unsigned char *ustr = (const unsigned char*) str;
+    unsigned int slow = 0;
+    for (int i = 0; i < strl; ++i) {
+        unsigned int c = ustr[i];
+        slow |= (c >= 0x7f) | ((c < 0x20) & ((c < 0x09) | (c > 0x0d)));
+    }
+    if (!slow) {
+        char *dst = (placeholder && placeholdersz > strl) ? placeholder : malloc(strl + 1);
+        if (!dst) {
+            *dstptr = NULL;
+            return UTF8PROC_ERROR_NOMEM;
+        }
+        for (int i = 0; i < strl; ++i) {
+            unsigned int c = ustr[i];
+            dst[i] = c + ((c - 'A' < 26U) << 5);
+        }
+        dst[strl] = '\0';
+        *dstptr = dst;
+        return strl;
+    }
     return tcutf8map((const uint8_t*) str, strl, placeholder, placeholdersz, (uint8_t**) dstptr,
             UTF8PROC_COMPOSE | UTF8PROC_IGNORE | UTF8PROC_LUMP | UTF8PROC_CASEFOLD | UTF8PROC_STRIPMARK);
 }
@@ -2967,6 +2967,67 @@ EJDB_EXPORT bool tclock(HANDLE fd, bool ex, bool nb);
 EJDB_EXPORT bool tcunlock(HANDLE fd);
 
 
+typedef struct { /* type of structure for an asynchronous reader of files */
+    int depth; /* maximum number of reads in flight */
+    int bsiz; /* size of each read buffer */
+    char *bufs; /* region of read buffers */
+    int *fbufs; /* stack of indexes of free buffers */
+    int fnum; /* number of free buffers */
+    int *dbufs; /* queue of indexes of buffers of completed reads */
+    int dnum; /* number of buffers of completed reads */
+    int dcur; /* index of the next completed read in the queue */
+    int64_t *tags; /* tags of the reads of buffers */
+    int *rsizs; /* sizes read into buffers or -1 on error */
+    int qnum; /* number of queued reads not submitted */
+    int inum; /* number of submitted reads not completed */
+    bool fixed; /* whether buffers are registered in the kernel */
+    void *ring; /* submission and completion rings of the platform */
+} TCAIO;
+
+
+/* Create an asynchronous reader of files.
+   `depth' specifies the maximum number of reads in flight.
+   `bsiz' specifies the size of the buffer of each read.
+   The return value is the new reader object or `NULL' if asynchronous I/O is not supported.
+   The reader is backed by io_uring on Linux, its buffers are registered in the kernel once.
+   Because the object of the return value is allocated by the function, it should be deleted with
+   the function `tcaiodel' when it is no longer in use. */
+EJDB_EXPORT TCAIO *tcaionew(int depth, int bsiz);
+
+
+/* Delete an asynchronous reader of files.
+   `aio' specifies the reader object.
+   Reads in flight are waited for. */
+EJDB_EXPORT void tcaiodel(TCAIO *aio);
+
+
+/* Queue reading of a region of a file.
+   `aio' specifies the reader object.
+   `fd' specifies the file descriptor.
+   `off' specifies the offset of the region.
+   `len' specifies the length of the region.  It should not be more than the buffer size.
+   `tag' specifies an arbitrary number returned with the data by `tcaionext'.
+   If successful, the return value is true, else, it is false.  It fails if every buffer holds a
+   read which is in flight or not consumed by `tcaionext'. */
+EJDB_EXPORT bool tcaioread(TCAIO *aio, HANDLE fd, uint64_t off, int len, int64_t tag);
+
+
+/* Submit queued reads and wait for all reads in flight.
+   `aio' specifies the reader object.
+   If successful, the return value is true, else, it is false. */
+EJDB_EXPORT bool tcaiowait(TCAIO *aio);
+
+
+/* Get the data of the next completed read.
+   `aio' specifies the reader object.
+   `tagp' specifies the pointer to the variable into which the tag of the read is assigned.
+   `sp' specifies the pointer to the variable into which the size of the data is assigned.  It is
+   -1 if the read failed.
+   The return value is the pointer to the data or `NULL' if no completed read is left.  The region
+   is valid until `NULL' is returned, all buffers of completed reads are free then. */
+EJDB_EXPORT const char *tcaionext(TCAIO *aio, int64_t *tagp, int *sp);
+
+
 /* Execute a shell command.
    `args' specifies an array of the command name and its arguments.
    `anum' specifies the number of elements of the array.
@@ -3185,6 +3246,67 @@ EJDB_EXPORT char *tcbsencode(const char *ptr, int size, int *sp);
 EJDB_EXPORT char *tcbsdecode(const char *ptr, int size, int *sp);
 
 
+typedef struct { /* type of structure for a dictionary of LZ encoding */
+    char *buf; /* content of the dictionary */
+    int size; /* size of the content */
+    uint32_t *htab; /* positions of 4-byte sequences of the content by their hashes */
+} TCLZDICT;
+
+
+/* Create a dictionary object of LZ encoding.
+   `ptr' specifies the pointer to the region of the dictionary content.
+   `size' specifies the size of the region.  Only the last 65535 bytes are used.
+   The return value is the new dictionary object.
+   Because the object of the return value is created with the function `tclzdictnew', it should
+   be deleted with the function `tclzdictdel' when it is no longer in use. */
+EJDB_EXPORT TCLZDICT *tclzdictnew(const char *ptr, int size);
+
+
+/* Delete a dictionary object of LZ encoding.
+   `dict' specifies the dictionary object. */
+EJDB_EXPORT void tclzdictdel(TCLZDICT *dict);
+
+
+/* Build the content of a dictionary of LZ encoding from sample objects.
+   `samples' specifies a list object of sample objects, such as typical records.
+   `size' specifies the maximum size of the dictionary content.
+   `sp' specifies the pointer to the variable into which the size of the region of the return
+   value is assigned.
+   The return value is the pointer to the dictionary content made of the sample fragments
+   repeated most often across the samples.  It is `NULL' if the samples have no such fragments.
+   Because the region of the return value is allocated with the `malloc' call, it should be
+   released with the `free' call when it is no longer in use. */
+EJDB_EXPORT char *tclzdicttrain(const TCLIST *samples, int size, int *sp);
+
+
+/* Compress a serial object with LZ encoding.
+   `ptr' specifies the pointer to the region.
+   `size' specifies the size of the region.
+   `dict' specifies the dictionary object or `NULL' if no dictionary is used.
+   `sp' specifies the pointer to the variable into which the size of the region of the return
+   value is assigned.
+   If successful, the return value is the pointer to the result object, else, it is `NULL'.
+   LZ encoding is much faster than Deflate encoding, a dictionary built from similar objects
+   improves the ratio of small objects.  Because the region of the return value is allocated
+   with the `malloc' call, it should be released with the `free' call when it is no longer in
+   use. */
+EJDB_EXPORT char *tclzencode(const char *ptr, int size, const TCLZDICT *dict, int *sp);
+
+
+/* Decompress a serial object compressed with LZ encoding.
+   `ptr' specifies the pointer to the region.
+   `size' specifies the size of the region.
+   `dict' specifies the dictionary object used by the encoding or `NULL'.
+   `sp' specifies the pointer to a variable into which the size of the region of the return
+   value is assigned.
+   If successful, the return value is the pointer to the result object, else, it is `NULL'.
+   Because an additional zero code is appended at the end of the region of the return value,
+   the return value can be treated as a character string.  Because the region of the return
+   value is allocated with the `malloc' call, it should be released with the `free' call when it
+   is no longer in use. */
+EJDB_EXPORT char *tclzdecode(const char *ptr, int size, const TCLZDICT *dict, int *sp);
+
+
 /* Compress a serial object with Deflate encoding.
    `ptr' specifies the pointer to the region.
    `size' specifies the size of the region.
@@ -3920,6 +4042,7 @@ EJDB_EXPORT off_t tcpagsize(void);
 
 /**
  * Convert string into case insensitive normalized format.
+ * ASCII strings are lowercased without UTF-8 decomposition.
  * @param str Str pointer
  * @param strlen String data length in bytes
  * @param dstptr Allocated NULL terminated destination buffer
@@ -1119,6 +1119,19 @@ static int procmisc(int rnum){
     if(dsiz != slen || strcmp(dec, str)) err = true;
     tcfree(dec);
     tcfree(buf);
+    buf = tclzencode(str, slen, NULL, &bsiz);
+    dec = tclzdecode(buf, bsiz, NULL, &dsiz);
+    if(!dec || dsiz != slen || strcmp(dec, str)) err = true;
+    tcfree(dec);
+    tcfree(buf);
+    TCLZDICT *lzdict = tclzdictnew(str, slen);
+    buf = tclzencode(str, slen, lzdict, &bsiz);
+    if(bsiz >= slen) err = true;
+    dec = tclzdecode(buf, bsiz, lzdict, &dsiz);
+    if(!dec || dsiz != slen || strcmp(dec, str)) err = true;
+    tcfree(dec);
+    tcfree(buf);
+    tclzdictdel(lzdict);
     int idx;
     buf = tcbwtencode(str, slen, &idx);
     if(memcmp(buf, "4\"o 5a23s-%+=> 1b/\"<&YNe", slen) || idx != 13) err = true;